@@ -58,16 +58,70 @@ extern "C"
 {
 #endif /* __cplusplus */
 
+typedef struct upgrade_s upgrade;
+
 /* the API ``plan'' contains both the kernel plan and problem */
 struct X(plan_s) {
-     plan *pln;
+     plan *volatile pln; /* see APIPLAN_PLN */
      problem *prb;
      int sign;
+     int realtime; /* planned with FFTW_REALTIME */
+     volatile unsigned flags; /* with which it was planned, and */
+     int nthr;       /* threads, to re-create it from wisdom */
+     size_t workspace; /* of the first pln, see X(workspace_size) */
+     plan *estimate;   /* the pln that FFTW_ASYNC replaced, or 0 */
+     upgrade *pending; /* the FFTW_ASYNC planning, or 0 */
 };
 
 /* shorthand */
 typedef struct X(plan_s) apiplan;
 
+/* the plan to execute, which FFTW_ASYNC replaces at some point while
+   others may be executing it */
+#define APIPLAN_PLN(p) ATOMIC_LOAD(&(p)->pln)
+
+/* FFTW_ASYNC: planning the problem of P again, with the rigor that P
+   asked for, on a scratch copy of the problem (see X(problem_scratch)).
+   The threads library runs X(upgrade_plan) in the background for every
+   upgrade given to upgrade_start_hook, and then X(upgrade_install)
+   unless X(destroy_plan) cancelled it meanwhile; upgrade_cancel_hook
+   returns 0 if it is too late to cancel, in which case the threads
+   library destroys P when done.  upgrade_wait_hook waits until it is
+   done with all upgrades. */
+struct upgrade_s {
+     apiplan *p;
+     problem *prb;     /* scratch copy of p->prb, 0 once planned */
+     R *scratch;       /* its arrays */
+     unsigned flags;   /* to plan with, then those that made pln */
+     int nthr;
+     double timelimit;
+     plan *pln;        /* the result, or 0 */
+
+     /* for the threads library */
+     int state;
+     int cancelled;
+     upgrade *next;
+};
+
+extern void (*X(upgrade_start_hook))(upgrade *u);
+extern int (*X(upgrade_cancel_hook))(upgrade *u);
+extern void (*X(upgrade_wait_hook))(void);
+void X(upgrade_plan)(upgrade *u);
+void X(upgrade_install)(upgrade *u);
+
+/* bracket the execution of an apiplan whose plan needs N bytes of
+   scratch memory, see REALTIME_CHECK.  The arena of the calling thread
+   only gets that large without malloc if the thread made the plan, or
+   if the memory comes from X(execute_with_workspace); debug builds stop
+   FFTW_REALTIME executions that would allocate it (X(realtime_begin)) */
+#ifdef REALTIME_CHECKS
+#define REALTIME_BEGIN(p, n) ((p)->realtime ? X(realtime_begin)(n) : (void)0)
+#define REALTIME_END(p) ((p)->realtime ? X(realtime_enter)(0) : (void)0)
+#else
+#define REALTIME_BEGIN(p, n) ((void)0)
+#define REALTIME_END(p) ((void)0)
+#endif
+
 /* complex type for internal use */
 typedef R C[2];
 
@@ -103,6 +157,7 @@ void X(configure_planner)(planner *plnr);
 void X(mapflags)(planner *, unsigned);
 
 apiplan *X(mkapiplan)(int sign, unsigned flags, problem *prb);
+int X(record_apiplan)(const apiplan *p, plan_record *rec, twid_record *twrec);
 
 rdft_kind *X(map_r2r_kind)(int rank, const X(r2r_kind) * kind);
 
@@ -110,6 +165,13 @@ typedef void (*planner_hook_t)(void);
                                                      
 void X(set_planner_hooks)(planner_hook_t before, planner_hook_t after);
 
+typedef planner *(*thread_planner_hook_t)(void);
+
+planner *X(thread_planner)(void);
+void X(unmap_wisdom)(void);
+void X(set_thread_planner_hooks)(thread_planner_hook_t get,
+				 planner_hook_t forget);
+
 #ifdef __cplusplus
 }  /* extern "C" */
 #endif /* __cplusplus */
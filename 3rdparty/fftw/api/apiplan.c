@@ -22,6 +22,10 @@
 
 static planner_hook_t before_planner_hook = 0, after_planner_hook = 0;
 
+void (*X(upgrade_start_hook))(upgrade *u) = 0;
+int (*X(upgrade_cancel_hook))(upgrade *u) = 0;
+void (*X(upgrade_wait_hook))(void) = 0;
+
 void X(set_planner_hooks)(planner_hook_t before, planner_hook_t after)
 {
      before_planner_hook = before;
@@ -83,21 +87,118 @@ static plan *mkplan(planner *plnr, unsigned flags,
      return pln;
 }
 
+static enum wakefulness awake_mode(void)
+{
+     if (sizeof(trigreal) > sizeof(R)) {
+	  /* this is probably faster, and we have enough trigreal
+	     bits to maintain accuracy */
+	  return AWAKE_SQRTN_TABLE;
+     } else {
+	  /* more accurate */
+	  return AWAKE_SINCOS;
+     }
+}
+
+/* plan at incrementally increasing patience, up to that of FLAGS,
+   until we run out of time */
+static plan *mkplan_patiently(planner *plnr, unsigned flags,
+			      const problem *prb,
+			      unsigned *flags_used, double *pcost)
+{
+     static const unsigned int pats[] = {FFTW_ESTIMATE, FFTW_MEASURE,
+                                         FFTW_PATIENT, FFTW_EXHAUSTIVE};
+     int pat, pat_max;
+     plan *pln;
+
+     pat_max = flags & FFTW_ESTIMATE ? 0 :
+	  (flags & FFTW_EXHAUSTIVE ? 3 :
+	   (flags & FFTW_PATIENT ? 2 : 1));
+     pat = plnr->timelimit >= 0 ? 0 : pat_max;
+
+     flags &= ~(FFTW_ESTIMATE | FFTW_MEASURE |
+		FFTW_PATIENT | FFTW_EXHAUSTIVE);
+
+     plnr->start_time = X(get_crude_time)();
+
+     for (pln = 0, *flags_used = 0; pat <= pat_max; ++pat) {
+	  plan *pln1;
+	  unsigned tmpflags = flags | pats[pat];
+	  pln1 = mkplan(plnr, tmpflags, prb, 0u);
+
+	  if (!pln1) {
+	       /* don't bother continuing if planner failed or timed out */
+	       A(!pln || plnr->timed_out);
+	       break;
+	  }
+
+	  X(plan_destroy_internal)(pln);
+	  pln = pln1;
+	  *flags_used = tmpflags;
+	  *pcost = pln->pcost;
+     }
+
+     return pln;
+}
+
+/* FFTW_ASYNC: an upgrade of the plan for PRB, unless there is nothing
+   to gain or nobody to plan in the background, in which case we plan
+   with FLAGS right away */
+static upgrade *mkupgrade(planner *plnr, unsigned flags, problem *prb)
+{
+     upgrade *u;
+     plan *pln;
+     R *scratch;
+     problem *sprb;
+
+     if (!X(upgrade_start_hook) || (flags & FFTW_ESTIMATE))
+	  return 0;
+
+     /* no need to wait if wisdom has the answer */
+     pln = mkplan0(plnr, flags, prb, 0, WISDOM_ONLY);
+     plnr->wisdom_state = WISDOM_NORMAL;
+     if (pln) {
+	  X(plan_destroy_internal)(pln);
+	  return 0;
+     }
+
+     if (!(sprb = X(problem_scratch)(prb, &scratch)))
+	  return 0;
+
+     u = (upgrade *) MALLOC(sizeof(upgrade), PLANS);
+     u->p = 0;
+     u->prb = sprb;
+     u->scratch = scratch;
+     u->flags = flags;
+     u->nthr = plnr->nthr;
+     u->timelimit = plnr->timelimit;
+     u->pln = 0;
+     return u;
+}
+
+static void destroy_upgrade(upgrade *u)
+{
+     if (u->pln) {
+	  X(plan_awake)(u->pln, SLEEPY);
+	  X(plan_destroy_internal)(u->pln);
+     }
+     X(problem_destroy)(u->prb);
+     X(ifree0)(u->scratch);
+     X(ifree)(u);
+}
+
 apiplan *X(mkapiplan)(int sign, unsigned flags, problem *prb)
 {
      apiplan *p = 0;
      plan *pln;
      unsigned flags_used_for_planning;
      planner *plnr;
-     static const unsigned int pats[] = {FFTW_ESTIMATE, FFTW_MEASURE,
-                                         FFTW_PATIENT, FFTW_EXHAUSTIVE};
-     int pat, pat_max;
+     upgrade *u = 0;
      double pcost = 0;
      
      if (before_planner_hook)
           before_planner_hook();
      
-     plnr = X(the_planner)();
+     plnr = X(thread_planner)();
 
      if (flags & FFTW_WISDOM_ONLY) {
 	  /* Special mode that returns a plan only if wisdom is present,
@@ -106,34 +207,12 @@ apiplan *X(mkapiplan)(int sign, unsigned flags, problem *prb)
 	  flags_used_for_planning = flags;
 	  pln = mkplan0(plnr, flags, prb, 0, WISDOM_ONLY);
      } else {
-	  pat_max = flags & FFTW_ESTIMATE ? 0 :
-	       (flags & FFTW_EXHAUSTIVE ? 3 :
-		(flags & FFTW_PATIENT ? 2 : 1));
-	  pat = plnr->timelimit >= 0 ? 0 : pat_max;
-
-	  flags &= ~(FFTW_ESTIMATE | FFTW_MEASURE |
-		     FFTW_PATIENT | FFTW_EXHAUSTIVE);
-
-	  plnr->start_time = X(get_crude_time)();
-
-	  /* plan at incrementally increasing patience until we run
-	     out of time */
-	  for (pln = 0, flags_used_for_planning = 0; pat <= pat_max; ++pat) {
-	       plan *pln1;
-	       unsigned tmpflags = flags | pats[pat];
-	       pln1 = mkplan(plnr, tmpflags, prb, 0u);
-
-	       if (!pln1) {
-		    /* don't bother continuing if planner failed or timed out */
-		    A(!pln || plnr->timed_out);
-		    break;
-	       }
-
-	       X(plan_destroy_internal)(pln);
-	       pln = pln1;
-	       flags_used_for_planning = tmpflags;
-	       pcost = pln->pcost;
-	  }
+	  /* with FFTW_ASYNC, estimate now and plan properly later */
+	  if ((flags & FFTW_ASYNC) && (u = mkupgrade(plnr, flags, prb)))
+	       flags = force_estimator(flags);
+
+	  pln = mkplan_patiently(plnr, flags, prb,
+				 &flags_used_for_planning, &pcost);
      }
 
      if (pln) {
@@ -141,6 +220,11 @@ apiplan *X(mkapiplan)(int sign, unsigned flags, problem *prb)
 	  p = (apiplan *) MALLOC(sizeof(apiplan), PLANS);
 	  p->prb = prb;
 	  p->sign = sign; /* cache for execute_dft */
+	  p->realtime = (flags & FFTW_REALTIME) != 0;
+	  p->flags = flags_used_for_planning;
+	  p->nthr = plnr->nthr;
+	  p->estimate = 0;
+	  p->pending = u;
 
 	  /* re-create plan from wisdom, adding blessing */
 	  p->pln = mkplan(plnr, flags_used_for_planning, prb, BLESSING);
@@ -148,20 +232,24 @@ apiplan *X(mkapiplan)(int sign, unsigned flags, problem *prb)
 	  /* record pcost from most recent measurement for use in X(cost) */
 	  p->pln->pcost = pcost;
 
-	  if (sizeof(trigreal) > sizeof(R)) {
-	       /* this is probably faster, and we have enough trigreal
-		  bits to maintain accuracy */
-	       X(plan_awake)(p->pln, AWAKE_SQRTN_TABLE);
-	  } else {
-	       /* more accurate */
-	       X(plan_awake)(p->pln, AWAKE_SINCOS);
-	  }
+	  X(plan_awake)(p->pln, awake_mode());
+	  p->workspace = p->pln->workspace;
+
+	  /* executing a realtime plan must not allocate, so get the
+	     scratch memory of the planning thread ready now */
+	  if (p->realtime)
+	       X(scratch_reserve)(p->pln->workspace);
 
 	  /* we don't use pln for p->pln, above, since by re-creating the
 	     plan we might use more patient wisdom from a timed-out mkplan */
 	  X(plan_destroy_internal)(pln);
-     } else
+     } else {
 	  X(problem_destroy)(prb);
+	  if (u) {
+	       destroy_upgrade(u);
+	       u = 0;
+	  }
+     }
 
      /* discard all information not necessary to reconstruct the plan */
      plnr->adt->forget(plnr, FORGET_ACCURSED);
@@ -172,18 +260,139 @@ apiplan *X(mkapiplan)(int sign, unsigned flags, problem *prb)
 
      if (after_planner_hook)
           after_planner_hook();
+
+     if (u) {
+	  u->p = p;
+	  X(upgrade_start_hook)(u);
+     }
      
      return p;
 }
 
+/* FFTW_ASYNC, in the background: plan the scratch copy of the problem
+   of U->p, and re-create the result for the arrays of U->p from the
+   wisdom thus gained, without touching them.  Leaves the plan, if any,
+   in U->pln. */
+void X(upgrade_plan)(upgrade *u)
+{
+     planner *plnr;
+     plan *pln;
+     unsigned flags_used;
+     double pcost = 0, timelimit;
+     int nthr;
+
+     if (before_planner_hook)
+          before_planner_hook();
+
+     /* plan like the thread that asked for it */
+     plnr = X(thread_planner)();
+     nthr = plnr->nthr;
+     timelimit = plnr->timelimit;
+     plnr->nthr = u->nthr;
+     plnr->timelimit = u->timelimit;
+
+     pln = mkplan_patiently(plnr, u->flags, u->prb, &flags_used, &pcost);
+     if (pln) {
+	  X(plan_destroy_internal)(pln);
+	  pln = mkplan0(plnr, flags_used, u->p->prb, BLESSING, WISDOM_ONLY);
+	  plnr->wisdom_state = WISDOM_NORMAL;
+     }
+     if (pln) {
+	  pln->pcost = pcost;
+	  X(plan_awake)(pln, awake_mode());
+	  u->flags = flags_used;
+     }
+     u->pln = pln;
+
+     plnr->adt->forget(plnr, FORGET_ACCURSED);
+     plnr->nthr = nthr;
+     plnr->timelimit = timelimit;
+
+     if (after_planner_hook)
+          after_planner_hook();
+
+     X(problem_destroy)(u->prb);
+     u->prb = 0;
+     X(ifree)(u->scratch);
+     u->scratch = 0;
+}
+
+/* FFTW_ASYNC: have U->p execute the plan of U from now on.  Executions
+   in flight finish with the old plan, which stays until
+   X(destroy_plan). */
+void X(upgrade_install)(upgrade *u)
+{
+     apiplan *p = u->p;
+
+     /* executing must not allocate more scratch memory than it did */
+     if (u->pln && p->realtime && u->pln->workspace > p->workspace)
+	  return;
+
+     if (u->pln) {
+	  p->estimate = p->pln;
+	  ATOMIC_STORE(&p->flags, u->flags);
+	  ATOMIC_STORE(&p->pln, u->pln);
+	  u->pln = 0;
+     }
+}
+
+/* re-create the plan tree of P from wisdom, adding the solutions it
+   uses to REC and the twiddle tables it uses to TWREC (if nonzero).
+   Returns 0 if the wisdom is gone. */
+int X(record_apiplan)(const apiplan *p, plan_record *rec, twid_record *twrec)
+{
+     planner *plnr;
+     plan *pln;
+     int nthr, ok;
+
+     if (before_planner_hook)
+          before_planner_hook();
+
+     plnr = X(thread_planner)();
+     nthr = plnr->nthr;
+     plnr->nthr = p->nthr;
+     plnr->record = rec;
+     pln = mkplan0(plnr, ATOMIC_LOAD(&p->flags), p->prb, BLESSING,
+		   WISDOM_ONLY);
+     plnr->record = 0;
+     plnr->nthr = nthr;
+     plnr->wisdom_state = WISDOM_NORMAL;
+
+     ok = (pln != 0);
+     if (pln) {
+	  if (twrec) {
+	       X(twiddle_record)(twrec);
+	       X(plan_awake)(pln, awake_mode());
+	       X(twiddle_record)(0);
+	       X(plan_awake)(pln, SLEEPY);
+	  }
+	  X(plan_destroy_internal)(pln);
+     }
+
+     if (after_planner_hook)
+          after_planner_hook();
+
+     return ok;
+}
+
 void X(destroy_plan)(X(plan) p)
 {
      if (p) {
+	  if (p->pending && X(upgrade_cancel_hook)
+	      && !X(upgrade_cancel_hook)(p->pending))
+	       return; /* the threads library destroys P when done */
+
           if (before_planner_hook)
                before_planner_hook();
      
           X(plan_awake)(p->pln, SLEEPY);
           X(plan_destroy_internal)(p->pln);
+	  if (p->estimate) {
+	       X(plan_awake)(p->estimate, SLEEPY);
+	       X(plan_destroy_internal)(p->estimate);
+	  }
+	  if (p->pending)
+	       destroy_upgrade(p->pending);
           X(problem_destroy)(p->prb);
           X(ifree)(p);
 
@@ -0,0 +1,180 @@
+/*
+ * Copyright (c) 2003, 2007-14 Matteo Frigo
+ * Copyright (c) 2003, 2007-14 Massachusetts Institute of Technology
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+/* Binary wisdom files hold a binary_wisdom (see planner.c), which the
+   planner looks up where it lies.  Where we have mmap(), the file is
+   mapped read-only and shared with every other process that maps it;
+   otherwise it is read into memory. */
+
+#include "api/api.h"
+#include <stdio.h>
+#include <string.h>
+
+#if defined(HAVE_MMAP) && defined(HAVE_SYS_MMAN_H) && defined(HAVE_UNISTD_H)
+#  define USE_MMAP 1
+#  include <sys/types.h>
+#  include <sys/stat.h>
+#  include <sys/mman.h>
+#  include <fcntl.h>
+#  include <unistd.h>
+#endif
+
+/* the files we gave the planner, which must outlive it */
+typedef struct mapping_s {
+     void *p;
+     size_t bytes;
+     int mapped; /* by mmap(), else by MALLOC */
+     struct mapping_s *next;
+} mapping;
+
+static mapping *mappings = 0;
+
+static void *map_file(const char *filename, size_t *bytes, int *mapped)
+{
+     void *p = 0;
+     FILE *f;
+
+#ifdef USE_MMAP
+     {
+	  int fd = open(filename, O_RDONLY);
+	  struct stat st;
+
+	  if (fd < 0)
+	       return 0;
+	  if (!fstat(fd, &st) && st.st_size > 0) {
+	       *bytes = (size_t) st.st_size;
+	       p = mmap(0, *bytes, PROT_READ, MAP_SHARED, fd, 0);
+	       if (p == MAP_FAILED)
+		    p = 0;
+	  }
+	  close(fd);
+	  if (p) {
+	       *mapped = 1;
+	       return p;
+	  }
+     }
+#endif
+
+     /* read it instead */
+     if (!(f = fopen(filename, "rb")))
+	  return 0;
+     if (!fseek(f, 0, SEEK_END)) {
+	  long n = ftell(f);
+	  if (n > 0 && !fseek(f, 0, SEEK_SET)) {
+	       *bytes = (size_t) n;
+	       p = MALLOC(*bytes, HASHT);
+	       if (fread(p, 1, *bytes, f) != *bytes) {
+		    X(ifree)(p);
+		    p = 0;
+	       }
+	  }
+     }
+     fclose(f);
+     *mapped = 0;
+     return p;
+}
+
+static void unmap(void *p, size_t bytes, int mapped)
+{
+#ifdef USE_MMAP
+     if (mapped) {
+	  munmap(p, bytes);
+	  return;
+     }
+#endif
+     UNUSED(bytes);
+     UNUSED(mapped);
+     X(ifree)(p);
+}
+
+int X(import_wisdom_from_binary_filename)(const char *filename)
+{
+     size_t bytes;
+     int mapped;
+     void *p = map_file(filename, &bytes, &mapped);
+     mapping *m;
+
+     if (!p)
+	  return 0;
+
+     if (!X(planner_map_wisdom)(X(the_planner)(),
+				(const binary_wisdom *) p, bytes)) {
+	  unmap(p, bytes, mapped);
+	  return 0;
+     }
+
+     m = (mapping *) MALLOC(sizeof(mapping), HASHT);
+     m->p = p;
+     m->bytes = bytes;
+     m->mapped = mapped;
+     X(lock)();
+     m->next = mappings;
+     mappings = m;
+     X(unlock)();
+     return 1;
+}
+
+/* Processes may have FILENAME mapped, so write a new file and rename
+   it, rather than changing the one they see. */
+int X(export_wisdom_to_binary_filename)(const char *filename)
+{
+     planner *plnr = X(the_planner)();
+     binary_wisdom *w;
+     size_t bytes;
+     char *tmp;
+     FILE *f;
+     int ret;
+
+     X(lock)();
+     w = X(planner_binary_wisdom)(plnr, &bytes);
+     X(unlock)();
+
+     tmp = (char *) MALLOC(strlen(filename) + 5, OTHER);
+     strcpy(tmp, filename);
+     strcat(tmp, ".tmp");
+
+     ret = 0;
+     if ((f = fopen(tmp, "wb"))) {
+	  ret = (fwrite(w, 1, bytes, f) == bytes);
+	  if (fclose(f)) ret = 0; /* error closing file */
+	  if (ret && rename(tmp, filename)) {
+	       /* some systems don't rename onto an existing file */
+	       remove(filename);
+	       ret = !rename(tmp, filename);
+	  }
+	  if (!ret)
+	       remove(tmp);
+     }
+
+     X(ifree)(tmp);
+     X(ifree)(w);
+     return ret;
+}
+
+/* called by X(cleanup), once the planner is gone */
+void X(unmap_wisdom)(void)
+{
+     while (mappings) {
+	  mapping *m = mappings;
+	  mappings = m->next;
+	  unmap(m->p, m->bytes, m->mapped);
+	  X(ifree)(m);
+     }
+}
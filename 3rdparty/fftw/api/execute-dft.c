@@ -24,9 +24,12 @@
 /* guru interface: requires care in alignment etcetera. */
 void X(execute_dft)(const X(plan) p, C *in, C *out)
 {
-     plan_dft *pln = (plan_dft *) p->pln;
+     plan_dft *pln = (plan_dft *) APIPLAN_PLN(p);
+     REALTIME_BEGIN(p, pln->super.workspace);
+     X(scratch_reserve)(pln->super.workspace);
      if (p->sign == FFT_SIGN)
 	  pln->apply((plan *) pln, in[0], in[0]+1, out[0], out[0]+1);
      else
 	  pln->apply((plan *) pln, in[0]+1, in[0], out[0]+1, out[0]);
+     REALTIME_END(p);
 }
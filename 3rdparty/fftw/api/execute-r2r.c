@@ -24,6 +24,9 @@
 /* guru interface: requires care in alignment, etcetera. */
 void X(execute_r2r)(const X(plan) p, R *in, R *out)
 {
-     plan_rdft *pln = (plan_rdft *) p->pln;
+     plan_rdft *pln = (plan_rdft *) APIPLAN_PLN(p);
+     REALTIME_BEGIN(p, pln->super.workspace);
+     X(scratch_reserve)(pln->super.workspace);
      pln->apply((plan *) pln, in, out);
+     REALTIME_END(p);
 }
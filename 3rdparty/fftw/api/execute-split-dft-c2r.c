@@ -24,7 +24,10 @@
 /* guru interface: requires care in alignment, r - i, etcetera. */
 void X(execute_split_dft_c2r)(const X(plan) p, R *ri, R *ii, R *out)
 {
-     plan_rdft2 *pln = (plan_rdft2 *) p->pln;
+     plan_rdft2 *pln = (plan_rdft2 *) APIPLAN_PLN(p);
      problem_rdft2 *prb = (problem_rdft2 *) p->prb;
+     REALTIME_BEGIN(p, pln->super.workspace);
+     X(scratch_reserve)(pln->super.workspace);
      pln->apply((plan *) pln, out, out + (prb->r1 - prb->r0), ri, ii);
+     REALTIME_END(p);
 }
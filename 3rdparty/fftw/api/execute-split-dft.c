@@ -24,6 +24,9 @@
 /* guru interface: requires care in alignment, r - i, etcetera. */
 void X(execute_split_dft)(const X(plan) p, R *ri, R *ii, R *ro, R *io)
 {
-     plan_dft *pln = (plan_dft *) p->pln;
+     plan_dft *pln = (plan_dft *) APIPLAN_PLN(p);
+     REALTIME_BEGIN(p, pln->super.workspace);
+     X(scratch_reserve)(pln->super.workspace);
      pln->apply((plan *) pln, ri, ii, ro, io);
+     REALTIME_END(p);
 }
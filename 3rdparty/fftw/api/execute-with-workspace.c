@@ -0,0 +1,48 @@
+/*
+ * Copyright (c) 2003, 2007-14 Matteo Frigo
+ * Copyright (c) 2003, 2007-14 Massachusetts Institute of Technology
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+
+#include "api/api.h"
+
+/* bytes of scratch memory the plan uses while it executes, including
+   room to align it; the same for the life of the plan */
+size_t X(workspace_size)(const X(plan) p)
+{
+     size_t n = p->workspace;
+     return n ? n + SCRATCH_ALIGNMENT : 0;
+}
+
+/* execute out of the caller's WORK of X(workspace_size) bytes instead
+   of the memory that FFTW keeps for the calling thread */
+void X(execute_with_workspace)(const X(plan) p, void *work)
+{
+     plan *pln = APIPLAN_PLN(p);
+     scratch saved;
+
+     /* a plan from FFTW_ASYNC may need more than WORK */
+     if (pln->workspace > p->workspace)
+	  pln = p->estimate;
+
+     X(scratch_borrow)(work, X(workspace_size)(p), &saved);
+     REALTIME_BEGIN(p, pln->workspace);
+     pln->adt->solve(pln, p->prb);
+     REALTIME_END(p);
+     X(scratch_return)(&saved);
+}
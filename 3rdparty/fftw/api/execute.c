@@ -22,6 +22,9 @@
 
 void X(execute)(const X(plan) p)
 {
-     plan *pln = p->pln;
+     plan *pln = APIPLAN_PLN(p);
+     REALTIME_BEGIN(p, pln->workspace);
+     X(scratch_reserve)(pln->workspace);
      pln->adt->solve(pln, p->prb);
+     REALTIME_END(p);
 }
@@ -24,7 +24,9 @@ void X(export_wisdom_to_file)(FILE *output_file)
 {
      printer *p = X(mkprinter_file)(output_file);
      planner *plnr = X(the_planner)();
+     X(lock)();
      plnr->adt->exprt(plnr, p);
+     X(unlock)();
      X(printer_destroy)(p);
 }
 
@@ -27,6 +27,8 @@ char *X(export_wisdom_to_string)(void)
      size_t cnt;
      char *s;
 
+     /* the count must hold for the second export */
+     X(lock)();
      p = X(mkprinter_cnt)(&cnt);
      plnr->adt->exprt(plnr, p);
      X(printer_destroy)(p);
@@ -37,6 +39,7 @@ char *X(export_wisdom_to_string)(void)
           plnr->adt->exprt(plnr, p);
           X(printer_destroy)(p);
      }
+     X(unlock)();
 
      return s;
 }
@@ -39,6 +39,8 @@ void X(export_wisdom)(void (*write_char)(char c, void *), void *data)
 
      p->write_char = write_char;
      p->data = data;
+     X(lock)();
      plnr->adt->exprt(plnr, (printer *) p);
+     X(unlock)();
      X(printer_destroy)((printer *) p);
 }
@@ -25,8 +25,21 @@
 
 FFTW_VOIDFUNC F77(execute, EXECUTE)(X(plan) * const p)
 {
-     plan *pln = (*p)->pln;
+     plan *pln = APIPLAN_PLN(*p);
+     REALTIME_BEGIN(*p, pln->workspace);
+     X(scratch_reserve)(pln->workspace);
      pln->adt->solve(pln, (*p)->prb);
+     REALTIME_END(*p);
+}
+
+FFTW_VOIDFUNC F77(execute_with_workspace, EXECUTE_WITH_WORKSPACE)(X(plan) * const p, void *work)
+{
+     X(execute_with_workspace)(*p, work);
+}
+
+FFTW_VOIDFUNC F77(workspace_size, WORKSPACE_SIZE)(double *bytes, X(plan) * const p)
+{
+     *bytes = (double) X(workspace_size)(*p);
 }
 
 FFTW_VOIDFUNC F77(destroy_plan, DESTROY_PLAN)(X(plan) *p)
@@ -94,6 +107,16 @@ FFTW_VOIDFUNC F77(set_timelimit,SET_TIMELIMIT)(double *t)
      X(set_timelimit)(*t);
 }
 
+FFTW_VOIDFUNC F77(set_twiddle_cache_limit,SET_TWIDDLE_CACHE_LIMIT)(double *bytes)
+{
+     X(set_twiddle_cache_limit)((size_t) *bytes);
+}
+
+FFTW_VOIDFUNC F77(twiddle_cache_stats,TWIDDLE_CACHE_STATS)(double *hits, double *misses, double *bytes)
+{
+     X(twiddle_cache_stats)(hits, misses, bytes);
+}
+
 /******************************** DFT ***********************************/
 
 FFTW_VOIDFUNC F77(plan_dft, PLAN_DFT)(X(plan) *p, int *rank, const int *n,
@@ -173,18 +196,24 @@ FFTW_VOIDFUNC F77(plan_guru_split_dft, PLAN_GURU_SPLIT_DFT)(X(plan) *p, int *ran
 
 FFTW_VOIDFUNC F77(execute_dft, EXECUTE_DFT)(X(plan) * const p, C *in, C *out)
 {
-     plan_dft *pln = (plan_dft *) (*p)->pln;
+     plan_dft *pln = (plan_dft *) APIPLAN_PLN(*p);
+     REALTIME_BEGIN(*p, pln->super.workspace);
+     X(scratch_reserve)(pln->super.workspace);
      if ((*p)->sign == FFT_SIGN)
           pln->apply((plan *) pln, in[0], in[0]+1, out[0], out[0]+1);
      else
           pln->apply((plan *) pln, in[0]+1, in[0], out[0]+1, out[0]);
+     REALTIME_END(*p);
 }
 
 FFTW_VOIDFUNC F77(execute_split_dft, EXECUTE_SPLIT_DFT)(X(plan) * const p,
 					       R *ri, R *ii, R *ro, R *io)
 {
-     plan_dft *pln = (plan_dft *) (*p)->pln;
+     plan_dft *pln = (plan_dft *) APIPLAN_PLN(*p);
+     REALTIME_BEGIN(*p, pln->super.workspace);
+     X(scratch_reserve)(pln->super.workspace);
      pln->apply((plan *) pln, ri, ii, ro, io);
+     REALTIME_END(*p);
 }
 
 /****************************** DFT r2c *********************************/
@@ -268,17 +297,23 @@ FFTW_VOIDFUNC F77(plan_guru_split_dft_r2c, PLAN_GURU_SPLIT_DFT_R2C)(
 
 FFTW_VOIDFUNC F77(execute_dft_r2c, EXECUTE_DFT_R2C)(X(plan) * const p, R *in, C *out)
 {
-     plan_rdft2 *pln = (plan_rdft2 *) (*p)->pln;
+     plan_rdft2 *pln = (plan_rdft2 *) APIPLAN_PLN(*p);
      problem_rdft2 *prb = (problem_rdft2 *) (*p)->prb;
+     REALTIME_BEGIN(*p, pln->super.workspace);
+     X(scratch_reserve)(pln->super.workspace);
      pln->apply((plan *) pln, in, in + (prb->r1 - prb->r0), out[0], out[0]+1);
+     REALTIME_END(*p);
 }
 
 FFTW_VOIDFUNC F77(execute_split_dft_r2c, EXECUTE_SPLIT_DFT_R2C)(X(plan) * const p,
 						       R *in, R *ro, R *io)
 {
-     plan_rdft2 *pln = (plan_rdft2 *) (*p)->pln;
+     plan_rdft2 *pln = (plan_rdft2 *) APIPLAN_PLN(*p);
      problem_rdft2 *prb = (problem_rdft2 *) (*p)->prb;
+     REALTIME_BEGIN(*p, pln->super.workspace);
+     X(scratch_reserve)(pln->super.workspace);
      pln->apply((plan *) pln, in, in + (prb->r1 - prb->r0), ro, io);
+     REALTIME_END(*p);
 }
 
 /****************************** DFT c2r *********************************/
@@ -362,17 +397,23 @@ FFTW_VOIDFUNC F77(plan_guru_split_dft_c2r, PLAN_GURU_SPLIT_DFT_C2R)(
 
 FFTW_VOIDFUNC F77(execute_dft_c2r, EXECUTE_DFT_C2R)(X(plan) * const p, C *in, R *out)
 {
-     plan_rdft2 *pln = (plan_rdft2 *) (*p)->pln;
+     plan_rdft2 *pln = (plan_rdft2 *) APIPLAN_PLN(*p);
      problem_rdft2 *prb = (problem_rdft2 *) (*p)->prb;
+     REALTIME_BEGIN(*p, pln->super.workspace);
+     X(scratch_reserve)(pln->super.workspace);
      pln->apply((plan *) pln, out, out + (prb->r1 - prb->r0), in[0], in[0]+1);
+     REALTIME_END(*p);
 }
 
 FFTW_VOIDFUNC F77(execute_split_dft_c2r, EXECUTE_SPLIT_DFT_C2R)(X(plan) * const p,
 					   R *ri, R *ii, R *out)
 {
-     plan_rdft2 *pln = (plan_rdft2 *) (*p)->pln;
+     plan_rdft2 *pln = (plan_rdft2 *) APIPLAN_PLN(*p);
      problem_rdft2 *prb = (problem_rdft2 *) (*p)->prb;
+     REALTIME_BEGIN(*p, pln->super.workspace);
+     X(scratch_reserve)(pln->super.workspace);
      pln->apply((plan *) pln, out, out + (prb->r1 - prb->r0), ri, ii);
+     REALTIME_END(*p);
 }
 
 /****************************** r2r *********************************/
@@ -453,6 +494,9 @@ FFTW_VOIDFUNC F77(plan_guru_r2r, PLAN_GURU_R2R)(
 
 FFTW_VOIDFUNC F77(execute_r2r, EXECUTE_R2R)(X(plan) * const p, R *in, R *out)
 {
-     plan_rdft *pln = (plan_rdft *) (*p)->pln;
+     plan_rdft *pln = (plan_rdft *) APIPLAN_PLN(*p);
+     REALTIME_BEGIN(*p, pln->super.workspace);
+     X(scratch_reserve)(pln->super.workspace);
      pln->apply((plan *) pln, in, out);
+     REALTIME_END(*p);
 }
@@ -42,6 +42,10 @@
       PARAMETER (FFTW_ESTIMATE=64)
       INTEGER FFTW_WISDOM_ONLY
       PARAMETER (FFTW_WISDOM_ONLY=2097152)
+      INTEGER FFTW_REALTIME
+      PARAMETER (FFTW_REALTIME=4194304)
+      INTEGER FFTW_ASYNC
+      PARAMETER (FFTW_ASYNC=8388608)
       INTEGER FFTW_ESTIMATE_PATIENT
       PARAMETER (FFTW_ESTIMATE_PATIENT=128)
       INTEGER FFTW_BELIEVE_PCOST
@@ -141,6 +141,12 @@ typedef fftw_read_char_func_do_not_use_me X(read_char_func);            \
 FFTW_EXTERN void                                                        \
 FFTW_CDECL X(execute)(const X(plan) p);                                 \
                                                                         \
+FFTW_EXTERN size_t                                                      \
+FFTW_CDECL X(workspace_size)(const X(plan) p);                          \
+                                                                        \
+FFTW_EXTERN void                                                        \
+FFTW_CDECL X(execute_with_workspace)(const X(plan) p, void *work);      \
+                                                                        \
 FFTW_EXTERN X(plan)                                                     \
 FFTW_CDECL X(plan_dft)(int rank, const int *n,                          \
                        C *in, C *out, int sign, unsigned flags);        \
@@ -377,6 +383,13 @@ FFTW_EXTERN void                                                        \
 FFTW_CDECL X(set_timelimit)(double t);                                  \
                                                                         \
 FFTW_EXTERN void                                                        \
+FFTW_CDECL X(set_twiddle_cache_limit)(size_t bytes);                    \
+                                                                        \
+FFTW_EXTERN void                                                        \
+FFTW_CDECL X(twiddle_cache_stats)(double *hits, double *misses,         \
+                                  double *bytes);                       \
+                                                                        \
+FFTW_EXTERN void                                                        \
 FFTW_CDECL X(plan_with_nthreads)(int nthreads);                         \
                                                                         \
 FFTW_EXTERN int                                                         \
@@ -394,6 +407,16 @@ FFTW_CDECL X(threads_set_callback)(                                     \
      char *jobdata, size_t elsize, int njobs, void *data), void *data); \
                                                                         \
 FFTW_EXTERN void                                                        \
+FFTW_CDECL X(threads_set_spin)(int usec);                               \
+                                                                        \
+FFTW_EXTERN int                                                         \
+FFTW_CDECL X(threads_set_affinity)(int policy, const int *cpus,         \
+                                   int ncpus);                          \
+                                                                        \
+FFTW_EXTERN void                                                        \
+FFTW_CDECL X(threads_first_touch)(void *p, size_t n);                   \
+                                                                        \
+FFTW_EXTERN void                                                        \
 FFTW_CDECL X(make_planner_thread_safe)(void);                           \
                                                                         \
 FFTW_EXTERN int                                                         \
@@ -423,6 +446,26 @@ FFTW_CDECL X(import_wisdom_from_string)(const char *input_string);      \
 FFTW_EXTERN int                                                         \
 FFTW_CDECL X(import_wisdom)(X(read_char_func) read_char, void *data);   \
                                                                         \
+FFTW_EXTERN int                                                         \
+FFTW_CDECL X(export_wisdom_to_binary_filename)(const char *filename);   \
+                                                                        \
+FFTW_EXTERN int                                                         \
+FFTW_CDECL X(import_wisdom_from_binary_filename)(const char *filename); \
+                                                                        \
+FFTW_EXTERN int                                                         \
+FFTW_CDECL X(export_plans_to_filename)(const char *filename,            \
+                   const X(plan) *plans, int nplans, int twiddles);     \
+                                                                        \
+FFTW_EXTERN int                                                         \
+FFTW_CDECL X(export_plans_to_file)(FILE *output_file,                   \
+                   const X(plan) *plans, int nplans, int twiddles);     \
+                                                                        \
+FFTW_EXTERN int                                                         \
+FFTW_CDECL X(import_plans_from_filename)(const char *filename);         \
+                                                                        \
+FFTW_EXTERN int                                                         \
+FFTW_CDECL X(import_plans_from_file)(FILE *input_file);                 \
+                                                                        \
 FFTW_EXTERN void                                                        \
 FFTW_CDECL X(fprint_plan)(const X(plan) p, FILE *output_file);          \
                                                                         \
@@ -488,6 +531,12 @@ FFTW_DEFINE_API(FFTW_MANGLE_QUAD, __float128, fftwq_complex)
 
 #define FFTW_NO_TIMELIMIT (-1.0)
 
+/* placement policies for fftw_threads_set_affinity */
+#define FFTW_AFFINITY_NONE (0)
+#define FFTW_AFFINITY_COMPACT (1)
+#define FFTW_AFFINITY_SCATTER (2)
+#define FFTW_AFFINITY_EXPLICIT (3)
+
 /* documented flags */
 #define FFTW_MEASURE (0U)
 #define FFTW_DESTROY_INPUT (1U << 0)
@@ -498,6 +547,8 @@ FFTW_DEFINE_API(FFTW_MANGLE_QUAD, __float128, fftwq_complex)
 #define FFTW_PATIENT (1U << 5) /* IMPATIENT is default */
 #define FFTW_ESTIMATE (1U << 6)
 #define FFTW_WISDOM_ONLY (1U << 21)
+#define FFTW_REALTIME (1U << 22)
+#define FFTW_ASYNC (1U << 23)
 
 /* undocumented beyond-guru flags */
 #define FFTW_ESTIMATE_PATIENT (1U << 7)
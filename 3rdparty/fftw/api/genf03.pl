@@ -72,6 +72,10 @@ sub canonicalize_type {
     "const fftwf_plan" => "type(C_PTR), value",
     "const fftwl_plan" => "type(C_PTR), value",
     "const fftwq_plan" => "type(C_PTR), value",
+    "const fftw_plan *" => "type(C_PTR), dimension(*), intent(in)",
+    "const fftwf_plan *" => "type(C_PTR), dimension(*), intent(in)",
+    "const fftwl_plan *" => "type(C_PTR), dimension(*), intent(in)",
+    "const fftwq_plan *" => "type(C_PTR), dimension(*), intent(in)",
 
     "const int *" => "integer(C_INT), dimension(*), intent(in)",
     "ptrdiff_t *" => "integer(C_INTPTR_T), intent(out)",
@@ -122,6 +122,7 @@ void X(mapflags)(planner *plnr, unsigned flags)
 	  EQV(FFTW_NO_SIMD, NO_SIMD),
 	  EQV(FFTW_CONSERVE_MEMORY, CONSERVE_MEMORY),
 	  EQV(FFTW_NO_BUFFERING, NO_BUFFERING),
+	  EQV(FFTW_REALTIME, REALTIME),
 	  NEQV(FFTW_ALLOW_LARGE_GENERIC, NO_LARGE_GENERIC)
      };
 
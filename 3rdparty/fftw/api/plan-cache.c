@@ -0,0 +1,335 @@
+/*
+ * Copyright (c) 2003, 2007-14 Matteo Frigo
+ * Copyright (c) 2003, 2007-14 Massachusetts Institute of Technology
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+/* Plan caches: the solutions that the trees of some plans use, and
+   optionally their twiddle tables, in a binary file.  Unlike text
+   wisdom, which records every problem the planner ever solved, a plan
+   cache holds just what it takes to re-create the given plans without
+   searching and without computing twiddle factors.
+
+   The file is only meant to be read on the machine that wrote it, by
+   the same FFTW: it is in native byte order, and the header must match
+   the configuration of the planner (precision and solvers) and the
+   SIMD extensions of the CPU.  Nothing in it is trusted: twiddle
+   tables must have the shape twiddle.c would give them and agree with
+   it in a few sampled places, and no length in it may exceed what is
+   left of the file.  Layout:
+
+     plan_cache_header
+     nsols plan_solution
+     ntwids times: twiddle_header, ninstr tw_instr, bytes of twiddles
+*/
+
+#include "api/api.h"
+#include <string.h>
+
+#define MAGIC "FFTWPLNS"
+#define FORMAT_VERSION 1
+#define BYTE_ORDER_MARK 0x01020304U
+#define MAX_ENTRIES (1U << 20) /* of either kind, against corrupt files */
+#define MAX_N ((INT)1 << (sizeof(INT) * 8 - 4)) /* trig.c computes 4n */
+#define MAX_UNSEEKABLE ((size_t)1 << 30) /* bytes, when the length is unknown */
+
+typedef struct {
+     char magic[8];
+     unsigned version;
+     unsigned byte_order;
+     unsigned sizeof_R, sizeof_INT, sizeof_md5uint;
+     unsigned cpu;
+     md5uint configuration[4];
+     unsigned nsols, ntwids;
+} plan_cache_header;
+
+typedef struct {
+     int wakefulness;
+     INT n, r, m, ninstr;
+     size_t bytes;
+} twiddle_header;
+
+/* the SIMD extensions of the CPU, which decide the solvers we have */
+static unsigned cpu_features(void)
+{
+     unsigned f = 0;
+#if HAVE_SSE2
+     if (X(have_simd_sse2)()) f |= 1U << 0;
+#endif
+#if HAVE_AVX
+     if (X(have_simd_avx)()) f |= 1U << 1;
+#endif
+#if HAVE_AVX_128_FMA
+     if (X(have_simd_avx_128_fma)()) f |= 1U << 2;
+#endif
+#if HAVE_AVX2
+     if (X(have_simd_avx2)()) f |= 1U << 3;
+     if (X(have_simd_avx2_128)()) f |= 1U << 4;
+#endif
+#if HAVE_AVX512
+     if (X(have_simd_avx512)()) f |= 1U << 5;
+#endif
+#if HAVE_KCVI
+     if (X(have_simd_kcvi)()) f |= 1U << 6;
+#endif
+#if HAVE_ALTIVEC
+     if (X(have_simd_altivec)()) f |= 1U << 7;
+#endif
+#if HAVE_VSX
+     if (X(have_simd_vsx)()) f |= 1U << 8;
+#endif
+#if HAVE_NEON
+     if (X(have_simd_neon)()) f |= 1U << 9;
+#endif
+     return f;
+}
+
+static void mkheader(plan_cache_header *h)
+{
+     memset(h, 0, sizeof(*h));
+     memcpy(h->magic, MAGIC, sizeof(h->magic));
+     h->version = FORMAT_VERSION;
+     h->byte_order = BYTE_ORDER_MARK;
+     h->sizeof_R = sizeof(R);
+     h->sizeof_INT = sizeof(INT);
+     h->sizeof_md5uint = sizeof(md5uint);
+     h->cpu = cpu_features();
+     X(planner_signature)(X(the_planner)(), h->configuration);
+}
+
+static INT ninstr(const tw_instr *p)
+{
+     INT n = 1;
+     for ( ; p->op != TW_NEXT; ++p)
+	  ++n;
+     return n;
+}
+
+static int write_twiddle(FILE *f, const twid *t)
+{
+     twiddle_header th;
+
+     th.wakefulness = (int) t->wakefulness;
+     th.n = t->n;
+     th.r = t->r;
+     th.m = t->m;
+     th.ninstr = ninstr(t->instr);
+     th.bytes = t->bytes;
+
+     return (fwrite(&th, sizeof(th), 1, f) == 1
+	     && fwrite(t->instr, sizeof(tw_instr), (size_t)th.ninstr, f)
+	     == (size_t)th.ninstr
+	     && fwrite(t->W, 1, th.bytes, f) == th.bytes);
+}
+
+int X(export_plans_to_file)(FILE *output_file,
+			    const X(plan) *plans, int nplans, int twiddles)
+{
+     plan_record rec;
+     twid_record twrec;
+     plan_cache_header h;
+     int i, ok = 1;
+
+     rec.sols = 0;
+     rec.nsols = rec.solsiz = 0;
+     twrec.twids = 0;
+     twrec.ntwids = twrec.siz = 0;
+
+     for (i = 0; ok && i < nplans; ++i)
+	  ok = X(record_apiplan)(plans[i], &rec, twiddles ? &twrec : 0);
+
+     if (ok) {
+	  mkheader(&h);
+	  h.nsols = rec.nsols;
+	  h.ntwids = (unsigned) twrec.ntwids;
+
+	  ok = (fwrite(&h, sizeof(h), 1, output_file) == 1
+		&& fwrite(rec.sols, sizeof(plan_solution), rec.nsols,
+			  output_file) == rec.nsols);
+	  for (i = 0; ok && i < twrec.ntwids; ++i)
+	       ok = write_twiddle(output_file, twrec.twids[i]);
+     }
+
+     X(twiddle_record_destroy)(&twrec);
+     X(ifree0)(rec.sols);
+     return ok;
+}
+
+int X(export_plans_to_filename)(const char *filename,
+				const X(plan) *plans, int nplans, int twiddles)
+{
+     FILE *f = fopen(filename, "wb");
+     int ret;
+     if (!f) return 0; /* error opening file */
+     ret = X(export_plans_to_file)(f, plans, nplans, twiddles);
+     if (fclose(f)) ret = 0; /* error closing file */
+     return ret;
+}
+
+/* a twiddle table read from the file, not yet given to twiddle.c */
+typedef struct {
+     twiddle_header th;
+     tw_instr *instr;
+     R *W;
+} pending_twiddle;
+
+/* whether TH and INSTR describe a table that twiddle.c would compute */
+static int twiddle_ok(const twiddle_header *th, const tw_instr *instr)
+{
+     INT i, ntwiddle;
+
+     if (th->wakefulness <= SLEEPY || th->wakefulness > AWAKE_SINCOS)
+	  return 0;
+     if (th->n <= 0 || th->n > MAX_N
+	 || th->r <= 0 || th->r > th->n || th->m <= 0 || th->m > th->n)
+	  return 0;
+     for (i = 0; i < th->ninstr - 1; ++i)
+	  if (instr[i].op == TW_NEXT || instr[i].op > TW_HALF)
+	       return 0;
+     if (instr[i].op != TW_NEXT || instr[i].v <= 0 || th->m % instr[i].v)
+	  return 0;
+
+     /* TH->BYTES is known to fit in the file.  Bounding R by it keeps
+	the number of twiddles per iteration from overflowing, and
+	dividing instead of multiplying does the same for the number of
+	iterations */
+     if (th->bytes % sizeof(R) || th->r - 1 > (INT)(th->bytes / sizeof(R)))
+	  return 0;
+     ntwiddle = X(twiddle_length)(th->r, instr);
+     if (ntwiddle == 0)
+	  return th->bytes == 0;
+     return (th->bytes / sizeof(R)) % (size_t)ntwiddle == 0
+	  && (th->bytes / sizeof(R)) / (size_t)ntwiddle
+	  == (size_t)(th->m / instr[i].v);
+}
+
+/* how many bytes F has after the current position, so that a corrupt
+   length is rejected before it is allocated */
+static size_t bytes_left(FILE *f)
+{
+     long here = ftell(f), end;
+
+     if (here < 0 || fseek(f, 0, SEEK_END))
+	  return MAX_UNSEEKABLE;
+     end = ftell(f);
+     if (fseek(f, here, SEEK_SET) || end < here)
+	  return 0;
+     return (size_t)(end - here);
+}
+
+/* take N bytes out of what is LEFT of the file, if it has them */
+static int take(size_t *left, size_t n)
+{
+     if (n > *left)
+	  return 0;
+     *left -= n;
+     return 1;
+}
+
+static int read_twiddle(FILE *f, pending_twiddle *pt, size_t *left)
+{
+     twiddle_header *th = &pt->th;
+
+     pt->instr = 0;
+     pt->W = 0;
+     if (fread(th, sizeof(*th), 1, f) != 1
+	 || th->ninstr <= 0 || th->ninstr > 1024
+	 || !take(left, sizeof(*th) + sizeof(tw_instr) * (size_t)th->ninstr))
+	  return 0;
+
+     pt->instr = (tw_instr *)MALLOC(sizeof(tw_instr) * (size_t)th->ninstr,
+				    TWIDDLES);
+     if (fread(pt->instr, sizeof(tw_instr), (size_t)th->ninstr, f)
+	 != (size_t)th->ninstr || !take(left, th->bytes)
+	 || !twiddle_ok(th, pt->instr))
+	  return 0;
+
+     pt->W = (R *)MALLOC(th->bytes, TWIDDLES);
+     return (fread(pt->W, 1, th->bytes, f) == th->bytes
+	     && X(twiddle_check)(pt->instr, th->n, th->r, th->m, pt->W));
+}
+
+int X(import_plans_from_file)(FILE *input_file)
+{
+     plan_cache_header h, want;
+     plan_solution *sols = 0;
+     pending_twiddle *pts = 0;
+     unsigned i, npts = 0;
+     size_t left;
+     int ok;
+
+     /* read and check everything before touching the planner */
+     mkheader(&want);
+     if (fread(&h, sizeof(h), 1, input_file) != 1
+	 || memcmp(h.magic, want.magic, sizeof(h.magic))
+	 || h.version != want.version
+	 || h.byte_order != want.byte_order
+	 || h.sizeof_R != want.sizeof_R
+	 || h.sizeof_INT != want.sizeof_INT
+	 || h.sizeof_md5uint != want.sizeof_md5uint
+	 || h.cpu != want.cpu
+	 || memcmp(h.configuration, want.configuration,
+		   sizeof(h.configuration))
+	 || h.nsols > MAX_ENTRIES || h.ntwids > MAX_ENTRIES)
+	  return 0;
+
+     left = bytes_left(input_file);
+     if (!take(&left, sizeof(plan_solution) * h.nsols)
+	 || h.ntwids > left / sizeof(twiddle_header))
+	  return 0;
+
+     sols = (plan_solution *)MALLOC(sizeof(plan_solution) * (h.nsols + 1),
+				    HASHT);
+     ok = (fread(sols, sizeof(plan_solution), h.nsols, input_file)
+	   == h.nsols);
+
+     if (ok && h.ntwids) {
+	  pts = (pending_twiddle *)MALLOC(sizeof(pending_twiddle) * h.ntwids,
+					  TWIDDLES);
+	  for ( ; ok && npts < h.ntwids; ++npts)
+	       ok = read_twiddle(input_file, pts + npts, &left);
+     }
+
+     if (ok)
+	  ok = X(planner_preload)(X(the_planner)(), sols, h.nsols);
+
+     for (i = 0; i < npts; ++i) {
+	  pending_twiddle *pt = pts + i;
+	  if (ok) {
+	       X(twiddle_preload)((enum wakefulness) pt->th.wakefulness,
+				  pt->instr, pt->th.n, pt->th.r, pt->th.m,
+				  pt->W, pt->th.bytes);
+	  } else {
+	       X(ifree0)(pt->instr);
+	       X(ifree0)(pt->W);
+	  }
+     }
+
+     X(ifree0)(pts);
+     X(ifree)(sols);
+     return ok;
+}
+
+int X(import_plans_from_filename)(const char *filename)
+{
+     FILE *f = fopen(filename, "rb");
+     int ret;
+     if (!f) return 0; /* error opening file */
+     ret = X(import_plans_from_file)(f);
+     if (fclose(f)) ret = 0; /* error closing file */
+     return ret;
+}
@@ -21,6 +21,8 @@
 #include "api/api.h"
 
 static planner *plnr = 0;
+static thread_planner_hook_t thread_planner_hook = 0;
+static planner_hook_t forget_thread_planners_hook = 0;
 
 /* create the planner for the rest of the API */
 planner *X(the_planner)(void)
@@ -33,12 +35,38 @@ planner *X(the_planner)(void)
      return plnr;
 }
 
+void X(set_thread_planner_hooks)(thread_planner_hook_t get,
+				 planner_hook_t forget)
+{
+     thread_planner_hook = get;
+     forget_thread_planners_hook = forget;
+}
+
+/* the planner that plans for the calling thread: the_planner, unless
+   the threads library gives every thread its own sibling of it */
+planner *X(thread_planner)(void)
+{
+     if (thread_planner_hook)
+	  return thread_planner_hook();
+     return X(the_planner)();
+}
+
 void X(cleanup)(void)
 {
+     /* FFTW_ASYNC planning uses the planner */
+     if (X(upgrade_wait_hook))
+	  X(upgrade_wait_hook)();
+
      if (plnr) {
+	  /* siblings share the wisdom of plnr, so they go first */
+	  if (forget_thread_planners_hook)
+	       forget_thread_planners_hook();
           X(planner_destroy)(plnr);
           plnr = 0;
      }
+     X(unmap_wisdom)();
+     X(twiddle_flush)();
+     X(scratch_release)();
 }
 
 void X(set_timelimit)(double tlim) 
@@ -47,3 +75,13 @@ void X(set_timelimit)(double tlim)
 	called, so use X(the_planner)() */
      X(the_planner)()->timelimit = tlim; 
 }
+
+void X(set_twiddle_cache_limit)(size_t bytes)
+{
+     X(twiddle_set_limit)(bytes);
+}
+
+void X(twiddle_cache_stats)(double *hits, double *misses, double *bytes)
+{
+     X(twiddle_stats)(hits, misses, bytes);
+}
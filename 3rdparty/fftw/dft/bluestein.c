@@ -84,7 +84,7 @@ static void apply(const plan *ego_, R *ri, R *ii, R *ro, R *io)
      const P *ego = (const P *) ego_;
      INT i, n = ego->n, nb = ego->nb, is = ego->is, os = ego->os;
      R *w = ego->w, *W = ego->W;
-     R *b = (R *) MALLOC(2 * nb * sizeof(R), BUFFERS);
+     R *b = (R *) X(scratch_get)(2 * nb * sizeof(R));
 
      /* multiply input by conjugate bluestein sequence */
      for (i = 0; i < n; ++i) {
@@ -124,7 +124,7 @@ static void apply(const plan *ego_, R *ri, R *ii, R *ro, R *io)
           io[i*os] = xi * wr - xr * wi;
      }
 
-     X(ifree)(b);	  
+     X(scratch_put)(b);
 }
 
 static void awake(plan *ego_, enum wakefulness wakefulness)
@@ -222,6 +222,7 @@ static plan *mkplan(const solver *ego, const problem *p_, planner *plnr)
      pln->cldf = cldf;
      pln->is = p->sz->dims[0].is;
      pln->os = p->sz->dims[0].os;
+     X(plan_scratch)(&pln->super.super, 2 * nb * sizeof(R));
 
      X(ops_add)(&cldf->ops, &cldf->ops, &pln->super.super.ops);
      pln->super.super.ops.add += 4 * n + 2 * nb;
@@ -299,6 +299,8 @@ static plan *mkcldw(const ct_solver *ego_,
      if (ego->bufferedp) {
 	  /* 8 load/stores * N * V */
 	  pln->super.super.ops.other += 8 * r * mcount * v;
+	  X(plan_scratch)(&pln->super.super, BUF_SCRATCH(
+			       r * compute_batchsize(r) * 2 * sizeof(R)));
      }
 
      pln->super.super.could_prune_now_p =
@@ -265,8 +265,12 @@ static plan *mkplan(const solver *ego_, const problem *p_, planner *plnr)
      X(ops_zero)(&pln->super.super.ops);
      X(ops_madd2)(pln->vl / e->genus->vl, &e->ops, &pln->super.super.ops);
 
-     if (ego->bufferedp) 
+     if (ego->bufferedp) {
 	  pln->super.super.ops.other += 4 * pln->n * pln->vl;
+	  X(plan_scratch)(&pln->super.super, BUF_SCRATCH(
+			       pln->n * compute_batchsize(pln->n)
+			       * 2 * sizeof(R)));
+     }
 
      pln->super.super.could_prune_now_p = !ego->bufferedp;
      return &(pln->super.super);
@@ -145,6 +145,7 @@ static plan *mkplan(const solver *ego, const problem *p_, planner *plnr)
      pln->is = p->sz->dims[0].is;
      pln->os = p->sz->dims[0].os;
      pln->td = 0;
+     X(plan_scratch)(&pln->super.super, BUF_SCRATCH(n * 2 * sizeof(E)));
 
      pln->super.super.ops.add = (n-1) * 5;
      pln->super.super.ops.mul = 0;
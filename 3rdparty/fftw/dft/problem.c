@@ -65,13 +65,36 @@ static void zero(const problem *ego_)
      X(tensor_destroy)(sz);
 }
 
+static void extents(const problem *ego_, extent *in, extent *out)
+{
+     const problem_dft *ego = (const problem_dft *) ego_;
+     tensor *sz = X(tensor_append)(ego->vecsz, ego->sz);
+     INT ilo, ihi, olo, ohi;
+     X(tensor_index_range)(sz, &ilo, &ihi, &olo, &ohi);
+     X(extent_add)(in, ego->ri, ilo, ihi);
+     X(extent_add)(in, ego->ii, ilo, ihi);
+     X(extent_add)(out, ego->ro, olo, ohi);
+     X(extent_add)(out, ego->io, olo, ohi);
+     X(tensor_destroy)(sz);
+}
+
+static problem *displace(const problem *ego_, INT din, INT dout)
+{
+     const problem_dft *ego = (const problem_dft *) ego_;
+     return X(mkproblem_dft)(ego->sz, ego->vecsz,
+			     ego->ri + din, ego->ii + din,
+			     ego->ro + dout, ego->io + dout);
+}
+
 static const problem_adt padt =
 {
      PROBLEM_DFT,
      hash,
      zero,
      print,
-     destroy
+     destroy,
+     extents,
+     displace
 };
 
 problem *X(mkproblem_dft)(const tensor *sz, const tensor *vecsz,
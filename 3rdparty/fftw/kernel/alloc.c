@@ -23,6 +23,7 @@
 void *X(malloc_plain)(size_t n)
 {
      void *p;
+     REALTIME_CHECK("malloc");
      if (n == 0)
           n = 1;
      p = X(kernel_malloc)(n);
@@ -37,6 +38,7 @@ void *X(malloc_plain)(size_t n)
 
 void X(ifree)(void *p)
 {
+     REALTIME_CHECK("free");
      X(kernel_free)(p);
 }
 
@@ -22,13 +22,51 @@
 #include <stdio.h>
 #include <stdlib.h>
 
-void X(assertion_failed)(const char *s, int line, const char *file)
+static void die(void)
 {
-     fflush(stdout);
-     fprintf(stderr, "fftw: %s:%d: assertion failed: %s\n", file, line, s);
 #ifdef HAVE_ABORT
      abort();
 #else
      exit(EXIT_FAILURE);
 #endif
 }
+
+void X(assertion_failed)(const char *s, int line, const char *file)
+{
+     fflush(stdout);
+     fprintf(stderr, "fftw: %s:%d: assertion failed: %s\n", file, line, s);
+     die();
+}
+
+#ifdef REALTIME_CHECKS
+static THREAD_LOCAL int realtime; /* executing an FFTW_REALTIME plan */
+
+void X(realtime_enter)(int enter)
+{
+     realtime += enter ? 1 : -1;
+}
+
+/* enter, for a plan that needs N bytes of the arena of the thread */
+void X(realtime_begin)(size_t n)
+{
+     if (!X(scratch_reserved)(n)) {
+	  fflush(stdout);
+	  fprintf(stderr, "fftw: an FFTW_REALTIME plan needs %lu bytes of "
+		  "scratch memory that this thread has not got; execute it "
+		  "with fftw_execute_with_workspace from threads other "
+		  "than the one that made it\n", (unsigned long)n);
+	  die();
+     }
+     X(realtime_enter)(1);
+}
+
+void X(realtime_check)(const char *what)
+{
+     if (realtime) {
+	  fflush(stdout);
+	  fprintf(stderr, "fftw: %s while executing an FFTW_REALTIME plan\n",
+		  what);
+	  die();
+     }
+}
+#endif
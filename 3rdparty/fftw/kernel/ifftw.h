@@ -182,37 +182,100 @@ void *alloca(size_t);
 #    define STACK_MALLOC(T, p, n) p = (T)alloca(n) 
 #    define STACK_FREE(n) 
 #  endif
+#  define BUF_STACK_MAX MAX_STACK_ALLOC
 
 #else /* ! HAVE_ALLOCA */
    /* use malloc instead of alloca */
 #  define STACK_MALLOC(T, p, n) p = (T)MALLOC(n, OTHER)
 #  define STACK_FREE(n) X(ifree)(n)
+   /* buffers come from scratch memory, which does not malloc once
+      reserved */
+#  define BUF_STACK_MAX ((size_t)0)
 #endif /* ! HAVE_ALLOCA */
 
-/* allocation of buffers.  If these grow too large use malloc(), else
-   use STACK_MALLOC (hopefully reducing to alloca()). */
+/* allocation of buffers.  If these grow too large use scratch memory
+   (see below), else use STACK_MALLOC (hopefully reducing to
+   alloca()). */
 
 /* 64KiB ought to be enough for anybody */
 #define MAX_STACK_ALLOC ((size_t)64 * 1024)
 
 #define BUF_ALLOC(T, p, n)			\
 {						\
-     if (n < MAX_STACK_ALLOC) {			\
+     if (n < BUF_STACK_MAX) {			\
 	  STACK_MALLOC(T, p, n);		\
      } else {					\
-	  p = (T)MALLOC(n, BUFFERS);		\
+	  p = (T)X(scratch_get)(n);		\
      }						\
 }
 
 #define BUF_FREE(p, n)				\
 {						\
-     if (n < MAX_STACK_ALLOC) {			\
+     if (n < BUF_STACK_MAX) {			\
 	  STACK_FREE(p);			\
      } else {					\
-	  X(ifree)(p);				\
+	  X(scratch_put)(p);			\
      }						\
 }
 
+/* the scratch BUF_ALLOC(T, p, n) takes, for X(plan_scratch) */
+#define BUF_SCRATCH(n) ((n) < BUF_STACK_MAX ? (size_t)0 : (size_t)(n))
+
+/*-----------------------------------------------------------------------*/
+/* scratch.c: */
+
+/* Buffers that apply() needs while it runs come from an arena of the
+   executing thread, used as a stack.  The plan declares their size
+   when it is made (X(plan_scratch)), X(plan_awake) sums that up over
+   the plan tree into plan->workspace, and the arena is made that large
+   before the plan runs (X(scratch_reserve)), so that executing does not
+   call malloc.  Whatever does not fit still comes from malloc. */
+#if defined(_MSC_VER)
+#  define THREAD_LOCAL __declspec(thread)
+#elif defined(__GNUC__)
+#  define THREAD_LOCAL __thread
+#elif defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L \
+      && !defined(__STDC_NO_THREADS__)
+#  define THREAD_LOCAL _Thread_local
+#endif
+/* without THREAD_LOCAL, scratch memory always comes from malloc */
+
+typedef struct {
+     char *base;
+     size_t size, top;
+     int borrowed; /* base belongs to the caller, see X(scratch_borrow) */
+} scratch;
+
+#define SCRATCH_ALIGNMENT 64 /* every block, so that SIMD codelets apply */
+
+size_t X(scratch_round)(size_t n);
+IFFTW_EXTERN void *X(scratch_get)(size_t n);
+IFFTW_EXTERN void X(scratch_put)(void *p);
+IFFTW_EXTERN void X(scratch_reserve)(size_t n);
+int X(scratch_reserved)(size_t n);
+void X(scratch_borrow)(void *work, size_t n, scratch *saved);
+void X(scratch_return)(const scratch *saved);
+IFFTW_EXTERN void X(scratch_release)(void);
+
+/* called once by every thread that gets an arena, so that the threads
+   library can release it when the thread exits */
+extern void (*X(scratch_hook))(void);
+
+/* Executing a plan made with FFTW_REALTIME must not allocate memory or
+   block.  Debug builds check: the api brackets such executions with
+   X(realtime_begin) and X(realtime_enter), and REALTIME_CHECK() reports
+   calls in between.  X(realtime_begin) also reports when the arena of
+   the calling thread is too small for the plan. */
+#if defined(FFTW_DEBUG) && defined(THREAD_LOCAL)
+#  define REALTIME_CHECKS 1
+IFFTW_EXTERN void X(realtime_begin)(size_t n);
+IFFTW_EXTERN void X(realtime_enter)(int enter);
+IFFTW_EXTERN void X(realtime_check)(const char *what);
+#  define REALTIME_CHECK(what) X(realtime_check)(what)
+#else
+#  define REALTIME_CHECK(what)
+#endif
+
 /*-----------------------------------------------------------------------*/
 /* define uintptr_t if it is not already defined */
 
@@ -449,6 +512,8 @@ tensor *X(mktensor_5d)(INT n0, INT is0, INT os0,
 INT X(tensor_sz)(const tensor *sz);
 void X(tensor_md5)(md5 *p, const tensor *t);
 INT X(tensor_max_index)(const tensor *sz);
+void X(tensor_index_range)(const tensor *sz, INT *ilo, INT *ihi,
+			   INT *olo, INT *ohi);
 INT X(tensor_min_istride)(const tensor *sz);
 INT X(tensor_min_ostride)(const tensor *sz);
 INT X(tensor_min_stride)(const tensor *sz);
@@ -494,12 +559,25 @@ enum {
      PROBLEM_LAST 
 };
 
+/* the bytes [lo, hi) that the arrays of a problem may touch, which
+   span at least BYTES */
+typedef struct {
+     uintptr_t lo, hi;
+     size_t bytes;
+} extent;
+
 typedef struct {
      int problem_kind;
      void (*hash) (const problem *ego, md5 *p);
      void (*zero) (const problem *ego);
      void (*print) (const problem *ego, printer *p);
      void (*destroy) (problem *ego);
+
+     /* optional, see X(problem_scratch): add the memory the arrays
+	may touch to IN and OUT, and copy the problem onto arrays
+	DIN and DOUT reals away */
+     void (*extent) (const problem *ego, extent *in, extent *out);
+     problem *(*displace) (const problem *ego, INT din, INT dout);
 } problem_adt;
 
 struct problem_s {
@@ -509,6 +587,8 @@ struct problem_s {
 problem *X(mkproblem)(size_t sz, const problem_adt *adt);
 void X(problem_destroy)(problem *ego);
 problem *X(mkproblem_unsolvable)(void);
+void X(extent_add)(extent *e, R *p, INT lo, INT hi);
+problem *X(problem_scratch)(const problem *ego, R **scratch);
 
 /*-----------------------------------------------------------------------*/
 /* print.c */
@@ -561,9 +641,12 @@ struct plan_s {
      double pcost;
      enum wakefulness wakefulness; /* used for debugging only */
      int could_prune_now_p;
+     size_t scratch; /* taken by apply() itself, see X(plan_scratch) */
+     size_t workspace; /* scratch of the whole tree, set when awake */
 };
 
 plan *X(mkplan)(size_t size, const plan_adt *adt);
+IFFTW_EXTERN void X(plan_scratch)(plan *ego, size_t n);
 void X(plan_destroy_internal)(plan *ego);
 IFFTW_EXTERN void X(plan_awake)(plan *ego, enum wakefulness wakefulness);
 void X(plan_null_destroy)(plan *ego);
@@ -601,6 +684,56 @@ typedef struct slvdesc_s {
 } slvdesc;
 
 typedef struct solution_s solution; /* opaque */
+typedef struct slots_s slots; /* opaque */
+
+/* the solutions that planning a problem uses, see planner->record */
+typedef struct {
+     md5uint s[4];
+     unsigned l, u, timelimit_impatience, slvndx;
+} plan_solution;
+
+typedef struct {
+     plan_solution *sols;
+     unsigned nsols, solsiz;
+} plan_record;
+
+/* binary wisdom: this header, followed by a hash table of HASHSIZ
+   plan_solutions laid out like the planner's (see planner.c), which
+   the planner reads where it lies, e.g. in a file mapped into memory */
+typedef struct {
+     char magic[8];
+     unsigned version, byte_order, sizeof_md5uint;
+     unsigned hashsiz, nsols;
+     md5uint configuration[4];
+} binary_wisdom;
+
+#define BINARY_WISDOM_EMPTY 0xffffffffU /* slvndx of an empty slot */
+
+/* Loads and stores of the planner data that concurrent planners read
+   without locking (see X(mkplanner_sibling)).  Without them, the
+   threads library serializes planning instead. */
+#if defined(__ATOMIC_ACQUIRE)
+#  define HAVE_ATOMICS 1
+#  define ATOMIC_LOAD(p) __atomic_load_n(p, __ATOMIC_ACQUIRE)
+#  define ATOMIC_STORE(p, v) __atomic_store_n(p, v, __ATOMIC_RELEASE)
+#elif defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+   /* volatile accesses are acquire/release (/volatile:ms) */
+#  define HAVE_ATOMICS 1
+#  define ATOMIC_LOAD(p) (*(p))
+#  define ATOMIC_STORE(p, v) (*(p) = (v))
+#else
+#  define HAVE_ATOMICS 0
+#  define ATOMIC_LOAD(p) (*(p))
+#  define ATOMIC_STORE(p, v) (*(p) = (v))
+#endif
+
+/* Serialize changes to the data shared by concurrent planners: wisdom,
+   twiddle factors and Rader omegas.  The hooks are installed by the
+   threads library, and are 0 otherwise. */
+extern void (*X(lock_hook))(void);
+extern void (*X(unlock_hook))(void);
+void X(lock)(void);
+void X(unlock)(void);
 
 /* interpretation of L and U: 
 
@@ -647,7 +780,8 @@ enum {
      CONSERVE_MEMORY = 0x4000,
      NO_DHT_R2HC = 0x8000,
      NO_UGLY = 0x10000,
-     ALLOW_PRUNING = 0x20000
+     ALLOW_PRUNING = 0x20000,
+     REALTIME = 0x40000 /* apply() neither allocates nor blocks */
 };
 
 /* hashtable information */
@@ -676,13 +810,14 @@ enum {
 #define NO_FIXED_RADIX_LARGE_NP(plnr) \
   (PLNR_L(plnr) & NO_FIXED_RADIX_LARGE_N)
 #define NO_NONTHREADEDP(plnr) \
-  ((PLNR_L(plnr) & NO_NONTHREADED) && (plnr)->nthr > 1)
+  ((PLNR_L(plnr) & NO_NONTHREADED) && (plnr)->nthr > 1 && !REALTIMEP(plnr))
 
 #define NO_DESTROY_INPUTP(plnr) (PLNR_L(plnr) & NO_DESTROY_INPUT)
 #define NO_SIMDP(plnr) (PLNR_L(plnr) & NO_SIMD)
 #define CONSERVE_MEMORYP(plnr) (PLNR_L(plnr) & CONSERVE_MEMORY)
 #define NO_DHT_R2HCP(plnr) (PLNR_L(plnr) & NO_DHT_R2HC)
 #define NO_BUFFERINGP(plnr) (PLNR_L(plnr) & NO_BUFFERING)
+#define REALTIMEP(plnr) (PLNR_L(plnr) & REALTIME)
 
 typedef enum { FORGET_ACCURSED, FORGET_EVERYTHING } amnesia;
 
@@ -712,13 +847,17 @@ typedef struct {
      int (*imprt)(planner *ego, scanner *sc);
 } planner_adt;
 
-/* hash table of solutions */
+/* hash table of solutions.  Slots are filled once and never reused,
+   and the table is replaced wholesale when it grows, so that planners
+   sharing it can look up solutions without locking. */
 typedef struct {
-     solution *solutions;
-     unsigned hashsiz, nelem;
+     slots *volatile tab;
+     const binary_wisdom *volatile mapped; /* read-only, blessed only */
+     unsigned nelem;  /* live entries */
+     unsigned nused;  /* live and dead entries */
+     int refcnt;      /* planners sharing the table */
 
      /* statistics */
-     int lookup, succ_lookup, lookup_iter;
      int insert, insert_iter, insert_unknown;
      int nrehash;
 } hashtab;
@@ -743,12 +882,15 @@ struct planner_s {
 
      wisdom_state_t wisdom_state;
 
-     hashtab htab_blessed;
+     hashtab *htab_blessed; /* shared with the siblings of this planner */
      hashtab htab_unblessed;
 
      int nthr;
      flags_t flags;
 
+     /* if nonzero, mkplan() adds the solutions it uses here */
+     plan_record *record;
+
      crude_time start_time;
      double timelimit; /* elapsed_since(start_time) at which to bail out */
      int timed_out; /* whether most recent search timed out */
@@ -758,10 +900,17 @@ struct planner_s {
      int nplan;    /* number of plans evaluated */
      double pcost, epcost; /* total pcost of measured/estimated plans */
      int nprob;    /* number of problems evaluated */
+     int lookup, succ_lookup, lookup_iter; /* wisdom lookups */
 };
 
 planner *X(mkplanner)(void);
+planner *X(mkplanner_sibling)(const planner *ego);
 void X(planner_destroy)(planner *ego);
+void X(planner_signature)(planner *ego, md5uint sig[4]);
+int X(planner_preload)(planner *ego, const plan_solution *sols,
+		       unsigned nsols);
+binary_wisdom *X(planner_binary_wisdom)(planner *ego, size_t *bytes);
+int X(planner_map_wisdom)(planner *ego, const binary_wisdom *w, size_t bytes);
 
 /*
   Iterate over all solvers.   Read:
@@ -887,11 +1036,30 @@ typedef struct twid_s {
      const tw_instr *instr;
      struct twid_s *cdr;
      enum wakefulness wakefulness;
+     size_t bytes;             /* size of W */
+     struct twid_s *prev, *next; /* idle list, when refcnt == 0 */
+     tw_instr *own_instr;      /* copy of instr, see X(twiddle_preload) */
+     int preloaded;            /* preloaded and not used yet */
 } twid;
 
+/* the tables that a thread acquires, see X(twiddle_record) */
+typedef struct {
+     twid **twids;
+     INT ntwids, siz;
+} twid_record;
+
 INT X(twiddle_length)(INT r, const tw_instr *p);
 void X(twiddle_awake)(enum wakefulness wakefulness,
 		      twid **pp, const tw_instr *instr, INT n, INT r, INT m);
+void X(twiddle_set_limit)(size_t lim);
+void X(twiddle_stats)(double *hits, double *misses, double *bytes);
+void X(twiddle_flush)(void);
+void X(twiddle_record)(twid_record *rec);
+void X(twiddle_record_destroy)(twid_record *rec);
+int X(twiddle_check)(const tw_instr *instr, INT n, INT r, INT m,
+		      const R *W);
+void X(twiddle_preload)(enum wakefulness wakefulness, tw_instr *instr,
+			INT n, INT r, INT m, R *W, size_t bytes);
 
 /*-----------------------------------------------------------------------*/
 /* trig.c */
@@ -951,7 +1119,7 @@ INT X(modulo)(INT a, INT n);
 typedef struct rader_tls rader_tl;
 
 void X(rader_tl_insert)(INT k1, INT k2, INT k3, R *W, rader_tl **tl);
-R *X(rader_tl_find)(INT k1, INT k2, INT k3, rader_tl *t);
+R *X(rader_tl_find)(INT k1, INT k2, INT k3, rader_tl **tl);
 void X(rader_tl_delete)(R *W, rader_tl **tl);
 
 /*-----------------------------------------------------------------------*/
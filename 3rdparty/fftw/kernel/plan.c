@@ -35,10 +35,19 @@ plan *X(mkplan)(size_t size, const plan_adt *adt)
      p->pcost = 0.0;
      p->wakefulness = SLEEPY;
      p->could_prune_now_p = 0;
+     p->scratch = 0;
+     p->workspace = 0;
      
      return p;
 }
 
+/* declare a block of N bytes that apply() takes from X(scratch_get) */
+void X(plan_scratch)(plan *ego, size_t n)
+{
+     if (n > 0)
+	  ego->scratch += X(scratch_round)(n);
+}
+
 /*
  * destroy a plan
  */
@@ -58,13 +67,30 @@ void X(plan_null_destroy)(plan *ego)
      /* nothing */
 }
 
+/* largest workspace among the children that the plan being awakened
+   has awakened so far */
+#ifdef THREAD_LOCAL
+static THREAD_LOCAL size_t children_workspace;
+#else
+static size_t children_workspace; /* only an estimate, then */
+#endif
+
 void X(plan_awake)(plan *ego, enum wakefulness wakefulness)
 {
      if (ego) {
+	  size_t siblings = children_workspace;
+
 	  A(((wakefulness == SLEEPY) ^ (ego->wakefulness == SLEEPY)));
 	  
+	  children_workspace = 0;
 	  ego->adt->awake(ego, wakefulness);
 	  ego->wakefulness = wakefulness;
+
+	  /* any one thread runs the children one at a time, each on top
+	     of the scratch of its parent */
+	  ego->workspace = ego->scratch + children_workspace;
+	  children_workspace = siblings > ego->workspace ? 
+	       siblings : ego->workspace;
      }
 }
 
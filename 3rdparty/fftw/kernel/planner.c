@@ -30,8 +30,8 @@
 		    supplicanti parce [rms]
 */
 
-#define VALIDP(solution) ((solution)->flags.hash_info & H_VALID)
-#define LIVEP(solution) ((solution)->flags.hash_info & H_LIVE)
+#define VALIDP(solution) (ATOMIC_LOAD(&(solution)->state) & H_VALID)
+#define LIVEP(solution) (ATOMIC_LOAD(&(solution)->state) & H_LIVE)
 #define SLVNDX(solution) ((solution)->flags.slvndx)
 #define BLISS(flags) (((flags).hash_info) & BLESSING)
 #define INFEASIBLE_SLVNDX ((1U<<BITS_FOR_SLVNDX)-1)
@@ -46,6 +46,22 @@
 static void check(hashtab *ht);
 #endif
 
+void (*X(lock_hook))(void) = 0;
+void (*X(unlock_hook))(void) = 0;
+
+void X(lock)(void)
+{
+     REALTIME_CHECK("locking the planner");
+     if (X(lock_hook))
+	  X(lock_hook)();
+}
+
+void X(unlock)(void)
+{
+     if (X(unlock_hook))
+	  X(unlock_hook)();
+}
+
 /* x <= y */
 #define LEQ(x, y) (((x) & (y)) == (x))
 
@@ -151,22 +167,6 @@ static void signature_of_configuration(md5 *m, planner *ego)
   md5-related stuff:
 */
 
-/* first hash function */
-static unsigned h1(const hashtab *ht, const md5sig s)
-{
-     unsigned h = s[0] % ht->hashsiz;
-     A(h == (s[0] % ht->hashsiz));
-     return h;
-}
-
-/* second hash function (for double hashing) */
-static unsigned h2(const hashtab *ht, const md5sig s)
-{
-     unsigned h = 1U + s[1] % (ht->hashsiz - 1);
-     A(h == (1U + s[1] % (ht->hashsiz - 1)));
-     return h;
-}
-
 static void md5hash(md5 *m, const problem *p, const planner *plnr)
 {
      X(md5begin)(m);
@@ -198,15 +198,39 @@ static void sigcpy(const md5sig a, md5sig b)
 struct solution_s {
      md5sig s;
      flags_t flags;
+     volatile unsigned state; /* H_VALID | H_LIVE, stored after the rest */
+};
+
+struct slots_s {
+     unsigned hashsiz;
+     slots *retired; /* tables this one replaced, see rehash() */
+     solution solutions[1]; /* not really 1 */
 };
 
-static solution *htab_lookup(hashtab *ht, const md5sig s, 
+/* first hash function */
+static unsigned h1(const slots *t, const md5sig s)
+{
+     unsigned h = s[0] % t->hashsiz;
+     A(h == (s[0] % t->hashsiz));
+     return h;
+}
+
+/* second hash function (for double hashing) */
+static unsigned h2(const slots *t, const md5sig s)
+{
+     unsigned h = 1U + s[1] % (t->hashsiz - 1);
+     A(h == (1U + s[1] % (t->hashsiz - 1)));
+     return h;
+}
+
+static solution *htab_lookup(planner *ego, hashtab *ht, const md5sig s, 
 			     const flags_t *flagsp)
 {
-     unsigned g, h = h1(ht, s), d = h2(ht, s);
+     slots *t = ATOMIC_LOAD(&ht->tab);
+     unsigned g, h = h1(t, s), d = h2(t, s);
      solution *best = 0;
 
-     ++ht->lookup;
+     ++ego->lookup;
 
      /* search all entries that match; select the one with
 	the lowest flags.u */
@@ -216,10 +240,11 @@ static solution *htab_lookup(hashtab *ht, const md5sig s,
 	element or after traversing the whole table. */
      g = h;
      do {
-	  solution *l = ht->solutions + g;
-	  ++ht->lookup_iter;
-	  if (VALIDP(l)) {
-	       if (LIVEP(l)
+	  solution *l = t->solutions + g;
+	  unsigned state = ATOMIC_LOAD(&l->state);
+	  ++ego->lookup_iter;
+	  if (state & H_VALID) {
+	       if ((state & H_LIVE)
 		   && md5eq(s, l->s)
 		   && subsumes(&l->flags, SLVNDX(l), flagsp) ) { 
 		    if (!best || LEQ(l->flags.u, best->flags.u))
@@ -228,19 +253,78 @@ static solution *htab_lookup(hashtab *ht, const md5sig s,
 	  } else 
 	       break;
 
-	  g = addmod(g, d, ht->hashsiz);
+	  g = addmod(g, d, t->hashsiz);
      } while (g != h);
 
      if (best) 
-	  ++ht->succ_lookup;
+	  ++ego->succ_lookup;
      return best;
 }
 
+/* whether slot L of binary wisdom is a solution that we can use */
+static int mapped_ok(const planner *ego, const plan_solution *l)
+{
+     if (l->slvndx == INFEASIBLE_SLVNDX)
+	  return 1;
+     return l->slvndx < ego->nslvdesc && l->timelimit_impatience == 0;
+}
+
+/* like htab_lookup, in the binary wisdom of the planner.  Since that is
+   read-only, the solution found is copied into TMP. */
+static solution *mapped_lookup(planner *ego, const md5sig s,
+			       const flags_t *flagsp, solution *tmp)
+{
+     const binary_wisdom *w = ATOMIC_LOAD(&ego->htab_blessed->mapped);
+     const plan_solution *tab, *best = 0;
+     unsigned g, h, d;
+     flags_t flags;
+
+     if (!w)
+	  return 0;
+
+     tab = (const plan_solution *) (w + 1);
+     h = s[0] % w->hashsiz;
+     d = 1U + s[1] % (w->hashsiz - 1);
+
+     ++ego->lookup;
+     g = h;
+     do {
+	  const plan_solution *l = tab + g;
+	  ++ego->lookup_iter;
+	  if (l->slvndx == BINARY_WISDOM_EMPTY)
+	       break;
+	  if (md5eq(s, l->s) && mapped_ok(ego, l)) {
+	       flags.l = l->l;
+	       flags.u = l->u;
+	       flags.timelimit_impatience = l->timelimit_impatience;
+	       if (subsumes(&flags, l->slvndx, flagsp)
+		   && (!best || LEQ(l->u, best->u)))
+		    best = l;
+	  }
+	  g = addmod(g, d, w->hashsiz);
+     } while (g != h);
+
+     if (!best)
+	  return 0;
+
+     ++ego->succ_lookup;
+     sigcpy(best->s, tmp->s);
+     tmp->flags.l = best->l;
+     tmp->flags.u = best->u;
+     tmp->flags.timelimit_impatience = best->timelimit_impatience;
+     tmp->flags.hash_info = BLESSING;
+     SLVNDX(tmp) = best->slvndx;
+     tmp->state = H_VALID | H_LIVE;
+     return tmp;
+}
+
+/* TMP receives solutions from binary wisdom */
 static solution *hlookup(planner *ego, const md5sig s, 
-			 const flags_t *flagsp)
+			 const flags_t *flagsp, solution *tmp)
 {
-     solution *sol = htab_lookup(&ego->htab_blessed, s, flagsp);
-     if (!sol) sol = htab_lookup(&ego->htab_unblessed, s, flagsp);
+     solution *sol = htab_lookup(ego, ego->htab_blessed, s, flagsp);
+     if (!sol) sol = htab_lookup(ego, &ego->htab_unblessed, s, flagsp);
+     if (!sol) sol = mapped_lookup(ego, s, flagsp, tmp);
      return sol;
 }
 
@@ -249,17 +333,21 @@ static void fill_slot(hashtab *ht, const md5sig s, const flags_t *flagsp,
 {
      ++ht->insert;
      ++ht->nelem;
-     A(!LIVEP(slot));
+     ++ht->nused;
+     A(!VALIDP(slot));
      slot->flags.u = flagsp->u;
      slot->flags.l = flagsp->l;
      slot->flags.timelimit_impatience = flagsp->timelimit_impatience;
-     slot->flags.hash_info |= H_VALID | H_LIVE;
+     slot->flags.hash_info = 0;
      SLVNDX(slot) = slvndx;
 
      /* keep this check enabled in case we add so many solvers
 	that the bitfield overflows */
      CK(SLVNDX(slot) == slvndx);     
      sigcpy(s, slot->s);
+
+     /* publish the slot, which is never written again */
+     ATOMIC_STORE(&slot->state, H_VALID | H_LIVE);
 }
 
 static void kill_slot(hashtab *ht, solution *slot)
@@ -267,54 +355,88 @@ static void kill_slot(hashtab *ht, solution *slot)
      A(LIVEP(slot)); /* ==> */ A(VALIDP(slot));
 
      --ht->nelem;
-     slot->flags.hash_info = H_VALID;
+     ATOMIC_STORE(&slot->state, H_VALID);
 }
 
-static void hinsert0(hashtab *ht, const md5sig s, const flags_t *flagsp, 
-		     unsigned slvndx)
+static void hinsert0(hashtab *ht, slots *t, const md5sig s,
+		     const flags_t *flagsp, unsigned slvndx)
 {
      solution *l;
-     unsigned g, h = h1(ht, s), d = h2(ht, s); 
+     unsigned g, h = h1(t, s), d = h2(t, s); 
 
      ++ht->insert_unknown;
 
-     /* search for nonfull slot */
-     for (g = h; ; g = addmod(g, d, ht->hashsiz)) {
+     /* search for an unused slot */
+     for (g = h; ; g = addmod(g, d, t->hashsiz)) {
 	  ++ht->insert_iter;
-	  l = ht->solutions + g;
-	  if (!LIVEP(l)) break;
-	  A((g + d) % ht->hashsiz != h);
+	  l = t->solutions + g;
+	  if (!VALIDP(l)) break;
+	  A((g + d) % t->hashsiz != h);
      }
 
      fill_slot(ht, s, flagsp, slvndx, l);
 }
 
+static slots *mkslots(unsigned hashsiz)
+{
+     slots *t = (slots *)MALLOC(sizeof(slots) 
+				+ (hashsiz - 1) * sizeof(solution), HASHT);
+     unsigned h;
+
+     t->hashsiz = hashsiz;
+     t->retired = 0;
+     for (h = 0; h < hashsiz; ++h) 
+	  t->solutions[h].state = 0;
+     return t;
+}
+
+static void slots_destroy(slots *t)
+{
+     while (t) {
+	  slots *retired = t->retired;
+	  X(ifree)(t);
+	  t = retired;
+     }
+}
+
+/* install T as the table of HT.  Planners sharing HT may still be
+   probing the old table, which is therefore kept until HT is no longer
+   shared.  Shared tables at least double in size when they grow, so
+   that the tables they retire add up to less than the current one. */
+static void install(hashtab *ht, slots *t)
+{
+     slots *o = ht->tab;
+
+     if (o && ht->refcnt > 1) {
+	  t->retired = o;
+	  o = 0;
+     }
+     ATOMIC_STORE(&ht->tab, t);
+     slots_destroy(o);
+}
+
 static void rehash(hashtab *ht, unsigned nsiz)
 {
-     unsigned osiz = ht->hashsiz, h;
-     solution *osol = ht->solutions, *nsol;
+     slots *o = ht->tab, *t;
+     unsigned h;
 
+     if (o && ht->refcnt > 1 && nsiz < 2 * o->hashsiz)
+	  nsiz = 2 * o->hashsiz;
      nsiz = (unsigned)X(next_prime)((INT)nsiz);
-     nsol = (solution *)MALLOC(nsiz * sizeof(solution), HASHT);
+     t = mkslots(nsiz);
      ++ht->nrehash;
 
-     /* init new table */
-     for (h = 0; h < nsiz; ++h) 
-	  nsol[h].flags.hash_info = 0;
-
-     /* install new table */
-     ht->hashsiz = nsiz;
-     ht->solutions = nsol;
-     ht->nelem = 0;
-
-     /* copy table */
-     for (h = 0; h < osiz; ++h) {
-	  solution *l = osol + h;
-	  if (LIVEP(l))
-	       hinsert0(ht, l->s, &l->flags, SLVNDX(l));
+     /* copy the live entries, leaving out the dead ones */
+     ht->nelem = ht->nused = 0;
+     if (o) {
+	  for (h = 0; h < o->hashsiz; ++h) {
+	       solution *l = o->solutions + h;
+	       if (LIVEP(l))
+		    hinsert0(ht, t, l->s, &l->flags, SLVNDX(l));
+	  }
      }
 
-     X(ifree0)(osol);
+     install(ht, t);
 }
 
 static unsigned minsz(unsigned nelem)
@@ -329,9 +451,8 @@ static unsigned nextsz(unsigned nelem)
 
 static void hgrow(hashtab *ht)
 {
-     unsigned nelem = ht->nelem;
-     if (minsz(nelem) >= ht->hashsiz)
-	  rehash(ht, nextsz(nelem));
+     if (!ht->tab || minsz(ht->nused) >= ht->tab->hashsiz)
+	  rehash(ht, nextsz(ht->nelem));
 }
 
 #if 0
@@ -347,53 +468,88 @@ static void hshrink(hashtab *ht)
 static void htab_insert(hashtab *ht, const md5sig s, const flags_t *flagsp,
 			unsigned slvndx)
 {
-     unsigned g, h = h1(ht, s), d = h2(ht, s);
-     solution *first = 0;
+     slots *t = ht->tab;
+     unsigned g, h = h1(t, s), d = h2(t, s);
 
      /* Remove all entries that are subsumed by the new one.  */
      /* This loop may potentially traverse the whole table, since at
-	least one element is guaranteed to be !LIVEP, but all elements
+	least one element is guaranteed to be !VALIDP, but all elements
 	may be VALIDP.  Hence, we stop after at the first invalid
 	element or after traversing the whole table. */
      g = h;
      do {
-	  solution *l = ht->solutions + g;
+	  solution *l = t->solutions + g;
 	  ++ht->insert_iter;
 	  if (VALIDP(l)) {
 	       if (LIVEP(l) && md5eq(s, l->s)) {
 		    if (subsumes(flagsp, slvndx, &l->flags)) {
-			 if (!first) first = l;
 			 kill_slot(ht, l);
-		    } else {
+		    } else if (subsumes(&l->flags, SLVNDX(l), flagsp)) {
 			 /* It is an error to insert an element that
-			    is subsumed by an existing entry. */
-			 A(!subsumes(&l->flags, SLVNDX(l), flagsp));
+			    is subsumed by an existing entry, unless
+			    another planner sharing the table got
+			    there first. */
+			 A(ht->refcnt > 1);
+			 return;
 		    }
 	       }
 	  } else 
 	       break;
 
-	  g = addmod(g, d, ht->hashsiz);
+	  g = addmod(g, d, t->hashsiz);
      } while (g != h);
 
-     if (first) {
-	  /* overwrite FIRST */
-	  fill_slot(ht, s, flagsp, slvndx, first);
-     } else {
-	  /* create a new entry */
- 	  hgrow(ht);
-	  hinsert0(ht, s, flagsp, slvndx);
-     }
+     /* create a new entry; slots readers may be looking at are
+	never overwritten */
+     hgrow(ht);
+     hinsert0(ht, ht->tab, s, flagsp, slvndx);
 }
 
 static void hinsert(planner *ego, const md5sig s, const flags_t *flagsp, 
 		    unsigned slvndx)
 {
-     htab_insert(BLISS(*flagsp) ? &ego->htab_blessed : &ego->htab_unblessed,
-		 s, flagsp, slvndx );
+     if (BLISS(*flagsp)) {
+	  X(lock)();
+	  htab_insert(ego->htab_blessed, s, flagsp, slvndx);
+	  X(unlock)();
+     } else {
+	  htab_insert(&ego->htab_unblessed, s, flagsp, slvndx);
+     }
 }
 
 
+/* add a solution to ego->record, unless it is there already */
+static void record(planner *ego, const md5sig s, const flags_t *flagsp,
+		   unsigned slvndx)
+{
+     plan_record *r = ego->record;
+     plan_solution *sol;
+     unsigned i;
+
+     for (i = 0; i < r->nsols; ++i) {
+	  sol = r->sols + i;
+	  if (md5eq(s, sol->s) && sol->l == flagsp->l && sol->u == flagsp->u)
+	       return;
+     }
+
+     if (r->nsols >= r->solsiz) {
+	  plan_solution *osols = r->sols;
+	  r->solsiz = 1 + r->solsiz + r->solsiz / 4;
+	  r->sols = (plan_solution *)MALLOC(r->solsiz * sizeof(plan_solution),
+					    HASHT);
+	  for (i = 0; i < r->nsols; ++i)
+	       r->sols[i] = osols[i];
+	  X(ifree0)(osols);
+     }
+
+     sol = r->sols + r->nsols++;
+     sigcpy(s, sol->s);
+     sol->l = flagsp->l;
+     sol->u = flagsp->u;
+     sol->timelimit_impatience = flagsp->timelimit_impatience;
+     sol->slvndx = slvndx;
+}
+
 static void invoke_hook(planner *ego, plan *pln, const problem *p, 
 			int optimalp)
 {
@@ -626,8 +782,9 @@ static plan *mkplan(planner *ego, const problem *p)
      md5 m;
      unsigned slvndx;
      flags_t flags_of_solution;
-     solution *sol;
+     solution *sol, msol;
      solver *s;
+     int mapped = 0; /* whether the solution is binary wisdom */
 
      ASSERT_ALIGNED_DOUBLE;
      A(LEQ(PLNR_L(ego), PLNR_U(ego)));
@@ -637,7 +794,9 @@ static plan *mkplan(planner *ego, const problem *p)
 
 
 #ifdef FFTW_DEBUG
-     check(&ego->htab_blessed);
+     X(lock)();
+     check(ego->htab_blessed);
+     X(unlock)();
      check(&ego->htab_unblessed);
 #endif
 
@@ -653,7 +812,7 @@ static plan *mkplan(planner *ego, const problem *p)
      flags_of_solution = ego->flags;
 
      if (ego->wisdom_state != WISDOM_IGNORE_ALL) {
-	  if ((sol = hlookup(ego, m.s, &flags_of_solution))) { 
+	  if ((sol = hlookup(ego, m.s, &flags_of_solution, &msol))) { 
 	       /* wisdom is acceptable */
 	       wisdom_state_t owisdom_state = ego->wisdom_state;
 	       
@@ -663,12 +822,14 @@ static plan *mkplan(planner *ego, const problem *p)
 		    goto do_search; /* ignore not-ok wisdom */
 	       
 	       slvndx = SLVNDX(sol);
+	       mapped = (sol == &msol);
 	       
 	       if (slvndx == INFEASIBLE_SLVNDX) {
 		    if (ego->wisdom_state == WISDOM_IGNORE_INFEASIBLE)
 			 goto do_search;
-		    else
-			 return 0;   /* known to be infeasible */
+		    if (ego->record)
+			 record(ego, m.s, &sol->flags, slvndx);
+		    return 0;   /* known to be infeasible */
 	       }
 	       
 	       flags_of_solution = sol->flags;
@@ -703,6 +864,8 @@ static plan *mkplan(planner *ego, const problem *p)
      }
 
  do_search:
+     mapped = 0;
+
      /* cannot search in WISDOM_ONLY mode */
      if (ego->wisdom_state == WISDOM_ONLY)
 	  goto wisdom_is_bogus;
@@ -730,12 +893,14 @@ static plan *mkplan(planner *ego, const problem *p)
  skip_search:
      if (ego->wisdom_state == WISDOM_NORMAL ||
 	 ego->wisdom_state == WISDOM_ONLY) {
-	  if (pln) {
+	  if (!pln)
+	       slvndx = INFEASIBLE_SLVNDX;
+	  if (!mapped) /* binary wisdom is used in place, not copied */
 	       hinsert(ego, m.s, &flags_of_solution, slvndx);
+	  if (ego->record)
+	       record(ego, m.s, &flags_of_solution, slvndx);
+	  if (pln)
 	       invoke_hook(ego, pln, p, 1);
-	  } else {
-	       hinsert(ego, m.s, &flags_of_solution, INFEASIBLE_SLVNDX);
-	  }
      }
 
      return pln;
@@ -748,31 +913,44 @@ static plan *mkplan(planner *ego, const problem *p)
 
 static void htab_destroy(hashtab *ht)
 {
-     X(ifree)(ht->solutions);
-     ht->solutions = 0;
-     ht->nelem = 0U;
+     slots_destroy(ht->tab);
+     ht->tab = 0;
+     ht->nelem = ht->nused = 0U;
 }
 
 static void mkhashtab(hashtab *ht)
 {
      ht->nrehash = 0;
-     ht->succ_lookup = ht->lookup = ht->lookup_iter = 0;
      ht->insert = ht->insert_iter = ht->insert_unknown = 0;
 
-     ht->solutions = 0;
-     ht->hashsiz = ht->nelem = 0U;
+     ht->tab = 0;
+     ht->mapped = 0;
+     ht->nelem = ht->nused = 0U;
+     ht->refcnt = 1;
      hgrow(ht);			/* so that hashsiz > 0 */
 }
 
+/* empty a table that other planners may be reading */
+static void htab_clear(hashtab *ht)
+{
+     ht->nelem = ht->nused = 0U;
+     install(ht, mkslots((unsigned)X(next_prime)((INT)nextsz(0))));
+}
+
 /* destroy hash table entries.  If FORGET_EVERYTHING, destroy the whole
    table.  If FORGET_ACCURSED, then destroy entries that are not blessed. */
 static void forget(planner *ego, amnesia a)
 {
      switch (a) {
 	 case FORGET_EVERYTHING:
-	      htab_destroy(&ego->htab_blessed);
-	      mkhashtab(&ego->htab_blessed);
-	      /* fall through */
+	      /* other threads may be forgetting the same wisdom */
+	      X(lock)();
+	      htab_clear(ego->htab_blessed);
+	      ATOMIC_STORE(&ego->htab_blessed->mapped, 0);
+	      htab_destroy(&ego->htab_unblessed);
+	      mkhashtab(&ego->htab_unblessed);
+	      X(unlock)();
+	      break;
 	 case FORGET_ACCURSED:
 	      htab_destroy(&ego->htab_unblessed);
 	      mkhashtab(&ego->htab_unblessed);
@@ -786,11 +964,36 @@ static void forget(planner *ego, amnesia a)
 #define WISDOM_PREAMBLE PACKAGE "-" VERSION " " STRINGIZE(X(wisdom))
 static const char stimeout[] = "TIMEOUT";
 
+static void exprt1(planner *ego, printer *p, unsigned slvndx,
+		   unsigned l, unsigned u, unsigned timelimit_impatience,
+		   const md5uint *s)
+{
+     const char *reg_nam;
+     int reg_id;
+
+     if (slvndx == INFEASIBLE_SLVNDX) {
+	  reg_nam = stimeout;
+	  reg_id = 0;
+     } else {
+	  slvdesc *sp = ego->slvdescs + slvndx;
+	  reg_nam = sp->reg_nam;
+	  reg_id = sp->reg_id;
+     }
+
+     /* qui salvandos salvas gratis
+	salva me fons pietatis */
+     p->print(p, "  (%s %d #x%x #x%x #x%x #x%M #x%M #x%M #x%M)\n",
+	      reg_nam, reg_id, l, u, timelimit_impatience,
+	      s[0], s[1], s[2], s[3]);
+}
+
 /* tantus labor non sit cassus */
+/* callers hold X(lock), lest the table change between two exports */
 static void exprt(planner *ego, printer *p)
 {
      unsigned h;
-     hashtab *ht = &ego->htab_blessed;
+     slots *t = ego->htab_blessed->tab;
+     const binary_wisdom *w = ego->htab_blessed->mapped;
      md5 m;
 
      signature_of_configuration(&m, ego);
@@ -799,27 +1002,21 @@ static void exprt(planner *ego, printer *p)
 	      "(" WISDOM_PREAMBLE " #x%M #x%M #x%M #x%M\n",
 	      m.s[0], m.s[1], m.s[2], m.s[3]);
 
-     for (h = 0; h < ht->hashsiz; ++h) {
-	  solution *l = ht->solutions + h;
-	  if (LIVEP(l)) {
-	       const char *reg_nam;
-	       int reg_id;
-
-	       if (SLVNDX(l) == INFEASIBLE_SLVNDX) {
-		    reg_nam = stimeout;
-		    reg_id = 0;
-	       } else {
-		    slvdesc *sp = ego->slvdescs + SLVNDX(l);
-		    reg_nam = sp->reg_nam;
-		    reg_id = sp->reg_id;
-	       }
+     for (h = 0; h < t->hashsiz; ++h) {
+	  solution *l = t->solutions + h;
+	  if (LIVEP(l))
+	       exprt1(ego, p, SLVNDX(l), l->flags.l, l->flags.u,
+		      l->flags.timelimit_impatience, l->s);
+     }
 
-	       /* qui salvandos salvas gratis
-		  salva me fons pietatis */
-	       p->print(p, "  (%s %d #x%x #x%x #x%x #x%M #x%M #x%M #x%M)\n",
-			reg_nam, reg_id, 
-			l->flags.l, l->flags.u, l->flags.timelimit_impatience, 
-			l->s[0], l->s[1], l->s[2], l->s[3]);
+     /* binary wisdom, so that it can be converted to text */
+     if (w) {
+	  const plan_solution *tab = (const plan_solution *) (w + 1);
+	  for (h = 0; h < w->hashsiz; ++h) {
+	       const plan_solution *l = tab + h;
+	       if (l->slvndx != BINARY_WISDOM_EMPTY && mapped_ok(ego, l))
+		    exprt1(ego, p, l->slvndx, l->l, l->u,
+			   l->timelimit_impatience, l->s);
 	  }
      }
      p->print(p, ")\n");
@@ -835,8 +1032,8 @@ static int imprt(planner *ego, scanner *sc)
      flags_t flags;
      int reg_id;
      unsigned slvndx;
-     hashtab *ht = &ego->htab_blessed;
-     hashtab old;
+     solution *sols = 0, msol;
+     unsigned i, nsols = 0, solsiz = 0;
      md5 m;
 
      if (!sc->scan(sc, 
@@ -851,15 +1048,8 @@ static int imprt(planner *ego, scanner *sc)
 	  return 0;
      }
      
-     /* make a backup copy of the hash table (cache the hash) */
-     {
-	  unsigned h, hsiz = ht->hashsiz;
-	  old = *ht;
-	  old.solutions = (solution *)MALLOC(hsiz * sizeof(solution), HASHT);
-	  for (h = 0; h < hsiz; ++h)
-	       old.solutions[h] = ht->solutions[h];
-     }
-
+     /* read everything before touching the hash table, which other
+	planners may be reading */
      while (1) {
 	  if (sc->scan(sc, ")"))
 	       break;
@@ -891,17 +1081,35 @@ static int imprt(planner *ego, scanner *sc)
 	  CK(flags.u == u);
 	  CK(flags.timelimit_impatience == timelimit_impatience);
 
-	  if (!hlookup(ego, sig, &flags))
-	       hinsert(ego, sig, &flags, slvndx);
+	  if (nsols >= solsiz) {
+	       solution *osols = sols;
+	       solsiz = 1 + solsiz + solsiz / 4;
+	       sols = (solution *)MALLOC(solsiz * sizeof(solution), HASHT);
+	       for (i = 0; i < nsols; ++i)
+		    sols[i] = osols[i];
+	       X(ifree0)(osols);
+	  }
+	  sigcpy(sig, sols[nsols].s);
+	  sols[nsols].flags = flags;
+	  SLVNDX(sols + nsols) = slvndx;
+	  ++nsols;
+     }
+
+     X(lock)();
+     for (i = 0; i < nsols; ++i) {
+	  solution *l = sols + i;
+	  flags = l->flags;
+	  if (!hlookup(ego, l->s, &flags, &msol))
+	       htab_insert(ego->htab_blessed, l->s, &flags, SLVNDX(l));
      }
+     X(unlock)();
 
-     X(ifree0)(old.solutions);
+     X(ifree0)(sols);
      return 1;
 
  bad:
      /* ``The wisdom of FFTW must be above suspicion.'' */
-     X(ifree0)(ht->solutions);
-     *ht = old;
+     X(ifree0)(sols);
      return 0;
 }
 
@@ -920,6 +1128,7 @@ planner *X(mkplanner)(void)
 
      p->adt = &padt;
      p->nplan = p->nprob = 0;
+     p->lookup = p->succ_lookup = p->lookup_iter = 0;
      p->pcost = p->epcost = 0.0;
      p->hook = 0;
      p->cost_hook = 0;
@@ -937,10 +1146,12 @@ planner *X(mkplanner)(void)
      p->flags.timelimit_impatience = 0;
      p->flags.hash_info = 0;
      p->nthr = 1;
+     p->record = 0;
      p->need_timeout_check = 1;
      p->timelimit = -1;
 
-     mkhashtab(&p->htab_blessed);
+     p->htab_blessed = (hashtab *) MALLOC(sizeof(hashtab), HASHT);
+     mkhashtab(p->htab_blessed);
      mkhashtab(&p->htab_unblessed);
 
      for (i = 0; i < PROBLEM_LAST; ++i)
@@ -949,10 +1160,44 @@ planner *X(mkplanner)(void)
      return p;
 }
 
+/*
+ * create a planner with the solvers, settings and wisdom of EGO, to
+ * plan concurrently with it.  Siblings share their blessed hash
+ * table.  The caller must serialize the creation and destruction of
+ * siblings with X(lock), and must not register more solvers with EGO.
+ */
+planner *X(mkplanner_sibling)(const planner *ego)
+{
+     planner *p = (planner *) MALLOC(sizeof(planner), PLANNERS);
+     unsigned i;
+
+     *p = *ego;
+     p->nplan = p->nprob = 0;
+     p->lookup = p->succ_lookup = p->lookup_iter = 0;
+     p->pcost = p->epcost = 0.0;
+     p->wisdom_state = WISDOM_NORMAL;
+     p->record = 0;
+
+     p->slvdescs = (slvdesc *)MALLOC(ego->slvdescsiz * sizeof(slvdesc),
+				     SLVDESCS);
+     for (i = 0; i < ego->nslvdesc; ++i) {
+	  p->slvdescs[i] = ego->slvdescs[i];
+	  X(solver_use)(p->slvdescs[i].slv);
+     }
+
+     ++p->htab_blessed->refcnt;
+     mkhashtab(&p->htab_unblessed);
+
+     return p;
+}
+
 void X(planner_destroy)(planner *ego)
 {
-     /* destroy hash table */
-     htab_destroy(&ego->htab_blessed);
+     /* destroy hash tables */
+     if (--ego->htab_blessed->refcnt == 0) {
+	  htab_destroy(ego->htab_blessed);
+	  X(ifree)(ego->htab_blessed);
+     }
      htab_destroy(&ego->htab_unblessed);
 
      /* destroy solvdesc table */
@@ -988,34 +1233,205 @@ plan *X(mkplan_f_d)(planner *ego, problem *p,
      return pln;
 }
 
+/* the signature of the configuration of EGO, see imprt() */
+void X(planner_signature)(planner *ego, md5uint sig[4])
+{
+     md5 m;
+
+     signature_of_configuration(&m, ego);
+     sigcpy(m.s, sig);
+}
+
+/* add the solutions of a plan_record made by a planner with the same
+   signature.  Returns 0, leaving the wisdom alone, if they are bogus. */
+int X(planner_preload)(planner *ego, const plan_solution *sols,
+		       unsigned nsols)
+{
+     solution msol;
+     flags_t flags;
+     unsigned i;
+
+     for (i = 0; i < nsols; ++i) {
+	  const plan_solution *sol = sols + i;
+
+	  flags.l = sol->l;
+	  flags.u = sol->u;
+	  flags.timelimit_impatience = sol->timelimit_impatience;
+	  if (flags.l != sol->l || flags.u != sol->u ||
+	      flags.timelimit_impatience != sol->timelimit_impatience)
+	       return 0;
+	  if (sol->slvndx != INFEASIBLE_SLVNDX &&
+	      (sol->slvndx >= ego->nslvdesc || sol->timelimit_impatience != 0))
+	       return 0;
+     }
+
+     X(lock)();
+     for (i = 0; i < nsols; ++i) {
+	  const plan_solution *sol = sols + i;
+
+	  flags.l = sol->l;
+	  flags.u = sol->u;
+	  flags.timelimit_impatience = sol->timelimit_impatience;
+	  flags.hash_info = BLESSING;
+	  if (!hlookup(ego, sol->s, &flags, &msol))
+	       htab_insert(ego->htab_blessed, sol->s, &flags, sol->slvndx);
+     }
+     X(unlock)();
+
+     return 1;
+}
+
+/*
+ * binary wisdom
+ */
+#define BINARY_WISDOM_MAGIC "FFTWWISB"
+#define BINARY_WISDOM_VERSION 1
+#define BYTE_ORDER_MARK 0x01020304U
+
+static void mkbinary_header(planner *ego, binary_wisdom *w)
+{
+     md5 m;
+
+     memset(w, 0, sizeof(*w));
+     memcpy(w->magic, BINARY_WISDOM_MAGIC, sizeof(w->magic));
+     w->version = BINARY_WISDOM_VERSION;
+     w->byte_order = BYTE_ORDER_MARK;
+     w->sizeof_md5uint = sizeof(md5uint);
+     signature_of_configuration(&m, ego);
+     sigcpy(m.s, w->configuration);
+}
+
+/* add a solution to the binary hash table TAB, by double hashing */
+static void binary_insert(plan_solution *tab, unsigned hashsiz,
+			  const md5sig s, unsigned l, unsigned u,
+			  unsigned timelimit_impatience, unsigned slvndx,
+			  unsigned *nsols)
+{
+     unsigned g = s[0] % hashsiz, d = 1U + s[1] % (hashsiz - 1);
+     plan_solution *sol;
+
+     for (;; g = addmod(g, d, hashsiz)) {
+	  sol = tab + g;
+	  if (sol->slvndx == BINARY_WISDOM_EMPTY)
+	       break;
+	  if (md5eq(s, sol->s) && sol->l == l && sol->u == u)
+	       return; /* already there */
+     }
+
+     sigcpy(s, sol->s);
+     sol->l = l;
+     sol->u = u;
+     sol->timelimit_impatience = timelimit_impatience;
+     sol->slvndx = slvndx;
+     ++*nsols;
+}
+
+/* the blessed wisdom of EGO, including its binary wisdom, as binary
+   wisdom of *BYTES bytes.  Callers hold X(lock). */
+binary_wisdom *X(planner_binary_wisdom)(planner *ego, size_t *bytes)
+{
+     slots *t = ego->htab_blessed->tab;
+     const binary_wisdom *ow = ego->htab_blessed->mapped;
+     const plan_solution *otab = 0;
+     binary_wisdom *w;
+     plan_solution *tab;
+     unsigned h, n = ego->htab_blessed->nelem, hashsiz, nsols = 0;
+
+     if (ow) {
+	  otab = (const plan_solution *) (ow + 1);
+	  for (h = 0; h < ow->hashsiz; ++h)
+	       n += (otab[h].slvndx != BINARY_WISDOM_EMPTY);
+     }
+
+     /* at most half full, so that lookups stop early */
+     hashsiz = (unsigned)X(next_prime)((INT)(2 * n + 3));
+     *bytes = sizeof(binary_wisdom) + hashsiz * sizeof(plan_solution);
+     w = (binary_wisdom *)MALLOC(*bytes, HASHT);
+     tab = (plan_solution *) (w + 1);
+     memset(tab, 0, hashsiz * sizeof(plan_solution));
+     for (h = 0; h < hashsiz; ++h)
+	  tab[h].slvndx = BINARY_WISDOM_EMPTY;
+
+     for (h = 0; h < t->hashsiz; ++h) {
+	  solution *l = t->solutions + h;
+	  if (LIVEP(l))
+	       binary_insert(tab, hashsiz, l->s, l->flags.l, l->flags.u,
+			     l->flags.timelimit_impatience, SLVNDX(l), &nsols);
+     }
+     for (h = 0; ow && h < ow->hashsiz; ++h) {
+	  const plan_solution *l = otab + h;
+	  if (l->slvndx != BINARY_WISDOM_EMPTY && mapped_ok(ego, l))
+	       binary_insert(tab, hashsiz, l->s, l->l, l->u,
+			     l->timelimit_impatience, l->slvndx, &nsols);
+     }
+
+     mkbinary_header(ego, w);
+     w->hashsiz = hashsiz;
+     w->nsols = nsols;
+     return w;
+}
+
+/* use the binary wisdom W of BYTES bytes, which must stay valid until
+   the planner is destroyed, in place of any earlier binary wisdom.
+   Returns 0 if W does not fit the planner. */
+int X(planner_map_wisdom)(planner *ego, const binary_wisdom *w, size_t bytes)
+{
+     binary_wisdom want;
+
+     if (bytes < sizeof(binary_wisdom))
+	  return 0;
+
+     mkbinary_header(ego, &want);
+     if (memcmp(w->magic, want.magic, sizeof(want.magic))
+	 || w->version != want.version
+	 || w->byte_order != want.byte_order
+	 || w->sizeof_md5uint != want.sizeof_md5uint
+	 || !md5eq(w->configuration, want.configuration)
+	 || w->hashsiz < 2 || w->nsols >= w->hashsiz
+	 || w->hashsiz != (bytes - sizeof(binary_wisdom))
+	                  / sizeof(plan_solution)
+	 || bytes != sizeof(binary_wisdom)
+	             + w->hashsiz * sizeof(plan_solution))
+	  return 0;
+
+     X(lock)();
+     ATOMIC_STORE(&ego->htab_blessed->mapped, w);
+     X(unlock)();
+     return 1;
+}
+
 /*
  * Debugging code:
  */
 #ifdef FFTW_DEBUG
 static void check(hashtab *ht)
 {
-     unsigned live = 0;
+     slots *t = ht->tab;
+     unsigned live = 0, used = 0;
      unsigned i;
 
-     A(ht->nelem < ht->hashsiz);
+     A(ht->nused < t->hashsiz);
 
-     for (i = 0; i < ht->hashsiz; ++i) {
-	  solution *l = ht->solutions + i; 
+     for (i = 0; i < t->hashsiz; ++i) {
+	  solution *l = t->solutions + i; 
 	  if (LIVEP(l)) 
 	       ++live; 
+	  if (VALIDP(l)) 
+	       ++used; 
      }
 
      A(ht->nelem == live);
+     A(ht->nused == used);
 
-     for (i = 0; i < ht->hashsiz; ++i) {
-	  solution *l1 = ht->solutions + i; 
+     for (i = 0; i < t->hashsiz; ++i) {
+	  solution *l1 = t->solutions + i; 
 	  int foundit = 0;
 	  if (LIVEP(l1)) {
-	       unsigned g, h = h1(ht, l1->s), d = h2(ht, l1->s);
+	       unsigned g, h = h1(t, l1->s), d = h2(t, l1->s);
 
 	       g = h;
 	       do {
-		    solution *l = ht->solutions + g;
+		    solution *l = t->solutions + g;
 		    if (VALIDP(l)) {
 			 if (l1 == l)
 			      foundit = 1;
@@ -1025,7 +1441,7 @@ static void check(hashtab *ht)
 			 }
 		    } else 
 			 break;
-		    g = addmod(g, d, ht->hashsiz);
+		    g = addmod(g, d, t->hashsiz);
 	       } while (g != h);
 
 	       A(foundit);
@@ -66,7 +66,8 @@ static const problem_adt padt =
      unsolvable_hash,
      unsolvable_zero,
      unsolvable_print,
-     unsolvable_destroy
+     unsolvable_destroy,
+     0, 0
 };
 
 /* there is no point in malloc'ing this one */
@@ -76,3 +77,81 @@ problem *X(mkproblem_unsolvable)(void)
 {
      return &the_unsolvable_problem;
 }
+
+/* the elements LO..HI of array P */
+void X(extent_add)(extent *e, R *p, INT lo, INT hi)
+{
+     uintptr_t a = (uintptr_t) (UNTAINT(p) + lo);
+     uintptr_t b = (uintptr_t) (UNTAINT(p) + hi + 1);
+
+     if (!e->bytes || a < e->lo) e->lo = a;
+     if (!e->bytes || b > e->hi) e->hi = b;
+     e->bytes += b - a;
+}
+
+/* Any displacement by a multiple of UNIT keeps the alignment of an
+   array, as far as X(ialignment_of) and SIMD codelets can tell, and
+   moves it by whole reals. */
+#define UNIT ((uintptr_t) SCRATCH_ALIGNMENT * sizeof(R))
+
+/* room for E at SCRATCH + *USED, and the displacement to get there;
+   takes up to 2 * UNIT bytes more than E spans */
+static INT place(const extent *e, char *scratch, size_t *used)
+{
+     uintptr_t at = ((uintptr_t) scratch + *used + UNIT - 1) & ~(UNIT - 1);
+     at += e->lo % UNIT;
+     *used = (size_t) (at - (uintptr_t) scratch) + (e->hi - e->lo);
+     return (INT) (((intptr_t) at - (intptr_t) e->lo) / (intptr_t) sizeof(R));
+}
+
+static int too_sparse(const extent *e)
+{
+     return e->hi - e->lo > 2 * e->bytes + UNIT;
+}
+
+/* For FFTW_ASYNC: a copy of EGO on arrays in new memory, returned in
+   *SCRATCH for the caller to X(ifree), so that planning the copy leaves
+   the arrays of EGO alone.  The input arrays keep their distances from
+   each other, and so do the output arrays, and both keep their
+   alignment; that is all the hash of a problem sees, so the copy has
+   the wisdom of EGO.  Returns 0 if EGO cannot be copied, or if its
+   arrays are so far apart that the copy would take much more memory
+   than they do. */
+problem *X(problem_scratch)(const problem *ego, R **scratch)
+{
+     extent in, out;
+     size_t n, used;
+     INT din, dout;
+
+     if (!ego->adt->displace)
+	  return 0;
+
+     in.bytes = out.bytes = 0;
+     ego->adt->extent(ego, &in, &out);
+     if (!in.bytes || !out.bytes)
+	  return 0;
+
+     if (in.lo < out.hi && out.lo < in.hi) {
+	  /* overlapping, in place in particular: move them together */
+	  if (out.lo < in.lo) in.lo = out.lo;
+	  if (out.hi > in.hi) in.hi = out.hi;
+	  in.bytes += out.bytes;
+	  if (too_sparse(&in))
+	       return 0;
+	  n = (in.hi - in.lo) + 2 * UNIT;
+	  *scratch = (R *) MALLOC(n, BUFFERS);
+	  used = 0;
+	  din = dout = place(&in, (char *) *scratch, &used);
+     } else {
+	  if (too_sparse(&in) || too_sparse(&out))
+	       return 0;
+	  n = (in.hi - in.lo) + (out.hi - out.lo) + 4 * UNIT;
+	  *scratch = (R *) MALLOC(n, BUFFERS);
+	  used = 0;
+	  din = place(&in, (char *) *scratch, &used);
+	  dout = place(&out, (char *) *scratch, &used);
+     }
+     A(used <= n);
+
+     return ego->adt->displace(ego, din, dout);
+}
@@ -25,7 +25,8 @@
 */
 
 
-/* shared twiddle and omega lists, keyed by two/three integers. */
+/* shared twiddle and omega lists, keyed by two/three integers.
+   Planners may share them concurrently, hence X(lock). */
 struct rader_tls {
      INT k1, k2, k3;
      R *W;
@@ -37,18 +38,26 @@ void X(rader_tl_insert)(INT k1, INT k2, INT k3, R *W, rader_tl **tl)
 {
      rader_tl *t = (rader_tl *) MALLOC(sizeof(rader_tl), TWIDDLES);
      t->k1 = k1; t->k2 = k2; t->k3 = k3; t->W = W;
-     t->refcnt = 1; t->cdr = *tl; *tl = t;
+     t->refcnt = 1;
+     X(lock)();
+     t->cdr = *tl; *tl = t;
+     X(unlock)();
 }
 
-R *X(rader_tl_find)(INT k1, INT k2, INT k3, rader_tl *t)
+R *X(rader_tl_find)(INT k1, INT k2, INT k3, rader_tl **tl)
 {
-     while (t && (t->k1 != k1 || t->k2 != k2 || t->k3 != k3))
+     rader_tl *t;
+     R *W = 0;
+
+     X(lock)();
+     for (t = *tl; t && (t->k1 != k1 || t->k2 != k2 || t->k3 != k3); )
 	  t = t->cdr;
      if (t) {
 	  ++t->refcnt;
-	  return t->W;
-     } else 
-	  return 0;
+	  W = t->W;
+     }
+     X(unlock)();
+     return W;
 }
 
 void X(rader_tl_delete)(R *W, rader_tl **tl)
@@ -56,11 +65,17 @@ void X(rader_tl_delete)(R *W, rader_tl **tl)
      if (W) {
 	  rader_tl **tp, *t;
 
+	  X(lock)();
 	  for (tp = tl; (t = *tp) && t->W != W; tp = &t->cdr)
 	       ;
 
-	  if (t && --t->refcnt <= 0) {
+	  if (t && --t->refcnt <= 0)
 	       *tp = t->cdr;
+	  else
+	       t = 0;
+	  X(unlock)();
+
+	  if (t) {
 	       X(ifree)(t->W);
 	       X(ifree)(t);
 	  }
@@ -0,0 +1,144 @@
+/*
+ * Copyright (c) 2003, 2007-14 Matteo Frigo
+ * Copyright (c) 2003, 2007-14 Massachusetts Institute of Technology
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+
+/* scratch memory for apply(), see ifftw.h */
+
+#include "kernel/ifftw.h"
+
+void (*X(scratch_hook))(void) = 0;
+
+size_t X(scratch_round)(size_t n)
+{
+     return (n + (SCRATCH_ALIGNMENT - 1)) & ~(size_t)(SCRATCH_ALIGNMENT - 1);
+}
+
+#ifdef THREAD_LOCAL
+
+static THREAD_LOCAL scratch arena;
+
+void *X(scratch_get)(size_t n)
+{
+     size_t m = X(scratch_round)(n);
+
+     if (m <= arena.size - arena.top) {
+	  void *p = arena.base + arena.top;
+	  arena.top += m;
+	  return p;
+     }
+     return MALLOC(n, BUFFERS);
+}
+
+void X(scratch_put)(void *p)
+{
+     uintptr_t q = (uintptr_t)p, b = (uintptr_t)arena.base;
+
+     if (q >= b && q < b + arena.size) {
+	  /* blocks are released in reverse order */
+	  A(q < b + arena.top);
+	  arena.top = (size_t)(q - b);
+     } else
+	  X(ifree)(p);
+}
+
+void X(scratch_reserve)(size_t n)
+{
+     /* only between executions: the arena cannot move while in use */
+     if (n > arena.size && arena.top == 0 && !arena.borrowed) {
+	  if (!arena.base && X(scratch_hook))
+	       X(scratch_hook)();
+	  X(ifree0)(arena.base);
+	  arena.base = (char *)MALLOC(n, BUFFERS);
+	  arena.size = n;
+     }
+}
+
+/* whether N bytes can be had without malloc */
+int X(scratch_reserved)(size_t n)
+{
+     return X(scratch_round)(n) <= arena.size - arena.top;
+}
+
+/* execute out of the caller's memory WORK of N bytes */
+void X(scratch_borrow)(void *work, size_t n, scratch *saved)
+{
+     uintptr_t w = (uintptr_t)work;
+     size_t skip = (size_t)(-w & (SCRATCH_ALIGNMENT - 1));
+
+     *saved = arena;
+     arena.base = (char *)work + skip;
+     arena.size = n > skip ? n - skip : 0;
+     arena.top = 0;
+     arena.borrowed = 1;
+}
+
+void X(scratch_return)(const scratch *saved)
+{
+     A(arena.top == 0);
+     arena = *saved;
+}
+
+/* free the arena of the calling thread */
+void X(scratch_release)(void)
+{
+     if (!arena.borrowed && arena.top == 0) {
+	  X(ifree0)(arena.base);
+	  arena.base = 0;
+	  arena.size = 0;
+     }
+}
+
+#else /* !THREAD_LOCAL */
+
+void *X(scratch_get)(size_t n)
+{
+     return MALLOC(n, BUFFERS);
+}
+
+void X(scratch_put)(void *p)
+{
+     X(ifree)(p);
+}
+
+void X(scratch_reserve)(size_t n)
+{
+     UNUSED(n);
+}
+
+int X(scratch_reserved)(size_t n)
+{
+     return n == 0;
+}
+
+void X(scratch_borrow)(void *work, size_t n, scratch *saved)
+{
+     UNUSED(work); UNUSED(n); UNUSED(saved);
+}
+
+void X(scratch_return)(const scratch *saved)
+{
+     UNUSED(saved);
+}
+
+void X(scratch_release)(void)
+{
+}
+
+#endif /* !THREAD_LOCAL */
@@ -35,6 +35,23 @@ INT X(tensor_max_index)(const tensor *sz)
      return X(imax)(ni, no);
 }
 
+/* the lowest and highest index of the input and of the output,
+   with the signs of the strides */
+void X(tensor_index_range)(const tensor *sz, INT *ilo, INT *ihi,
+			   INT *olo, INT *ohi)
+{
+     int i;
+
+     A(FINITE_RNK(sz->rnk));
+     *ilo = *ihi = *olo = *ohi = 0;
+     for (i = 0; i < sz->rnk; ++i) {
+          const iodim *p = sz->dims + i;
+	  INT di = (p->n - 1) * p->is, d_o = (p->n - 1) * p->os;
+	  if (di < 0) *ilo += di; else *ihi += di;
+	  if (d_o < 0) *olo += d_o; else *ohi += d_o;
+     }
+}
+
 #define tensor_min_xstride(sz, xs) {			\
      A(FINITE_RNK(sz->rnk));				\
      if (sz->rnk == 0) return 0;			\
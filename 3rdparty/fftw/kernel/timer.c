@@ -146,6 +146,7 @@ typedef crude_time ticks;
        int repeat;
 
        X(plan_awake)(pln, AWAKE_ZERO);
+       X(scratch_reserve)(pln->workspace);
        p->adt->zero(p);
 
   start_over:
@@ -24,18 +24,32 @@
 #include "kernel/ifftw.h"
 #include <math.h>
 
-#define HASHSZ 109
-
-/* hash table of known twiddle factors */
-static twid *twlist[HASHSZ];
-
-static INT hash(INT n, INT r)
+#define HASHSZ 109 /* initial number of buckets */
+
+/* Cache of twiddle tables, shared by all plans and planners under
+   X(lock).  A table that no plan uses any longer is not freed right
+   away, but kept on the IDLE list, most recently used first, for as
+   long as the cache holds at most LIMIT bytes. */
+static twid **twlist = 0;
+static INT twlistsiz = 0, ntwid = 0;
+static twid *idle_first = 0, *idle_last = 0;
+static size_t bytes = 0, limit = 0;
+static double hits = 0, misses = 0;
+
+/* where the calling thread records the tables it acquires */
+#ifdef THREAD_LOCAL
+static THREAD_LOCAL twid_record *recording = 0;
+#else
+static twid_record *recording = 0; /* one recording thread at a time */
+#endif
+
+static INT hash(INT n, INT r, INT siz)
 {
      INT h = n * 17 + r;
 
      if (h < 0) h = -h;
 
-     return (h % HASHSZ);
+     return (h % siz);
 }
 
 static int equal_instr(const tw_instr *p, const tw_instr *q)
@@ -80,13 +94,88 @@ static twid *lookup(enum wakefulness wakefulness,
 {
      twid *p;
 
-     for (p = twlist[hash(n,r)]; 
+     if (!twlist)
+	  return 0;
+
+     for (p = twlist[hash(n, r, twlistsiz)]; 
 	  p && !ok_twid(p, wakefulness, q, n, r, m); 
 	  p = p->cdr)
           ;
      return p;
 }
 
+static void rehash(INT nsiz)
+{
+     twid **otab = twlist, **ntab;
+     INT i, osiz = twlistsiz;
+
+     ntab = (twid **)MALLOC(nsiz * sizeof(twid *), TWIDDLES);
+     for (i = 0; i < nsiz; ++i)
+	  ntab[i] = 0;
+
+     for (i = 0; i < osiz; ++i) {
+	  twid *p, *cdr;
+	  for (p = otab[i]; p; p = cdr) {
+	       INT h = hash(p->n, p->r, nsiz);
+	       cdr = p->cdr;
+	       p->cdr = ntab[h];
+	       ntab[h] = p;
+	  }
+     }
+
+     twlist = ntab;
+     twlistsiz = nsiz;
+     X(ifree0)(otab);
+}
+
+static void insert(twid *p)
+{
+     INT h;
+
+     /* keep the chains short */
+     if (ntwid >= twlistsiz)
+	  rehash(X(next_prime)(X(imax)(HASHSZ, 2 * twlistsiz + 1)));
+
+     /* cons! onto twlist */
+     h = hash(p->n, p->r, twlistsiz);
+     p->cdr = twlist[h];
+     twlist[h] = p;
+     ++ntwid;
+     bytes += p->bytes;
+}
+
+static void remove_idle(twid *p)
+{
+     if (p->prev) p->prev->next = p->next; else idle_first = p->next;
+     if (p->next) p->next->prev = p->prev; else idle_last = p->prev;
+}
+
+static void discard(twid *p)
+{
+     twid **q;
+
+     for (q = &twlist[hash(p->n, p->r, twlistsiz)]; *q != p; 
+	  q = &((*q)->cdr))
+	  ;
+     *q = p->cdr;
+     --ntwid;
+     bytes -= p->bytes;
+     X(ifree)(p->W);
+     X(ifree0)(p->own_instr);
+     X(ifree)(p);
+}
+
+/* free least recently used idle tables until the cache fits */
+static void evict(void)
+{
+     while (bytes > limit && idle_last) {
+	  twid *p = idle_last;
+
+	  remove_idle(p);
+	  discard(p);
+     }
+}
+
 static INT twlen0(INT r, const tw_instr *p, INT *vl)
 {
      INT ntwiddle = 0;
@@ -122,7 +211,7 @@ INT X(twiddle_length)(INT r, const tw_instr *p)
 }
 
 static R *compute(enum wakefulness wakefulness,
-		  const tw_instr *instr, INT n, INT r, INT m)
+		  const tw_instr *instr, INT n, INT r, INT m, size_t *nbytes)
 {
      INT ntwiddle, j, vl;
      R *W, *W0;
@@ -134,7 +223,8 @@ static R *compute(enum wakefulness wakefulness,
 
      A(m % vl == 0);
 
-     W0 = W = (R *)MALLOC((ntwiddle * (m / vl)) * sizeof(R), TWIDDLES);
+     *nbytes = (ntwiddle * (m / vl)) * sizeof(R);
+     W0 = W = (R *)MALLOC(*nbytes, TWIDDLES);
 
      for (j = 0; j < m; j += vl) {
           for (p = instr; p->op != TW_NEXT; ++p) {
@@ -194,28 +284,195 @@ static R *compute(enum wakefulness wakefulness,
      return W0;
 }
 
+/* whether |W[i] - D[i]| is small for the N entries, allowing for tables
+   computed with another trigonometric generator */
+static int near(const R *W, const R *d, int n)
+{
+     const R tol = sizeof(R) == sizeof(float) ? 1e-5 : 1e-12;
+     int i;
+
+     for (i = 0; i < n; ++i)
+	  if (!(W[i] - d[i] <= tol && d[i] - W[i] <= tol))
+	       return 0;
+     return 1;
+}
+
+/* whether |A * B| < N, without overflowing */
+static int below(INT a, INT b, INT n)
+{
+     if (a < 0) a = -a;
+     if (b < 0) b = -b;
+     return a == 0 || b <= (n - 1) / a;
+}
+
+/* check one iteration J of the loop in compute(), whose twiddles start
+   at W: the first, middle and last ones of TW_FULL and TW_HALF, and all
+   the others */
+static int check_block(triggen *t, const tw_instr *p,
+		       INT n, INT r, INT j, const R *W)
+{
+     R d[2];
+
+     for ( ; p->op != TW_NEXT; ++p) {
+	  INT jv = j + (INT)p->v;
+
+	  switch (p->op) {
+	      case TW_FULL: {
+		   INT k, i[3];
+		   i[0] = 1; i[1] = (r + 1) / 2; i[2] = r - 1;
+		   if (!below(jv, r - 1, n))
+			return 0;
+		   for (k = 0; k < 3 && i[k] < r; ++k) {
+			t->cexp(t, jv * i[k], d);
+			if (!near(W + 2 * (i[k] - 1), d, 2))
+			     return 0;
+		   }
+		   W += (r - 1) * 2;
+		   break;
+	      }
+
+	      case TW_HALF: {
+		   INT k, i[2];
+		   if ((r % 2) != 1)
+			return 0;
+		   i[0] = 1; i[1] = (r - 1) / 2;
+		   for (k = 0; k < 2 && i[k] + i[k] < r; ++k) {
+			t->cexp(t, MULMOD(i[k], jv, n), d);
+			if (!near(W + 2 * (i[k] - 1), d, 2))
+			     return 0;
+		   }
+		   W += (r - 1);
+		   break;
+	      }
+
+	      case TW_COS:
+	      case TW_SIN:
+	      case TW_CEXP:
+		   if (!below(jv, (INT)p->i, n))
+			return 0;
+		   t->cexp(t, jv * (INT)p->i, d);
+		   if (p->op == TW_CEXP) {
+			if (!near(W, d, 2))
+			     return 0;
+			W += 2;
+		   } else {
+			if (!near(W, d + (p->op == TW_SIN), 1))
+			     return 0;
+			W += 1;
+		   }
+		   break;
+
+	      default:
+		   return 0;
+	  }
+     }
+     return 1;
+}
+
+/* whether W, a table read from elsewhere for X(twiddle_preload), agrees
+   with what compute() gives in the first, second, middle and last
+   iterations of its loop.  The caller has checked that INSTR is well
+   formed and that W has the length compute() would give it.  The
+   indices compute() asserts on are checked instead, and the reference
+   values come from AWAKE_SINCOS, which needs no memory whatever N is. */
+int X(twiddle_check)(const tw_instr *instr, INT n, INT r, INT m, const R *W)
+{
+     INT ntwiddle, vl, nv, s, b[4];
+     triggen *t;
+     int ok = 1;
+
+     ntwiddle = twlen0(r, instr, &vl);
+     nv = m / vl;
+     b[0] = 0; b[1] = 1; b[2] = nv / 2; b[3] = nv - 1;
+
+     t = X(mktriggen)(AWAKE_SINCOS, n);
+     for (s = 0; ok && s < 4; ++s)
+	  if (b[s] < nv)
+	       ok = check_block(t, instr, n, r, b[s] * vl,
+				W + b[s] * ntwiddle);
+     X(triggen_destroy)(t);
+     return ok;
+}
+
+static void use(twid *p)
+{
+     if (p->refcnt++ == 0) {
+	  if (p->preloaded)
+	       p->preloaded = 0; /* never was idle */
+	  else
+	       remove_idle(p);
+     }
+}
+
+static void record(twid *p)
+{
+     INT i;
+
+     for (i = 0; i < recording->ntwids; ++i)
+	  if (recording->twids[i] == p)
+	       return;
+
+     if (recording->ntwids >= recording->siz) {
+	  twid **otwids = recording->twids;
+	  recording->siz = 1 + recording->siz + recording->siz / 4;
+	  recording->twids = (twid **)MALLOC(recording->siz * sizeof(twid *),
+					     TWIDDLES);
+	  for (i = 0; i < recording->ntwids; ++i)
+	       recording->twids[i] = otwids[i];
+	  X(ifree0)(otwids);
+     }
+
+     use(p); /* the recording keeps the table */
+     recording->twids[recording->ntwids++] = p;
+}
+
 static void mktwiddle(enum wakefulness wakefulness,
 		      twid **pp, const tw_instr *instr, INT n, INT r, INT m)
 {
      twid *p;
-     INT h;
+     R *W;
+     size_t nbytes;
 
+     X(lock)();
      if ((p = lookup(wakefulness, instr, n, r, m))) {
-          ++p->refcnt;
-     } else {
-	  p = (twid *) MALLOC(sizeof(twid), TWIDDLES);
-	  p->n = n;
-	  p->r = r;
-	  p->m = m;
-	  p->instr = instr;
-	  p->refcnt = 1;
-	  p->wakefulness = wakefulness;
-	  p->W = compute(wakefulness, instr, n, r, m);
-
-	  /* cons! onto twlist */
-	  h = hash(n, r);
-	  p->cdr = twlist[h];
-	  twlist[h] = p;
+	  use(p);
+	  ++hits;
+     }
+     X(unlock)();
+
+     if (!p) {
+	  /* compute without holding the lock */
+	  W = compute(wakefulness, instr, n, r, m, &nbytes);
+
+	  X(lock)();
+	  ++misses;
+	  if ((p = lookup(wakefulness, instr, n, r, m))) {
+	       /* somebody else was faster */
+	       use(p);
+	  } else {
+	       p = (twid *) MALLOC(sizeof(twid), TWIDDLES);
+	       p->n = n;
+	       p->r = r;
+	       p->m = m;
+	       p->instr = instr;
+	       p->refcnt = 1;
+	       p->wakefulness = wakefulness;
+	       p->W = W;
+	       p->bytes = nbytes;
+	       p->own_instr = 0;
+	       p->preloaded = 0;
+	       W = 0;
+	       insert(p);
+	  }
+	  X(unlock)();
+
+	  X(ifree0)(W);
+     }
+
+     if (recording) {
+	  X(lock)();
+	  record(p);
+	  X(unlock)();
      }
 
      *pp = p;
@@ -224,21 +481,18 @@ static void mktwiddle(enum wakefulness wakefulness,
 static void twiddle_destroy(twid **pp)
 {
      twid *p = *pp;
-     twid **q;
 
+     X(lock)();
      if ((--p->refcnt) == 0) {
-	  /* remove p from twiddle list */
-	  for (q = &twlist[hash(p->n, p->r)]; *q; q = &((*q)->cdr)) {
-	       if (*q == p) {
-		    *q = p->cdr;
-		    X(ifree)(p->W);
-		    X(ifree)(p);
-		    *pp = 0;
-		    return;
-	       }
-	  }
-	  A(0 /* can't happen */ );
+	  /* move to the front of the idle list */
+	  p->prev = 0;
+	  p->next = idle_first;
+	  if (idle_first) idle_first->prev = p; else idle_last = p;
+	  idle_first = p;
+	  evict();
      }
+     X(unlock)();
+     *pp = 0;
 }
 
 
@@ -254,3 +508,95 @@ void X(twiddle_awake)(enum wakefulness wakefulness, twid **pp,
 	      break;
      }
 }
+
+/* keep idle twiddle tables while the cache holds at most LIM bytes */
+void X(twiddle_set_limit)(size_t lim)
+{
+     X(lock)();
+     limit = lim;
+     evict();
+     X(unlock)();
+}
+
+void X(twiddle_stats)(double *nhits, double *nmisses, double *nbytes)
+{
+     X(lock)();
+     *nhits = hits;
+     *nmisses = misses;
+     *nbytes = (double)bytes;
+     X(unlock)();
+}
+
+/* free all idle tables, and the cache itself once it is empty */
+void X(twiddle_flush)(void)
+{
+     size_t lim;
+     INT h;
+
+     X(lock)();
+     lim = limit;
+     limit = 0;
+     evict();
+     limit = lim;
+     for (h = 0; h < twlistsiz; ++h) {
+	  twid *p, *cdr;
+	  for (p = twlist[h]; p; p = cdr) {
+	       cdr = p->cdr;
+	       if (p->preloaded)
+		    discard(p);
+	  }
+     }
+     if (!ntwid) {
+	  X(ifree0)(twlist);
+	  twlist = 0;
+	  twlistsiz = 0;
+     }
+     X(unlock)();
+}
+
+/* record the tables that the calling thread acquires in REC, and keep
+   them until X(twiddle_record_destroy)(REC); stop if REC == 0 */
+void X(twiddle_record)(twid_record *rec)
+{
+     recording = rec;
+}
+
+void X(twiddle_record_destroy)(twid_record *rec)
+{
+     INT i;
+
+     for (i = 0; i < rec->ntwids; ++i)
+	  twiddle_destroy(rec->twids + i);
+     X(ifree0)(rec->twids);
+     rec->twids = 0;
+     rec->ntwids = rec->siz = 0;
+}
+
+/* add a table computed elsewhere, taking over INSTR and W.  It stays
+   until it has been used and became idle, or until X(twiddle_flush) */
+void X(twiddle_preload)(enum wakefulness wakefulness, tw_instr *instr,
+			INT n, INT r, INT m, R *W, size_t bytes)
+{
+     twid *p;
+
+     X(lock)();
+     if (lookup(wakefulness, instr, n, r, m)) {
+	  X(unlock)();
+	  X(ifree)(instr);
+	  X(ifree)(W);
+	  return;
+     }
+
+     p = (twid *) MALLOC(sizeof(twid), TWIDDLES);
+     p->n = n;
+     p->r = r;
+     p->m = m;
+     p->instr = p->own_instr = instr;
+     p->refcnt = 0;
+     p->preloaded = 1;
+     p->wakefulness = wakefulness;
+     p->W = W;
+     p->bytes = bytes;
+     insert(p);
+     X(unlock)();
+}
@@ -84,7 +84,8 @@ static const problem_adt padt =
      hash,
      zero,
      print,
-     destroy
+     destroy,
+     0, 0
 };
 
 problem *XM(mkproblem_rdft)(const dtensor *sz, INT vn,
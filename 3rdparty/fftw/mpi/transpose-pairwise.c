@@ -58,7 +58,7 @@ static void transpose_chunks(int *sched, int n_pes, int my_pe,
 	  /* TODO: explore non-synchronous send/recv? */
 
 	  if (I == O) {
-	       R *buf = (R*) MALLOC(sizeof(R) * sbs[0], BUFFERS);
+	       R *buf = (R*) X(scratch_get)(sizeof(R) * sbs[0]);
 	       
 	       for (i = 0; i < n_pes; ++i) {
 		    int pe = sched[i];
@@ -78,7 +78,7 @@ static void transpose_chunks(int *sched, int n_pes, int my_pe,
 		    }
 	       }
 
-	       X(ifree)(buf);
+	       X(scratch_put)(buf);
 	  }
 	  else { /* I != O */
 	       for (i = 0; i < n_pes; ++i) {
@@ -452,6 +452,7 @@ static plan *mkplan(const solver *ego_, const problem *p_, planner *plnr)
 	  fill1_comm_sched(pln->sched, my_pe, n_pes);
 	  if (sort_pe >= 0)
 	       sort1_comm_sched(pln->sched, n_pes, sort_pe, ascending);
+	  X(plan_scratch)(&pln->super.super, sizeof(R) * sbs[0]);
      }
 
      X(ops_zero)(&pln->super.super.ops);
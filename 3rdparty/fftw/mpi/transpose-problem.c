@@ -81,7 +81,8 @@ static const problem_adt padt =
      hash,
      zero,
      print,
-     destroy
+     destroy,
+     0, 0
 };
 
 problem *XM(mkproblem_transpose)(INT nx, INT ny, INT vn,
@@ -372,8 +372,11 @@ static plan *mkcldw(const hc2c_solver *ego_, rdft_kind kind,
      X(ops_madd2)(v, &cld0->ops, &pln->super.super.ops);
      X(ops_madd2)(v, &cldm->ops, &pln->super.super.ops);
 
-     if (ego->bufferedp) 
+     if (ego->bufferedp) {
 	  pln->super.super.ops.other += 4 * r * m * v;
+	  X(plan_scratch)(&pln->super.super, BUF_SCRATCH(
+			       r * compute_batchsize(r) * 2 * sizeof(R)));
+     }
 
      return &(pln->super.super);
 
@@ -66,7 +66,7 @@ static void apply(const plan *ego_, R *I, R *O)
      R *buf, *omega;
      R r0;
 
-     buf = (R *) MALLOC(sizeof(R) * npad, BUFFERS);
+     buf = (R *) X(scratch_get)(sizeof(R) * npad);
 
      /* First, permute the input, storing in buf: */
      g = ego->g; 
@@ -151,7 +151,7 @@ static void apply(const plan *ego_, R *I, R *O)
 #endif
      A(gpower == 1);
 
-     X(ifree)(buf);
+     X(scratch_put)(buf);
 }
 
 static R *mkomega(enum wakefulness wakefulness,
@@ -163,7 +163,7 @@ static R *mkomega(enum wakefulness wakefulness,
      trigreal scale;
      triggen *t;
 
-     if ((omega = X(rader_tl_find)(n, npad + 1, ginv, omegas))) 
+     if ((omega = X(rader_tl_find)(n, npad + 1, ginv, &omegas))) 
 	  return omega;
 
      omega = (R *)MALLOC(sizeof(R) * npad, TWIDDLES);
@@ -349,6 +349,7 @@ static plan *mkplan(const solver *ego_, const problem *p_, planner *plnr)
      pln->npad = npad;
      pln->is = is;
      pln->os = os;
+     X(plan_scratch)(&pln->super.super, sizeof(R) * npad);
 
      X(ops_add)(&cld1->ops, &cld2->ops, &pln->super.super.ops);
      pln->super.super.ops.other += (npad/2-1)*6 + npad + n + (n-1) * ego->pad;
@@ -311,8 +311,11 @@ static plan *mkplan(const solver *ego_, const problem *p_, planner *plnr)
 		  &ego->desc->ops,
 		  &pln->super.super.ops);
 
-     if (ego->bufferedp) 
+     if (ego->bufferedp) {
 	  pln->super.super.ops.other += 2 * n * pln->vl;
+	  X(plan_scratch)(&pln->super.super, BUF_SCRATCH(
+			       n * compute_batchsize(n) * sizeof(R)));
+     }
 
      pln->super.super.could_prune_now_p = !ego->bufferedp;
 
@@ -206,6 +206,7 @@ static plan *mkplan(const solver *ego_, const problem *p_, planner *plnr)
      pln->os = p->sz->dims[0].os;
      pln->td = 0;
      pln->kind = ego->kind;
+     X(plan_scratch)(&pln->super.super, BUF_SCRATCH(n * sizeof(E)));
 
      pln->super.super.ops.add = (n-1) * 2.5;
      pln->super.super.ops.mul = 0;
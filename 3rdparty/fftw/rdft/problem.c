@@ -113,13 +113,33 @@ static void zero(const problem *ego_)
      X(tensor_destroy)(sz);
 }
 
+static void extents(const problem *ego_, extent *in, extent *out)
+{
+     const problem_rdft *ego = (const problem_rdft *) ego_;
+     tensor *sz = X(tensor_append)(ego->vecsz, ego->sz);
+     INT ilo, ihi, olo, ohi;
+     X(tensor_index_range)(sz, &ilo, &ihi, &olo, &ohi);
+     X(extent_add)(in, ego->I, ilo, ihi);
+     X(extent_add)(out, ego->O, olo, ohi);
+     X(tensor_destroy)(sz);
+}
+
+static problem *displace(const problem *ego_, INT din, INT dout)
+{
+     const problem_rdft *ego = (const problem_rdft *) ego_;
+     return X(mkproblem_rdft)(ego->sz, ego->vecsz,
+			      ego->I + din, ego->O + dout, ego->kind);
+}
+
 static const problem_adt padt =
 {
      PROBLEM_RDFT,
      hash,
      zero,
      print,
-     destroy
+     destroy,
+     extents,
+     displace
 };
 
 /* Dimensions of size 1 that are not REDFT/RODFT are no-ops and can be
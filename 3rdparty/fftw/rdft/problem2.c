@@ -133,13 +133,50 @@ static void zero(const problem *ego_)
      }
 }
 
+/* the real arrays get the input strides for R2HC, the complex ones
+   for HC2R; using the real n on the complex side errs on the safe side */
+static void extents(const problem *ego_, extent *in, extent *out)
+{
+     const problem_rdft2 *ego = (const problem_rdft2 *) ego_;
+     tensor *sz = X(tensor_append)(ego->vecsz, ego->sz);
+     INT ilo, ihi, olo, ohi;
+     X(tensor_index_range)(sz, &ilo, &ihi, &olo, &ohi);
+     if (R2HC_KINDP(ego->kind)) {
+	  X(extent_add)(in, ego->r0, ilo, ihi);
+	  X(extent_add)(in, ego->r1, ilo, ihi);
+	  X(extent_add)(out, ego->cr, olo, ohi);
+	  X(extent_add)(out, ego->ci, olo, ohi);
+     } else {
+	  X(extent_add)(in, ego->cr, ilo, ihi);
+	  X(extent_add)(in, ego->ci, ilo, ihi);
+	  X(extent_add)(out, ego->r0, olo, ohi);
+	  X(extent_add)(out, ego->r1, olo, ohi);
+     }
+     X(tensor_destroy)(sz);
+}
+
+static problem *displace(const problem *ego_, INT din, INT dout)
+{
+     const problem_rdft2 *ego = (const problem_rdft2 *) ego_;
+     INT dr = din, dc = dout;
+     if (!R2HC_KINDP(ego->kind)) {
+	  dr = dout;
+	  dc = din;
+     }
+     return X(mkproblem_rdft2)(ego->sz, ego->vecsz,
+			       ego->r0 + dr, ego->r1 + dr,
+			       ego->cr + dc, ego->ci + dc, ego->kind);
+}
+
 static const problem_adt padt =
 {
      PROBLEM_RDFT2,
      hash,
      zero,
      print,
-     destroy
+     destroy,
+     extents,
+     displace
 };
 
 problem *X(mkproblem_rdft2)(const tensor *sz, const tensor *vecsz,
@@ -175,7 +175,7 @@ static void apply_gcd(const plan *ego_, R *I, R *O)
      const P *ego = (const P *) ego_;
      INT n = ego->nd, m = ego->md, d = ego->d;
      INT vl = ego->vl;
-     R *buf = (R *)MALLOC(sizeof(R) * ego->nbuf, BUFFERS);
+     R *buf = (R *)X(scratch_get)(sizeof(R) * ego->nbuf);
      INT i, num_el = n*m*d*vl;
 
      A(ego->n == n * d && ego->m == m * d);
@@ -221,7 +221,7 @@ static void apply_gcd(const plan *ego_, R *I, R *O)
 	  }
      }
 
-     X(ifree)(buf);
+     X(scratch_put)(buf);
 }
 
 static int applicable_gcd(const problem_rdft *p, planner *plnr,
@@ -326,7 +326,7 @@ static void apply_cut(const plan *ego_, R *I, R *O)
      const P *ego = (const P *) ego_;
      INT n = ego->n, m = ego->m, nc = ego->nc, mc = ego->mc, vl = ego->vl;
      INT i;
-     R *buf1 = (R *)MALLOC(sizeof(R) * ego->nbuf, BUFFERS);
+     R *buf1 = (R *)X(scratch_get)(sizeof(R) * ego->nbuf);
      UNUSED(O);
 
      if (m > mc) {
@@ -354,7 +354,7 @@ static void apply_cut(const plan *ego_, R *I, R *O)
 	       memcpy(I + mc*(n*vl), buf1, (m-mc)*(n*vl)*sizeof(R));
      }
 
-     X(ifree)(buf1);
+     X(scratch_put)(buf1);
 }
 
 /* only cut one dimension if the resulting buffer is small enough */
@@ -651,10 +651,10 @@ static void apply_toms513(const plan *ego_, R *I, R *O)
      const P *ego = (const P *) ego_;
      INT n = ego->n, m = ego->m;
      INT vl = ego->vl;
-     R *buf = (R *)MALLOC(sizeof(R) * ego->nbuf, BUFFERS);
+     R *buf = (R *)X(scratch_get)(sizeof(R) * ego->nbuf);
      UNUSED(O);
      transpose_toms513(I, n, m, vl, (char *) (buf + 2*vl), (n+m)/2, buf);
-     X(ifree)(buf);
+     X(scratch_put)(buf);
 }
 
 static int applicable_toms513(const problem_rdft *p, planner *plnr,
@@ -753,6 +753,7 @@ static plan *mkplan(const solver *ego_, const problem *p_, planner *plnr)
 	  X(plan_destroy_internal)(&(pln->super.super));
 	  return 0;
      }
+     X(plan_scratch)(&pln->super.super, sizeof(R) * pln->nbuf); /* final */
 
      return &(pln->super.super);
 }
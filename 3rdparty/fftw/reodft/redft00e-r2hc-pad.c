@@ -49,7 +49,7 @@ static void apply(const plan *ego_, R *I, R *O)
      INT ivs = ego->ivs, ovs = ego->ovs;
      R *buf;
 
-     buf = (R *) MALLOC(sizeof(R) * (2*n), BUFFERS);
+     buf = (R *) X(scratch_get)(sizeof(R) * (2*n));
 
      for (iv = 0; iv < vl; ++iv, I += ivs, O += ovs) {
 	  buf[0] = I[0];
@@ -73,7 +73,7 @@ static void apply(const plan *ego_, R *I, R *O)
 	  }
      }
 
-     X(ifree)(buf);
+     X(scratch_put)(buf);
 }
 
 static void awake(plan *ego_, enum wakefulness wakefulness)
@@ -159,6 +159,7 @@ static plan *mkplan(const solver *ego_, const problem *p_, planner *plnr)
      pln = MKPLAN_RDFT(P, &padt, apply);
 
      pln->n = n;
+     X(plan_scratch)(&pln->super.super, sizeof(R) * (2*n));
      pln->is = p->sz->dims[0].is;
      pln->cld = cld;
      pln->cldcpy = cldcpy;
@@ -66,7 +66,7 @@ static void apply(const plan *ego_, R *I, R *O)
      R *buf;
      E csum;
 
-     buf = (R *) MALLOC(sizeof(R) * n, BUFFERS);
+     buf = (R *) X(scratch_get)(sizeof(R) * n);
 
      for (iv = 0; iv < vl; ++iv, I += ivs, O += ovs) {
 	  buf[0] = I[0] + I[is * n];
@@ -103,7 +103,7 @@ static void apply(const plan *ego_, R *I, R *O)
 	  }
      }
 
-     X(ifree)(buf);
+     X(scratch_put)(buf);
 }
 
 static void awake(plan *ego_, enum wakefulness wakefulness)
@@ -182,6 +182,7 @@ static plan *mkplan(const solver *ego_, const problem *p_, planner *plnr)
      pln = MKPLAN_RDFT(P, &padt, apply);
 
      pln->n = n;
+     X(plan_scratch)(&pln->super.super, sizeof(R) * n);
      pln->is = p->sz->dims[0].is;
      pln->os = p->sz->dims[0].os;
      pln->cld = cld;
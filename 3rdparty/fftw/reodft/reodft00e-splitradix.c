@@ -58,7 +58,7 @@ static void apply_e(const plan *ego_, R *I, R *O)
      R *W = ego->td->W - 2;
      R *buf;
 
-     buf = (R *) MALLOC(sizeof(R) * n2, BUFFERS);
+     buf = (R *) X(scratch_get)(sizeof(R) * n2);
 
      for (iv = 0; iv < vl; ++iv, I += ivs, O += ovs) {
 	  /* do size (n-1)/2 r2hc transform of odd-indexed elements
@@ -121,7 +121,7 @@ static void apply_e(const plan *ego_, R *I, R *O)
 	  }
      }
 
-     X(ifree)(buf);
+     X(scratch_put)(buf);
 }
 
 /* rodft00 */
@@ -135,7 +135,7 @@ static void apply_o(const plan *ego_, R *I, R *O)
      R *W = ego->td->W - 2;
      R *buf;
 
-     buf = (R *) MALLOC(sizeof(R) * n2, BUFFERS);
+     buf = (R *) X(scratch_get)(sizeof(R) * n2);
 
      for (iv = 0; iv < vl; ++iv, I += ivs, O += ovs) {
 	  /* do size (n+1)/2 r2hc transform of even-indexed elements
@@ -203,7 +203,7 @@ static void apply_o(const plan *ego_, R *I, R *O)
 	  }
      }
 
-     X(ifree)(buf);
+     X(scratch_put)(buf);
 }
 
 static void awake(plan *ego_, enum wakefulness wakefulness)
@@ -314,6 +314,7 @@ static plan *mkplan(const solver *ego_, const problem *p_, planner *plnr)
      pln = MKPLAN_RDFT(P, &padt, p->kind[0] == REDFT00 ? apply_e : apply_o);
 
      pln->n = n;
+     X(plan_scratch)(&pln->super.super, sizeof(R) * (n/2));
      pln->is = p->sz->dims[0].is;
      pln->os = p->sz->dims[0].os;
      pln->clde = clde;
@@ -91,7 +91,7 @@ static void apply_re01(const plan *ego_, R *I, R *O)
      R *W = ego->td->W;
      R *buf;
 
-     buf = (R *) MALLOC(sizeof(R) * n, BUFFERS);
+     buf = (R *) X(scratch_get)(sizeof(R) * n);
 
      for (iv = 0; iv < vl; ++iv, I += ivs, O += ovs) {
 	  buf[0] = I[0];
@@ -130,7 +130,7 @@ static void apply_re01(const plan *ego_, R *I, R *O)
 	  }
      }
 
-     X(ifree)(buf);
+     X(scratch_put)(buf);
 }
 
 /* ro01 is same as re01, but with i <-> n - 1 - i in the input and
@@ -145,7 +145,7 @@ static void apply_ro01(const plan *ego_, R *I, R *O)
      R *W = ego->td->W;
      R *buf;
 
-     buf = (R *) MALLOC(sizeof(R) * n, BUFFERS);
+     buf = (R *) X(scratch_get)(sizeof(R) * n);
 
      for (iv = 0; iv < vl; ++iv, I += ivs, O += ovs) {
 	  buf[0] = I[is * (n - 1)];
@@ -184,7 +184,7 @@ static void apply_ro01(const plan *ego_, R *I, R *O)
 	  }
      }
 
-     X(ifree)(buf);
+     X(scratch_put)(buf);
 }
 
 static void apply_re10(const plan *ego_, R *I, R *O)
@@ -197,7 +197,7 @@ static void apply_re10(const plan *ego_, R *I, R *O)
      R *W = ego->td->W;
      R *buf;
 
-     buf = (R *) MALLOC(sizeof(R) * n, BUFFERS);
+     buf = (R *) X(scratch_get)(sizeof(R) * n);
 
      for (iv = 0; iv < vl; ++iv, I += ivs, O += ovs) {
 	  buf[0] = I[0];
@@ -233,7 +233,7 @@ static void apply_re10(const plan *ego_, R *I, R *O)
 	  }
      }
 
-     X(ifree)(buf);
+     X(scratch_put)(buf);
 }
 
 /* ro10 is same as re10, but with i <-> n - 1 - i in the output and
@@ -248,7 +248,7 @@ static void apply_ro10(const plan *ego_, R *I, R *O)
      R *W = ego->td->W;
      R *buf;
 
-     buf = (R *) MALLOC(sizeof(R) * n, BUFFERS);
+     buf = (R *) X(scratch_get)(sizeof(R) * n);
 
      for (iv = 0; iv < vl; ++iv, I += ivs, O += ovs) {
 	  buf[0] = I[0];
@@ -284,7 +284,7 @@ static void apply_ro10(const plan *ego_, R *I, R *O)
 	  }
      }
 
-     X(ifree)(buf);
+     X(scratch_put)(buf);
 }
 
 static void awake(plan *ego_, enum wakefulness wakefulness)
@@ -370,6 +370,7 @@ static plan *mkplan(const solver *ego_, const problem *p_, planner *plnr)
      }
 
      pln->n = n;
+     X(plan_scratch)(&pln->super.super, sizeof(R) * n);
      pln->is = p->sz->dims[0].is;
      pln->os = p->sz->dims[0].os;
      pln->cld = cld;
@@ -61,7 +61,7 @@ static void apply_re11(const plan *ego_, R *I, R *O)
      R *buf;
      E cur;
 
-     buf = (R *) MALLOC(sizeof(R) * n, BUFFERS);
+     buf = (R *) X(scratch_get)(sizeof(R) * n);
 
      for (iv = 0; iv < vl; ++iv, I += ivs, O += ovs) {
 	  /* I wish that this didn't require an extra pass. */
@@ -110,7 +110,7 @@ static void apply_re11(const plan *ego_, R *I, R *O)
 	  }
      }
 
-     X(ifree)(buf);
+     X(scratch_put)(buf);
 }
 
 /* like for rodft01, rodft11 is obtained from redft11 by
@@ -126,7 +126,7 @@ static void apply_ro11(const plan *ego_, R *I, R *O)
      R *buf;
      E cur;
 
-     buf = (R *) MALLOC(sizeof(R) * n, BUFFERS);
+     buf = (R *) X(scratch_get)(sizeof(R) * n);
 
      for (iv = 0; iv < vl; ++iv, I += ivs, O += ovs) {
 	  /* I wish that this didn't require an extra pass. */
@@ -175,7 +175,7 @@ static void apply_ro11(const plan *ego_, R *I, R *O)
 	  }
      }
 
-     X(ifree)(buf);
+     X(scratch_put)(buf);
 }
 
 static void awake(plan *ego_, enum wakefulness wakefulness)
@@ -260,6 +260,7 @@ static plan *mkplan(const solver *ego_, const problem *p_, planner *plnr)
 
      pln = MKPLAN_RDFT(P, &padt, p->kind[0]==REDFT11 ? apply_re11:apply_ro11);
      pln->n = n;
+     X(plan_scratch)(&pln->super.super, sizeof(R) * n);
      pln->is = p->sz->dims[0].is;
      pln->os = p->sz->dims[0].os;
      pln->cld = cld;
@@ -67,7 +67,7 @@ static void apply_re11(const plan *ego_, R *I, R *O)
      R *W2;
      R *buf;
 
-     buf = (R *) MALLOC(sizeof(R) * n, BUFFERS);
+     buf = (R *) X(scratch_get)(sizeof(R) * n);
 
      for (iv = 0; iv < vl; ++iv, I += ivs, O += ovs) {
 	  buf[0] = K(2.0) * I[0];
@@ -180,7 +180,7 @@ static void apply_re11(const plan *ego_, R *I, R *O)
 	  }
      }
 
-     X(ifree)(buf);
+     X(scratch_put)(buf);
 }
 
 #if 0
@@ -200,7 +200,7 @@ static void apply_re11(const plan *ego_, R *I, R *O)
      R *W;
      R *buf;
 
-     buf = (R *) MALLOC(sizeof(R) * n, BUFFERS);
+     buf = (R *) X(scratch_get)(sizeof(R) * n);
 
      for (iv = 0; iv < vl; ++iv, I += ivs, O += ovs) {
 	  buf[0] = K(2.0) * I[0];
@@ -257,7 +257,7 @@ static void apply_re11(const plan *ego_, R *I, R *O)
 	  }
      }
 
-     X(ifree)(buf);
+     X(scratch_put)(buf);
 }
 
 #endif /* 0 */
@@ -275,7 +275,7 @@ static void apply_ro11(const plan *ego_, R *I, R *O)
      R *W2;
      R *buf;
 
-     buf = (R *) MALLOC(sizeof(R) * n, BUFFERS);
+     buf = (R *) X(scratch_get)(sizeof(R) * n);
 
      for (iv = 0; iv < vl; ++iv, I += ivs, O += ovs) {
 	  buf[0] = K(2.0) * I[is * (n - 1)];
@@ -388,7 +388,7 @@ static void apply_ro11(const plan *ego_, R *I, R *O)
 	  }
      }
 
-     X(ifree)(buf);
+     X(scratch_put)(buf);
 }
 
 static void awake(plan *ego_, enum wakefulness wakefulness)
@@ -474,6 +474,7 @@ static plan *mkplan(const solver *ego_, const problem *p_, planner *plnr)
 
      pln = MKPLAN_RDFT(P, &padt, p->kind[0]==REDFT11 ? apply_re11:apply_ro11);
      pln->n = n;
+     X(plan_scratch)(&pln->super.super, sizeof(R) * n);
      pln->is = p->sz->dims[0].is;
      pln->os = p->sz->dims[0].os;
      pln->cld = cld;
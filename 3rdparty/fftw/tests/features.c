@@ -0,0 +1,709 @@
+/* Checks of the parts of the API that the bench program does not
+   exercise.  Each is a separate test,
+
+     features <test>
+
+   which prints nothing and exits with 0 if all is well; without a test
+   it lists them.  The program needs POSIX threads, and it is not a good
+   place to learn FFTW usage either: it uses the internal headers, like
+   hook.c, to know how FFTW was configured. */
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define CALLING_FFTW /* hack for Windows DLL nonsense */
+#include "api/api.h"
+
+#ifdef HAVE_UNISTD_H
+#  include <unistd.h>
+#  include <sys/types.h>
+#  include <sys/wait.h>
+#endif
+
+typedef X(complex) cplx;
+
+static const char *test;
+
+static void fail(const char *what)
+{
+     fprintf(stderr, "features %s: %s\n", test, what);
+     exit(EXIT_FAILURE);
+}
+
+#define CHECK(cond, what) ((cond) ? (void)0 : fail(what))
+
+static double tolerance(void)
+{
+     return sizeof(R) == sizeof(float) ? 1e-4 : 1e-10;
+}
+
+static cplx *mkarray(int n)
+{
+     cplx *a = (cplx *) X(malloc)(sizeof(cplx) * (size_t)n);
+     CHECK(a != 0, "out of memory");
+     return a;
+}
+
+static void fill(cplx *a, int n, int seed)
+{
+     int i;
+     for (i = 0; i < n; ++i) {
+	  a[i][0] = (R)(((i * 7 + seed * 13) % 17) - 8);
+	  a[i][1] = (R)(((i * 5 + seed * 3) % 11) - 5);
+     }
+}
+
+/* max |A - B| relative to max |B| */
+static double difference(const cplx *a, const cplx *b, int n)
+{
+     double d = 0, m = 0, e;
+     int i, k;
+     for (i = 0; i < n; ++i)
+	  for (k = 0; k < 2; ++k) {
+	       e = (double)a[i][k] - (double)b[i][k];
+	       if (e < 0) e = -e;
+	       if (e > d) d = e;
+	       e = (double)b[i][k];
+	       if (e < 0) e = -e;
+	       if (e > m) m = e;
+	  }
+     return m > 0 ? d / m : d;
+}
+
+/* the forward transform of input FILL(SEED), by an estimated plan */
+static cplx *reference(int n, int seed)
+{
+     cplx *in = mkarray(n), *out = mkarray(n);
+     X(plan) p = X(plan_dft_1d)(n, in, out, FFTW_FORWARD, FFTW_ESTIMATE);
+     CHECK(p != 0, "no estimated plan");
+     fill(in, n, seed);
+     X(execute)(p);
+     X(destroy_plan)(p);
+     X(free)(in);
+     return out;
+}
+
+static void sleep_ms(int ms)
+{
+     struct timespec ts;
+     ts.tv_sec = ms / 1000;
+     ts.tv_nsec = (long)(ms % 1000) * 1000000L;
+     nanosleep(&ts, 0);
+}
+
+static int wisdom_has(int n, unsigned flags)
+{
+     cplx *in = mkarray(n), *out = mkarray(n);
+     X(plan) p = X(plan_dft_1d)(n, in, out, FFTW_FORWARD,
+				flags | FFTW_WISDOM_ONLY);
+     X(destroy_plan)(p);
+     X(free)(in);
+     X(free)(out);
+     return p != 0;
+}
+
+/*************************************************************************/
+/* workspace: X(execute_with_workspace) computes what X(execute) does,
+   with one workspace shared by several plans, in any thread */
+
+#define NWS 3
+static const int ws_sizes[NWS] = { 1000, 4096, 10007 };
+
+typedef struct {
+     X(plan) p[NWS];
+     cplx *a[NWS], *want[NWS];
+     void *work;
+} ws_state;
+
+static void ws_run(ws_state *s)
+{
+     int i;
+     for (i = 0; i < NWS; ++i) {
+	  fill(s->a[i], ws_sizes[i], i);
+	  X(execute_with_workspace)(s->p[i], s->work);
+	  CHECK(difference(s->a[i], s->want[i], ws_sizes[i]) == 0,
+		"execute_with_workspace differs from execute");
+     }
+}
+
+static void *ws_thread(void *arg)
+{
+     ws_run((ws_state *) arg);
+     return 0;
+}
+
+static void workspace(void)
+{
+     ws_state s;
+     pthread_t t;
+     size_t max = 0, ws;
+     int i, any = 0;
+
+     for (i = 0; i < NWS; ++i) {
+	  int n = ws_sizes[i];
+	  cplx *ref = reference(n, i);
+
+	  /* in place, which makes most plans need a buffer */
+	  s.a[i] = mkarray(n);
+	  s.want[i] = mkarray(n);
+	  s.p[i] = X(plan_dft_1d)(n, s.a[i], s.a[i], FFTW_FORWARD,
+				  FFTW_ESTIMATE);
+	  CHECK(s.p[i] != 0, "no plan");
+	  ws = X(workspace_size)(s.p[i]);
+	  if (ws > max) max = ws;
+	  any |= ws > 0;
+
+	  fill(s.a[i], n, i);
+	  X(execute)(s.p[i]);
+	  CHECK(difference(s.a[i], ref, n) < tolerance(), "wrong transform");
+	  memcpy(s.want[i], s.a[i], sizeof(cplx) * (size_t)n);
+	  X(free)(ref);
+     }
+     CHECK(any, "no plan needs a workspace");
+
+     s.work = X(malloc)(max);
+     ws_run(&s);
+     CHECK(pthread_create(&t, 0, ws_thread, &s) == 0, "pthread_create");
+     pthread_join(t, 0);
+
+     X(free)(s.work);
+     for (i = 0; i < NWS; ++i) {
+	  X(destroy_plan)(s.p[i]);
+	  X(free)(s.a[i]);
+	  X(free)(s.want[i]);
+     }
+     X(cleanup)();
+}
+
+/*************************************************************************/
+/* realtime: an FFTW_REALTIME plan runs in the planning thread, and in
+   others with a workspace.  Debug builds abort when another thread
+   executes it without one. */
+
+#define RT_N 10007
+
+typedef struct {
+     X(plan) p;
+     cplx *a, *want;
+     void *work; /* or 0 for X(execute) */
+} rt_state;
+
+static void *rt_thread(void *arg)
+{
+     rt_state *s = (rt_state *) arg;
+
+     fill(s->a, RT_N, 1);
+     if (s->work)
+	  X(execute_with_workspace)(s->p, s->work);
+     else
+	  X(execute)(s->p);
+     CHECK(difference(s->a, s->want, RT_N) < tolerance(), "wrong transform");
+     return 0;
+}
+
+static void realtime(void)
+{
+     rt_state s;
+     pthread_t t;
+
+     s.want = reference(RT_N, 1);
+     s.a = mkarray(RT_N);
+     s.p = X(plan_dft_1d)(RT_N, s.a, s.a, FFTW_FORWARD,
+			  FFTW_ESTIMATE | FFTW_REALTIME);
+     CHECK(s.p != 0, "no plan");
+     CHECK(X(workspace_size)(s.p) > 0, "the plan needs no workspace");
+
+     s.work = 0;
+     rt_thread(&s);
+
+     s.work = X(malloc)(X(workspace_size)(s.p));
+     CHECK(pthread_create(&t, 0, rt_thread, &s) == 0, "pthread_create");
+     pthread_join(t, 0);
+     X(free)(s.work);
+
+#ifdef HAVE_UNISTD_H
+     {
+	  int status;
+	  pid_t pid;
+
+	  fflush(stderr);
+	  pid = fork();
+	  CHECK(pid >= 0, "fork");
+	  if (pid == 0) {
+	       /* not the planning thread, and no workspace; the
+		  diagnostic is expected */
+	       if (!freopen("/dev/null", "w", stderr))
+		    _exit(1);
+	       s.work = 0;
+	       if (pthread_create(&t, 0, rt_thread, &s) == 0)
+		    pthread_join(t, 0);
+	       _exit(0);
+	  }
+	  CHECK(waitpid(pid, &status, 0) == pid, "waitpid");
+#  ifdef REALTIME_CHECKS
+	  CHECK(WIFSIGNALED(status) && WTERMSIG(status) == SIGABRT,
+		"executing without scratch memory did not abort");
+#  else
+	  CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0,
+		"executing in another thread failed");
+#  endif
+     }
+#endif
+
+     X(destroy_plan)(s.p);
+     X(free)(s.a);
+     X(free)(s.want);
+     X(cleanup)();
+}
+
+/*************************************************************************/
+/* twiddles: the cache keeps idle tables up to its limit, and the
+   statistics say so */
+
+typedef struct {
+     double hits, misses, bytes;
+} tw_stats;
+
+static tw_stats twiddle_stats(void)
+{
+     tw_stats s;
+     X(twiddle_cache_stats)(&s.hits, &s.misses, &s.bytes);
+     return s;
+}
+
+static void plan_and_destroy(int n)
+{
+     cplx *in = mkarray(n), *out = mkarray(n);
+     X(plan) p = X(plan_dft_1d)(n, in, out, FFTW_FORWARD, FFTW_ESTIMATE);
+     CHECK(p != 0, "no plan");
+     X(destroy_plan)(p);
+     X(free)(in);
+     X(free)(out);
+}
+
+static void twiddles(void)
+{
+     tw_stats s0, s1, s2;
+     cplx *in, *out;
+     X(plan) p;
+     int n = 4096;
+
+     /* by default tables go with the last plan using them */
+     s0 = twiddle_stats();
+     CHECK(s0.bytes == 0, "tables before any plan");
+     plan_and_destroy(n);
+     s1 = twiddle_stats();
+     CHECK(s1.misses > s0.misses, "no table computed");
+     CHECK(s1.bytes == 0, "tables kept without a cache");
+     plan_and_destroy(n);
+     s2 = twiddle_stats();
+     CHECK(s2.misses > s1.misses, "tables reused without a cache");
+
+     /* while a plan uses them they stay, whatever the limit */
+     in = mkarray(n);
+     out = mkarray(n);
+     p = X(plan_dft_1d)(n, in, out, FFTW_FORWARD, FFTW_ESTIMATE);
+     CHECK(p != 0, "no plan");
+     CHECK(twiddle_stats().bytes > 0, "no tables for a live plan");
+
+     /* with a cache, idle tables stay and are reused */
+     X(set_twiddle_cache_limit)((size_t)1 << 24);
+     X(destroy_plan)(p);
+     s1 = twiddle_stats();
+     CHECK(s1.bytes > 0, "idle tables not kept");
+     plan_and_destroy(n);
+     s2 = twiddle_stats();
+     CHECK(s2.misses == s1.misses, "cached tables computed again");
+     CHECK(s2.hits > s1.hits, "no cache hits");
+     CHECK(s2.bytes == s1.bytes, "cache grew for the same plan");
+
+     /* lowering the limit evicts, and so does X(cleanup) */
+     X(set_twiddle_cache_limit)(0);
+     CHECK(twiddle_stats().bytes == 0, "tables kept over the limit");
+     X(set_twiddle_cache_limit)((size_t)1 << 24);
+     plan_and_destroy(n);
+     CHECK(twiddle_stats().bytes > 0, "idle tables not kept");
+     X(cleanup)();
+     CHECK(twiddle_stats().bytes == 0, "idle tables kept by cleanup");
+
+     X(free)(in);
+     X(free)(out);
+}
+
+/*************************************************************************/
+/* plans and wisdom: plan caches and binary wisdom survive a round trip
+   through a file, and corrupt files are rejected without changing
+   anything */
+
+#define NPC 3
+static const int pc_sizes[NPC] = { 1000, 4096, 8633 };
+
+static void write_file(const char *name, const char *data, size_t n)
+{
+     FILE *f = fopen(name, "wb");
+     CHECK(f != 0, "cannot create a file");
+     CHECK(fwrite(data, 1, n, f) == n && !fclose(f), "cannot write a file");
+}
+
+static char *read_file(const char *name, size_t *n)
+{
+     FILE *f = fopen(name, "rb");
+     char *data;
+     long len;
+
+     CHECK(f != 0, "cannot open a file");
+     CHECK(!fseek(f, 0, SEEK_END) && (len = ftell(f)) > 0
+	   && !fseek(f, 0, SEEK_SET), "cannot size a file");
+     *n = (size_t)len;
+     data = (char *) malloc(*n);
+     CHECK(data && fread(data, 1, *n, f) == *n, "cannot read a file");
+     fclose(f);
+     return data;
+}
+
+/* corrupt copies of the file NAME: truncated, with a different magic
+   number, and with its last 8 bytes changed (the last twiddle factor)
+   if it is a PLAN_CACHE, which may have trailing bytes, or with
+   trailing garbage otherwise.  IMPORT must reject each, and leave no
+   wisdom behind. */
+static void reject_corrupt(const char *name, int (*import)(const char *),
+			   int plan_cache)
+{
+     static const char *bad = "features-bad.bin";
+     size_t n;
+     char *data = read_file(name, &n), *more;
+
+     write_file(bad, data, n / 2);
+     CHECK(!import(bad), "truncated file accepted");
+
+     data[0] ^= 1;
+     write_file(bad, data, n);
+     CHECK(!import(bad), "wrong magic number accepted");
+     data[0] ^= 1;
+
+     if (plan_cache) {
+	  R x = (R)0.123;
+	  memcpy(data + n - sizeof(R), &x, sizeof(R));
+	  write_file(bad, data, n);
+	  CHECK(!import(bad), "wrong twiddle factor accepted");
+     } else {
+	  more = (char *) malloc(n + 16);
+	  CHECK(more != 0, "out of memory");
+	  memcpy(more, data, n);
+	  memset(more + n, 0x55, 16);
+	  write_file(bad, more, n + 16);
+	  CHECK(!import(bad), "trailing garbage accepted");
+	  free(more);
+     }
+
+     CHECK(!wisdom_has(pc_sizes[0], FFTW_MEASURE),
+	   "wisdom after rejecting a file");
+     free(data);
+     remove(bad);
+}
+
+/* measure the plans, export them with EXPORT_, forget, check that
+   corrupt files are rejected, and import with IMPORT */
+static void round_trip(int (*export_)(const char *, X(plan) *),
+		       int (*import)(const char *), int plan_cache)
+{
+     static const char *name = "features.bin";
+     X(plan) p[NPC];
+     cplx *in[NPC], *out[NPC], *ref;
+     tw_stats s0, s1;
+     int i;
+
+     for (i = 0; i < NPC; ++i) {
+	  in[i] = mkarray(pc_sizes[i]);
+	  out[i] = mkarray(pc_sizes[i]);
+	  p[i] = X(plan_dft_1d)(pc_sizes[i], in[i], out[i], FFTW_FORWARD,
+				FFTW_MEASURE);
+	  CHECK(p[i] != 0, "no plan");
+     }
+     CHECK(export_(name, p), "export failed");
+     for (i = 0; i < NPC; ++i)
+	  X(destroy_plan)(p[i]);
+     X(forget_wisdom)();
+     X(cleanup)();
+
+     reject_corrupt(name, import, plan_cache);
+
+     CHECK(import(name), "import failed");
+     s0 = twiddle_stats();
+     for (i = 0; i < NPC; ++i) {
+	  p[i] = X(plan_dft_1d)(pc_sizes[i], in[i], out[i], FFTW_FORWARD,
+				FFTW_MEASURE | FFTW_WISDOM_ONLY);
+	  CHECK(p[i] != 0, "imported wisdom lacks a plan");
+     }
+     s1 = twiddle_stats();
+     if (plan_cache)
+	  CHECK(s1.misses == s0.misses, "imported twiddles computed again");
+
+     for (i = 0; i < NPC; ++i) {
+	  ref = reference(pc_sizes[i], i);
+	  fill(in[i], pc_sizes[i], i);
+	  X(execute)(p[i]);
+	  CHECK(difference(out[i], ref, pc_sizes[i]) < tolerance(),
+		"wrong transform");
+	  X(free)(ref);
+	  X(destroy_plan)(p[i]);
+	  X(free)(in[i]);
+	  X(free)(out[i]);
+     }
+     X(cleanup)();
+     remove(name);
+}
+
+static int export_plans(const char *name, X(plan) *p)
+{
+     return X(export_plans_to_filename)(name, p, NPC, 1);
+}
+
+static int export_binary(const char *name, X(plan) *p)
+{
+     UNUSED(p);
+     return X(export_wisdom_to_binary_filename)(name);
+}
+
+static void plans(void)
+{
+     round_trip(export_plans, X(import_plans_from_filename), 1);
+}
+
+static void wisdom(void)
+{
+     round_trip(export_binary, X(import_wisdom_from_binary_filename), 0);
+}
+
+/*************************************************************************/
+/* async: threads executing plans made with FFTW_ASYNC get the right
+   results before, while and after the upgrade replaces the plan */
+
+#define NAS 3
+#define AS_THREADS 2
+#define AS_TIMEOUT 60 /* seconds */
+static const int as_sizes[NAS] = { 1000, 4096, 8633 };
+
+typedef struct {
+     X(plan) p[NAS];
+     cplx *want[NAS];
+     pthread_mutex_t lock;
+     int stop, errors, rounds;
+} as_state;
+
+static void *as_thread(void *arg)
+{
+     as_state *s = (as_state *) arg;
+     cplx *in[NAS], *out[NAS];
+     int i, stop = 0, errors = 0, rounds = 0;
+
+     for (i = 0; i < NAS; ++i) {
+	  in[i] = mkarray(as_sizes[i]);
+	  out[i] = mkarray(as_sizes[i]);
+     }
+     while (!stop) {
+	  for (i = 0; i < NAS; ++i) {
+	       fill(in[i], as_sizes[i], i);
+	       X(execute_dft)(s->p[i], in[i], out[i]);
+	       errors += difference(out[i], s->want[i], as_sizes[i])
+		    >= tolerance();
+	  }
+	  ++rounds;
+	  pthread_mutex_lock(&s->lock);
+	  stop = s->stop;
+	  pthread_mutex_unlock(&s->lock);
+     }
+     pthread_mutex_lock(&s->lock);
+     s->errors += errors;
+     s->rounds += rounds;
+     pthread_mutex_unlock(&s->lock);
+     for (i = 0; i < NAS; ++i) {
+	  X(free)(in[i]);
+	  X(free)(out[i]);
+     }
+     return 0;
+}
+
+static void async(void)
+{
+     as_state s;
+     pthread_t t[AS_THREADS];
+     cplx *in[NAS], *out[NAS];
+     time_t start;
+     int i, done;
+
+     CHECK(X(init_threads)(), "init_threads failed");
+     pthread_mutex_init(&s.lock, 0);
+     s.stop = s.errors = s.rounds = 0;
+     for (i = 0; i < NAS; ++i) {
+	  s.want[i] = reference(as_sizes[i], i);
+	  in[i] = mkarray(as_sizes[i]);
+	  out[i] = mkarray(as_sizes[i]);
+	  s.p[i] = X(plan_dft_1d)(as_sizes[i], in[i], out[i], FFTW_FORWARD,
+				  FFTW_MEASURE | FFTW_ASYNC);
+	  CHECK(s.p[i] != 0, "no plan");
+     }
+     for (i = 0; i < AS_THREADS; ++i)
+	  CHECK(pthread_create(t + i, 0, as_thread, &s) == 0,
+		"pthread_create");
+
+     /* the upgrades are done soon after the planner has their wisdom */
+     start = time(0);
+     do {
+	  sleep_ms(10);
+	  for (done = i = 0; i < NAS; ++i)
+	       done += wisdom_has(as_sizes[i], FFTW_MEASURE);
+     } while (done < NAS && time(0) - start < AS_TIMEOUT);
+     sleep_ms(100);
+
+     pthread_mutex_lock(&s.lock);
+     s.stop = 1;
+     pthread_mutex_unlock(&s.lock);
+     for (i = 0; i < AS_THREADS; ++i)
+	  pthread_join(t[i], 0);
+     CHECK(done == NAS, "upgrades took too long");
+     CHECK(s.errors == 0, "wrong transform");
+
+     for (i = 0; i < NAS; ++i) {
+	  fill(in[i], as_sizes[i], i);
+	  X(execute)(s.p[i]);
+	  CHECK(difference(out[i], s.want[i], as_sizes[i]) < tolerance(),
+		"wrong transform after the upgrade");
+	  X(destroy_plan)(s.p[i]);
+	  X(free)(in[i]);
+	  X(free)(out[i]);
+	  X(free)(s.want[i]);
+     }
+     pthread_mutex_destroy(&s.lock);
+     X(cleanup_threads)();
+}
+
+/* async-destroy: destroying plans whose upgrade is queued, probably
+   running, or done.  The first upgrade is slow, but limited in time. */
+static void async_destroy(void)
+{
+     static const int sizes[NAS] = { 8633, 1000, 4096 };
+     static const unsigned flags[NAS] =
+	  { FFTW_PATIENT, FFTW_MEASURE, FFTW_MEASURE };
+     X(plan) p[NAS];
+     cplx *in[NAS], *out[NAS];
+     time_t start;
+     int i;
+
+     CHECK(X(init_threads)(), "init_threads failed");
+     X(set_timelimit)(1.0);
+     for (i = 0; i < NAS; ++i) {
+	  in[i] = mkarray(sizes[i]);
+	  out[i] = mkarray(sizes[i]);
+	  p[i] = X(plan_dft_1d)(sizes[i], in[i], out[i], FFTW_FORWARD,
+				flags[i] | FFTW_ASYNC);
+	  CHECK(p[i] != 0, "no plan");
+     }
+
+     /* queued behind the others */
+     X(destroy_plan)(p[NAS - 1]);
+
+     /* the upgrader has had time to start */
+     sleep_ms(20);
+     fill(in[0], sizes[0], 0);
+     X(execute)(p[0]);
+     X(destroy_plan)(p[0]);
+
+     start = time(0);
+     while (!wisdom_has(sizes[1], flags[1])
+	    && time(0) - start < AS_TIMEOUT)
+	  sleep_ms(10);
+     CHECK(wisdom_has(sizes[1], flags[1]), "upgrade took too long");
+     fill(in[1], sizes[1], 1);
+     X(execute)(p[1]);
+     X(destroy_plan)(p[1]);
+
+     /* the library still works */
+     X(cleanup)();
+     p[0] = X(plan_dft_1d)(sizes[1], in[1], out[1], FFTW_FORWARD,
+			   FFTW_MEASURE | FFTW_ASYNC);
+     CHECK(p[0] != 0, "no plan after cleanup");
+     X(destroy_plan)(p[0]);
+
+     X(cleanup_threads)();
+     for (i = 0; i < NAS; ++i) {
+	  X(free)(in[i]);
+	  X(free)(out[i]);
+     }
+}
+
+/* async-cleanup: X(cleanup) with upgrades queued waits for them */
+static void async_cleanup(void)
+{
+     X(plan) p[NAS];
+     cplx *in[NAS], *out[NAS], *ref;
+     X(plan) q;
+     int i;
+
+     CHECK(X(init_threads)(), "init_threads failed");
+     for (i = 0; i < NAS; ++i) {
+	  in[i] = mkarray(as_sizes[i]);
+	  out[i] = mkarray(as_sizes[i]);
+	  p[i] = X(plan_dft_1d)(as_sizes[i], in[i], out[i], FFTW_FORWARD,
+				FFTW_MEASURE | FFTW_ASYNC);
+	  CHECK(p[i] != 0, "no plan");
+     }
+
+     /* the plans are undefined after this, so they are leaked */
+     X(cleanup)();
+
+     ref = reference(as_sizes[0], 0);
+     q = X(plan_dft_1d)(as_sizes[0], in[0], out[0], FFTW_FORWARD,
+			FFTW_MEASURE | FFTW_ASYNC);
+     CHECK(q != 0, "no plan after cleanup");
+     fill(in[0], as_sizes[0], 0);
+     X(execute)(q);
+     CHECK(difference(out[0], ref, as_sizes[0]) < tolerance(),
+	   "wrong transform after cleanup");
+     X(destroy_plan)(q);
+     X(free)(ref);
+
+     X(cleanup_threads)();
+     for (i = 0; i < NAS; ++i) {
+	  X(free)(in[i]);
+	  X(free)(out[i]);
+     }
+}
+
+/*************************************************************************/
+
+static const struct {
+     const char *name;
+     void (*run)(void);
+} tests[] = {
+     { "workspace", workspace },
+     { "realtime", realtime },
+     { "twiddles", twiddles },
+     { "plans", plans },
+     { "wisdom", wisdom },
+     { "async", async },
+     { "async-destroy", async_destroy },
+     { "async-cleanup", async_cleanup }
+};
+
+int main(int argc, char *argv[])
+{
+     size_t i;
+
+     for (i = 0; argc == 2 && i < sizeof(tests) / sizeof(tests[0]); ++i)
+	  if (!strcmp(argv[1], tests[i].name)) {
+	       test = tests[i].name;
+	       tests[i].run();
+	       return EXIT_SUCCESS;
+	  }
+
+     fprintf(stderr, "usage: features <test>, one of:");
+     for (i = 0; i < sizeof(tests) / sizeof(tests[0]); ++i)
+	  fprintf(stderr, " %s", tests[i].name);
+     fprintf(stderr, "\n");
+     return EXIT_FAILURE;
+}
@@ -103,6 +103,12 @@ void useropt(const char *arg)
           fprintf(stderr, "Serial FFTW; ignoring threads_callback option.\n");
 #endif
      else if (sscanf(arg, "nthreads=%d", &x) == 1) nthreads = x;
+     else if (sscanf(arg, "spin=%d", &x) == 1)
+#ifdef HAVE_SMP
+          FFTW(threads_set_spin)(x);
+#else
+          fprintf(stderr, "Serial FFTW; ignoring spin option.\n");
+#endif
 #ifdef FFTW_RANDOM_ESTIMATOR
      else if (sscanf(arg, "eseed=%d", &x) == 1) FFTW(random_estimate_seed) = x;
 #endif
@@ -20,6 +20,7 @@
 
 #include "api/api.h"
 #include "threads/threads.h"
+#include <string.h>
 
 static int threads_inited = 0;
 
@@ -85,6 +86,49 @@ int X(planner_nthreads)(void)
     return X(the_planner)()->nthr;
 }
 
+void X(threads_set_spin)(int usec)
+{
+     X(ithreads_set_spin)(usec);
+}
+
+int X(threads_set_affinity)(int policy, const int *cpus, int ncpus)
+{
+     return X(ithreads_set_affinity)(policy, cpus, ncpus);
+}
+
+typedef struct {
+     char *p;
+     size_t n;
+     int nblocks;
+} touch_data;
+
+static void *touch(spawn_data *d)
+{
+     touch_data *td = (touch_data *) d->data;
+     size_t block = (td->n + td->nblocks - 1) / td->nblocks;
+     size_t lo = block * d->min, hi = block * d->max;
+
+     if (hi > td->n) hi = td->n;
+     if (lo < hi)
+	  memset(td->p + lo, 0, hi - lo);
+     return 0;
+}
+
+/* Zero N bytes at P, split into as many blocks as plans get threads,
+   each one from the thread that will work on that block (once threads
+   are pinned, see X(threads_set_affinity)).  The memory thereby ends
+   up on the NUMA node of the thread using it. */
+void X(threads_first_touch)(void *p, size_t n)
+{
+     touch_data td;
+     int nthr = X(planner_nthreads)();
+
+     td.p = (char *) p;
+     td.n = n;
+     td.nblocks = nthr;
+     X(spawn_loop)(nthr, nthr, touch, (void *) &td);
+}
+
 void X(make_planner_thread_safe)(void)
 {
      X(threads_register_planner_hooks)();
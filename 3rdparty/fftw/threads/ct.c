@@ -40,6 +40,7 @@ static void *spawn_apply(spawn_data *d)
      INT thr_num = d->thr_num;
 
      plan_dftw *cldw = (plan_dftw *) (ego->cldws[thr_num]);
+     X(scratch_reserve)(cldw->super.workspace);
      cldw->apply((plan *) cldw, ego->r, ego->i);
      return 0;
 }
@@ -128,7 +129,8 @@ static plan *mkplan(const solver *ego_, const problem *p_, planner *plnr)
 	  X(dft_solve), awake, print, destroy
      };
 
-     if (plnr->nthr <= 1 || !X(ct_applicable)(ego, p_, plnr))
+     if (plnr->nthr <= 1 || REALTIMEP(plnr)
+	 || !X(ct_applicable)(ego, p_, plnr))
           return (plan *) 0;
 
      p = (const problem_dft *) p_;
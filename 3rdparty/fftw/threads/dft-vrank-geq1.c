@@ -50,6 +50,7 @@ static void *spawn_apply(spawn_data *d)
      int thr_num = d->thr_num;
      plan_dft *cld = (plan_dft *) ego->cldrn[thr_num];
 
+     X(scratch_reserve)(cld->super.workspace);
      cld->apply((plan *) cld,
 		ego->ri + thr_num * its, ego->ii + thr_num * its,
 		ego->ro + thr_num * ots, ego->io + thr_num * ots);
@@ -113,6 +114,7 @@ static int applicable0(const solver *ego_, const problem *p_,
 
      return (1
 	     && plnr->nthr > 1
+	     && !REALTIMEP(plnr) /* spawning threads blocks */
 	     && FINITE_RNK(p->vecsz->rnk)
 	     && p->vecsz->rnk > 0
 	     && pickdim(ego, p->vecsz, p->ri != p->ro, dp)
@@ -42,3 +42,13 @@ FFTW_VOIDFUNC F77(cleanup_threads, CLEANUP_THREADS)(void)
 {
      X(cleanup_threads)();
 }
+
+FFTW_VOIDFUNC F77(threads_set_spin, THREADS_SET_SPIN)(int *usec)
+{
+     X(threads_set_spin)(*usec);
+}
+
+FFTW_VOIDFUNC F77(threads_set_affinity, THREADS_SET_AFFINITY)(int *okay, int *policy, const int *cpus, int *ncpus)
+{
+     *okay = X(threads_set_affinity)(*policy, *ncpus > 0 ? cpus : 0, *ncpus);
+}
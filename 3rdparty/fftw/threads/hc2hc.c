@@ -38,6 +38,7 @@ static void *spawn_apply(spawn_data *d)
      PD *ego = (PD *) d->data;
      
      plan_hc2hc *cldw = (plan_hc2hc *) (ego->cldws[d->thr_num]);
+     X(scratch_reserve)(cldw->super.workspace);
      cldw->apply((plan *) cldw, ego->IO);
      return 0;
 }
@@ -126,7 +127,8 @@ static plan *mkplan(const solver *ego_, const problem *p_, planner *plnr)
 	  X(rdft_solve), awake, print, destroy
      };
 
-     if (plnr->nthr <= 1 || !X(hc2hc_applicable)(ego, p_, plnr))
+     if (plnr->nthr <= 1 || REALTIMEP(plnr)
+	 || !X(hc2hc_applicable)(ego, p_, plnr))
           return (plan *) 0;
 
      p = (const problem_rdft *) p_;
@@ -31,6 +31,21 @@ int X(ithreads_init)(void)
      return 0; /* no error */
 }
 
+/* waiting threads are OpenMP's business (see OMP_WAIT_POLICY) */
+void X(ithreads_set_spin)(int usec)
+{
+     UNUSED(usec);
+}
+
+/* placement is OpenMP's business too (see OMP_PROC_BIND and
+   OMP_PLACES) */
+int X(ithreads_set_affinity)(int policy, const int *cpus, int ncpus)
+{
+     UNUSED(cpus);
+     UNUSED(ncpus);
+     return policy == FFTW_AFFINITY_NONE;
+}
+
 /* Distribute a loop from 0 to loopmax-1 over nthreads threads.
    proc(d) is called to execute a block of iterations from d->min
    to d->max-1.  d->thr_num indicate the number of the thread
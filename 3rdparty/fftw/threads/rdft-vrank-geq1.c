@@ -48,6 +48,7 @@ static void *spawn_apply(spawn_data *d)
      int thr_num = d->thr_num;
      plan_rdft *cld = (plan_rdft *) ego->cldrn[d->thr_num];
 
+     X(scratch_reserve)(cld->super.workspace);
      cld->apply((plan *) cld,
 		ego->I + thr_num * ego->its, ego->O + thr_num * ego->ots);
      return 0;
@@ -110,6 +111,7 @@ static int applicable0(const solver *ego_, const problem *p_,
 
      return (1
 	     && plnr->nthr > 1
+	     && !REALTIMEP(plnr) /* spawning threads blocks */
 	     && FINITE_RNK(p->vecsz->rnk)
 	     && p->vecsz->rnk > 0
 	     && pickdim(ego, p->vecsz, p->I != p->O, dp)
@@ -22,16 +22,24 @@
    function.  The first portion of this file is a set of macros to
    spawn and join threads on various systems. */
 
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#  define _GNU_SOURCE /* for pthread_setaffinity_np */
+#endif
+
 #include "threads/threads.h"
 #include "api/api.h"
 
 #if defined(USING_POSIX_THREADS)
 
 #include <pthread.h>
+#include <time.h>
 
 #ifdef HAVE_UNISTD_H
 #  include <unistd.h>
 #endif
+#ifdef HAVE_SYS_TIME_H
+#  include <sys/time.h>
+#endif
 
 /* implementation of semaphores and mutexes: */
 #if (defined(_POSIX_SEMAPHORES) && (_POSIX_SEMAPHORES >= 200112L))
@@ -156,6 +164,142 @@ typedef pthread_mutex_t os_static_mutex_t;
 static void os_static_mutex_lock(os_static_mutex_t *s) { pthread_mutex_lock(s); }
 static void os_static_mutex_unlock(os_static_mutex_t *s) { pthread_mutex_unlock(s); }
 
+/* sequentially consistent atomic operations, via the gcc builtins
+   (also understood by clang and icc) */
+typedef int os_atomic_t;
+#define os_atomic_load(p) __atomic_load_n(p, __ATOMIC_SEQ_CST)
+#define os_atomic_store(p, v) __atomic_store_n(p, v, __ATOMIC_SEQ_CST)
+#define os_atomic_exchange(p, v) __atomic_exchange_n(p, v, __ATOMIC_SEQ_CST)
+static int os_atomic_cas(os_atomic_t *p, int old, int new_)
+{
+     return __atomic_compare_exchange_n(p, &old, new_, 0,
+					__ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+static int os_atomic_add(os_atomic_t *p, int v)
+{
+     return __atomic_add_fetch(p, v, __ATOMIC_SEQ_CST);
+}
+#define os_atomic_load_ptr(p) __atomic_load_n(p, __ATOMIC_SEQ_CST)
+#define os_atomic_store_ptr(p, v) __atomic_store_n(p, v, __ATOMIC_SEQ_CST)
+#define os_atomic_exchange_ptr(p, v) __atomic_exchange_n(p, v, __ATOMIC_SEQ_CST)
+static int os_atomic_cas_ptr(void **p, void *old, void *new_)
+{
+     return __atomic_compare_exchange_n(p, &old, new_, 0,
+					__ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+
+static void os_pause(void)
+{
+#if defined(__i386__) || defined(__x86_64__)
+     __builtin_ia32_pause();
+#elif defined(__aarch64__)
+     __asm__ __volatile__("yield");
+#endif
+}
+
+/* a clock in microseconds, for bounding busy-waits; it may wrap */
+#if HAVE_CLOCK_GETTIME && defined(CLOCK_MONOTONIC)
+static unsigned long os_usec(void)
+{
+     struct timespec ts;
+     clock_gettime(CLOCK_MONOTONIC, &ts);
+     return (unsigned long)ts.tv_sec * 1000000UL
+	  + (unsigned long)(ts.tv_nsec / 1000);
+}
+#elif defined(HAVE_GETTIMEOFDAY)
+static unsigned long os_usec(void)
+{
+     struct timeval tv;
+     gettimeofday(&tv, 0);
+     return (unsigned long)tv.tv_sec * 1000000UL + (unsigned long)tv.tv_usec;
+}
+#else
+static unsigned long os_usec(void)
+{
+     return (unsigned long)(clock() * (1.0e6 / CLOCKS_PER_SEC));
+}
+#endif
+
+static int os_ncpus(void)
+{
+#if defined(HAVE_UNISTD_H) && defined(_SC_NPROCESSORS_ONLN)
+     return (int)sysconf(_SC_NPROCESSORS_ONLN);
+#else
+     return 1;
+#endif
+}
+
+/* thread-local storage */
+typedef pthread_key_t os_tls_t;
+static void os_tls_init(os_tls_t *k, void (*dtor)(void *))
+{
+     pthread_key_create(k, dtor);
+}
+static void os_tls_destroy(os_tls_t *k) { pthread_key_delete(*k); }
+static void *os_tls_get(os_tls_t *k) { return pthread_getspecific(*k); }
+static void os_tls_set(os_tls_t *k, void *v) { pthread_setspecific(*k, v); }
+
+/* CPU affinity, where available */
+#if defined(HAVE_PTHREAD_SETAFFINITY_NP) && defined(CPU_SETSIZE)
+#define HAVE_AFFINITY 1
+static cpu_set_t os_process_cpus; /* what we were allowed to run on */
+
+static void os_affinity_init(void)
+{
+     CPU_ZERO(&os_process_cpus);
+     pthread_getaffinity_np(pthread_self(), sizeof(cpu_set_t), &os_process_cpus);
+}
+
+/* lists the CPUs we may use, returns how many there are */
+static int os_cpus(int *cpus, int max)
+{
+     int i, n = 0;
+     for (i = 0; i < CPU_SETSIZE && n < max; ++i)
+	  if (CPU_ISSET(i, &os_process_cpus))
+	       cpus[n++] = i;
+     return n;
+}
+
+/* pin the calling thread to CPU, or unpin it if CPU < 0 */
+static int os_pin_self(int cpu)
+{
+     cpu_set_t s;
+     if (cpu < 0)
+	  s = os_process_cpus;
+     else {
+	  if (cpu >= CPU_SETSIZE) return 0;
+	  CPU_ZERO(&s);
+	  CPU_SET(cpu, &s);
+     }
+     return !pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &s);
+}
+#endif
+
+#if defined(__linux__)
+#include <dirent.h>
+#include <stdio.h>
+#include <string.h>
+/* NUMA node of CPU, from sysfs: /sys/devices/system/cpu/cpuN/nodeM */
+static int os_cpu_node(int cpu)
+{
+     char path[64];
+     DIR *dir;
+     struct dirent *e;
+     int node = 0;
+
+     sprintf(path, "/sys/devices/system/cpu/cpu%d", cpu);
+     if (!(dir = opendir(path)))
+	  return 0;
+     while ((e = readdir(dir)))
+	  if (!strncmp(e->d_name, "node", 4) && sscanf(e->d_name + 4, "%d", &node) == 1)
+	       break;
+     closedir(dir);
+     return node;
+}
+#else
+static int os_cpu_node(int cpu) { UNUSED(cpu); return 0; }
+#endif
+
 #elif defined(__WIN32__) || defined(_WIN32) || defined(_WINDOWS)
 /* hack: windef.h defines INT for its own purposes and this causes
    a conflict with our own INT in ifftw.h.  Divert the windows
@@ -245,6 +389,79 @@ static void os_static_mutex_unlock(os_static_mutex_t *s)
      LONG old = InterlockedExchange(s, 0);
      A(old == 1);
 }
+
+typedef volatile LONG os_atomic_t;
+#define os_atomic_load(p) InterlockedCompareExchange(p, 0, 0)
+#define os_atomic_store(p, v) InterlockedExchange(p, v)
+#define os_atomic_exchange(p, v) InterlockedExchange(p, v)
+#define os_atomic_cas(p, old, new_) (InterlockedCompareExchange(p, new_, old) == (old))
+#define os_atomic_add(p, v) (InterlockedExchangeAdd(p, v) + (v))
+#define os_atomic_load_ptr(p) InterlockedCompareExchangePointer((PVOID volatile *)(p), 0, 0)
+#define os_atomic_store_ptr(p, v) InterlockedExchangePointer((PVOID volatile *)(p), v)
+#define os_atomic_exchange_ptr(p, v) InterlockedExchangePointer((PVOID volatile *)(p), v)
+#define os_atomic_cas_ptr(p, old, new_) (InterlockedCompareExchangePointer((PVOID volatile *)(p), new_, old) == (old))
+#define os_pause() YieldProcessor()
+
+static unsigned long os_usec(void)
+{
+     LARGE_INTEGER t, freq;
+     QueryPerformanceCounter(&t);
+     QueryPerformanceFrequency(&freq);
+     return (unsigned long)(t.QuadPart * 1.0e6 / freq.QuadPart);
+}
+
+static int os_ncpus(void)
+{
+     SYSTEM_INFO si;
+     GetSystemInfo(&si);
+     return (int)si.dwNumberOfProcessors;
+}
+
+/* no destructors: what threads leave behind goes at X(cleanup) */
+typedef DWORD os_tls_t;
+static void os_tls_init(os_tls_t *k, void (*dtor)(void *))
+{
+     UNUSED(dtor);
+     *k = TlsAlloc();
+}
+static void os_tls_destroy(os_tls_t *k) { TlsFree(*k); }
+static void *os_tls_get(os_tls_t *k) { return TlsGetValue(*k); }
+static void os_tls_set(os_tls_t *k, void *v) { TlsSetValue(*k, v); }
+
+#define HAVE_AFFINITY 1
+static DWORD_PTR os_process_cpus;
+
+static void os_affinity_init(void)
+{
+     DWORD_PTR system_cpus;
+     if (!GetProcessAffinityMask(GetCurrentProcess(), &os_process_cpus, &system_cpus))
+	  os_process_cpus = 1;
+}
+
+static int os_cpus(int *cpus, int max)
+{
+     int i, n = 0;
+     for (i = 0; i < (int)(8 * sizeof(DWORD_PTR)) && n < max; ++i)
+	  if (os_process_cpus & ((DWORD_PTR)1 << i))
+	       cpus[n++] = i;
+     return n;
+}
+
+static int os_pin_self(int cpu)
+{
+     DWORD_PTR mask;
+     if (cpu >= (int)(8 * sizeof(DWORD_PTR))) return 0;
+     mask = cpu < 0 ? os_process_cpus : (DWORD_PTR)1 << cpu;
+     return SetThreadAffinityMask(GetCurrentThread(), mask) != 0;
+}
+
+static int os_cpu_node(int cpu)
+{
+     UCHAR node;
+     if (!GetNumaProcessorNode((UCHAR)cpu, &node) || node == 0xFF)
+	  return 0;
+     return node;
+}
 #else
 #error "No threading layer defined"
 #endif
@@ -252,38 +469,182 @@ static void os_static_mutex_unlock(os_static_mutex_t *s)
 /************************************************************************/
 
 /* Main code: */
-struct worker {
-     os_sem_t ready;
-     os_sem_t done;
-     struct work *w;
-     struct worker *cdr;
-};
 
-static struct worker *make_worker(void)
+/* Waking up a parked thread costs a system call on both sides, which
+   is more than a whole mid-size transform takes.  Threads waiting for
+   each other therefore first spin for a while on a generation counter
+   that is bumped by every signal, and only park on the semaphore when
+   nothing happened in the meantime.  The PARKED flag tells the
+   signaller whether the semaphore needs to be posted.  The spinning
+   is bounded in time rather than in iterations, because a pause
+   instruction takes anywhere from about 10 cycles to about 140
+   (Skylake and later), and the idle workers also look for work to
+   steal on every iteration. */
+#define CACHE_LINE 64
+#define DEFAULT_SPIN 20 /* microseconds */
+#define SPIN_CLOCK 32 /* iterations between looks at the clock, a power of 2 */
+
+static int spin_usec = -1; /* < 0: not chosen yet; see ATOMIC_LOAD */
+
+typedef struct {
+     int n;
+     unsigned long start;
+} spinner;
+
+static void spin_start(spinner *s)
 {
-     struct worker *q = (struct worker *)MALLOC(sizeof(*q), OTHER);
-     os_sem_init(&q->ready);
-     os_sem_init(&q->done);
-     return q;
+     s->n = 0;
+     s->start = 0; /* read from the clock by the first spin() */
+}
+
+/* pause, unless the thread has spun for long enough since spin_start */
+static int spin(spinner *s)
+{
+     int budget = ATOMIC_LOAD(&spin_usec);
+
+     if (budget <= 0)
+	  return 0;
+     if (!(s->n & (SPIN_CLOCK - 1))) {
+	  unsigned long now = os_usec();
+	  if (!s->n)
+	       s->start = now;
+	  else if (now - s->start >= (unsigned long)budget)
+	       return 0;
+     }
+     ++s->n;
+     os_pause();
+     return 1;
+}
+
+typedef struct {
+     os_atomic_t gen;
+     os_atomic_t parked;
+     os_sem_t sem;
+     char pad[CACHE_LINE]; /* keep the next event off this line */
+} event;
+
+static void event_init(event *e)
+{
+     e->gen = 0;
+     e->parked = 0;
+     os_sem_init(&e->sem);
+}
+
+static void event_destroy(event *e)
+{
+     os_sem_destroy(&e->sem);
+}
+
+static void event_signal(event *e)
+{
+     os_atomic_add(&e->gen, 1);
+     if (os_atomic_exchange(&e->parked, 0))
+	  os_sem_up(&e->sem);
 }
 
-static void unmake_worker(struct worker *q)
+/* wait until E has been signaled since its generation was SEEN */
+static void event_wait(event *e, int seen)
 {
-     os_sem_destroy(&q->done);
-     os_sem_destroy(&q->ready);
-     X(ifree)(q);
+     spinner sp;
+
+     spin_start(&sp);
+     do {
+	  if (os_atomic_load(&e->gen) != seen)
+	       return;
+     } while (spin(&sp));
+
+     os_atomic_exchange(&e->parked, 1);
+     if (os_atomic_load(&e->gen) != seen) {
+	  if (os_atomic_exchange(&e->parked, 0))
+	       return; /* the signaller didn't see us parked */
+	  /* else, it did and is about to post the semaphore */
+     }
+     os_sem_down(&e->sem);
 }
 
-struct work {
+/* Work stealing.  Every thread taking part in X(spawn_loop) owns a
+   deque of tasks: the pool workers, and any other thread for as long
+   as its outermost X(spawn_loop) runs.  X(spawn_loop) pushes all the
+   blocks but one onto the deque of the calling thread, does that one
+   itself, and then, until the rest is done, pops its own tasks and
+   steals other threads' ones.  Idle workers steal too.
+
+   Nested loops, e.g. a threaded plan whose child plan is threaded as
+   well, thereby share the same workers instead of spawning more of
+   them, and whoever is idle picks up the blocks that are left, so
+   uneven splits balance out.
+
+   The deques follow Chase and Lev ("Dynamic circular work-stealing
+   deque", SPAA 2005), with a fixed size: a block that doesn't fit is
+   done right away by the thread that spawned it.  Indices only ever
+   grow and are compared through their difference, so they may wrap.
+
+   Once workers are pinned to CPUs (see X(ithreads_set_affinity)),
+   where a block runs starts to matter: block i of a loop is mailed
+   to the (i-1)-th worker, the same one every time, so it keeps
+   finding its data in its own cache and NUMA node.  Only if that
+   worker doesn't pick it up while the spawning thread has nothing
+   else to do does it take the block back.  Thieves then also look
+   at deques on their own node first.  This is the mailbox scheme of
+   Acar, Blelloch and Blumofe ("The data locality of work stealing",
+   SPAA 2000). */
+#define DEQUE_SIZE 256 /* power of 2 */
+#define MAX_WORKERS 256
+#define MAX_DEQUES (MAX_WORKERS + 64)
+#define IDX(i) ((i) & (DEQUE_SIZE - 1))
+#define DIFF(a, b) ((int)((unsigned)(a) - (unsigned)(b)))
+#define NEXT(i, d) ((int)((unsigned)(i) + (unsigned)(d)))
+
+struct join {
+     os_atomic_t pending; /* tasks not yet done */
+     event *done; /* of the deque of the spawning thread */
+};
+
+struct task {
      spawn_function proc;
      spawn_data d;
-     struct worker *q; /* the worker responsible for performing this work */
+     struct join *j;
+     struct deque *mailed_to; /* NULL if pushed */
+};
+
+struct deque {
+     os_atomic_t top; /* where thieves steal */
+     char pad1[CACHE_LINE - sizeof(os_atomic_t)];
+     os_atomic_t bottom; /* where the owner pushes and pops */
+     char pad2[CACHE_LINE - sizeof(os_atomic_t)];
+     event join; /* signaled when one of the owner's loops is done */
+     os_atomic_t owned; /* for deques of threads outside of the pool */
+     int external;
+     unsigned rng; /* for picking victims; only used by the owner */
+     struct task *mailbox; /* a block meant for this worker */
+     os_atomic_t cpu, node; /* where the worker should run; -1 if anywhere */
+     int pinned_gen; /* affinity_gen the worker last pinned itself for */
+     struct task *tasks[DEQUE_SIZE];
+     void *block; /* as returned by MALLOC, before alignment */
 };
 
 static os_mutex_t queue_lock;
 static os_sem_t termination_semaphore;
+static os_tls_t current_deque;
+
+static struct deque *deques[MAX_DEQUES];
+static os_atomic_t ndeques;
+static struct deque *pool[MAX_WORKERS]; /* deques of the workers, in order */
+static os_atomic_t nworkers;
+
+/* placement of the workers, see X(ithreads_set_affinity) */
+#define MAX_PLACEMENT 1024
+static int placement[MAX_PLACEMENT], placement_node[MAX_PLACEMENT];
+static int nplacement; /* 0 if workers may run anywhere */
+static os_atomic_t affinity_gen;
+static os_atomic_t locality; /* mail blocks to the workers */
+
+/* idle workers park here, once they are done spinning */
+static os_sem_t idle_semaphore;
+static os_atomic_t sleepers;
+static os_atomic_t work_gen; /* bumped whenever tasks are pushed */
+static os_atomic_t terminating;
 
-static struct worker *worker_queue;
 #define WITH_QUEUE_LOCK(what)			\
 {						\
      os_mutex_lock(&queue_lock);		\
@@ -291,27 +652,188 @@ static struct worker *worker_queue;
      os_mutex_unlock(&queue_lock);		\
 }
 
+/* call with the queue lock held */
+static struct deque *make_deque(int external)
+{
+     void *block;
+     struct deque *q;
+     int n = ndeques;
+
+     if (n >= MAX_DEQUES)
+	  return 0;
+
+     block = MALLOC(sizeof(struct deque) + CACHE_LINE, OTHER);
+     q = (struct deque *)
+	  (((uintptr_t)block + CACHE_LINE - 1) & ~(uintptr_t)(CACHE_LINE - 1));
+     q->block = block;
+     q->top = q->bottom = 0;
+     event_init(&q->join);
+     q->owned = 1;
+     q->external = external;
+     q->rng = 2463534242U + 7 * (unsigned)n;
+     q->mailbox = 0;
+     q->cpu = q->node = -1;
+     q->pinned_gen = 0;
+
+     deques[n] = q;
+     os_atomic_store(&ndeques, n + 1);
+     return q;
+}
+
+static void unmake_deque(struct deque *q)
+{
+     event_destroy(&q->join);
+     X(ifree)(q->block);
+}
+
+/* owner only; 0 if full */
+static int deque_push(struct deque *q, struct task *t)
+{
+     int b = os_atomic_load(&q->bottom);
+     int top = os_atomic_load(&q->top);
+
+     if (DIFF(b, top) >= DEQUE_SIZE)
+	  return 0;
+     os_atomic_store_ptr(&q->tasks[IDX(b)], t);
+     os_atomic_store(&q->bottom, NEXT(b, 1));
+     return 1;
+}
+
+/* owner only */
+static struct task *deque_pop(struct deque *q)
+{
+     int b = NEXT(os_atomic_load(&q->bottom), -1);
+     int top;
+     struct task *t;
+
+     os_atomic_store(&q->bottom, b);
+     top = os_atomic_load(&q->top);
+     if (DIFF(b, top) < 0) {
+	  /* empty */
+	  os_atomic_store(&q->bottom, top);
+	  return 0;
+     }
+
+     t = os_atomic_load_ptr(&q->tasks[IDX(b)]);
+     if (b == top) {
+	  /* last one, so thieves may be after it too */
+	  if (!os_atomic_cas(&q->top, top, NEXT(top, 1)))
+	       t = 0;
+	  os_atomic_store(&q->bottom, NEXT(top, 1));
+     }
+     return t;
+}
+
+static struct task *deque_steal(struct deque *q)
+{
+     int top = os_atomic_load(&q->top);
+     int b = os_atomic_load(&q->bottom);
+     struct task *t;
+
+     if (DIFF(b, top) <= 0)
+	  return 0;
+     t = os_atomic_load_ptr(&q->tasks[IDX(top)]);
+     if (!os_atomic_cas(&q->top, top, NEXT(top, 1)))
+	  return 0; /* lost the race; somebody else will do it */
+     return t;
+}
+
+static struct task *steal_any(struct deque *self)
+{
+     int i, n = os_atomic_load(&ndeques);
+     int start, pass, node = os_atomic_load(&self->node);
+
+     if (n <= 1)
+	  return 0;
+
+     self->rng ^= self->rng << 13;
+     self->rng ^= self->rng >> 17;
+     self->rng ^= self->rng << 5;
+     start = (int)(self->rng % (unsigned)n);
+
+     /* with a known node, neighbours first */
+     for (pass = node < 0 || !os_atomic_load(&locality); pass < 2; ++pass)
+	  for (i = 0; i < n; ++i) {
+	       struct deque *victim = deques[(start + i) % n];
+	       struct task *t;
+	       if (victim == self) continue;
+	       if (!pass && os_atomic_load(&victim->node) != node) continue;
+	       if ((t = deque_steal(victim)))
+		    return t;
+	  }
+     return 0;
+}
+
+static void run(struct task *t)
+{
+     /* T and its join live on the stack of the spawning thread, which
+	may return as soon as PENDING drops to zero */
+     event *done = t->j->done;
+
+     t->proc(&t->d);
+     if (os_atomic_add(&t->j->pending, -1) == 0)
+	  event_signal(done);
+}
+
+/* take one parked worker off the count, if there is any */
+static int take_sleeper(void)
+{
+     int n;
+     while ((n = os_atomic_load(&sleepers)) > 0)
+	  if (os_atomic_cas(&sleepers, n, n - 1))
+	       return 1;
+     return 0;
+}
+
+static void notify(int n)
+{
+     os_atomic_add(&work_gen, 1);
+     while (n-- > 0 && take_sleeper())
+	  os_sem_up(&idle_semaphore);
+}
+
 static FFTW_WORKER worker(void *arg)
 {
-     struct worker *ego = (struct worker *)arg;
-     struct work *w;
+     struct deque *q = (struct deque *)arg;
+     struct task *t;
+     spinner sp;
+
+     os_tls_set(&current_deque, q);
+     spin_start(&sp);
 
      for (;;) {
-	  /* wait until work becomes available */
-	  os_sem_down(&ego->ready);
+	  int gen = os_atomic_load(&work_gen);
 
-	  w = ego->w;
+#ifdef HAVE_AFFINITY
+	  if (q->pinned_gen != os_atomic_load(&affinity_gen)) {
+	       q->pinned_gen = os_atomic_load(&affinity_gen);
+	       os_pin_self(os_atomic_load(&q->cpu));
+	  }
+#endif
+
+	  if ((t = (struct task *)os_atomic_exchange_ptr(&q->mailbox, 0))
+	      || (t = deque_pop(q)) || (t = steal_any(q))) {
+	       run(t);
+	       spin_start(&sp);
+	       continue;
+	  }
 
-	  /* !w->proc ==> terminate worker */
-	  if (!w->proc) break;
+	  if (os_atomic_load(&terminating)) break;
 
-	  /* do the work */
-          w->proc(&w->d);
+	  if (spin(&sp))
+	       continue;
 
-	  /* signal that work is done */
-	  os_sem_up(&ego->done);
+	  /* park, unless something got pushed since we last looked */
+	  os_atomic_add(&sleepers, 1);
+	  if (os_atomic_load(&work_gen) == gen || !take_sleeper())
+	       /* if somebody else took us off the count, they are
+		  about to post the semaphore */
+	       os_sem_down(&idle_semaphore);
+	  spin_start(&sp);
      }
 
+     X(scratch_release)();
+
      /* termination protocol */
      os_sem_up(&termination_semaphore);
 
@@ -320,75 +842,444 @@ static FFTW_WORKER worker(void *arg)
      return 0;
 }
 
-static void enqueue(struct worker *q)
+/* call with the queue lock held.  The first CPU is left for the
+   thread calling X(spawn_loop), which does the first block. */
+static void place(int k)
 {
-     WITH_QUEUE_LOCK({
-	  q->cdr = worker_queue;
-	  worker_queue = q;
-     });
+     struct deque *q = pool[k];
+     if (nplacement) {
+	  int i = (k + 1) % nplacement;
+	  os_atomic_store(&q->cpu, placement[i]);
+	  os_atomic_store(&q->node, placement_node[i]);
+     } else {
+	  os_atomic_store(&q->cpu, -1);
+	  os_atomic_store(&q->node, -1);
+     }
 }
 
-static struct worker *dequeue(void)
+/* make sure there are at least N workers, as far as MAX_WORKERS goes */
+static void hire(int n)
 {
-     struct worker *q;
+     if (n > MAX_WORKERS)
+	  n = MAX_WORKERS;
+     if (os_atomic_load(&nworkers) >= n)
+	  return;
 
      WITH_QUEUE_LOCK({
-	  q = worker_queue;
-	  if (q)
-	       worker_queue = q->cdr;
+	  while (nworkers < n) {
+	       struct deque *q = make_deque(0);
+	       if (!q) break;
+	       pool[nworkers] = q;
+	       place(nworkers);
+	       os_create_thread(worker, q);
+	       os_atomic_store(&nworkers, nworkers + 1);
+	  }
      });
+}
 
-     if (!q) {
-	  /* no worker is available.  Create one */
-	  q = make_worker();
-	  os_create_thread(worker, q);
+/* a deque for a thread outside of the pool, or NULL if there are too
+   many of them */
+static struct deque *borrow_deque(void)
+{
+     struct deque *q = 0;
+     int i, n = os_atomic_load(&ndeques);
+
+     for (i = 0; i < n; ++i) {
+	  q = deques[i];
+	  if (q->external && !os_atomic_load(&q->owned)
+	      && os_atomic_cas(&q->owned, 0, 1))
+	       return q;
      }
 
+     WITH_QUEUE_LOCK({
+	  q = make_deque(1);
+     });
      return q;
 }
 
+static void return_deque(struct deque *q)
+{
+     os_atomic_store(&q->owned, 0);
+}
 
-static void kill_workforce(void)
+/* take back a block its worker hasn't picked up yet */
+static struct task *reclaim(struct task *r, int n)
 {
-     struct work w;
+     int i;
+     for (i = 0; i < n; ++i) {
+	  struct task *t = &r[i];
+	  if (t->mailed_to && os_atomic_cas_ptr((void **)&t->mailed_to->mailbox, t, 0)) {
+	       t->mailed_to = 0;
+	       return t;
+	  }
+     }
+     return 0;
+}
 
-     w.proc = 0;
+/* help out until all the N tasks R of J are done */
+static void join(struct deque *q, struct join *j, struct task *r, int n)
+{
+     struct task *t;
+     spinner sp;
+
+     spin_start(&sp);
+     while (os_atomic_load(&j->pending) > 0) {
+	  if ((t = deque_pop(q)) || (t = steal_any(q)) || (t = reclaim(r, n))) {
+	       run(t);
+	       spin_start(&sp);
+	  } else if (!spin(&sp)) {
+	       /* the rest is being done elsewhere */
+	       int seen = os_atomic_load(&q->join.gen);
+	       if (os_atomic_load(&j->pending) > 0)
+		    event_wait(&q->join, seen);
+	       spin_start(&sp);
+	  }
+     }
+}
+
+static void kill_workforce(void)
+{
+     int i, n;
 
      WITH_QUEUE_LOCK({
 	  /* tell all workers that they must terminate.
 
-	     Because workers enqueue themselves before signaling the
-	     completion of the work, all workers belong to the worker queue
-	     if we get here.  Also, all workers are waiting at
-	     os_sem_down(ready), so we can hold the queue lock without
-	     deadlocking */
-	  while (worker_queue) {
-	       struct worker *q = worker_queue;
-	       worker_queue = q->cdr;
-	       q->w = &w;
-	       os_sem_up(&q->ready);
+	     All loops are done if we get here, so the workers are
+	     either looking for work or parked */
+	  n = nworkers;
+	  os_atomic_store(&terminating, 1);
+	  notify(n);
+	  for (i = 0; i < n; ++i)
 	       os_sem_down(&termination_semaphore);
-	       unmake_worker(q);
-	  }
+
+	  for (i = 0; i < ndeques; ++i)
+	       unmake_deque(deques[i]);
+	  os_atomic_store(&ndeques, 0);
+	  os_atomic_store(&nworkers, 0);
      });
 }
 
+/* FFTW_ASYNC: one thread plans the upgrades of plans (see api.h), in
+   the order they come, alongside the threads of the program.  It
+   plans with a sibling planner of its own, like every thread once
+   the planner hooks are in. */
+
+enum { UPGRADE_QUEUED, UPGRADE_RUNNING, UPGRADE_DONE };
+
+static os_mutex_t upgrade_lock;
+static os_sem_t upgrade_semaphore; /* up once per queued upgrade */
+static os_sem_t upgrade_idle_semaphore;
+static os_sem_t upgrader_termination_semaphore;
+static upgrade *upgrades, **upgrades_tail; /* the queue */
+static int upgrading; /* whether the upgrader is busy */
+static int upgrade_waiters;
+static int upgrader_started, upgrader_terminating;
+
+/* call with the upgrade lock held */
+static void wake_upgrade_waiters(void)
+{
+     if (!upgrades && !upgrading)
+	  for ( ; upgrade_waiters > 0; --upgrade_waiters)
+	       os_sem_up(&upgrade_idle_semaphore);
+}
+
+static FFTW_WORKER upgrader(void *arg)
+{
+     UNUSED(arg);
+
+     for (;;) {
+	  upgrade *u;
+	  int cancelled;
+
+	  os_sem_down(&upgrade_semaphore);
+	  os_mutex_lock(&upgrade_lock);
+	  if (upgrader_terminating) {
+	       os_mutex_unlock(&upgrade_lock);
+	       break;
+	  }
+	  /* the semaphore also counts upgrades cancelled since */
+	  if ((u = upgrades)) {
+	       if (!(upgrades = u->next))
+		    upgrades_tail = &upgrades;
+	       u->state = UPGRADE_RUNNING;
+	       upgrading = 1;
+	  }
+	  os_mutex_unlock(&upgrade_lock);
+	  if (!u)
+	       continue;
+
+	  X(upgrade_plan)(u);
+
+	  os_mutex_lock(&upgrade_lock);
+	  u->state = UPGRADE_DONE;
+	  if (!(cancelled = u->cancelled))
+	       X(upgrade_install)(u);
+	  os_mutex_unlock(&upgrade_lock);
+
+	  if (cancelled)
+	       X(destroy_plan)(u->p);
+
+	  os_mutex_lock(&upgrade_lock);
+	  upgrading = 0;
+	  wake_upgrade_waiters();
+	  os_mutex_unlock(&upgrade_lock);
+     }
+
+     X(scratch_release)();
+
+     /* termination protocol */
+     os_sem_up(&upgrader_termination_semaphore);
+
+     os_destroy_thread();
+     /* UNREACHABLE */
+     return 0;
+}
+
+static void upgrade_start(upgrade *u)
+{
+     /* the program may plan while the upgrader does */
+     X(threads_register_planner_hooks)();
+
+     os_mutex_lock(&upgrade_lock);
+     if (!upgrader_started) {
+	  os_create_thread(upgrader, 0);
+	  upgrader_started = 1;
+     }
+     u->state = UPGRADE_QUEUED;
+     u->cancelled = 0;
+     u->next = 0;
+     *upgrades_tail = u;
+     upgrades_tail = &u->next;
+     os_mutex_unlock(&upgrade_lock);
+
+     os_sem_up(&upgrade_semaphore);
+}
+
+static int upgrade_cancel(upgrade *u)
+{
+     int ret = 1;
+
+     os_mutex_lock(&upgrade_lock);
+     if (u->state == UPGRADE_QUEUED) {
+	  upgrade **up;
+	  for (up = &upgrades; *up != u; up = &(*up)->next)
+	       ;
+	  if (!(*up = u->next))
+	       upgrades_tail = up;
+	  u->state = UPGRADE_DONE;
+	  wake_upgrade_waiters();
+     } else if (u->state == UPGRADE_RUNNING) {
+	  u->cancelled = 1;
+	  ret = 0;
+     }
+     os_mutex_unlock(&upgrade_lock);
+
+     return ret;
+}
+
+static void upgrade_wait(void)
+{
+     os_mutex_lock(&upgrade_lock);
+     while (upgrades || upgrading) {
+	  ++upgrade_waiters;
+	  os_mutex_unlock(&upgrade_lock);
+	  os_sem_down(&upgrade_idle_semaphore);
+	  os_mutex_lock(&upgrade_lock);
+     }
+     os_mutex_unlock(&upgrade_lock);
+}
+
+static void upgrader_init(void)
+{
+     os_mutex_init(&upgrade_lock);
+     os_sem_init(&upgrade_semaphore);
+     os_sem_init(&upgrade_idle_semaphore);
+     os_sem_init(&upgrader_termination_semaphore);
+     upgrades = 0;
+     upgrades_tail = &upgrades;
+     upgrading = upgrade_waiters = 0;
+     upgrader_started = upgrader_terminating = 0;
+#if HAVE_ATOMICS
+     /* without atomics, executing could see a half-installed plan */
+     X(upgrade_start_hook) = upgrade_start;
+     X(upgrade_cancel_hook) = upgrade_cancel;
+     X(upgrade_wait_hook) = upgrade_wait;
+#endif
+}
+
+/* X(cleanup) waited for the upgrader, so no plans are left to upgrade
+   (any still queued are dropped, and keep the plans they have) */
+static void upgrader_cleanup(void)
+{
+     X(upgrade_start_hook) = 0;
+     X(upgrade_cancel_hook) = 0;
+     X(upgrade_wait_hook) = 0;
+
+     if (upgrader_started) {
+	  os_mutex_lock(&upgrade_lock);
+	  upgrader_terminating = 1;
+	  os_mutex_unlock(&upgrade_lock);
+	  os_sem_up(&upgrade_semaphore);
+	  os_sem_down(&upgrader_termination_semaphore);
+     }
+
+     os_mutex_destroy(&upgrade_lock);
+     os_sem_destroy(&upgrade_semaphore);
+     os_sem_destroy(&upgrade_idle_semaphore);
+     os_sem_destroy(&upgrader_termination_semaphore);
+}
+
 static os_static_mutex_t initialization_mutex = OS_STATIC_MUTEX_INITIALIZER;
 
+/* scratch memory (see kernel/scratch.c) of threads other than ours,
+   released when they exit: the key only serves to get
+   release_scratch() called */
+static os_tls_t scratch_key;
+
+static void release_scratch(void *k)
+{
+     UNUSED(k);
+     X(scratch_release)();
+}
+
+static void mark_scratch(void)
+{
+     os_tls_set(&scratch_key, &scratch_key);
+}
+
 int X(ithreads_init)(void)
 {
      os_static_mutex_lock(&initialization_mutex); {
           os_mutex_init(&queue_lock);
           os_sem_init(&termination_semaphore);
+	  os_sem_init(&idle_semaphore);
+	  os_tls_init(&current_deque, 0);
+	  os_tls_init(&scratch_key, release_scratch);
+	  X(scratch_hook) = mark_scratch;
+	  upgrader_init();
 
           WITH_QUEUE_LOCK({
-               worker_queue = 0;
+               ndeques = nworkers = 0;
+	       sleepers = 0;
+	       terminating = 0;
           });
+
+	  /* spinning only gets in the way when there is nobody
+	     else to run the thread we are waiting for */
+	  if (ATOMIC_LOAD(&spin_usec) < 0)
+	       ATOMIC_STORE(&spin_usec, os_ncpus() > 1 ? DEFAULT_SPIN : 0);
+#ifdef HAVE_AFFINITY
+	  os_affinity_init();
+#endif
      } os_static_mutex_unlock(&initialization_mutex);
 
      return 0; /* no error */
 }
 
+void X(ithreads_set_spin)(int usec)
+{
+     if (usec < 0)
+	  usec = os_ncpus() > 1 ? DEFAULT_SPIN : 0;
+     ATOMIC_STORE(&spin_usec, usec);
+}
+
+#ifdef HAVE_AFFINITY
+static int node_order(int a, int b)
+{
+     return placement_node[a] != placement_node[b]
+	  ? placement_node[a] - placement_node[b] : placement[a] - placement[b];
+}
+
+/* sort the placement by node and then CPU, with an insertion sort as
+   there are few CPUs */
+static void sort_placement(void)
+{
+     int i, j;
+     for (i = 1; i < nplacement; ++i)
+	  for (j = i; j > 0 && node_order(j - 1, j) > 0; --j) {
+	       int c = placement[j], nd = placement_node[j];
+	       placement[j] = placement[j - 1];
+	       placement_node[j] = placement_node[j - 1];
+	       placement[j - 1] = c;
+	       placement_node[j - 1] = nd;
+	  }
+}
+
+/* after sorting: take one CPU of each node in turn */
+static void scatter_placement(void)
+{
+     int c[MAX_PLACEMENT], nd[MAX_PLACEMENT], taken[MAX_PLACEMENT];
+     int i, n = 0;
+
+     for (i = 0; i < nplacement; ++i) taken[i] = 0;
+     while (n < nplacement) {
+	  int last = -1;
+	  for (i = 0; i < nplacement; ++i)
+	       if (!taken[i] && placement_node[i] != last) {
+		    c[n] = placement[i];
+		    nd[n] = placement_node[i];
+		    ++n;
+		    taken[i] = 1;
+		    last = placement_node[i];
+	       }
+     }
+     for (i = 0; i < nplacement; ++i) {
+	  placement[i] = c[i];
+	  placement_node[i] = nd[i];
+     }
+}
+#endif
+
+/* Pins the workers according to POLICY, to the NCPUS CPUS, or to all
+   of the CPUs the process may use if CPUS is NULL.  Returns 0 if
+   pinning isn't supported here. */
+int X(ithreads_set_affinity)(int policy, const int *cpus, int ncpus)
+{
+#ifdef HAVE_AFFINITY
+     int i, k;
+
+     if (policy != FFTW_AFFINITY_NONE && policy != FFTW_AFFINITY_COMPACT
+	 && policy != FFTW_AFFINITY_SCATTER && policy != FFTW_AFFINITY_EXPLICIT)
+	  return 0;
+     if (policy == FFTW_AFFINITY_EXPLICIT && (!cpus || ncpus <= 0))
+	  return 0;
+
+     WITH_QUEUE_LOCK({
+	  nplacement = 0;
+	  if (policy != FFTW_AFFINITY_NONE) {
+	       if (cpus) {
+		    for (i = 0; i < ncpus && i < MAX_PLACEMENT; ++i)
+			 placement[i] = cpus[i];
+		    nplacement = i;
+	       } else
+		    nplacement = os_cpus(placement, MAX_PLACEMENT);
+
+	       for (i = 0; i < nplacement; ++i)
+		    placement_node[i] = os_cpu_node(placement[i]);
+	       if (policy == FFTW_AFFINITY_COMPACT)
+		    sort_placement();
+	       else if (policy == FFTW_AFFINITY_SCATTER) {
+		    sort_placement();
+		    scatter_placement();
+	       }
+	  }
+
+	  for (k = 0; k < nworkers; ++k)
+	       place(k);
+	  os_atomic_store(&locality, nplacement > 0);
+	  os_atomic_add(&affinity_gen, 1);
+     });
+
+     /* have the parked workers pin themselves right away */
+     notify(os_atomic_load(&nworkers));
+     return 1;
+#else
+     UNUSED(cpus);
+     UNUSED(ncpus);
+     return policy == FFTW_AFFINITY_NONE;
+#endif
+}
+
 /* Distribute a loop from 0 to loopmax-1 over nthreads threads.
    proc(d) is called to execute a block of iterations from d->min
    to d->max-1.  d->thr_num indicate the number of the thread
@@ -404,6 +1295,7 @@ void X(spawn_loop)(int loopmax, int nthr, spawn_function proc, void *data)
      A(loopmax >= 0);
      A(nthr > 0);
      A(proc);
+     REALTIME_CHECK("spawning threads");
 
      if (!loopmax) return;
 
@@ -430,39 +1322,72 @@ void X(spawn_loop)(int loopmax, int nthr, spawn_function proc, void *data)
           STACK_FREE(sdata);
      }
      else {
-          struct work *r;
-          STACK_MALLOC(struct work *, r, sizeof(struct work) * nthr);
+          struct task *r;
+	  struct join j;
+	  struct deque *q = (struct deque *)os_tls_get(&current_deque);
+	  int borrowed = 0;
+
+	  if (!q && nthr > 1) {
+	       /* outermost loop of a thread outside of the pool */
+	       if ((q = borrow_deque())) {
+		    os_tls_set(&current_deque, q);
+		    borrowed = 1;
+	       }
+	  }
+
+          STACK_MALLOC(struct task *, r, sizeof(struct task) * nthr);
 
           /* distribute work: */
+	  j.pending = 0;
+	  j.done = q ? &q->join : 0;
           for (i = 0; i < nthr; ++i) {
-               struct work *w = &r[i];
-               spawn_data *d = &w->d;
+               struct task *t = &r[i];
+               spawn_data *d = &t->d;
 
                d->max = (d->min = i * block_size) + block_size;
                if (d->max > loopmax)
                     d->max = loopmax;
                d->thr_num = i;
                d->data = data;
-               w->proc = proc;
-
-               if (i == nthr - 1) {
-                    /* do the work ourselves */
-                    proc(d);
-               } else {
-                    /* assign a worker to W */
-                    w->q = dequeue();
-
-                    /* tell worker w->q to do it */
-                    w->q->w = w; /* Dirac could have written this */
-                    os_sem_up(&w->q->ready);
-               }
-          }
+               t->proc = proc;
+	       t->j = &j;
+	       t->mailed_to = 0;
+	  }
 
-          for (i = 0; i < nthr - 1; ++i) {
-               struct work *w = &r[i];
-               os_sem_down(&w->q->done);
-               enqueue(w->q);
-          }
+	  if (q && nthr > 1) {
+	       int mail;
+
+	       hire(nthr - 1);
+	       mail = os_atomic_load(&locality) ? os_atomic_load(&nworkers) : 0;
+	       j.pending = nthr - 1;
+	       for (i = 1; i < nthr; ++i) {
+		    struct task *t = &r[i];
+		    if (mail) {
+			 struct deque *w = pool[(i - 1) % mail];
+			 if (w != q && os_atomic_cas_ptr((void **)&w->mailbox, 0, t)) {
+			      t->mailed_to = w;
+			      continue;
+			 }
+		    }
+		    /* the last block gets stolen first */
+		    if (!deque_push(q, t))
+			 run(t);
+	       }
+	       notify(nthr - 1);
+
+	       /* do the first block ourselves, then help with the rest */
+	       proc(&r[0].d);
+	       join(q, &j, r + 1, nthr - 1);
+	  } else {
+	       /* a single block, or out of deques so nobody can help */
+	       for (i = 0; i < nthr; ++i)
+		    proc(&r[i].d);
+	  }
+
+	  if (borrowed) {
+	       os_tls_set(&current_deque, 0);
+	       return_deque(q);
+	  }
 
           STACK_FREE(r);
      }
@@ -470,9 +1395,14 @@ void X(spawn_loop)(int loopmax, int nthr, spawn_function proc, void *data)
 
 void X(threads_cleanup)(void)
 {
+     upgrader_cleanup();
      kill_workforce();
      os_mutex_destroy(&queue_lock);
      os_sem_destroy(&termination_semaphore);
+     os_sem_destroy(&idle_semaphore);
+     os_tls_destroy(&current_deque);
+     X(scratch_hook) = 0;
+     os_tls_destroy(&scratch_key);
 }
 
 static os_static_mutex_t install_planner_hooks_mutex = OS_STATIC_MUTEX_INITIALIZER;
@@ -489,12 +1419,108 @@ static void unlock_planner_mutex(void)
      os_mutex_unlock(&planner_mutex);
 }
 
+/* Concurrent planning: every thread plans with its own sibling of
+   the_planner (see X(mkplanner_sibling)), and the planner mutex only
+   guards the data they share, while they change it. */
+struct thread_planner {
+     planner *plnr; /* 0 until the thread plans, and after X(cleanup) */
+     struct thread_planner *next;
+};
+
+static os_tls_t thread_planner_key;
+static struct thread_planner *thread_planners = 0;
+
+static planner *get_thread_planner(void)
+{
+     struct thread_planner *t =
+	  (struct thread_planner *) os_tls_get(&thread_planner_key);
+     planner *plnr, *p;
+
+     os_mutex_lock(&planner_mutex); {
+	  plnr = X(the_planner)();
+
+	  if (!t) {
+	       t = (struct thread_planner *)
+		    MALLOC(sizeof(struct thread_planner), OTHER);
+	       t->plnr = 0;
+	       t->next = thread_planners;
+	       thread_planners = t;
+	       os_tls_set(&thread_planner_key, t);
+	  }
+
+	  /* make a new sibling if the_planner got more solvers */
+	  if (t->plnr && t->plnr->nslvdesc != plnr->nslvdesc) {
+	       X(planner_destroy)(t->plnr);
+	       t->plnr = 0;
+	  }
+	  if (!t->plnr)
+	       t->plnr = X(mkplanner_sibling)(plnr);
+
+	  /* settings made through the API go to the_planner */
+	  p = t->plnr;
+	  p->nthr = plnr->nthr;
+	  p->timelimit = plnr->timelimit;
+	  p->hook = plnr->hook;
+	  p->cost_hook = plnr->cost_hook;
+	  p->wisdom_ok_hook = plnr->wisdom_ok_hook;
+	  p->nowisdom_hook = plnr->nowisdom_hook;
+	  p->bogosity_hook = plnr->bogosity_hook;
+     } os_mutex_unlock(&planner_mutex);
+
+     return p;
+}
+
+static void unlink_thread_planner(struct thread_planner *t)
+{
+     struct thread_planner **tp;
+
+     for (tp = &thread_planners; *tp != t; tp = &(*tp)->next)
+	  ;
+     *tp = t->next;
+}
+
+/* thread exit */
+static void destroy_thread_planner(void *t_)
+{
+     struct thread_planner *t = (struct thread_planner *) t_;
+
+     os_mutex_lock(&planner_mutex); {
+	  unlink_thread_planner(t);
+	  if (t->plnr)
+	       X(planner_destroy)(t->plnr);
+     } os_mutex_unlock(&planner_mutex);
+     X(ifree)(t);
+}
+
+static void forget_thread_planners(void)
+{
+     struct thread_planner *t;
+
+     os_mutex_lock(&planner_mutex); {
+	  for (t = thread_planners; t; t = t->next) {
+	       if (t->plnr)
+		    X(planner_destroy)(t->plnr);
+	       t->plnr = 0;
+	  }
+     } os_mutex_unlock(&planner_mutex);
+}
+
 void X(threads_register_planner_hooks)(void)
 {
      os_static_mutex_lock(&install_planner_hooks_mutex); {
           if (!planner_hooks_installed) {
                os_mutex_init(&planner_mutex);
+#if HAVE_ATOMICS
+	       os_tls_init(&thread_planner_key, destroy_thread_planner);
+	       X(lock_hook) = lock_planner_mutex;
+	       X(unlock_hook) = unlock_planner_mutex;
+	       X(set_thread_planner_hooks)(get_thread_planner,
+					   forget_thread_planners);
+#else
+	       /* siblings cannot read wisdom without locking, so
+		  serialize all planning instead */
                X(set_planner_hooks)(lock_planner_mutex, unlock_planner_mutex);
+#endif
                planner_hooks_installed = 1;
           }
      } os_static_mutex_unlock(&install_planner_hooks_mutex);
@@ -35,6 +35,8 @@ typedef void *(*spawn_function) (spawn_data *);
 void X(spawn_loop)(int loopmax, int nthreads,
 		   spawn_function proc, void *data);
 int X(ithreads_init)(void);
+void X(ithreads_set_spin)(int usec);
+int X(ithreads_set_affinity)(int policy, const int *cpus, int ncpus);
 void X(threads_cleanup)(void);
 
 typedef void (*spawnloop_function)(spawn_function, spawn_data *, size_t, int, void *);
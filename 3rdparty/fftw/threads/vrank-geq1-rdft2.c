@@ -52,6 +52,7 @@ static void *spawn_apply(spawn_data *d)
      int thr_num = d->thr_num;
      plan_rdft2 *cld = (plan_rdft2 *) ego->cldrn[d->thr_num];
 
+     X(scratch_reserve)(cld->super.workspace);
      cld->apply((plan *) cld,
 		ego->r0 + thr_num * its, ego->r1 + thr_num * its,
 		ego->cr + thr_num * ots, ego->ci + thr_num * ots);
@@ -116,6 +117,7 @@ static int applicable0(const solver *ego_, const problem *p_,
      if (FINITE_RNK(p->vecsz->rnk)
 	 && p->vecsz->rnk > 0
 	 && plnr->nthr > 1
+	 && !REALTIMEP(plnr) /* spawning threads blocks */
 	 && pickdim(ego, p->vecsz, p->r0 != p->cr, dp)) {
 	  if (p->r0 != p->cr)
 	       return 1;  /* can always operate out-of-place */
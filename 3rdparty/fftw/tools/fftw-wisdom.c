@@ -87,6 +87,8 @@ static struct my_option options[] =
 
   {"no-system-wisdom", NOARG, 'n'},
   {"wisdom-file", REQARG, 'w'},
+  {"binary-file", REQARG, 'B'},
+  {"binary", NOARG, 'b'},
 
 #ifdef HAVE_SMP
   {"threads", REQARG, 'T'},
@@ -116,6 +118,8 @@ static void help(FILE *f, const char *program_name)
  "             -x, --exhaustive: plan in EXHAUSTIVE mode (may be slow)\n"
  "       -n, --no-system-wisdom: don't read /etc/fftw/ system wisdom file\n"
  "  -w FILE, --wisdom-file=FILE: read wisdom from FILE (stdin if -)\n"
+ "  -B FILE, --binary-file=FILE: read binary wisdom from FILE\n"
+ "                 -b, --binary: output binary wisdom (needs -o FILE)\n"
 #ifdef HAVE_SMP
  "            -T N, --threads=N: plan with N threads\n"
 #endif
@@ -154,6 +158,7 @@ int bench_main(int argc, char *argv[])
      int impatient = 0;
      int system_wisdom = 1;
      int canonical = 0;
+     int binary = 0;
      double hours = 0;
      FILE *output_file;
      char *output_fname = 0;
@@ -262,6 +267,18 @@ int bench_main(int argc, char *argv[])
 		   break;
 	      }
 
+	      case 'B':
+		   if (!FFTW(import_wisdom_from_binary_filename)(my_optarg)) {
+			fprintf(stderr, "fftw_wisdom: error reading binary "
+				"wisdom from \"%s\"\n", my_optarg);
+			exit(EXIT_FAILURE);
+		   }
+		   break;
+
+	      case 'b':
+		   binary = 1;
+		   break;
+
 #ifdef HAVE_SMP
 	      case 'T':
 		   nthreads = atoi(my_optarg);
@@ -324,7 +341,12 @@ int bench_main(int argc, char *argv[])
      nproblems = iproblem;
      qsort(problems, nproblems, sizeof(bench_problem *), prob_size_cmp);
 
-     if (!output_fname)
+     if (binary && !output_fname) {
+	  fprintf(stderr, "fftw-wisdom: binary wisdom requires -o FILE\n");
+	  exit(EXIT_FAILURE);
+     }
+
+     if (!output_fname || binary)
 	  output_file = stdout;
      else
 	  if (!(output_file = fopen(output_fname, "w"))) {
@@ -348,7 +370,14 @@ int bench_main(int argc, char *argv[])
 	 && hours < (time((time_t*)0) - begin) / 3600.0)
 	  fprintf(stderr, "EXCEEDED TIME LIMIT OF %g HOURS.\n", hours);
 
-     FFTW(export_wisdom_to_file)(output_file);
+     if (binary) {
+	  if (!FFTW(export_wisdom_to_binary_filename)(output_fname)) {
+	       fprintf(stderr, "fftw-wisdom: error writing \"%s\"\n",
+		       output_fname);
+	       exit(EXIT_FAILURE);
+	  }
+     } else
+	  FFTW(export_wisdom_to_file)(output_file);
      if (output_file != stdout)
 	  fclose(output_file);
      if (output_fname)
@@ -0,0 +1,428 @@
+/*! \file analysis.c
+ *  \brief Audio input buffering and spectrum analysis.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "analysis.h"
+#include "common.h"
+#include "resampler.h"
+#include <libsuperderpy.h>
+#include <math.h>
+
+static void CopyLatest(const float* ring, int ring_size, int ringpos, float* dst, int n) {
+	int end = ringpos - n;
+	if (end < 0) {
+		end += ring_size;
+	}
+	int first = MIN(n, ring_size - end);
+	memcpy(dst, ring + end, first * sizeof(float));
+	memcpy(dst + first, ring, (n - first) * sizeof(float));
+}
+
+static void InitTransform(struct Analysis* a, struct AnalysisLevel* level, int size, float step) {
+	level->size = size;
+	level->step = step;
+	level->window = CreateHanningWindow(size, false);
+	level->in_stride = (size + 3) & ~3;
+	level->out_stride = (size / 2 + 2) & ~1;
+	level->in = fftw_malloc(sizeof(double) * level->in_stride * a->channels);
+	level->out = fftw_malloc(sizeof(fftw_complex) * level->out_stride * a->channels);
+	level->plan = fftw_plan_many_dft_r2c(1, &size, a->channels, level->in, NULL, 1, level->in_stride, level->out, NULL, 1, level->out_stride, FFTW_ESTIMATE);
+	level->single = fftw_plan_dft_r2c_1d(size, level->in, level->out, FFTW_ESTIMATE);
+	level->magnitude = calloc((size / 2 + 1) * a->channels, sizeof(float));
+}
+
+static void SwapTransform(struct AnalysisLevel* a, struct AnalysisLevel* b) {
+	struct AnalysisLevel tmp = *a;
+	a->size = b->size;
+	a->step = b->step;
+	a->window = b->window;
+	a->in = b->in;
+	a->out = b->out;
+	a->in_stride = b->in_stride;
+	a->out_stride = b->out_stride;
+	a->plan = b->plan;
+	a->single = b->single;
+	a->magnitude = b->magnitude;
+
+	b->size = tmp.size;
+	b->step = tmp.step;
+	b->window = tmp.window;
+	b->in = tmp.in;
+	b->out = tmp.out;
+	b->in_stride = tmp.in_stride;
+	b->out_stride = tmp.out_stride;
+	b->plan = tmp.plan;
+	b->single = tmp.single;
+	b->magnitude = tmp.magnitude;
+}
+
+static void DestroyTransform(struct AnalysisLevel* level) {
+	fftw_destroy_plan(level->plan);
+	fftw_destroy_plan(level->single);
+	fftw_free(level->in);
+	fftw_free(level->out);
+	free(level->window);
+	free(level->magnitude);
+}
+
+// Smallest FFT size AnalysisSetResolution can go down to.
+static int MinSize(struct Analysis* a) {
+	// multi-resolution levels have to fit at least two octaves of q bins
+	return a->multires ? MAX(ANALYSIS_MIN_FFT_SIZE, 4 * a->q) : ANALYSIS_MIN_FFT_SIZE;
+}
+
+// `window` is the FFT size the caller would use at ANALYSIS_REFERENCE_RATE.
+// The actual size gets scaled with the analysis rate, so both the covered time span
+// and the width of each frequency bin stay the same regardless of the rate.
+// With more than one channel, each input channel gets its own spectrum.
+struct Analysis* CreateAnalysis(struct Game* game, int device_rate, int window, int channels) {
+	struct Analysis* a = calloc(1, sizeof(struct Analysis));
+
+	char def[16];
+	snprintf(def, sizeof(def), "%d", ANALYSIS_DEFAULT_RATE);
+	a->rate = strtol(GetConfigOptionDefault(game, "analysis", "rate", def), NULL, 10);
+	if (a->rate <= 0 || a->rate > device_rate) {
+		a->rate = device_rate;
+	}
+	a->device_rate = device_rate;
+	a->fft_size = (int)((long)window * a->rate / ANALYSIS_REFERENCE_RATE);
+	a->channels = MAX(1, MIN(channels, ANALYSIS_MAX_CHANNELS));
+
+	a->ring_size = a->rate;
+	a->ringbuffer = calloc(a->ring_size * a->channels, sizeof(float));
+	a->fftbuffer = calloc(a->fft_size * a->channels, sizeof(float));
+	for (int c = 0; c < a->channels; c++) {
+		a->resampler[c] = CreateResampler(device_rate, a->rate, ANALYSIS_RESAMPLER_TAPS);
+	}
+	a->mutex = al_create_mutex();
+
+	snprintf(def, sizeof(def), "%d", ANALYSIS_DEFAULT_Q);
+	a->q = strtol(GetConfigOptionDefault(game, "analysis", "q", def), NULL, 10);
+	a->multires = strcmp(GetConfigOptionDefault(game, "analysis", "mode", "single"), "multires") == 0 && a->q > 0;
+
+	// Each level needs at least 8 * q bins, so its upper octave stays well within the passband
+	// of the next decimator.
+	a->num_levels = 1;
+	if (a->multires) {
+		while ((a->fft_size >> a->num_levels) >= 8 * a->q) {
+			a->num_levels++;
+		}
+	}
+	if (a->num_levels == 1) {
+		a->multires = false;
+	}
+
+	a->levels = calloc(a->num_levels, sizeof(struct AnalysisLevel));
+	int size = a->fft_size >> (a->num_levels - 1);
+	for (int l = 0; l < a->num_levels; l++) {
+		struct AnalysisLevel* level = &a->levels[l];
+		InitTransform(a, level, size, a->fft_size / (float)(size << l));
+		if (l == 0) {
+			level->ringbuffer = a->ringbuffer;
+			level->ring_size = a->ring_size;
+		} else {
+			level->ring_size = a->ring_size >> l;
+			level->ringbuffer = calloc(level->ring_size * a->channels, sizeof(float));
+			for (int c = 0; c < a->channels; c++) {
+				level->decimator[c] = CreateResampler(2, 1, ANALYSIS_DECIMATOR_TAPS);
+			}
+		}
+		if (a->multires) {
+			level->buffer = calloc(size * a->channels, sizeof(float));
+			level->buffer_stride = size;
+		} else {
+			level->buffer = a->fftbuffer;
+			level->buffer_stride = a->fft_size;
+		}
+	}
+	a->spectrum = calloc((a->fft_size / 2 + 1) * a->channels, sizeof(float));
+
+	// In realtime mode, the transforms for every resolution get prepared up front,
+	// so changing it later doesn't have to allocate or plan anything.
+	a->realtime = strtol(GetConfigOptionDefault(game, "analysis", "realtime", "0"), NULL, 10);
+	if (a->realtime) {
+		while ((size >> (a->max_shift + 1)) >= MinSize(a)) {
+			a->max_shift++;
+		}
+		a->resolutions = calloc((a->max_shift + 1) * a->num_levels, sizeof(struct AnalysisLevel));
+		for (int shift = 1; shift <= a->max_shift; shift++) {
+			for (int l = 0; l < a->num_levels; l++) {
+				InitTransform(a, &a->resolutions[shift * a->num_levels + l], size >> shift, a->fft_size / (float)((size >> shift) << l));
+			}
+		}
+	}
+
+	PrintConsole(game, "Analysis: %d Hz -> %d Hz, FFT size %d, %d channel(s)", device_rate, a->rate, a->fft_size, a->channels);
+	if (a->multires) {
+		PrintConsole(game, "Analysis: multi-resolution, %d levels of %d samples", a->num_levels, size);
+	}
+	return a;
+}
+
+// Pushes freshly written samples of the previous level through the decimator.
+static int FeedLevel(struct AnalysisLevel* level, const struct AnalysisLevel* prev, int channel, int start, int count, int* pos) {
+	const float* src = prev->ringbuffer + channel * prev->ring_size;
+	float* dst = level->ringbuffer + channel * level->ring_size;
+	int first = MIN(count, prev->ring_size - start);
+	int written = Resample(level->decimator[channel], src + start, first, 1, 0, dst, level->ring_size, pos);
+	written += Resample(level->decimator[channel], src, count - first, 1, 0, dst, level->ring_size, pos);
+	return written;
+}
+
+// When downmixing a stereo input with just one microphone plugged in, use only the
+// channel that has anything in it instead of letting the silent one halve the signal.
+static int PickInputChannel(const float* buffer, unsigned int samples) {
+	float peak[2] = {0, 0};
+	for (unsigned int i = 0; i < samples * 2; i++) {
+		peak[i % 2] = MAX(peak[i % 2], fabsf(buffer[i]));
+	}
+	if (peak[0] < ANALYSIS_SILENCE && peak[1] >= ANALYSIS_SILENCE) {
+		return 1;
+	}
+	if (peak[1] < ANALYSIS_SILENCE && peak[0] >= ANALYSIS_SILENCE) {
+		return 0;
+	}
+	return -1;
+}
+
+// Called from the mixer thread or the capture thread.
+// REMEMBER: don't use any drawing code inside this function
+// In realtime mode nothing gets locked. New positions are published only after the samples
+// before them are written, and the ring buffers are much longer than the windows, so
+// the writer never gets to the part that's being copied out in AnalysisGetWindow.
+void AnalysisFeed(struct Analysis* a, const float* buffer, unsigned int samples, int channels) {
+	if (!a->realtime) {
+		// critical section: don't use ringbuffer behind our back, as it's getting rewritten
+		al_lock_mutex(a->mutex);
+	}
+
+	int source = -1;
+	if (a->channels == 1 && channels == 2) {
+		source = PickInputChannel(buffer, samples);
+	}
+
+	// all channels get converted in lockstep, so they all advance by the same count
+	int start = a->ringpos, count = 0, end = start;
+	for (int c = 0; c < a->channels; c++) {
+		end = start;
+		int channel = (a->channels == 1) ? source : MIN(c, channels - 1);
+		count = Resample(a->resampler[c], buffer, samples, channels, channel, a->ringbuffer + c * a->ring_size, a->ring_size, &end);
+	}
+
+	for (int l = 1; l < a->num_levels; l++) {
+		struct AnalysisLevel* level = &a->levels[l];
+		int next = level->ringpos, pos = next, written = 0;
+		for (int c = 0; c < a->channels; c++) {
+			pos = next;
+			written = FeedLevel(level, &a->levels[l - 1], c, start, count, &pos);
+		}
+		__atomic_store_n(&level->ringpos, pos, __ATOMIC_RELEASE);
+		count = written;
+		start = next;
+	}
+
+	double now = al_get_time(); // vDSO, no syscall
+	__atomic_store(&a->fed, &now, __ATOMIC_RELAXED);
+	__atomic_store_n(&a->levels[0].ringpos, end, __ATOMIC_RELEASE);
+	__atomic_store_n(&a->ringpos, end, __ATOMIC_RELEASE);
+
+	if (!a->realtime) {
+		al_unlock_mutex(a->mutex);
+	}
+}
+
+// Takes a snapshot of the most recent fft_size samples (and of each level's window
+// in multi-resolution mode) for AnalysisSpectrum to work on. Channels are laid out
+// one after another, fft_size samples apart.
+float* AnalysisGetWindow(struct Analysis* a) {
+	if (!a->realtime) {
+		al_lock_mutex(a->mutex);
+	}
+	int ringpos = __atomic_load_n(&a->ringpos, __ATOMIC_ACQUIRE);
+	for (int c = 0; c < a->channels; c++) {
+		CopyLatest(a->ringbuffer + c * a->ring_size, a->ring_size, ringpos, a->fftbuffer + c * a->fft_size, a->fft_size);
+	}
+	__atomic_load(&a->fed, &a->window_fed, __ATOMIC_RELAXED);
+	if (a->multires) {
+		for (int l = 0; l < a->num_levels; l++) {
+			struct AnalysisLevel* level = &a->levels[l];
+			int pos = __atomic_load_n(&level->ringpos, __ATOMIC_ACQUIRE);
+			for (int c = 0; c < a->channels; c++) {
+				CopyLatest(level->ringbuffer + c * level->ring_size, level->ring_size, pos, level->buffer + c * level->buffer_stride, level->size);
+			}
+		}
+	}
+	if (!a->realtime) {
+		al_unlock_mutex(a->mutex);
+	}
+
+	for (int c = 0; c < a->channels; c++) {
+		float peak = 0;
+		const float* buf = a->fftbuffer + c * a->fft_size;
+		for (int i = 0; i < a->fft_size; i++) {
+			peak = MAX(peak, fabsf(buf[i]));
+		}
+		a->silent[c] = peak < ANALYSIS_SILENCE;
+	}
+	return a->fftbuffer;
+}
+
+// The latest samples of a channel that the given level transforms, as of the last
+// AnalysisGetWindow; there are as many as the level's size.
+const float* AnalysisLevelWindow(struct Analysis* a, int l, int c) {
+	struct AnalysisLevel* level = &a->levels[l];
+	return level->buffer + c * level->buffer_stride + (a->multires ? 0 : a->fft_size - level->size);
+}
+
+static void TransformLevel(struct Analysis* a, int l) {
+	struct AnalysisLevel* level = &a->levels[l];
+	int active = 0;
+	for (int c = 0; c < a->channels; c++) {
+		if (a->silent[c]) {
+			memset(level->magnitude + c * (level->size / 2 + 1), 0, (level->size / 2 + 1) * sizeof(float));
+			continue;
+		}
+		const float* buf = AnalysisLevelWindow(a, l, c);
+		double* in = level->in + c * level->in_stride;
+		for (int i = 0; i < level->size; i++) {
+			in[i] = buf[i] * level->window[i];
+		}
+		active++;
+	}
+
+	if (active == a->channels) {
+		fftw_execute(level->plan);
+	} else {
+		// the strides keep every channel aligned the same way as the first one,
+		// so the single channel plan can be reused for any of them
+		for (int c = 0; c < a->channels; c++) {
+			if (!a->silent[c]) {
+				fftw_execute_dft_r2c(level->single, level->in + c * level->in_stride, level->out + c * level->out_stride);
+			}
+		}
+	}
+
+	for (int c = 0; c < a->channels; c++) {
+		if (a->silent[c]) {
+			continue;
+		}
+		const fftw_complex* out = level->out + c * level->out_stride;
+		float* magnitude = level->magnitude + c * (level->size / 2 + 1);
+		for (int i = 0; i < level->size / 2 + 1; i++) {
+			double re = out[i][0] / level->size, im = out[i][1] / level->size;
+			magnitude[i] = sqrt(re * re + im * im);
+		}
+	}
+}
+
+// Magnitude spectrum of the last window taken with AnalysisGetWindow, fft_size / 2 + 1
+// bins per channel. Silent channels aren't transformed at all and come out as zeros.
+// In multi-resolution mode every bin is taken from the shortest window that still
+// resolves at least `q` bins below it. Whenever a level is coarser than the full size
+// FFT, its output gets interpolated to the full size bin grid.
+float* AnalysisSpectrum(struct Analysis* a) {
+	for (int l = 0; l < a->num_levels; l++) {
+		TransformLevel(a, l);
+	}
+
+	if (a->num_levels == 1 && a->levels[0].step == 1) {
+		return a->levels[0].magnitude;
+	}
+
+	for (int c = 0; c < a->channels; c++) {
+		float* spectrum = a->spectrum + c * (a->fft_size / 2 + 1);
+		int l = a->num_levels - 1;
+		for (int i = 0; i < a->fft_size / 2 + 1; i++) {
+			while (l > 0 && i >= a->q * a->levels[l - 1].step) {
+				l--;
+			}
+			struct AnalysisLevel* level = &a->levels[l];
+			const float* magnitude = level->magnitude + c * (level->size / 2 + 1);
+			float pos = i / level->step;
+			int j = MIN((int)pos, level->size / 2);
+			int k = MIN(j + 1, level->size / 2);
+			float frac = pos - (int)pos;
+			spectrum[i] = magnitude[j] * (1 - frac) + magnitude[k] * frac;
+		}
+	}
+	return a->spectrum;
+}
+
+// Makes every FFT `shift` times two smaller, trading frequency resolution for speed.
+// The spectrum keeps its size, with bins interpolated from the smaller transforms.
+void AnalysisSetResolution(struct Analysis* a, int shift) {
+	int base = a->fft_size >> (a->num_levels - 1);
+	while ((base >> shift) < MinSize(a) && shift > 0) {
+		shift--;
+	}
+	if (shift == a->shift) {
+		return;
+	}
+
+	if (a->realtime) {
+		// the slot of the current resolution is empty, so the current transforms go there
+		for (int l = 0; l < a->num_levels; l++) {
+			SwapTransform(&a->levels[l], &a->resolutions[shift * a->num_levels + l]);
+			SwapTransform(&a->resolutions[shift * a->num_levels + l], &a->resolutions[a->shift * a->num_levels + l]);
+		}
+		a->shift = shift;
+		return;
+	}
+	a->shift = shift;
+
+	int size = base >> shift;
+	for (int l = 0; l < a->num_levels; l++) {
+		struct AnalysisLevel* level = &a->levels[l];
+		DestroyTransform(level);
+		InitTransform(a, level, size, a->fft_size / (float)(size << l));
+	}
+}
+
+void DestroyAnalysis(struct Analysis* a) {
+	for (int l = 0; l < a->num_levels; l++) {
+		struct AnalysisLevel* level = &a->levels[l];
+		DestroyTransform(level);
+		if (l > 0) {
+			for (int c = 0; c < a->channels; c++) {
+				DestroyResampler(level->decimator[c]);
+			}
+			free(level->ringbuffer);
+		}
+		if (a->multires) {
+			free(level->buffer);
+		}
+	}
+	for (int c = 0; c < a->channels; c++) {
+		DestroyResampler(a->resampler[c]);
+	}
+	if (a->realtime) {
+		for (int i = 0; i < (a->max_shift + 1) * a->num_levels; i++) {
+			if (a->resolutions[i].size) {
+				DestroyTransform(&a->resolutions[i]);
+			}
+		}
+		free(a->resolutions);
+	}
+	free(a->spectrum);
+	free(a->levels);
+	al_destroy_mutex(a->mutex);
+	free(a->ringbuffer);
+	free(a->fftbuffer);
+	free(a);
+}
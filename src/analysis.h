@@ -0,0 +1,102 @@
+/*! \file analysis.h
+ *  \brief Audio input buffering and spectrum analysis.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef WAAAA_ANALYSIS_H
+#define WAAAA_ANALYSIS_H
+
+#include <fftw3.h>
+#include <libsuperderpy.h>
+
+#define ANALYSIS_REFERENCE_RATE 44100 // rate at which the FFT sizes used by gamestates were tuned
+#define ANALYSIS_DEFAULT_RATE 11025
+#define ANALYSIS_RESAMPLER_TAPS 64
+#define ANALYSIS_DECIMATOR_TAPS 32
+#define ANALYSIS_DEFAULT_Q 16 // bins per octave kept by the multi-resolution mode
+#define ANALYSIS_MIN_FFT_SIZE 32
+#define ANALYSIS_MAX_CHANNELS 2
+#define ANALYSIS_SILENCE 0.0001 // peak below which a channel is considered silent (-80 dB)
+
+struct Resampler;
+
+// One FFT in the analysis cascade. In single resolution mode there's just one
+// that covers the whole spectrum; in multi-resolution mode each next level runs
+// on a signal decimated by two, trading time resolution for frequency resolution.
+// All channels are transformed in one batch, laid out one after another.
+struct AnalysisLevel {
+	int size; // FFT size
+	float step; // width of its bins, in bins of the full size FFT
+
+	float* ringbuffer; // ring_size samples per channel
+	int ring_size;
+	int ringpos;
+	struct Resampler* decimator[ANALYSIS_MAX_CHANNELS]; // feeds this level from the previous one, NULL for the first level
+
+	float* buffer; // snapshot of the latest `size` samples of each channel
+	int buffer_stride;
+
+	float* window;
+	double* in;
+	fftw_complex* out;
+	int in_stride, out_stride; // padded, so each channel keeps the alignment of the first one
+	fftw_plan plan; // all channels at once
+	fftw_plan single; // just one, for when some of them are silent
+	float* magnitude; // size / 2 + 1 per channel
+};
+
+struct Analysis {
+	int device_rate; // rate of the audio being fed in
+	int rate; // rate the ring buffer and FFT operate at
+	int fft_size;
+	int channels; // analysed separately; 1 means the input gets downmixed
+
+	float* ringbuffer; // one second of audio per channel
+	int ring_size;
+	int ringpos;
+
+	double fed; // al_get_time() of the last AnalysisFeed
+	double window_fed; // the same, as of the last AnalysisGetWindow
+
+	float* fftbuffer; // the latest fft_size samples of each channel
+	bool silent[ANALYSIS_MAX_CHANNELS]; // whether the last window had nothing in it
+	struct Resampler* resampler[ANALYSIS_MAX_CHANNELS];
+
+	bool multires;
+	int q;
+	int num_levels;
+	struct AnalysisLevel* levels;
+	int shift; // see AnalysisSetResolution
+	float* spectrum; // fft_size / 2 + 1 magnitudes per channel, normalized by the FFT size
+
+	bool realtime; // no locking or allocation after creation, see AnalysisFeed
+	struct AnalysisLevel* resolutions; // spare transforms for each shift up to max_shift, realtime mode only
+	int max_shift;
+
+	ALLEGRO_MUTEX* mutex; // unused in realtime mode
+};
+
+struct Analysis* CreateAnalysis(struct Game* game, int device_rate, int window, int channels);
+void AnalysisFeed(struct Analysis* a, const float* buffer, unsigned int samples, int channels);
+float* AnalysisGetWindow(struct Analysis* a);
+float* AnalysisSpectrum(struct Analysis* a);
+const float* AnalysisLevelWindow(struct Analysis* a, int level, int channel);
+void AnalysisSetResolution(struct Analysis* a, int shift);
+void DestroyAnalysis(struct Analysis* a);
+
+#endif
@@ -0,0 +1,145 @@
+/*! \file atlas.c
+ *  \brief Texture atlas holding static bitmaps and a pre-rasterized font.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "atlas.h"
+#include <libsuperderpy.h>
+
+// Entries are packed on shelves: left to right, starting a new shelf below the
+// tallest entry of the current one once the row is full. That's far from optimal
+// in general, but we only pack a handful of bitmaps once at load time.
+// Everything ends up as sub-bitmaps of a single texture, so they can all be drawn
+// within one deferred drawing batch (see batch.c).
+
+static bool Reserve(struct Atlas* atlas, int w, int h, int* x, int* y) {
+	int pw = w + 2 * ATLAS_PADDING, ph = h + 2 * ATLAS_PADDING;
+	if (atlas->x + pw > atlas->width) {
+		atlas->x = 0;
+		atlas->y += atlas->shelf;
+		atlas->shelf = 0;
+	}
+	if (pw > atlas->width || atlas->y + ph > atlas->height) {
+		return false;
+	}
+	*x = atlas->x + ATLAS_PADDING;
+	*y = atlas->y + ATLAS_PADDING;
+	atlas->x += pw;
+	atlas->shelf = MAX(atlas->shelf, ph);
+	return true;
+}
+
+static void BeginDrawing(struct Atlas* atlas, ALLEGRO_STATE* state) {
+	al_store_state(state, ALLEGRO_STATE_TARGET_BITMAP | ALLEGRO_STATE_BLENDER);
+	al_set_target_bitmap(atlas->bitmap);
+	al_set_blender(ALLEGRO_ADD, ALLEGRO_ONE, ALLEGRO_ZERO); // plain copy
+}
+
+struct Atlas* CreateAtlas(int width, int height) {
+	struct Atlas* atlas = calloc(1, sizeof(struct Atlas));
+	atlas->width = width;
+	atlas->height = height;
+	atlas->bitmap = al_create_bitmap(width, height);
+
+	ALLEGRO_STATE state;
+	BeginDrawing(atlas, &state);
+	al_clear_to_color(al_map_rgba(0, 0, 0, 0));
+	int x, y;
+	if (Reserve(atlas, 1, 1, &x, &y)) {
+		al_draw_filled_rectangle(x - ATLAS_PADDING, y - ATLAS_PADDING, x + 1 + ATLAS_PADDING, y + 1 + ATLAS_PADDING, al_map_rgb(255, 255, 255));
+		atlas->white = al_create_sub_bitmap(atlas->bitmap, x, y, 1, 1);
+	}
+	al_restore_state(&state);
+	return atlas;
+}
+
+// Copies the source into the atlas and returns a sub-bitmap to use in its place,
+// or NULL if it didn't fit. The caller keeps owning both, but has to destroy the
+// returned one before the atlas.
+ALLEGRO_BITMAP* AtlasAdd(struct Atlas* atlas, ALLEGRO_BITMAP* source) {
+	int w = al_get_bitmap_width(source), h = al_get_bitmap_height(source);
+	int x, y;
+	if (!Reserve(atlas, w, h, &x, &y)) {
+		return NULL;
+	}
+
+	ALLEGRO_STATE state;
+	BeginDrawing(atlas, &state);
+	al_draw_bitmap(source, x, y, 0);
+
+	// extrude the edges into the padding
+	const int p = ATLAS_PADDING;
+	al_draw_scaled_bitmap(source, 0, 0, w, 1, x, y - p, w, p, 0);
+	al_draw_scaled_bitmap(source, 0, h - 1, w, 1, x, y + h, w, p, 0);
+	al_draw_scaled_bitmap(source, 0, 0, 1, h, x - p, y, p, h, 0);
+	al_draw_scaled_bitmap(source, w - 1, 0, 1, h, x + w, y, p, h, 0);
+	al_draw_scaled_bitmap(source, 0, 0, 1, 1, x - p, y - p, p, p, 0);
+	al_draw_scaled_bitmap(source, w - 1, 0, 1, 1, x + w, y - p, p, p, 0);
+	al_draw_scaled_bitmap(source, 0, h - 1, 1, 1, x - p, y + h, p, p, 0);
+	al_draw_scaled_bitmap(source, w - 1, h - 1, 1, 1, x + w, y + h, p, p, 0);
+	al_restore_state(&state);
+
+	return al_create_sub_bitmap(atlas->bitmap, x, y, w, h);
+}
+
+// Rasterizes printable ASCII into cells of the glyph's advance by the line height.
+bool AtlasAddFont(struct Atlas* atlas, ALLEGRO_FONT* font) {
+	atlas->line_height = al_get_font_line_height(font);
+
+	ALLEGRO_STATE state;
+	BeginDrawing(atlas, &state);
+	bool ok = true;
+	for (int i = 0; i < ATLAS_GLYPHS; i++) {
+		int codepoint = ATLAS_FIRST_GLYPH + i;
+		int advance = al_get_glyph_advance(font, codepoint, ALLEGRO_NO_KERNING);
+		int x, y;
+		if (advance <= 0 || !Reserve(atlas, advance, atlas->line_height, &x, &y)) {
+			ok = advance == 0;
+			continue;
+		}
+		al_draw_glyph(font, al_map_rgb(255, 255, 255), x, y, codepoint);
+		atlas->glyphs[i].bitmap = al_create_sub_bitmap(atlas->bitmap, x, y, advance, atlas->line_height);
+		atlas->glyphs[i].advance = advance;
+	}
+	al_restore_state(&state);
+	return ok;
+}
+
+int AtlasTextWidth(struct Atlas* atlas, const char* text) {
+	int width = 0;
+	for (const char* c = text; *c; c++) {
+		int i = *c - ATLAS_FIRST_GLYPH;
+		if (i >= 0 && i < ATLAS_GLYPHS) {
+			width += atlas->glyphs[i].advance;
+		}
+	}
+	return width;
+}
+
+void DestroyAtlas(struct Atlas* atlas) {
+	for (int i = 0; i < ATLAS_GLYPHS; i++) {
+		if (atlas->glyphs[i].bitmap) {
+			al_destroy_bitmap(atlas->glyphs[i].bitmap);
+		}
+	}
+	if (atlas->white) {
+		al_destroy_bitmap(atlas->white);
+	}
+	al_destroy_bitmap(atlas->bitmap);
+	free(atlas);
+}
@@ -0,0 +1,51 @@
+/*! \file atlas.h
+ *  \brief Texture atlas holding static bitmaps and a pre-rasterized font.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef WAAAA_ATLAS_H
+#define WAAAA_ATLAS_H
+
+#include <libsuperderpy.h>
+
+#define ATLAS_PADDING 1 // filled with the edges of each entry, so linear filtering doesn't bleed
+#define ATLAS_FIRST_GLYPH 32
+#define ATLAS_GLYPHS 95 // printable ASCII
+
+struct AtlasGlyph {
+	ALLEGRO_BITMAP* bitmap; // the whole cell, advance by line height
+	int advance;
+};
+
+struct Atlas {
+	ALLEGRO_BITMAP* bitmap;
+	int width, height;
+	int x, y, shelf; // packing position and the height of the current shelf
+
+	ALLEGRO_BITMAP* white; // single pixel, for drawing rectangles as sprites
+	struct AtlasGlyph glyphs[ATLAS_GLYPHS];
+	int line_height;
+};
+
+struct Atlas* CreateAtlas(int width, int height);
+ALLEGRO_BITMAP* AtlasAdd(struct Atlas* atlas, ALLEGRO_BITMAP* source);
+bool AtlasAddFont(struct Atlas* atlas, ALLEGRO_FONT* font);
+int AtlasTextWidth(struct Atlas* atlas, const char* text);
+void DestroyAtlas(struct Atlas* atlas);
+
+#endif
@@ -0,0 +1,153 @@
+/*! \file batch.c
+ *  \brief Sprite batcher sorting draws by layer, blend mode and texture.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "batch.h"
+#include "atlas.h"
+#include <libsuperderpy.h>
+
+// Allegro already collects consecutive draws of the same texture into one vertex
+// buffer while bitmap drawing is held, but has to flush it whenever the texture or
+// the blender changes. Sprites get queued up instead and then drawn sorted, so
+// each layer only switches as many times as it has distinct blenders and textures.
+// Together with the atlas that's usually a single flush for everything.
+
+struct SpriteBatch* CreateSpriteBatch(int capacity) {
+	struct SpriteBatch* b = calloc(1, sizeof(struct SpriteBatch));
+	b->capacity = capacity;
+	b->sprites = calloc(capacity, sizeof(struct Sprite));
+	return b;
+}
+
+void BatchSprite(struct SpriteBatch* b, ALLEGRO_BITMAP* bitmap, ALLEGRO_COLOR tint, float sx, float sy, float sw, float sh, float dx, float dy, float dw, float dh, int layer, enum BatchBlend blend) {
+	if (b->count == b->capacity) {
+		// order between layers can't be kept anymore, but at least nothing gets lost
+		BatchFlush(b);
+	}
+	ALLEGRO_BITMAP* parent = al_get_parent_bitmap(bitmap);
+	b->sprites[b->count] = (struct Sprite){
+		.bitmap = bitmap,
+		.texture = parent ? parent : bitmap,
+		.tint = tint,
+		.sx = sx,
+		.sy = sy,
+		.sw = sw,
+		.sh = sh,
+		.dx = dx,
+		.dy = dy,
+		.dw = dw,
+		.dh = dh,
+		.layer = layer,
+		.blend = blend,
+		.order = b->count,
+	};
+	b->count++;
+}
+
+void BatchRectangle(struct SpriteBatch* b, struct Atlas* atlas, float x1, float y1, float x2, float y2, ALLEGRO_COLOR color, int layer) {
+	BatchSprite(b, atlas->white, color, 0, 0, 1, 1, x1, y1, x2 - x1, y2 - y1, layer, BATCH_BLEND_ALPHA);
+}
+
+// Takes the same alignment flags as al_draw_text. Positions get rounded, so glyphs
+// stay sharp even with linear filtering.
+void BatchText(struct SpriteBatch* b, struct Atlas* atlas, ALLEGRO_COLOR color, float x, float y, int flags, int layer, const char* text) {
+	if (flags & ALLEGRO_ALIGN_CENTER) {
+		x -= AtlasTextWidth(atlas, text) / 2.0;
+	} else if (flags & ALLEGRO_ALIGN_RIGHT) {
+		x -= AtlasTextWidth(atlas, text);
+	}
+	x = (int)x;
+	y = (int)y;
+	for (const char* c = text; *c; c++) {
+		int i = *c - ATLAS_FIRST_GLYPH;
+		if (i < 0 || i >= ATLAS_GLYPHS || !atlas->glyphs[i].bitmap) {
+			continue;
+		}
+		if (*c != ' ') {
+			BatchSprite(b, atlas->glyphs[i].bitmap, color, 0, 0, atlas->glyphs[i].advance, atlas->line_height, x, y, atlas->glyphs[i].advance, atlas->line_height, layer, BATCH_BLEND_ALPHA);
+		}
+		x += atlas->glyphs[i].advance;
+	}
+}
+
+static int CompareSprites(const void* a, const void* b) {
+	const struct Sprite *x = a, *y = b;
+	if (x->layer != y->layer) {
+		return x->layer - y->layer;
+	}
+	if (x->blend != y->blend) {
+		return x->blend - y->blend;
+	}
+	if (x->texture != y->texture) {
+		return x->texture < y->texture ? -1 : 1;
+	}
+	return x->order - y->order;
+}
+
+static void SetBlender(enum BatchBlend blend) {
+	switch (blend) {
+		case BATCH_BLEND_ALPHA:
+			al_set_blender(ALLEGRO_ADD, ALLEGRO_ONE, ALLEGRO_INVERSE_ALPHA);
+			break;
+		case BATCH_BLEND_SUBTRACT:
+			al_set_separate_blender(ALLEGRO_DEST_MINUS_SRC, ALLEGRO_ONE, ALLEGRO_INVERSE_ALPHA, ALLEGRO_ADD, ALLEGRO_ONE, ALLEGRO_INVERSE_ALPHA);
+			break;
+		case BATCH_BLEND_MASK:
+			al_set_blender(ALLEGRO_ADD, ALLEGRO_ZERO, ALLEGRO_ALPHA);
+			break;
+	}
+}
+
+void BatchFlush(struct SpriteBatch* b) {
+	b->switches = 0;
+	if (!b->count) {
+		return;
+	}
+	qsort(b->sprites, b->count, sizeof(struct Sprite), CompareSprites);
+
+	enum BatchBlend blend = BATCH_BLEND_ALPHA;
+	ALLEGRO_BITMAP* texture = NULL;
+	bool held = al_is_bitmap_drawing_held();
+	al_hold_bitmap_drawing(true);
+	for (int i = 0; i < b->count; i++) {
+		struct Sprite* s = &b->sprites[i];
+		if (s->blend != blend) {
+			al_hold_bitmap_drawing(false); // blender changes don't flush on their own
+			SetBlender(s->blend);
+			al_hold_bitmap_drawing(true);
+			blend = s->blend;
+			b->switches++;
+		}
+		if (s->texture != texture) {
+			texture = s->texture;
+			b->switches++;
+		}
+		al_draw_tinted_scaled_bitmap(s->bitmap, s->tint, s->sx, s->sy, s->sw, s->sh, s->dx, s->dy, s->dw, s->dh, 0);
+	}
+	al_hold_bitmap_drawing(held);
+	if (blend != BATCH_BLEND_ALPHA) {
+		SetBlender(BATCH_BLEND_ALPHA);
+	}
+	b->count = 0;
+}
+
+void DestroySpriteBatch(struct SpriteBatch* b) {
+	free(b->sprites);
+	free(b);
+}
@@ -0,0 +1,58 @@
+/*! \file batch.h
+ *  \brief Sprite batcher sorting draws by layer, blend mode and texture.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef WAAAA_BATCH_H
+#define WAAAA_BATCH_H
+
+#include <libsuperderpy.h>
+
+struct Atlas;
+
+enum BatchBlend {
+	BATCH_BLEND_ALPHA, // premultiplied, Allegro's default
+	BATCH_BLEND_SUBTRACT, // dest - src in color, alpha blended as usual
+	BATCH_BLEND_MASK, // multiplies dest by source alpha
+};
+
+struct Sprite {
+	ALLEGRO_BITMAP* bitmap;
+	ALLEGRO_BITMAP* texture; // the parent of the bitmap, if it's a sub-bitmap
+	ALLEGRO_COLOR tint;
+	float sx, sy, sw, sh; // source region
+	float dx, dy, dw, dh; // destination
+	int layer; // lower layers get drawn first; order within a layer isn't kept across textures
+	enum BatchBlend blend;
+	int order; // submission order, to keep it stable otherwise
+};
+
+struct SpriteBatch {
+	struct Sprite* sprites;
+	int capacity, count;
+	int switches; // texture and blender changes in the last flush, for profiling
+};
+
+struct SpriteBatch* CreateSpriteBatch(int capacity);
+void BatchSprite(struct SpriteBatch* b, ALLEGRO_BITMAP* bitmap, ALLEGRO_COLOR tint, float sx, float sy, float sw, float sh, float dx, float dy, float dw, float dh, int layer, enum BatchBlend blend);
+void BatchRectangle(struct SpriteBatch* b, struct Atlas* atlas, float x1, float y1, float x2, float y2, ALLEGRO_COLOR color, int layer);
+void BatchText(struct SpriteBatch* b, struct Atlas* atlas, ALLEGRO_COLOR color, float x, float y, int flags, int layer, const char* text);
+void BatchFlush(struct SpriteBatch* b);
+void DestroySpriteBatch(struct SpriteBatch* b);
+
+#endif
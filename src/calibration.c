@@ -0,0 +1,245 @@
+/*! \file calibration.c
+ *  \brief Latency calibration with a click played back into the microphone.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "calibration.h"
+#include "analysis.h"
+#include "common.h"
+#include <libsuperderpy.h>
+#include <math.h>
+
+// A short chirp gets played through the effects mixer. The capture thread runs the
+// recorded signal through a matched filter (normalized correlation with the chirp)
+// and timestamps the peak using the time its fragment got emitted. From there the
+// click is followed along the same path as any other sound: once a window containing
+// it gets taken for analysis, the screen flashes, and the time until the frame with
+// the flash gets flipped is measured too.
+
+struct Calibration* CreateCalibration(struct Game* game, int rate) {
+	struct Calibration* c = calloc(1, sizeof(struct Calibration));
+	c->game = game;
+	c->rate = rate;
+	c->queue_depth = strtol(GetConfigOptionDefault(game, "calibration", "queue", CALIBRATION_DEFAULT_QUEUE), NULL, 10);
+	c->mutex = al_create_mutex();
+
+	c->length = rate * CALIBRATION_CLICK_LENGTH;
+	c->filter = calloc(c->length, sizeof(float));
+	c->history = calloc(c->length * 2, sizeof(float));
+	float* window = CreateHanningWindow(c->length, false);
+	double duration = c->length / (double)rate;
+	for (int i = 0; i < c->length; i++) {
+		double t = i / (double)rate;
+		double phase = 2 * ALLEGRO_PI * (CALIBRATION_CLICK_LOW * t + (CALIBRATION_CLICK_HIGH - CALIBRATION_CLICK_LOW) * t * t / (2 * duration));
+		c->filter[i] = sin(phase) * window[i];
+		c->filter_energy += c->filter[i] * c->filter[i];
+	}
+	free(window);
+
+	float* samples = al_malloc(c->length * sizeof(float));
+	for (int i = 0; i < c->length; i++) {
+		samples[i] = c->filter[i] * CALIBRATION_CLICK_GAIN;
+	}
+	c->click = al_create_sample(samples, c->length, rate, ALLEGRO_AUDIO_DEPTH_FLOAT32, ALLEGRO_CHANNEL_CONF_1, true);
+	c->instance = al_create_sample_instance(c->click);
+	al_attach_sample_instance_to_mixer(c->instance, game->audio.fx);
+	al_set_sample_instance_playmode(c->instance, ALLEGRO_PLAYMODE_ONCE);
+	return c;
+}
+
+void CalibrationStart(struct Calibration* c, int clicks) {
+	al_lock_mutex(c->mutex);
+	c->state = CALIBRATION_IDLE;
+	c->remaining = clicks;
+	c->misses = 0;
+	c->next_click = al_get_time();
+	al_unlock_mutex(c->mutex);
+
+	memset(&c->sum, 0, sizeof(struct CalibrationStages));
+	c->count = 0;
+	PrintConsole(c->game, "calibration: playing %d clicks, keep the microphone near the speakers", clicks);
+}
+
+// Capture listener, see CaptureSetListener.
+void CalibrationListen(void* data, const float* buffer, unsigned int samples, double emitted) {
+	struct Calibration* c = data;
+	double fed = al_get_time();
+
+	al_lock_mutex(c->mutex);
+	for (unsigned int i = 0; i < samples; i++) {
+		float x = (buffer[i * 2] + buffer[i * 2 + 1]) / 2;
+		c->histpos = (c->histpos + 1) % c->length;
+		float old = c->history[c->histpos];
+		c->history[c->histpos] = x;
+		c->history[c->histpos + c->length] = x;
+		c->energy = MAX(0, c->energy + x * x - old * old);
+
+		// time the newest sample got captured at
+		double t = emitted - (samples - 1 - i) / (double)c->rate;
+		if (c->state != CALIBRATION_LISTENING || t < c->played) {
+			continue;
+		}
+
+		const float* h = c->history + c->histpos + 1;
+		double correlation = 0;
+		for (int k = 0; k < c->length; k++) {
+			correlation += c->filter[k] * h[k];
+		}
+		double score = correlation / sqrt(c->energy * c->filter_energy + 1e-12);
+
+		if (score >= CALIBRATION_THRESHOLD && score > c->peak) {
+			c->peak = score;
+			c->peak_time = t;
+			c->emitted = emitted;
+			c->fed = fed;
+		} else if (c->peak > 0 && score < CALIBRATION_THRESHOLD) {
+			c->state = CALIBRATION_DETECTED;
+		}
+	}
+	al_unlock_mutex(c->mutex);
+}
+
+static void Report(struct Calibration* c) {
+	if (!c->count) {
+		PrintConsole(c->game, "calibration: no clicks detected (%d missed); check the volume and the microphone", c->misses);
+		return;
+	}
+	struct CalibrationStages* s = &c->sum;
+	double n = c->count / 1000.0; // averages, in milliseconds
+	double total = s->recorder + s->delivery + s->ring + s->window + s->draw + s->flip + s->queue;
+	PrintConsole(c->game, "calibration: %d clicks detected, %d missed", c->count, c->misses);
+	PrintConsole(c->game, "calibration: audio round trip %.1f ms (output buffers, air and input driver)", s->roundtrip / n);
+	PrintConsole(c->game, "calibration: mic to photon %.1f ms = recorder %.1f + delivery %.1f + ring buffer %.1f + FFT window %.1f",
+		total / n, s->recorder / n, s->delivery / n, s->ring / n, s->window / n);
+	PrintConsole(c->game, "calibration:     + draw %.1f + flip %.1f + render queue %.1f (%d frames)",
+		s->draw / n, s->flip / n, s->queue / n, c->queue_depth);
+}
+
+// To be called once per analysis step, after the window taken with AnalysisGetWindow has
+// been analysed (spectrum, onsets and pitch), so the ring buffer stage of a detected click
+// also covers the time spent on the analysis.
+void CalibrationUpdate(struct Calibration* c, struct Analysis* a) {
+	double now = al_get_time();
+	bool missed = false;
+
+	al_lock_mutex(c->mutex);
+	switch (c->state) {
+		case CALIBRATION_IDLE:
+			if (c->remaining && now >= c->next_click) {
+				al_play_sample_instance(c->instance);
+				c->played = al_get_time();
+				c->peak = 0;
+				c->state = CALIBRATION_LISTENING;
+			}
+			break;
+		case CALIBRATION_LISTENING:
+			if (now - c->played > CALIBRATION_TIMEOUT) {
+				missed = true;
+				c->misses++;
+				c->remaining--;
+				c->next_click = now + CALIBRATION_INTERVAL;
+				c->state = CALIBRATION_IDLE;
+			}
+			break;
+		case CALIBRATION_DETECTED:
+			if (a->window_fed >= c->fed) {
+				c->windowed = now;
+				c->flash = CALIBRATION_FLASH_FRAMES;
+				c->current.roundtrip = c->peak_time - (c->length - 1) / (double)c->rate - c->played;
+				c->current.recorder = c->emitted - c->peak_time;
+				c->current.delivery = c->fed - c->emitted;
+				c->current.ring = now - c->fed;
+				c->current.window = a->levels[0].size / 2.0 / a->rate;
+				c->state = CALIBRATION_FLASHING;
+			}
+			break;
+		default:
+			break;
+	}
+	bool done = missed && !c->remaining;
+	al_unlock_mutex(c->mutex);
+
+	if (missed) {
+		PrintConsole(c->game, "calibration: click not detected");
+	}
+	if (done) {
+		Report(c);
+	}
+}
+
+void CalibrationFrameStart(struct Calibration* c) {
+	double now = al_get_time();
+	if (c->frame_start) {
+		c->frame_time = c->frame_time ? (c->frame_time * 0.9 + (now - c->frame_start) * 0.1) : (now - c->frame_start);
+	}
+	c->frame_start = now;
+
+	al_lock_mutex(c->mutex);
+	bool done = false;
+	if (c->state == CALIBRATION_PRESENTING) {
+		c->current.flip = now - c->drawn;
+		c->current.queue = c->queue_depth * c->frame_time;
+		c->sum.roundtrip += c->current.roundtrip;
+		c->sum.recorder += c->current.recorder;
+		c->sum.delivery += c->current.delivery;
+		c->sum.ring += c->current.ring;
+		c->sum.window += c->current.window;
+		c->sum.draw += c->current.draw;
+		c->sum.flip += c->current.flip;
+		c->sum.queue += c->current.queue;
+		c->count++;
+		c->remaining--;
+		c->next_click = now + CALIBRATION_INTERVAL;
+		c->state = CALIBRATION_IDLE;
+		done = !c->remaining;
+	}
+	al_unlock_mutex(c->mutex);
+
+	if (done) {
+		Report(c);
+	}
+}
+
+// Whether the current frame should be flashed.
+bool CalibrationFlash(struct Calibration* c) {
+	return c->flash > 0;
+}
+
+void CalibrationFrameEnd(struct Calibration* c) {
+	if (!c->flash) {
+		return;
+	}
+	c->flash--;
+
+	al_lock_mutex(c->mutex);
+	if (c->state == CALIBRATION_FLASHING) {
+		c->drawn = al_get_time();
+		c->current.draw = c->drawn - c->windowed;
+		c->state = CALIBRATION_PRESENTING;
+	}
+	al_unlock_mutex(c->mutex);
+}
+
+void DestroyCalibration(struct Calibration* c) {
+	al_destroy_sample_instance(c->instance);
+	al_destroy_sample(c->click);
+	al_destroy_mutex(c->mutex);
+	free(c->filter);
+	free(c->history);
+	free(c);
+}
@@ -0,0 +1,96 @@
+/*! \file calibration.h
+ *  \brief Latency calibration with a click played back into the microphone.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef WAAAA_CALIBRATION_H
+#define WAAAA_CALIBRATION_H
+
+#include <libsuperderpy.h>
+
+#define CALIBRATION_CLICKS 10
+#define CALIBRATION_INTERVAL 0.75 // seconds between clicks
+#define CALIBRATION_TIMEOUT 0.5 // how long to listen for a click before giving up on it
+#define CALIBRATION_CLICK_LENGTH 0.005 // seconds
+#define CALIBRATION_CLICK_LOW 500 // Hz, the click is a chirp between these two
+#define CALIBRATION_CLICK_HIGH 4000
+#define CALIBRATION_CLICK_GAIN 0.8
+#define CALIBRATION_THRESHOLD 0.4 // normalized correlation with the click needed to detect it
+#define CALIBRATION_FLASH_FRAMES 3
+#define CALIBRATION_DEFAULT_QUEUE "1" // frames the driver is assumed to queue after a flip
+
+struct Analysis;
+
+enum CalibrationState {
+	CALIBRATION_IDLE,
+	CALIBRATION_LISTENING, // click played, the capture thread is looking for it
+	CALIBRATION_DETECTED, // waiting for a window that contains it
+	CALIBRATION_FLASHING, // waiting for the flash to be drawn
+	CALIBRATION_PRESENTING, // waiting for the flash to be flipped
+};
+
+// Seconds spent in each stage.
+struct CalibrationStages {
+	double roundtrip; // click played until it reached the microphone
+	double recorder; // captured until its fragment was complete
+	double delivery; // fragment complete until it got to the analysis
+	double ring; // fed until a window with it got taken
+	double window; // delay of the FFT window's center behind its newest sample
+	double draw; // window taken until the flash was drawn
+	double flip; // drawn until the next frame started
+	double queue; // frames possibly queued by the driver on top of that
+};
+
+struct Calibration {
+	struct Game* game;
+	int rate;
+	ALLEGRO_SAMPLE* click;
+	ALLEGRO_SAMPLE_INSTANCE* instance;
+	int queue_depth;
+
+	float* filter; // the click itself, which makes the matched filter
+	int length;
+	double filter_energy;
+	float* history; // 2 * length, mirrored so the correlation never wraps
+	int histpos;
+	double energy; // of the history
+
+	ALLEGRO_MUTEX* mutex; // the capture thread touches the state and everything it finds
+	enum CalibrationState state;
+	int remaining, misses;
+	double played, next_click;
+	double peak; // best correlation so far for the current click
+	double peak_time, emitted, fed;
+
+	double windowed, drawn;
+	double frame_start, frame_time;
+	int flash;
+	struct CalibrationStages current, sum;
+	int count;
+};
+
+struct Calibration* CreateCalibration(struct Game* game, int rate);
+void CalibrationStart(struct Calibration* c, int clicks);
+void CalibrationListen(void* data, const float* buffer, unsigned int samples, double emitted);
+void CalibrationUpdate(struct Calibration* c, struct Analysis* a);
+void CalibrationFrameStart(struct Calibration* c);
+bool CalibrationFlash(struct Calibration* c);
+void CalibrationFrameEnd(struct Calibration* c);
+void DestroyCalibration(struct Calibration* c);
+
+#endif
@@ -0,0 +1,171 @@
+/*! \file capture.c
+ *  \brief Microphone capture feeding the analysis straight from the recorder.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "capture.h"
+#include "analysis.h"
+#include "realtime.h"
+#include <libsuperderpy.h>
+
+// Recorder fragments used to arrive through the main event queue, so they waited for
+// whatever the game loop was busy with before they got analysed. Here they get their
+// own queue and a thread that feeds each one to the analysis as soon as it's emitted,
+// straight from the recorder's buffer.
+
+static void Ingest(struct Capture* c, ALLEGRO_EVENT* ev) {
+	ALLEGRO_AUDIO_RECORDER_EVENT* re = al_get_audio_recorder_event(ev);
+	double delivery = al_get_time() - ev->any.timestamp;
+
+	// Only the feed is a hot path, even in realtime analysis mode: every fragment still
+	// takes c->mutex twice, and the listener (the calibration's matched filter, while it
+	// runs) works under it, so CaptureSetListener or CaptureReportSpectrum on the main thread
+	// can hold the fragment up.
+	al_lock_mutex(c->mutex);
+	if (c->listener) {
+		c->listener(c->listener_data, re->buffer, re->samples, ev->any.timestamp);
+	}
+	al_unlock_mutex(c->mutex);
+
+	RealtimeEnter();
+	AnalysisFeed(c->analysis, re->buffer, re->samples, 2);
+	RealtimeLeave();
+
+	al_lock_mutex(c->mutex);
+	c->latency.delivery += delivery;
+	c->latency.fragments++;
+	al_unlock_mutex(c->mutex);
+}
+
+static void* CaptureThread(ALLEGRO_THREAD* thread, void* arg) {
+	struct Capture* c = arg;
+	while (!al_get_thread_should_stop(thread)) {
+		ALLEGRO_EVENT ev;
+		if (al_wait_for_event_timed(c->queue, &ev, 0.1) && ev.type == ALLEGRO_EVENT_AUDIO_RECORDER_FRAGMENT) {
+			Ingest(c, &ev);
+		}
+	}
+	return NULL;
+}
+
+// Returns NULL if there's no recorder available.
+struct Capture* CreateCapture(struct Game* game, struct Analysis* analysis, int rate) {
+	int fragments = strtol(GetConfigOptionDefault(game, "capture", "fragments", CAPTURE_DEFAULT_FRAGMENTS), NULL, 10);
+	int samples = strtol(GetConfigOptionDefault(game, "capture", "samples", CAPTURE_DEFAULT_SAMPLES), NULL, 10);
+	if (fragments <= 0) {
+		fragments = strtol(CAPTURE_DEFAULT_FRAGMENTS, NULL, 10);
+	}
+	if (samples <= 0) {
+		samples = strtol(CAPTURE_DEFAULT_SAMPLES, NULL, 10);
+	}
+
+	ALLEGRO_AUDIO_RECORDER* recorder = al_create_audio_recorder(fragments, samples, rate,
+		ALLEGRO_AUDIO_DEPTH_FLOAT32, ALLEGRO_CHANNEL_CONF_2);
+	if (!recorder) {
+		return NULL;
+	}
+
+	struct Capture* c = calloc(1, sizeof(struct Capture));
+	c->game = game;
+	c->analysis = analysis;
+	c->recorder = recorder;
+	c->fragments = fragments;
+	c->samples = samples;
+	c->rate = rate;
+	c->mutex = al_create_mutex();
+	c->last_report = al_get_time();
+
+#ifdef __EMSCRIPTEN__
+	// no threads to spare; the gamestate passes fragments in through CaptureProcessEvent
+	al_register_event_source(game->event_queue, al_get_audio_recorder_event_source(recorder));
+#else
+	c->queue = al_create_event_queue();
+	al_register_event_source(c->queue, al_get_audio_recorder_event_source(recorder));
+	c->thread = al_create_thread(CaptureThread, c);
+	al_start_thread(c->thread);
+#endif
+
+	PrintConsole(game, "Capture: %d fragments of %d samples (%.1f ms each)", fragments, samples, samples * 1000.0 / rate);
+	return c;
+}
+
+void CaptureStart(struct Capture* c) {
+	al_start_audio_recorder(c->recorder);
+}
+
+void CaptureStop(struct Capture* c) {
+	al_stop_audio_recorder(c->recorder);
+}
+
+// Feeds fragments that came through the main event queue. Returns true if the event was one.
+bool CaptureProcessEvent(struct Capture* c, ALLEGRO_EVENT* ev) {
+	if (c->thread || ev->type != ALLEGRO_EVENT_AUDIO_RECORDER_FRAGMENT) {
+		return false;
+	}
+	Ingest(c, ev);
+	return true;
+}
+
+// Pass NULL to remove the listener. Once this returns, the previous one won't be called anymore.
+void CaptureSetListener(struct Capture* c, CaptureListener* listener, void* data) {
+	al_lock_mutex(c->mutex);
+	c->listener = listener;
+	c->listener_data = data;
+	al_unlock_mutex(c->mutex);
+}
+
+// To be called once the spectrum of the latest window is ready. Every now and then
+// prints where the time between capturing a sound and analysing it goes.
+void CaptureReportSpectrum(struct Capture* c) {
+	double now = al_get_time();
+	if (!c->analysis->window_fed) {
+		return;
+	}
+
+	struct CaptureLatency latency = {0};
+	al_lock_mutex(c->mutex);
+	c->latency.analysis += now - c->analysis->window_fed;
+	c->latency.hops++;
+	bool report = now - c->last_report >= CAPTURE_REPORT_INTERVAL && c->latency.fragments;
+	if (report) {
+		latency = c->latency;
+		memset(&c->latency, 0, sizeof(struct CaptureLatency));
+		c->last_report = now;
+	}
+	al_unlock_mutex(c->mutex);
+
+	if (report) {
+		// the oldest sample of a fragment has waited for all the others to be recorded
+		double fragment = c->samples * 1000.0 / c->rate;
+		double delivery = latency.delivery * 1000.0 / latency.fragments;
+		double analysis = latency.analysis * 1000.0 / latency.hops;
+		PrintConsole(c->game, "latency: %.1f ms fragment + %.1f ms delivery + %.1f ms analysis = %.1f ms",
+			fragment, delivery, analysis, fragment + delivery + analysis);
+	}
+}
+
+void DestroyCapture(struct Capture* c) {
+	if (c->thread) {
+		al_set_thread_should_stop(c->thread);
+		al_destroy_thread(c->thread);
+		al_destroy_event_queue(c->queue);
+	}
+	al_destroy_audio_recorder(c->recorder);
+	al_destroy_mutex(c->mutex);
+	free(c);
+}
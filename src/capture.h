@@ -0,0 +1,67 @@
+/*! \file capture.h
+ *  \brief Microphone capture feeding the analysis straight from the recorder.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef WAAAA_CAPTURE_H
+#define WAAAA_CAPTURE_H
+
+#include <libsuperderpy.h>
+
+#define CAPTURE_DEFAULT_FRAGMENTS "32"
+#define CAPTURE_DEFAULT_SAMPLES "256" // per fragment
+#define CAPTURE_REPORT_INTERVAL 10.0 // seconds between latency reports
+
+struct Analysis;
+
+// Breakdown of the time between a sound hitting the microphone and its spectrum
+// being ready, summed since the last report.
+struct CaptureLatency {
+	double delivery; // from the recorder finishing a fragment until it got fed to the analysis
+	double analysis; // from then until the spectrum got computed
+	int fragments, hops;
+};
+
+// Gets each fragment (interleaved stereo) before the analysis does, along with the time
+// the recorder emitted it. Runs on the capture thread.
+typedef void CaptureListener(void* data, const float* buffer, unsigned int samples, double emitted);
+
+struct Capture {
+	struct Game* game;
+	struct Analysis* analysis;
+	ALLEGRO_AUDIO_RECORDER* recorder;
+	ALLEGRO_EVENT_QUEUE* queue; // just the recorder, so fragments don't wait behind the main loop
+	ALLEGRO_THREAD* thread; // NULL when fragments come through the main event queue instead
+	int fragments, samples, rate;
+
+	ALLEGRO_MUTEX* mutex; // guards latency and the listener
+	CaptureListener* listener;
+	void* listener_data;
+	struct CaptureLatency latency;
+	double last_report;
+};
+
+struct Capture* CreateCapture(struct Game* game, struct Analysis* analysis, int rate);
+void CaptureStart(struct Capture* c);
+void CaptureStop(struct Capture* c);
+bool CaptureProcessEvent(struct Capture* c, ALLEGRO_EVENT* ev);
+void CaptureSetListener(struct Capture* c, CaptureListener* listener, void* data);
+void CaptureReportSpectrum(struct Capture* c);
+void DestroyCapture(struct Capture* c);
+
+#endif
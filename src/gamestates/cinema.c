@@ -20,15 +20,15 @@
 
 #define ALLEGRO_UNSTABLE
 
+#include "../analysis.h"
+#include "../capture.h"
 #include "../common.h"
+#include "../realtime.h"
 #include <allegro5/allegro_color.h>
-#include <fftw3.h>
 #include <libsuperderpy.h>
 #include <math.h>
 
-#define SAMPLE_RATE 44100
-
-#define FFT_SAMPLES 8192
+#define FFT_SAMPLES 8192 // at ANALYSIS_REFERENCE_RATE, scaled down together with the analysis rate
 
 #define BARS_NUM (8192 / 2)
 #define BARS_WIDTH 4
@@ -48,18 +48,17 @@ struct GamestateResources {
 	// It gets created on load and then gets passed around to all other function calls.
 	ALLEGRO_FONT* font;
 	ALLEGRO_AUDIO_STREAM* audio;
-	ALLEGRO_AUDIO_RECORDER* recorder;
+	struct Capture* capture;
 	ALLEGRO_MIXER* mixer;
 	ALLEGRO_BITMAP *crt, *crtbg;
 	ALLEGRO_BITMAP* screen;
 	ALLEGRO_BITMAP* stage;
 	float bars[BARS_NUM];
-	float fft[SAMPLE_RATE / 2 + 1];
-	float ringbuffer[SAMPLE_RATE];
-	int ringpos;
-	float fftbuffer[FFT_SAMPLES];
+	float* fft;
 	float max_max, max, ballpos;
 
+	struct Analysis* analysis;
+
 	float rectwidth, rectpos, rectspeed;
 	bool recttop;
 
@@ -69,8 +68,6 @@ struct GamestateResources {
 	ALLEGRO_SAMPLE_INSTANCE* point;
 	ALLEGRO_SAMPLE* point_sample;
 
-	ALLEGRO_MUTEX* mutex;
-
 	int distortion;
 	float rotation;
 	int screamtime;
@@ -104,28 +101,16 @@ void Gamestate_Logic(struct Game* game, struct GamestateResources* data, double
 void Gamestate_Tick(struct Game* game, struct GamestateResources* data) {
 	// Called 60 times per second.
 
-	al_lock_mutex(data->mutex); // we don't want to get the ringbuffer rewritten as we access it
-	int end = data->ringpos - FFT_SAMPLES;
-	if (end < 0) {
-		end += SAMPLE_RATE;
-	}
-	int i = 0;
-	for (int pos = end; pos != data->ringpos; pos++) {
-		data->fftbuffer[i] = data->ringbuffer[pos];
-		//if (fabs(data->fftbuffer[i]) > 1) {
-		//	printf("fftbuffer[%d] = ringbuffer[%d] = %f\n", i, pos, data->fftbuffer[i]);
-		//}
-		i++;
-		if (pos == SAMPLE_RATE - 1) {
-			pos = -1;
-		}
+	RealtimeEnter();
+	FFT(AnalysisGetWindow(data->analysis), data->analysis->fft_size, data);
+	RealtimeLeave();
+	if (data->capture) {
+		CaptureReportSpectrum(data->capture);
 	}
 
-	FFT(data->fftbuffer, FFT_SAMPLES, data);
-	al_unlock_mutex(data->mutex);
-
 	float gain = 0;
-	for (int i = 0; i < BARS_NUM; i++) {
+	int bars = MIN(BARS_NUM, data->analysis->fft_size / 2 + 1 - 8);
+	for (int i = 0; i < bars; i++) {
 		data->bars[i] = 0;
 		int width = 1;
 		for (int j = i * width; j < i * width + width; j++) {
@@ -353,10 +338,10 @@ void Gamestate_Draw(struct Game* game, struct GamestateResources* data) {
 	/*
 	// WAVEFORM DRAWING
 	width=1;
-	for (int i=0; i<4096; i++) {
-		al_draw_filled_rectangle(i*width, 180/2 - data->fftbuffer[i]*180/2, i*width+width, 180/2, al_map_rgb(255,255,0));
+	for (int i=0; i<data->analysis->fft_size; i++) {
+		al_draw_filled_rectangle(i*width, 180/2 - data->analysis->fftbuffer[i]*180/2, i*width+width, 180/2, al_map_rgb(255,255,0));
 	}
-	al_draw_textf(data->font, al_map_rgb(255,255,255), 10, 10, ALLEGRO_ALIGN_LEFT, "%d", data->ringpos);
+	al_draw_textf(data->font, al_map_rgb(255,255,255), 10, 10, ALLEGRO_ALIGN_LEFT, "%d", data->analysis->ringpos);
 	*/
 
 	// BALL DRAWING
@@ -474,41 +459,15 @@ void Gamestate_Draw(struct Game* game, struct GamestateResources* data) {
 static void MixerPostprocess(void* buffer, unsigned int samples, void* userdata) {
 	// REMEMBER: don't use any drawing code inside this function
 	// PrintConsole etc. NOT ALLOWED!
-	float* buf = buffer;
 	struct GamestateResources* data = userdata;
-
-	// critical section: don't use ringbuffer behind our back, as it's getting rewritten
-	al_lock_mutex(data->mutex);
-
-	int end = data->ringpos + samples;
-	if (end >= SAMPLE_RATE) {
-		end -= SAMPLE_RATE;
-	}
-
-	// TODO: in case of mono signal, detect silent channel and ignore
-
-	int i = 0;
-	for (int pos = data->ringpos; pos != end; pos++) {
-		data->ringbuffer[pos] = (buf[i] + buf[i + 1]) / 2;
-		i += 2;
-		if (pos == SAMPLE_RATE - 1) {
-			pos = -1;
-		}
-	}
-	data->ringpos = end;
-
-	al_unlock_mutex(data->mutex);
+	RealtimeEnter();
+	AnalysisFeed(data->analysis, buffer, samples, 2);
+	RealtimeLeave();
 }
 
 void FFT(void* buffer, unsigned int samples, void* userdata) {
 	float* buf = buffer;
 	struct GamestateResources* data = userdata;
-	double* in;
-	fftw_complex* out;
-	in = (double*)fftw_malloc(sizeof(double) * samples);
-	out = (fftw_complex*)fftw_malloc(sizeof(fftw_complex) * (samples / 2 + 1));
-
-	float* window = CreateHanningWindow(samples, false);
 	float min = 0, max = 0;
 	for (int i = 0; i < samples; i++) {
 		if (buf[i] > max) {
@@ -527,14 +486,9 @@ void FFT(void* buffer, unsigned int samples, void* userdata) {
 	}
 	data->max = max;
 
-	for (unsigned int i = 0; i < samples; i++) {
-		in[i] = (buf[i] * window[i]) / data->max_max;
-		//buf[i] = 0;
-		//PrintConsole(data->game, "%d: %f", i, buf[i]);
-	}
-	//PrintConsole(data->game, "samples: %d, min: %f, max: %f, max_max: %f", samples, min, max, data->max_max);
-	//fflush(stdout);
-	free(window);
+	// the window gets normalized by max_max; as the transform is linear, it's enough to scale its output
+	float scale = data->max_max;
+	float* spectrum = AnalysisSpectrum(data->analysis);
 
 	if (max < data->max_max) {
 		data->max_max -= (data->max_max - max) / 1024.0;
@@ -543,14 +497,8 @@ void FFT(void* buffer, unsigned int samples, void* userdata) {
 		data->max_max = MAX_MAX_LIMIT; // reboot develop setting
 	}
 
-	fftw_plan p = fftw_plan_dft_r2c_1d(samples, in, out, FFTW_ESTIMATE);
-	fftw_execute(p);
-
 	for (int i = 0; i < (samples / 2 + 1); i++) {
-		out[i][0] *= 1. / samples;
-		out[i][1] *= 1. / samples;
-
-		double val = sqrt(out[i][0] * out[i][0] + out[i][1] * out[i][1]);
+		double val = spectrum[i] / scale;
 		if (data->music_mode) {
 			val = sqrt(sqrt(val)) * 2;
 		} else {
@@ -561,10 +509,6 @@ void FFT(void* buffer, unsigned int samples, void* userdata) {
 		}
 		data->fft[i] = val;
 	}
-
-	fftw_destroy_plan(p);
-	fftw_free(in);
-	fftw_free(out);
 }
 
 void Gamestate_ProcessEvent(struct Game* game, struct GamestateResources* data, ALLEGRO_EVENT* ev) {
@@ -593,9 +537,8 @@ void Gamestate_ProcessEvent(struct Game* game, struct GamestateResources* data,
 		LoadLevel(game, data, data->current_level);
 	}
 
-	if (ev->type == ALLEGRO_EVENT_AUDIO_RECORDER_FRAGMENT) {
-		ALLEGRO_AUDIO_RECORDER_EVENT* re = al_get_audio_recorder_event(ev);
-		MixerPostprocess(re->buffer, re->samples, data);
+	if (data->capture) {
+		CaptureProcessEvent(data->capture, ev);
 	}
 
 	if (ev->type == ALLEGRO_EVENT_DISPLAY_RESIZE) {
@@ -618,14 +561,13 @@ void* Gamestate_Load(struct Game* game, void (*progress)(struct Game*)) {
 	int flags = al_get_new_bitmap_flags();
 	al_set_new_bitmap_flags(flags ^ ALLEGRO_MAG_LINEAR);
 
-	for (int i = 0; i < SAMPLE_RATE; i++) {
-		data->ringbuffer[i] = 0;
-	}
+	int device_rate = al_get_mixer_frequency(game->audio.mixer);
+	data->analysis = CreateAnalysis(game, device_rate, FFT_SAMPLES, 1);
+	data->fft = calloc(data->analysis->fft_size / 2 + 1, sizeof(float));
 
 	data->music_mode = false;
-	data->mutex = al_create_mutex();
 
-	data->mixer = al_create_mixer(SAMPLE_RATE, ALLEGRO_AUDIO_DEPTH_FLOAT32, ALLEGRO_CHANNEL_CONF_2);
+	data->mixer = al_create_mixer(device_rate, ALLEGRO_AUDIO_DEPTH_FLOAT32, ALLEGRO_CHANNEL_CONF_2);
 	al_attach_mixer_to_mixer(data->mixer, game->audio.music);
 
 	data->audio = al_load_audio_stream(GetDataFilePath(game, "waaaa.flac"), 4, 4096);
@@ -635,18 +577,15 @@ void* Gamestate_Load(struct Game* game, void (*progress)(struct Game*)) {
 	al_attach_audio_stream_to_mixer(data->audio, data->mixer);
 	al_set_audio_stream_gain(data->audio, 0.5);
 
-	data->recorder = al_create_audio_recorder(128, 1024, SAMPLE_RATE,
-		ALLEGRO_AUDIO_DEPTH_FLOAT32, ALLEGRO_CHANNEL_CONF_2);
+	data->capture = CreateCapture(game, data->analysis, device_rate);
 
-	if (!data->recorder) {
+	if (!data->capture) {
 		data->music_mode = true;
 		PrintConsole(game, "ERROR: audio recorder failed!");
 	}
 
 	if (data->music_mode) {
 		al_set_mixer_postprocess_callback(data->mixer, MixerPostprocess, data);
-	} else {
-		al_register_event_source(game->event_queue, al_get_audio_recorder_event_source(data->recorder));
 	}
 
 	data->pixelator = CreateNotPreservedBitmap(320, 180);
@@ -704,8 +643,8 @@ void Gamestate_Unload(struct Game* game, struct GamestateResources* data) {
 	al_destroy_font(data->font);
 	al_destroy_audio_stream(data->audio);
 	al_destroy_mixer(data->mixer);
-	if (data->recorder) {
-		al_destroy_audio_recorder(data->recorder);
+	if (data->capture) {
+		DestroyCapture(data->capture);
 	}
 	al_destroy_bitmap(data->crt);
 	al_destroy_bitmap(data->screen);
@@ -718,7 +657,8 @@ void Gamestate_Unload(struct Game* game, struct GamestateResources* data) {
 	al_destroy_sample_instance(data->point);
 	al_destroy_sample(data->point_sample);
 
-	al_destroy_mutex(data->mutex);
+	DestroyAnalysis(data->analysis);
+	free(data->fft);
 	free(data);
 }
 
@@ -726,11 +666,10 @@ void Gamestate_Start(struct Game* game, struct GamestateResources* data) {
 	// Called when this gamestate gets control. Good place for initializing state,
 	// playing music etc.
 	data->use_shaders = false;
-	data->ringpos = 0;
 	data->max_max = MAX_MAX_LIMIT;
 	data->demo_mode = true;
-	if (data->recorder) {
-		al_start_audio_recorder(data->recorder);
+	if (data->capture) {
+		CaptureStart(data->capture);
 	}
 	LoadLevel(game, data, "levels/cinema.lvl");
 	data->x = 320 / 2;
@@ -757,8 +696,8 @@ void Gamestate_Start(struct Game* game, struct GamestateResources* data) {
 
 void Gamestate_Stop(struct Game* game, struct GamestateResources* data) {
 	// Called when gamestate gets stopped. Stop timers, music etc. here.
-	if (data->recorder) {
-		al_stop_audio_recorder(data->recorder);
+	if (data->capture) {
+		CaptureStop(data->capture);
 	}
 }
 
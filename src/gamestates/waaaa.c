@@ -20,25 +20,88 @@
 
 #define ALLEGRO_UNSTABLE
 
+#include "../analysis.h"
+#include "../atlas.h"
+#include "../batch.h"
+#include "../calibration.h"
+#include "../capture.h"
 #include "../common.h"
+#include "../governor.h"
+#include "../level.h"
+#include "../levelview.h"
+#include "../onset.h"
+#include "../particles.h"
+#include "../physics.h"
+#include "../pitch.h"
+#include "../realtime.h"
+#include "../rendergraph.h"
+#include "../waterfall.h"
 #include <allegro5/allegro_color.h>
-#include <fftw3.h>
 #include <libsuperderpy.h>
 #include <math.h>
 
-#define SAMPLE_RATE 44100 // FIXME: should match the main mixer
+#define FFT_SAMPLES 8192 // at ANALYSIS_REFERENCE_RATE, scaled down together with the analysis rate
 
-#define FFT_SAMPLES 8192
+#define BARS_SPLIT (BARS_OFFSET + BARS_VISIBLE / 2) // first bar of the second player in stereo
+#define MAX_MAX_LIMIT 0.042
 
-#define BARS_NUM (8192 / 2)
-#define BARS_WIDTH 4
-#define BARS_OFFSET 8
-#define BAR_HEIGHT 68
+#define WATERFALL_HISTORY "320" // hops
+#define WATERFALL_OPACITY 0.25
 
-#define MAX_MAX_LIMIT 0.042
+#define PITCH_CENTER 220 // Hz; pitch zones push lower voices to the left and higher ones to the right
+#define PITCH_FORCE 0.05 // per octave away from the center
+#define PITCH_MIN_CONFIDENCE 0.8
+
+#define ATLAS_SIZE 1024
+#define BATCH_CAPACITY 1024
+
+#define PARTICLES_CAPACITY 4096
+#define PARTICLES_GRAVITY 0.05
+#define PARTICLES_BAR_HIT_SPEED 1.5 // slower landings don't make a splash
+
+struct QualityLevel {
+	char* name;
+	int fft_shift; // see AnalysisSetResolution
+	int hop; // run the analysis every n-th frame
+	int blur_taps;
+	int crt_tier; // 2 - full resolution, 1 - half resolution, 0 - none (only without shaders)
+	bool shaders;
+};
 
-static const int BALL_WIDTH = 3;
-static const int BALL_HEIGHT = 3;
+// stepped through by the frame budget governor, best first
+static const struct QualityLevel QUALITY_LEVELS[] = {
+	{"full", 0, 1, 11, 2, true},
+	{"high", 0, 2, 6, 2, true},
+	{"medium", 1, 2, 3, 1, true},
+	{"low", 1, 3, 3, 1, false},
+	{"lowest", 2, 4, 0, 0, false},
+};
+
+// blurred background copies, most significant first
+static const struct {
+	int x, y;
+	bool scroll; // follows yoffset
+} BLUR_TAPS[] = {
+	{0, -40, false},
+	{0, -120, true},
+	{2, -40, false},
+	{2, -120, true},
+	{-2, -40, false},
+	{-2, -120, true},
+	{-2, -43, false},
+	{-2, -123, true},
+	{2, -43, false},
+	{2, -123, true},
+	{2, -200, false},
+};
+
+struct Passes {
+	int tint, background_shader, background_crt;
+	int scene;
+	int downsample, blur, blur_composite;
+	int chromatic, composite_shader, composite, crt, crt_composite;
+	int overlay, overlay_composite;
+};
 
 // TODO: play with moving window
 // TODO: mic volume / output fft normalization?
@@ -48,37 +111,45 @@ struct GamestateResources {
 	// This struct is for every resource allocated and used by your gamestate.
 	// It gets created on load and then gets passed around to all other function calls.
 	ALLEGRO_FONT* font;
+	struct Atlas* atlas; // crt, crtbg and the font
+	struct SpriteBatch* batch;
 	ALLEGRO_AUDIO_STREAM* audio;
-	ALLEGRO_AUDIO_RECORDER* recorder;
+	struct Capture* capture;
+	struct Calibration* calibration; // NULL without a recorder
 	ALLEGRO_MIXER* mixer;
 	ALLEGRO_BITMAP *crt, *crtbg;
 	ALLEGRO_BITMAP* screen;
-	ALLEGRO_BITMAP* stage;
-	float bars[BARS_NUM];
-	float fft[SAMPLE_RATE / 2 + 1];
-	float ringbuffer[SAMPLE_RATE];
-	int ringpos;
-	float fftbuffer[FFT_SAMPLES];
-	float max_max;
-
-	ALLEGRO_BITMAP *pixelator, *blurer, *background;
+	struct Level* level;
+	struct LevelView* view; // rasterizes the part of the level around the camera
+	float* fft[ANALYSIS_MAX_CHANNELS]; // one per player when playing in stereo
+	float max_max[ANALYSIS_MAX_CHANNELS];
+
+	struct Analysis* analysis;
+	struct OnsetDetector* onset[ANALYSIS_MAX_CHANNELS];
+	struct PitchTracker* pitch;
+	struct Waterfall* waterfall; // NULL when disabled
+	struct Particles* particles;
+	int kick; // extra distortion left from the last beat, in music mode
+	float reported_bpm;
+
+	struct RenderGraph* graph; // everything Gamestate_Draw does, as passes
+	struct Passes passes;
+	int screen_target;
+	struct {
+		ALLEGRO_COLOR background, tint;
+		float rot, scale, offset;
+		int yoffset;
+	} frame; // what the passes need to know about the current frame
 	ALLEGRO_SHADER* shader;
 
 	ALLEGRO_SAMPLE_INSTANCE* point;
 	ALLEGRO_SAMPLE* point_sample;
 
-	ALLEGRO_MUTEX* mutex;
-
-	int distortion;
-	float rotation;
+	struct Field field;
+	ALLEGRO_FILE* recording; // NULL unless [waaaa] record is set
 	int screamtime;
 	bool inmenu;
 	bool inmulti;
-	float vx, vy, x, y;
-
-	int shakin_dudi;
-	int score1, score2;
-	char level[80][45];
 
 	int yoffset;
 
@@ -90,251 +161,175 @@ struct GamestateResources {
 
 	bool use_shaders;
 	char* current_level;
+
+	struct Governor governor;
+	const struct QualityLevel* quality;
+	int hop_counter;
 };
 
 int Gamestate_ProgressCount = 1; // number of loading steps as reported by Gamestate_Load
 
-void FFT(void* buffer, unsigned int samples, void* userdata);
+void FFT(struct GamestateResources* data, int channel, float* spectrum);
 void LoadLevel(struct Game* game, struct GamestateResources* data, char* name);
 
-void Gamestate_Logic(struct Game* game, struct GamestateResources* data, double delta) {
-	al_lock_mutex(data->mutex); // we don't want to get the ringbuffer rewritten as we access it
-	int end = data->ringpos - FFT_SAMPLES;
-	if (end < 0) {
-		end += SAMPLE_RATE;
-	}
-	int i = 0;
-	for (int pos = end; pos != data->ringpos; pos++) {
-		data->fftbuffer[i] = data->ringbuffer[pos];
-		//if (fabsf(data->fftbuffer[i]) > 1) {
-		//	printf("fftbuffer[%d] = ringbuffer[%d] = %f\n", i, pos, data->fftbuffer[i]);
-		//}
-		i++;
-		if (pos == SAMPLE_RATE - 1) {
-			pos = -1;
-		}
+// In stereo, the right half of the field belongs to the second player and gets mirrored,
+// so both players have their low frequencies at the outer edges.
+static const float* BarSource(struct GamestateResources* data, int i, int* bar) {
+	*bar = i;
+	if (data->analysis->channels > 1 && i >= BARS_SPLIT && i <= BARS_OFFSET + BARS_VISIBLE) {
+		*bar = 2 * BARS_SPLIT - 1 - i;
+		return data->fft[1];
 	}
-
-	FFT(data->fftbuffer, FFT_SAMPLES, data);
-	al_unlock_mutex(data->mutex);
+	return data->fft[0];
 }
 
-void Gamestate_Tick(struct Game* game, struct GamestateResources* data) {
-	// Called 60 times per second.
-
-	float gain = 0, sum = 0;
-	int bwidth = 1;
-	for (int i = 0; i < BARS_NUM; i++) {
-		data->bars[i] = 0;
-		for (int j = i * bwidth; j < i * bwidth + bwidth; j++) {
-			data->bars[i] += data->fft[j + 8 * bwidth];
-			sum += data->fft[j + 8 * bwidth];
-			if (gain < data->fft[j + 8 * bwidth]) {
-				gain = data->fft[j + 8 * bwidth];
-			}
-		}
-		data->bars[i] /= bwidth;
+void Gamestate_Logic(struct Game* game, struct GamestateResources* data, double delta) {
+	data->hop_counter++;
+	if (data->hop_counter < data->quality->hop) {
+		return;
 	}
-	data->distortion = (gain - sum / (BARS_NUM * bwidth)) * 2;
-	data->rotation += data->distortion * 3;
-
-	//PrintConsole(game, "gain %f", gain);
-
-	// COLLISION HANDLING (sucks)
+	data->hop_counter = 0;
 
-	int oldx = data->x;
-	int oldy = data->y;
-
-	data->x += data->vx;
-	data->y += data->vy;
-
-	if (data->vx > 0) {
-		data->vx -= 0.005;
-	} else if (data->vx < 0) {
-		data->vx += 0.005;
+	double start = al_get_time();
+	RealtimeEnter();
+	AnalysisGetWindow(data->analysis);
+	float* spectrum = AnalysisSpectrum(data->analysis);
+	for (int c = 0; c < data->analysis->channels; c++) {
+		FFT(data, c, spectrum + c * (data->analysis->fft_size / 2 + 1));
+		OnsetFeed(data->onset[c], spectrum + c * (data->analysis->fft_size / 2 + 1), start);
 	}
-	data->vy += 0.075;
+	PitchTrack(data->pitch);
+	RealtimeLeave();
 
-	if (data->y > 180 - BALL_HEIGHT - 5) {
-		data->vy = -data->vy / 2;
-		data->y = 178 - 5;
+	if (data->calibration) {
+		CalibrationUpdate(data->calibration, data->analysis);
 	}
-	if (data->y < 0) {
-		data->y = 0;
-		data->vy = -data->vy * 0.75;
+	if (data->capture) {
+		CaptureReportSpectrum(data->capture);
 	}
 
-	if (data->x < 0) {
-		data->vx = -data->vx * 0.75;
-		data->x = 0;
-	}
-	if (data->x > 319) {
-		data->vx = -data->vx * 0.75;
-		data->x = 319;
-	}
-	if (data->y == 180 - BALL_HEIGHT - 5) {
-		if (data->vx > 0) {
-			data->vx -= 0.01;
-		} else if (data->vx < 0) {
-			data->vx += 0.01;
+	if (data->waterfall) {
+		float column[BARS_VISIBLE];
+		for (int i = 0; i < BARS_VISIBLE; i++) {
+			int bar;
+			const float* fft = BarSource(data, BARS_OFFSET + i, &bar);
+			column[i] = fft[bar + 8];
 		}
+		WaterfallPush(data->waterfall, column);
 	}
 
-	float x = 0;
-	float width = BARS_WIDTH;
-
-	for (int i = BARS_OFFSET; i <= 320 / BARS_WIDTH + BARS_OFFSET; i++) {
-		//width -= 0.02;
-		if (data->bars[i] != data->bars[i]) { // NaN
-			break;
+	if (data->music_mode) {
+		struct OnsetDetector* onset = data->onset[0];
+		if (onset->on_beat) {
+			data->kick = 4;
 		}
-		int pos = 176 - data->bars[i] * BAR_HEIGHT;
-		int prev = 176 - data->bars[i - 1] * BAR_HEIGHT;
-		int next = 176 - data->bars[i + 1] * BAR_HEIGHT;
-		//PrintConsole(game, "data->y %f, pos %d", data->y, pos);
-
-		if (data->y - BALL_HEIGHT >= pos) {
-			//PrintConsole(game, "i %d pos data->y %f pos %d out[i][0] %f", i, data->y, pos, out[i][0]);
-
-			if (x - 1 == data->x) {
-				// left
-				data->vy = (pos - data->y) / 10;
-				data->vx += -2;
-				PrintConsole(game, "left bump %d", pos);
-				data->y = pos;
-			} else if (x + width == data->x) {
-				// right
-				data->vy = (pos - data->y) / 10;
-				data->vx += 2;
-				data->y = pos;
-				PrintConsole(game, "right bump %d", pos);
-			} else if ((x <= data->x) && (x + width >= data->x)) {
-				data->vy = (pos - data->y) / 8; // - data->vy * 0.25;
-				data->vx += ((rand() / (float)RAND_MAX) - 0.5) * 2;
-				data->y = pos;
-				//PrintConsole(game, "center bump %d", pos);
-
-				if ((prev < pos) && (next > pos)) {
-					data->vx += -2;
-				}
-				if ((prev > pos) && (next < pos)) {
-					data->vy += 2;
-				}
-			}
+		if (fabs(onset->bpm - data->reported_bpm) >= 1) {
+			PrintConsole(game, "tempo: %.1f BPM (confidence %.2f)", onset->bpm, onset->confidence);
+			data->reported_bpm = onset->bpm;
 		}
-
-		//	al_draw_filled_rectangle(x, 180 - data->out[i][0] * 10, x+width, 180, al_map_rgb(255,255,255));
-		x += width;
 	}
+	GovernorReportAnalysis(&data->governor, al_get_time() - start);
+}
 
-	// collision with level
-
-	int oldsx = oldx / 4;
-	int oldsy = oldy / 4;
-
-	int sx = (int)(data->x / 4);
-	int sy = (int)(data->y / 4);
+static void SetQuality(struct Game* game, struct GamestateResources* data, int level) {
+	data->quality = &QUALITY_LEVELS[level];
+	AnalysisSetResolution(data->analysis, data->quality->fft_shift);
 
-	int tx = MAX(0, oldsx);
-	int ty = MAX(0, oldsy);
+	bool shaders = data->quality->shaders;
+#ifdef __EMSCRIPTEN__
+	shaders = true; // no CRT bitmaps to fall back to
+#endif
+	if (shaders != data->use_shaders) {
+		data->use_shaders = shaders;
+		LoadLevel(game, data, data->current_level);
+	}
 
-	int colx = MAX(0, sx);
-	int coly = MAX(0, sy);
+	PrintConsole(game, "quality: %s (level %d; FFT size %d, hop %d, blur taps %d, CRT tier %d, shaders %d)",
+		data->quality->name, level, data->analysis->levels[0].size, data->quality->hop, data->quality->blur_taps, data->quality->crt_tier, data->use_shaders);
+}
 
-	while ((tx != sx) && (ty != sy)) {
-		if (data->level[tx][ty] == '0') {
-			colx = tx;
-			coly = ty;
-			break;
-		}
+void Gamestate_Tick(struct Game* game, struct GamestateResources* data) {
+	// Called 60 times per second.
 
-		if (tx != sx) {
-			if (sx > tx) {
-				tx++;
-			} else {
-				tx--;
-			}
+	int bwidth = 1;
+	int bars = MIN(BARS_NUM, (data->analysis->fft_size / 2 + 1) / bwidth - 8);
+	for (int i = 0; i < bars; i++) {
+		int bar;
+		const float* fft = BarSource(data, i, &bar);
+		data->field.bars[i] = 0;
+		for (int j = bar * bwidth; j < bar * bwidth + bwidth; j++) {
+			data->field.bars[i] += fft[j + 8 * bwidth];
 		}
-		if (ty != sy) {
-			if (sy > ty) {
-				ty++;
-			} else {
-				ty--;
-			}
+		data->field.bars[i] /= bwidth;
+	}
+	// Below ANALYSIS_REFERENCE_RATE the bars run out at the Nyquist frequency. The ones past it
+	// count as silent, so the distortion still averages over the same 43 Hz - 22 kHz it did at
+	// 44.1 kHz, instead of the average rising as the rate goes down.
+	memset(data->field.bars + bars, 0, (BARS_NUM - bars) * sizeof(float));
+
+	struct FieldInput input;
+	input.distortion = FieldDistortion(data->field.bars, BARS_NUM);
+	for (int c = 0; c < 2; c++) {
+		// in stereo, the zones listen to the player on whose side of the field they are
+		int channel = MIN(c, data->analysis->channels - 1);
+		input.push[c] = 0;
+		if (data->pitch->frequency[channel] && data->pitch->confidence[channel] >= PITCH_MIN_CONFIDENCE) {
+			input.push[c] = log2(data->pitch->frequency[channel] / PITCH_CENTER) * PITCH_FORCE;
 		}
 	}
-
-	if ((data->level[colx][coly] == 'X') || (data->level[colx][coly] == 'Y')) {
-		data->vx = 0;
-		data->vy = 0;
-		data->x = 320 / 2;
-		data->y = 120;
-
-		data->shakin_dudi = 120;
-
-		if (data->level[colx][coly] == 'X') {
-			data->score1++;
-		} else {
-			data->score2++;
-		}
-
-		al_stop_sample_instance(data->point);
-		al_play_sample_instance(data->point);
+	if (data->recording) {
+		memcpy(input.bars, data->field.bars, sizeof(input.bars));
+		al_fwrite(data->recording, &input, sizeof(struct FieldInput));
 	}
 
-	if (data->level[colx][coly] == 'O') {
-		if (data->x != colx * 4) {
-			data->distortion = 3;
-		}
-		if (data->y != coly * 4) {
-			data->distortion = 3;
-		}
-		data->x = oldsx * 4;
-		data->y = oldsy * 4;
-		/*		if (data->vx > 0) {
-			data->x = -4;
-		} else {
-			data->x = +4;
-		}
-		if (data->vy > 0) {
-			data->y = -4;
-		} else {
-			data->y = +4;
-		}*/
-		PrintConsole(game, "collision %d %d", (int)(data->x / 4), (int)(data->y / 4));
-
-		data->vx = -data->vx * 0.5;
-		data->vy = -data->vy * 0.5;
+	int distortion = input.distortion;
+	if (data->kick) {
+		distortion += data->kick--;
+	}
+	FieldApplyDistortion(&data->field, distortion);
 
-		if (fabs(data->vx) < 0.2) {
-			data->vx *= 10;
-		}
-		if (fabs(data->vy) < 0.2) {
-			data->vy *= 10;
-		}
+	// particles live on the screen, not in the level
+	float x = data->field.x - data->field.camera, y = data->field.y, vy = data->field.vy;
+	int events = FieldStep(&data->field, input.push);
+	float ball = data->field.x - data->field.camera;
 
-		if ((data->x == oldx) && (data->y == oldy)) {
-			// we're stuck! RANDOMMMMM and hope for the best
-			data->vx = ((rand() / (float)RAND_MAX) - 0.5) * 5;
-			data->vy = ((rand() / (float)RAND_MAX) - 0.5) * 5;
-		}
+	ParticlesUpdate(data->particles);
+	if (events & FIELD_SCORE1) {
+		ParticlesBurst(data->particles, x, y, 600, 4, 90, al_map_rgb(96, 96, 255));
 	}
-
-	if (data->level[colx][coly] == '!') {
-		data->x = 320 / 2;
-		data->y = 120;
+	if (events & FIELD_SCORE2) {
+		ParticlesBurst(data->particles, x, y, 600, 4, 90, al_map_rgb(255, 96, 96));
+	}
+	if (events & FIELD_COLLISION) {
+		ParticlesBurst(data->particles, ball, data->field.y, 32, 1.5, 30, al_map_rgb(255, 255, 255));
+	}
+	if (events & (FIELD_LEFT_BUMP | FIELD_RIGHT_BUMP)) {
+		ParticlesBurst(data->particles, ball, data->field.y, 16, 2, 20, al_map_rgb(255, 255, 0));
+	}
+	if ((events & FIELD_BAR_HIT) && vy > PARTICLES_BAR_HIT_SPEED) {
+		ParticlesBurst(data->particles, ball, data->field.y, vy * 8, vy / 2, 20, al_map_rgb(255, 255, 0));
 	}
 
-	data->vx += sin(data->rotation / 20.0) / 75.0;
-
-	if (data->shakin_dudi) {
-		data->distortion = (rand() / (float)RAND_MAX) * 15;
-		data->rotation += data->distortion;
-		data->shakin_dudi--;
+	if (events & FIELD_LEFT_BUMP) {
+		PrintConsole(game, "left bump %d", (int)data->field.y);
+	}
+	if (events & FIELD_RIGHT_BUMP) {
+		PrintConsole(game, "right bump %d", (int)data->field.y);
+	}
+	if (events & FIELD_COLLISION) {
+		PrintConsole(game, "collision %d %d", (int)(data->field.x / 4), (int)(data->field.y / 4));
+	}
+	if (events & (FIELD_SCORE1 | FIELD_SCORE2)) {
+		al_stop_sample_instance(data->point);
+		al_play_sample_instance(data->point);
 	}
 
 	if (!data->music_mode) {
-		if (data->max_max <= MAX_MAX_LIMIT + 0.001) {
+		float max_max = data->max_max[0];
+		for (int c = 1; c < data->analysis->channels; c++) {
+			max_max = MAX(max_max, data->max_max[c]);
+		}
+		if (max_max <= MAX_MAX_LIMIT + 0.001) {
 			if (!data->demo_mode) {
 				// start demo mode
 				PrintConsole(game, "starting demo");
@@ -344,11 +339,11 @@ void Gamestate_Tick(struct Game* game, struct GamestateResources* data) {
 		} else {
 			if (data->demo_mode) {
 				// stop demo mode
-				PrintConsole(game, "out of demo at %f", data->max_max);
+				PrintConsole(game, "out of demo at %f", max_max);
 				data->demo_mode = false;
 				LoadLevel(game, data, "levels/multi.lvl");
-				data->score1 = 0;
-				data->score2 = 0;
+				data->field.score1 = 0;
+				data->field.score2 = 0;
 			}
 		}
 	}
@@ -361,112 +356,69 @@ void Gamestate_Tick(struct Game* game, struct GamestateResources* data) {
 
 void LoadLevel(struct Game* game, struct GamestateResources* data, char* name) {
 	ALLEGRO_FILE* file = al_fopen(GetDataFilePath(game, name), "r");
+	int64_t size = al_fsize(file);
+	char* text = malloc(size);
+	size = al_fread(file, text, size);
+	al_fclose(file);
 
-	//	data->score1 = 0;
-	//	data->score2 = 0;
-
-	char buf;
+	struct Level* level = CreateLevel(text, size);
+	free(text);
+	FieldSetLevel(&data->field, level);
 
-	int x = 0, y = 0;
-	while (al_fread(file, &buf, sizeof(char))) {
-		data->level[x][y] = buf;
-		if (buf != '\n') {
-			x++;
-			if (x == 80) {
-				x = 0;
-				y++;
-			}
-			if (y == 45) {
-				break;
-			}
-		}
+	if (data->view) {
+		DestroyLevelView(data->view);
+		DestroyLevel(data->level);
 	}
-
-	/*	data->x = 320/2;
-	data->y = 120;
-	data->vx = 0;
-	data->vy = 0;*/
-
-	al_fclose(file);
+	data->level = level;
+	data->view = CreateLevelView(level, !data->use_shaders);
 
 	data->current_level = name;
-
-	// drawing
-	al_set_target_bitmap(data->stage);
-	al_clear_to_color(al_map_rgba(0, 0, 0, 0));
-	al_hold_bitmap_drawing(true);
-	for (int x = 0; x < 80; x++) {
-		for (int y = 0; y < 45; y++) {
-			int color = 32;
-			if (!data->use_shaders) {
-				color = 50;
-			}
-			int color2 = 64;
-			if (!data->use_shaders) {
-				color2 = 95;
-			}
-			if (data->level[x][y] == 'O') {
-				al_draw_filled_rectangle(x * 4, y * 4, x * 4 + 4, y * 4 + 4, al_map_rgb(255, 255, 255));
-			}
-			if (data->level[x][y] == 'X') {
-				al_draw_filled_rectangle(x * 4, y * 4, x * 4 + 4, y * 4 + 4, al_map_rgba(0, 0, color, color));
-			}
-			if (data->level[x][y] == 'Y') {
-				al_draw_filled_rectangle(x * 4, y * 4, x * 4 + 4, y * 4 + 4, al_map_rgba(color, 0, 0, color));
-			}
-			if (data->level[x][y] == 'a') {
-				al_draw_filled_rectangle(x * 4, y * 4, x * 4 + 4, y * 4 + 4, al_map_rgba(color2, color2, color2, color2));
-			}
-		}
-	}
-	al_hold_bitmap_drawing(false);
-	SetFramebufferAsTarget(game);
 }
 
-void Gamestate_Draw(struct Game* game, struct GamestateResources* data) {
-	// Called as soon as possible, but no sooner than next Gamestate_Logic call.
-	// Draw everything to the screen here.
+// Passes of Gamestate_Draw, in the order they're declared in Gamestate_Load.
 
-	if (data->use_shaders) {
-		al_set_target_bitmap(data->pixelator);
-		al_clear_to_color(al_color_hsv(fabs(sin(data->rotation / 360.0)) * 360, 0.75, 0.5 + sin(data->rotation / 20.0) / 20.0));
+static void DrawBackgroundShader(struct Game* game, void* d, ALLEGRO_BITMAP* const* inputs) {
+	struct GamestateResources* data = d;
+	al_use_shader(data->shader);
+	al_set_shader_int("scaleFactor", 2);
+	al_draw_bitmap(inputs[0], 0, 0, 0);
+	al_use_shader(NULL);
+}
 
-		SetFramebufferAsTarget(game);
-		al_use_shader(data->shader);
-		al_set_shader_int("scaleFactor", 2);
+static void DrawBackgroundCRT(struct Game* game, void* d, ALLEGRO_BITMAP* const* inputs) {
+	struct GamestateResources* data = d;
+	ALLEGRO_TRANSFORM trans;
+	al_identity_transform(&trans);
+	al_set_clipping_rectangle(0, 0, al_get_display_width(game->display), al_get_display_height(game->display));
+	al_use_transform(&trans);
 
-		al_draw_bitmap(data->pixelator, 0, 0, 0);
+	al_clear_to_color(data->frame.background);
 
-		al_use_shader(NULL);
-	} else {
-		ALLEGRO_TRANSFORM trans;
-		al_identity_transform(&trans);
-		al_set_clipping_rectangle(0, 0, al_get_display_width(game->display), al_get_display_height(game->display));
-		al_use_transform(&trans);
-
-		al_clear_to_color(al_color_hsv(fabs(sin(data->rotation / 360.0)) * 360, 0.75, 0.5 + sin(data->rotation / 20.0) / 20.0));
-
-		al_set_separate_blender(ALLEGRO_DEST_MINUS_SRC, ALLEGRO_ONE, ALLEGRO_INVERSE_ALPHA, ALLEGRO_ADD, ALLEGRO_ONE, ALLEGRO_INVERSE_ALPHA);
-		al_hold_bitmap_drawing(true);
-		for (int i = 0; i < al_get_display_width(game->display); i += al_get_bitmap_width(data->crtbg)) {
-			for (int j = 0; j < al_get_display_height(game->display); j += al_get_bitmap_height(data->crtbg)) {
-				al_draw_bitmap(data->crtbg, i, j, 0);
+	if (data->quality->crt_tier) {
+		int w = al_get_bitmap_width(data->crtbg), h = al_get_bitmap_height(data->crtbg);
+		for (int i = 0; i < al_get_display_width(game->display); i += w) {
+			for (int j = 0; j < al_get_display_height(game->display); j += h) {
+				BatchSprite(data->batch, data->crtbg, al_map_rgb(255, 255, 255), 0, 0, w, h, i, j, w, h, 0, BATCH_BLEND_SUBTRACT);
 			}
 		}
-		al_hold_bitmap_drawing(false);
-		al_set_blender(ALLEGRO_ADD, ALLEGRO_ONE, ALLEGRO_INVERSE_ALPHA);
-
-		ResetClippingRectangle();
+		BatchFlush(data->batch);
 	}
 
-	al_set_target_bitmap(data->pixelator);
-	al_clear_to_color(al_map_rgba(0, 0, 0, 0));
+	ResetClippingRectangle();
+}
+
+static void DrawScene(struct Game* game, void* d, ALLEGRO_BITMAP* const* inputs) {
+	struct GamestateResources* data = d;
+
+	// WATERFALL DRAWING
+	if (data->waterfall) {
+		DrawWaterfall(data->waterfall, al_map_rgba_f(WATERFALL_OPACITY, WATERFALL_OPACITY, WATERFALL_OPACITY, WATERFALL_OPACITY), 0, 0, 320, 180);
+	}
 
 	// LEVEL DRAWING
-	al_draw_bitmap(data->stage, 0, 0, 0);
+	DrawLevelView(data->view, data->field.camera, 0, 320, 180);
 
 	// BAR DRAWING
-	al_hold_bitmap_drawing(true);
 	int width = 320 / BARS_NUM;
 	if (width == 0) {
 		width = 1;
@@ -474,162 +426,234 @@ void Gamestate_Draw(struct Game* game, struct GamestateResources* data) {
 	width *= BARS_WIDTH;
 	for (int i = BARS_OFFSET; i < BARS_NUM; i++) {
 		int a = i - BARS_OFFSET;
-		al_draw_filled_rectangle(a * width, (int)(176 - data->bars[i] * BAR_HEIGHT), a * width + width, 180, al_map_rgb(255, 255, 255));
+		BatchRectangle(data->batch, data->atlas, a * width, (int)(176 - data->field.bars[i] * BAR_HEIGHT), a * width + width, 180, al_map_rgb(255, 255, 255), 0);
 		if (a * width > game->viewport.width) {
 			break;
 		}
 	}
-	al_hold_bitmap_drawing(false);
 
 	// WAVEFORM DRAWING
 	/*
 	width = 1;
-	for (int i = 0; i < FFT_SAMPLES; i++) {
-		al_draw_filled_rectangle(i * width, 180 / 2 - data->fftbuffer[i] * 180 / 2, i * width + width, 180 / 2, al_map_rgb(255, 255, 0));
+	for (int i = 0; i < data->analysis->fft_size; i++) {
+		al_draw_filled_rectangle(i * width, 180 / 2 - data->analysis->fftbuffer[i] * 180 / 2, i * width + width, 180 / 2, al_map_rgb(255, 255, 0));
 	}
-	al_draw_textf(data->font, al_map_rgb(255, 255, 255), 10, 10, ALLEGRO_ALIGN_LEFT, "%d", data->ringpos);
+	al_draw_textf(data->font, al_map_rgb(255, 255, 255), 10, 10, ALLEGRO_ALIGN_LEFT, "%d", data->analysis->ringpos);
 	*/
 
 	// BALL DRAWING
 	if (!data->demo_mode) {
-		al_draw_textf(data->font, al_map_rgb(255, 255, 255), 320 / 2, 72, ALLEGRO_ALIGN_CENTER, data->shakin_dudi ? (((data->shakin_dudi / 10) % 2) ? "" : "SCORE!") : "WAAAA");
+		BatchText(data->batch, data->atlas, al_map_rgb(255, 255, 255), 320 / 2, 72, ALLEGRO_ALIGN_CENTER, 1, data->field.shakin_dudi ? (((data->field.shakin_dudi / 10) % 2) ? "" : "SCORE!") : "WAAAA");
 	}
 
-	al_draw_filled_rectangle(data->x - BALL_WIDTH, data->y - BALL_HEIGHT, data->x + BALL_WIDTH, data->y + BALL_HEIGHT,
-		al_map_rgb(255, 255, 0));
+	float ball = data->field.x - data->field.camera;
+	BatchRectangle(data->batch, data->atlas, ball - BALL_WIDTH, data->field.y - BALL_HEIGHT, ball + BALL_WIDTH, data->field.y + BALL_HEIGHT,
+		al_map_rgb(255, 255, 0), 1);
 
 	// UI DRAWING
 	if (!data->demo_mode) {
-		al_draw_textf(data->font, al_map_rgb(255, 255, 255), 320 / 2, 82, ALLEGRO_ALIGN_CENTER, "%d:%d", data->score1, data->score2);
+		char score[32];
+		snprintf(score, sizeof(score), "%d:%d", data->field.score1, data->field.score2);
+		BatchText(data->batch, data->atlas, al_map_rgb(255, 255, 255), 320 / 2, 82, ALLEGRO_ALIGN_CENTER, 1, score);
 	}
 	if (data->demo_mode && !data->music_mode) {
 		if (data->blink_counter < 50) {
-			al_draw_text(data->font, al_map_rgb(255, 255, 255), 320 / 2, 126, ALLEGRO_ALIGN_CENTER, "GRAB A MICROPHONE AND PLAY!");
+			BatchText(data->batch, data->atlas, al_map_rgb(255, 255, 255), 320 / 2, 126, ALLEGRO_ALIGN_CENTER, 1, "GRAB A MICROPHONE AND PLAY!");
 		}
 	}
+	BatchFlush(data->batch);
 
-	// FINAL DRAWING
-	al_set_target_bitmap(data->blurer);
-	al_clear_to_color(al_map_rgba(0, 0, 0, 0));
-
-	al_draw_scaled_bitmap(data->pixelator, 0, 0, 320, 180, 0, 0, 320 / 4, 180 / 4, 0);
-
-	float s = data->distortion / 5.0;
-	ALLEGRO_COLOR tint = al_map_rgba(32 * s, 32 * s, 32 * s, 32 * s);
-
-	float rot = sin(data->rotation / 20.0) / 20.0;
-
-	float scale = 1 - pow((fabs((320 / 2) - data->x) / (320 / 2.0)), 2) * 0.1;
+	// PARTICLE DRAWING
+	DrawParticles(data->particles);
+}
 
-	al_set_target_bitmap(data->background);
-	al_clear_to_color(al_map_rgba(0, 0, 0, 0));
+static void DrawDownsample(struct Game* game, void* d, ALLEGRO_BITMAP* const* inputs) {
+	al_draw_scaled_bitmap(inputs[0], 0, 0, 320, 180, 0, 0, 320 / 4, 180 / 4, 0);
+}
 
+static void DrawBlur(struct Game* game, void* d, ALLEGRO_BITMAP* const* inputs) {
+	struct GamestateResources* data = d;
+	float scale = 1.1 * 4 * data->frame.scale;
 	al_hold_bitmap_drawing(true);
-	al_draw_tinted_scaled_rotated_bitmap(data->blurer, tint, 320 / 4 / 2, (180 / 4) * (3 / 4), 320 / 2, 180 / 2 - 40, 1.1 * 4 * scale, 1.1 * 4 * scale, rot, 0);
-	al_draw_tinted_scaled_rotated_bitmap(data->blurer, tint, 320 / 4 / 2, (180 / 4) * (3 / 4), 320 / 2 + 2, 180 / 2 - 40, 1.1 * 4 * scale, 1.1 * 4 * scale, rot, 0);
-	al_draw_tinted_scaled_rotated_bitmap(data->blurer, tint, 320 / 4 / 2, (180 / 4) * (3 / 4), 320 / 2 - 2, 180 / 2 - 40, 1.1 * 4 * scale, 1.1 * 4 * scale, rot, 0);
-	al_draw_tinted_scaled_rotated_bitmap(data->blurer, tint, 320 / 4 / 2, (180 / 4) * (3 / 4), 320 / 2 - 2, 180 / 2 - 40 - 3, 1.1 * 4 * scale, 1.1 * 4 * scale, rot, 0);
-	al_draw_tinted_scaled_rotated_bitmap(data->blurer, tint, 320 / 4 / 2, (180 / 4) * (3 / 4), 320 / 2 + 2, 180 / 2 - 40 - 3, 1.1 * 4 * scale, 1.1 * 4 * scale, rot, 0);
-
-	al_draw_tinted_scaled_rotated_bitmap(data->blurer, tint, 320 / 4 / 2, (180 / 4) * (3 / 4), 320 / 2 + 2, 180 / 2 - 200, 1.1 * 4 * scale, 1.1 * 4 * scale, rot, 0);
-
-	int yoffset = data->yoffset;
-
-	al_draw_tinted_scaled_rotated_bitmap(data->blurer, tint, 320 / 4 / 2, (180 / 4) * (3 / 4), 320 / 2, 180 / 2 - 120 + yoffset, 1.1 * 4 * scale, 1.1 * 4 * scale, rot, 0);
-	al_draw_tinted_scaled_rotated_bitmap(data->blurer, tint, 320 / 4 / 2, (180 / 4) * (3 / 4), 320 / 2 + 2, 180 / 2 - 120 + yoffset, 1.1 * 4 * scale, 1.1 * 4 * scale, rot, 0);
-	al_draw_tinted_scaled_rotated_bitmap(data->blurer, tint, 320 / 4 / 2, (180 / 4) * (3 / 4), 320 / 2 - 2, 180 / 2 - 120 + yoffset, 1.1 * 4 * scale, 1.1 * 4 * scale, rot, 0);
-	al_draw_tinted_scaled_rotated_bitmap(data->blurer, tint, 320 / 4 / 2, (180 / 4) * (3 / 4), 320 / 2 - 2, 180 / 2 - 120 + yoffset - 3, 1.1 * 4 * scale, 1.1 * 4 * scale, rot, 0);
-	al_draw_tinted_scaled_rotated_bitmap(data->blurer, tint, 320 / 4 / 2, (180 / 4) * (3 / 4), 320 / 2 + 2, 180 / 2 - 120 + yoffset - 3, 1.1 * 4 * scale, 1.1 * 4 * scale, rot, 0);
+	for (int i = 0; i < data->quality->blur_taps; i++) {
+		al_draw_tinted_scaled_rotated_bitmap(inputs[0], data->frame.tint, 320 / 4 / 2, (180 / 4) * (3 / 4), 320 / 2 + BLUR_TAPS[i].x, 180 / 2 + BLUR_TAPS[i].y + (BLUR_TAPS[i].scroll ? data->frame.yoffset : 0), scale, scale, data->frame.rot, 0);
+	}
 	al_hold_bitmap_drawing(false);
+}
 
-	SetFramebufferAsTarget(game);
-	al_draw_bitmap(data->background, 0, 0, 0);
-
-	float offset = data->distortion / 2.0 * (rand() / (float)RAND_MAX);
+static void DrawBitmap(struct Game* game, void* d, ALLEGRO_BITMAP* const* inputs) {
+	al_draw_bitmap(inputs[0], 0, 0, 0);
+}
 
+static void DrawChromatic(struct Game* game, void* d, ALLEGRO_BITMAP* const* inputs) {
+	struct GamestateResources* data = d;
+	float scale = 1.1 * data->frame.scale, offset = data->frame.offset;
 	al_hold_bitmap_drawing(true);
-	al_draw_tinted_scaled_rotated_bitmap(data->pixelator, al_map_rgba(0, 192, 192, 192), 320 / 2, 180 * (3 / 4), 320 / 2 - 2 * offset, 180 / 2 - 120 + yoffset, 1.1 * scale, 1.1 * scale, rot, 0);
-	al_draw_tinted_scaled_rotated_bitmap(data->pixelator, al_map_rgba(192, 0, 0, 192), 320 / 2, 180 * (3 / 4), 320 / 2 + 2 * offset, 180 / 2 - 120 + yoffset, 1.1 * scale, 1.1 * scale, rot, 0);
+	al_draw_tinted_scaled_rotated_bitmap(inputs[0], al_map_rgba(0, 192, 192, 192), 320 / 2, 180 * (3 / 4), 320 / 2 - 2 * offset, 180 / 2 - 120 + data->frame.yoffset, scale, scale, data->frame.rot, 0);
+	al_draw_tinted_scaled_rotated_bitmap(inputs[0], al_map_rgba(192, 0, 0, 192), 320 / 2, 180 * (3 / 4), 320 / 2 + 2 * offset, 180 / 2 - 120 + data->frame.yoffset, scale, scale, data->frame.rot, 0);
 	al_hold_bitmap_drawing(false);
+}
 
-	if (data->use_shaders) {
-		al_use_shader(data->shader);
-		al_set_shader_int("scaleFactor", 1);
-		al_draw_scaled_rotated_bitmap(data->pixelator, 320 / 2, 180 * (3 / 4), 320 / 2, 180 / 2 - 120, 1.1 * scale, 1.1 * scale, rot, 0);
-		al_use_shader(NULL);
-	} else {
-		al_set_target_bitmap(data->screen);
-		al_clear_to_color(al_map_rgba(0, 0, 0, 0));
-
-		al_draw_scaled_bitmap(data->pixelator, 0, 0, 320, 180, 0, 0, al_get_bitmap_width(data->screen), al_get_bitmap_height(data->screen), 0);
-		al_hold_bitmap_drawing(true);
-		for (int i = 0; i < al_get_display_width(game->display); i += al_get_bitmap_width(data->crt) * 2) {
-			for (int j = 0; j < al_get_display_height(game->display); j += al_get_bitmap_height(data->crt)) {
-				al_draw_scaled_bitmap(data->crt, 0, 0, 500, 500, i, j, 1000, 500, 0);
-				//al_draw_bitmap(data->crt, i, j, 0);
-			}
-		}
-		al_hold_bitmap_drawing(false);
-
-		al_set_blender(ALLEGRO_ADD, ALLEGRO_ZERO, ALLEGRO_ALPHA); // now as a mask
-		al_draw_scaled_bitmap(data->pixelator, 0, 0, 320, 180, 0, 0, al_get_bitmap_width(data->screen), al_get_bitmap_height(data->screen), 0);
+static void DrawCompositeShader(struct Game* game, void* d, ALLEGRO_BITMAP* const* inputs) {
+	struct GamestateResources* data = d;
+	al_use_shader(data->shader);
+	al_set_shader_int("scaleFactor", 1);
+	al_draw_scaled_rotated_bitmap(inputs[0], 320 / 2, 180 * (3 / 4), 320 / 2, 180 / 2 - 120, 1.1 * data->frame.scale, 1.1 * data->frame.scale, data->frame.rot, 0);
+	al_use_shader(NULL);
+}
 
-		al_set_blender(ALLEGRO_ADD, ALLEGRO_ONE, ALLEGRO_INVERSE_ALPHA);
+static void DrawComposite(struct Game* game, void* d, ALLEGRO_BITMAP* const* inputs) {
+	struct GamestateResources* data = d;
+	al_draw_scaled_rotated_bitmap(inputs[0], 320 / 2, 180 * (3 / 4), 320 / 2, 180 / 2 - 120 + data->frame.yoffset, 1.1 * data->frame.scale, 1.1 * data->frame.scale, data->frame.rot, 0);
+}
 
-		//	al_use_shader(NULL);
+// at lower tier, only the top-left part of the screen bitmap gets used
+static void CRTSize(struct GamestateResources* data, int* w, int* h) {
+	int div = 3 - data->quality->crt_tier;
+	*w = al_get_bitmap_width(data->screen) / div;
+	*h = al_get_bitmap_height(data->screen) / div;
+}
 
-		SetFramebufferAsTarget(game);
-		//al_clear_to_color(al_map_rgb(0,255,0));
-		//al_draw_bitmap(data->screen, 0, 0,0);
-		//al_draw_scaled_bitmap(data->screen, 0 ,0, al_get_bitmap_width(data->screen), al_get_bitmap_height(data->screen), 0, 0, 320, 180, 0);
-		al_draw_scaled_rotated_bitmap(data->screen, al_get_bitmap_width(data->screen) / 2, al_get_bitmap_height(data->screen) * (3 / 4), 320 / 2, 180 / 2 - 120 + yoffset, 320 / (float)al_get_bitmap_width(data->screen) * 1.1 * scale, 180 / (float)al_get_bitmap_height(data->screen) * 1.1 * scale, rot, 0);
+static void DrawCRT(struct Game* game, void* d, ALLEGRO_BITMAP* const* inputs) {
+	struct GamestateResources* data = d;
+	int div = 3 - data->quality->crt_tier;
+	int sw, sh;
+	CRTSize(data, &sw, &sh);
+
+	ALLEGRO_COLOR white = al_map_rgb(255, 255, 255);
+	BatchSprite(data->batch, inputs[0], white, 0, 0, 320, 180, 0, 0, sw, sh, 0, BATCH_BLEND_ALPHA);
+	for (int i = 0; i < sw; i += al_get_bitmap_width(data->crt) * 2 / div) {
+		for (int j = 0; j < sh; j += al_get_bitmap_height(data->crt) / div) {
+			BatchSprite(data->batch, data->crt, white, 0, 0, 500, 500, i, j, 1000 / div, 500 / div, 1, BATCH_BLEND_ALPHA);
+		}
 	}
-
-	al_set_target_bitmap(data->pixelator);
-	al_clear_to_color(al_map_rgba(0, 0, 0, 0));
-	al_draw_text(data->font, al_map_rgb(255, 255, 255), 319, 180 - 9, ALLEGRO_ALIGN_RIGHT, "ALPHAAAA BUILD");
-	SetFramebufferAsTarget(game);
-	al_draw_scaled_bitmap(data->pixelator, 0, 0, 320, 180, 320 / 2, 180 / 2, 320 / 2, 180 / 2, 0);
+	BatchSprite(data->batch, inputs[0], white, 0, 0, 320, 180, 0, 0, sw, sh, 2, BATCH_BLEND_MASK); // now as a mask
+	BatchFlush(data->batch);
 }
 
-static void MixerPostprocess(void* buffer, unsigned int samples, void* userdata) {
-	// REMEMBER: don't use any drawing code inside this function
-	// PrintConsole etc. NOT ALLOWED!
-	float* buf = buffer;
-	struct GamestateResources* data = userdata;
+static void DrawCRTComposite(struct Game* game, void* d, ALLEGRO_BITMAP* const* inputs) {
+	struct GamestateResources* data = d;
+	int sw, sh;
+	CRTSize(data, &sw, &sh);
+	al_draw_tinted_scaled_rotated_bitmap_region(inputs[0], 0, 0, sw, sh, al_map_rgb(255, 255, 255), sw / 2, sh * (3 / 4), 320 / 2, 180 / 2 - 120 + data->frame.yoffset, 320 / (float)sw * 1.1 * data->frame.scale, 180 / (float)sh * 1.1 * data->frame.scale, data->frame.rot, 0);
+}
 
-	// critical section: don't use ringbuffer behind our back, as it's getting rewritten
-	al_lock_mutex(data->mutex);
+static void DrawOverlay(struct Game* game, void* d, ALLEGRO_BITMAP* const* inputs) {
+	struct GamestateResources* data = d;
+	BatchText(data->batch, data->atlas, al_map_rgb(255, 255, 255), 319, 180 - 9, ALLEGRO_ALIGN_RIGHT, 0, "ALPHAAAA BUILD");
+	BatchFlush(data->batch);
+}
 
-	int end = data->ringpos + samples;
-	if (end >= SAMPLE_RATE) {
-		end -= SAMPLE_RATE;
-	}
+static void DrawOverlayComposite(struct Game* game, void* d, ALLEGRO_BITMAP* const* inputs) {
+	al_draw_scaled_bitmap(inputs[0], 0, 0, 320, 180, 320 / 2, 180 / 2, 320 / 2, 180 / 2, 0);
+}
 
-	// TODO: in case of mono signal, detect silent channel and ignore
+static void CreatePasses(struct Game* game, struct GamestateResources* data) {
+	struct RenderGraph* g = CreateRenderGraph(game);
+	data->graph = g;
+
+	// targets with matching sizes get to share bitmaps wherever their uses don't overlap
+	int tint = RenderGraphTarget(g, "tint", 320, 180);
+	int scene = RenderGraphTarget(g, "scene", 320, 180);
+	int small = RenderGraphTarget(g, "small", 320 / 4, 180 / 4);
+	int blurred = RenderGraphTarget(g, "blurred", 320, 180);
+	int overlay = RenderGraphTarget(g, "overlay", 320, 180);
+	data->screen_target = RenderGraphImport(g, "screen", data->screen);
+
+	struct Passes* p = &data->passes;
+	p->tint = RenderGraphPass(g, "tint", tint, NULL);
+	p->background_shader = RenderGraphPass(g, "background", RENDER_FRAMEBUFFER, DrawBackgroundShader);
+	RenderGraphInput(g, p->background_shader, tint);
+	p->background_crt = RenderGraphPass(g, "background", RENDER_FRAMEBUFFER, DrawBackgroundCRT);
+
+	p->scene = RenderGraphPass(g, "scene", scene, DrawScene);
+	RenderGraphClear(g, p->scene, al_map_rgba(0, 0, 0, 0));
+
+	p->downsample = RenderGraphPass(g, "downsample", small, DrawDownsample);
+	RenderGraphInput(g, p->downsample, scene);
+	RenderGraphClear(g, p->downsample, al_map_rgba(0, 0, 0, 0));
+	p->blur = RenderGraphPass(g, "blur", blurred, DrawBlur);
+	RenderGraphInput(g, p->blur, small);
+	RenderGraphClear(g, p->blur, al_map_rgba(0, 0, 0, 0));
+	p->blur_composite = RenderGraphPass(g, "blur composite", RENDER_FRAMEBUFFER, DrawBitmap);
+	RenderGraphInput(g, p->blur_composite, blurred);
+
+	p->chromatic = RenderGraphPass(g, "chromatic", RENDER_FRAMEBUFFER, DrawChromatic);
+	RenderGraphInput(g, p->chromatic, scene);
+	p->composite_shader = RenderGraphPass(g, "composite", RENDER_FRAMEBUFFER, DrawCompositeShader);
+	RenderGraphInput(g, p->composite_shader, scene);
+	p->composite = RenderGraphPass(g, "composite", RENDER_FRAMEBUFFER, DrawComposite);
+	RenderGraphInput(g, p->composite, scene);
+	p->crt = RenderGraphPass(g, "crt", data->screen_target, DrawCRT);
+	RenderGraphInput(g, p->crt, scene);
+	RenderGraphClear(g, p->crt, al_map_rgba(0, 0, 0, 0));
+	p->crt_composite = RenderGraphPass(g, "crt composite", RENDER_FRAMEBUFFER, DrawCRTComposite);
+	RenderGraphInput(g, p->crt_composite, data->screen_target);
+
+	p->overlay = RenderGraphPass(g, "overlay", overlay, DrawOverlay);
+	RenderGraphClear(g, p->overlay, al_map_rgba(0, 0, 0, 0));
+	p->overlay_composite = RenderGraphPass(g, "overlay composite", RENDER_FRAMEBUFFER, DrawOverlayComposite);
+	RenderGraphInput(g, p->overlay_composite, overlay);
+}
 
-	int i = 0;
-	for (int pos = data->ringpos; pos != end; pos++) {
-		data->ringbuffer[pos] = (buf[i] + buf[i + 1]) / 2;
-		i += 2;
-		if (pos == SAMPLE_RATE - 1) {
-			pos = -1;
-		}
+void Gamestate_Draw(struct Game* game, struct GamestateResources* data) {
+	// Called as soon as possible, but no sooner than next Gamestate_Logic call.
+	// Draw everything to the screen here.
+	GovernorFrameStart(&data->governor);
+	if (data->calibration) {
+		CalibrationFrameStart(data->calibration);
+	}
+
+	struct RenderGraph* g = data->graph;
+	struct Passes* p = &data->passes;
+	bool shaders = data->use_shaders, blur = data->quality->blur_taps, crt = !shaders && data->quality->crt_tier;
+	RenderGraphEnable(g, p->tint, shaders);
+	RenderGraphEnable(g, p->background_shader, shaders);
+	RenderGraphEnable(g, p->background_crt, !shaders);
+	RenderGraphEnable(g, p->downsample, blur);
+	RenderGraphEnable(g, p->blur, blur);
+	RenderGraphEnable(g, p->blur_composite, blur);
+	RenderGraphEnable(g, p->composite_shader, shaders);
+	RenderGraphEnable(g, p->composite, !shaders && !crt);
+	RenderGraphEnable(g, p->crt, crt);
+	RenderGraphEnable(g, p->crt_composite, crt);
+
+	data->frame.background = al_color_hsv(fabs(sin(data->field.rotation / 360.0)) * 360, 0.75, 0.5 + sin(data->field.rotation / 20.0) / 20.0);
+	RenderGraphClear(g, p->tint, data->frame.background);
+
+	float s = data->field.distortion / 5.0;
+	data->frame.tint = al_map_rgba(32 * s, 32 * s, 32 * s, 32 * s);
+	data->frame.rot = sin(data->field.rotation / 20.0) / 20.0;
+	float ball = data->field.x - data->field.camera;
+	data->frame.scale = 1 - pow((fabs((320 / 2) - ball) / (320 / 2.0)), 2) * 0.1;
+	data->frame.yoffset = data->yoffset;
+	data->frame.offset = data->field.distortion / 2.0 * (rand() / (float)RAND_MAX);
+
+	RenderGraphExecute(g, data);
+
+	if (data->calibration && CalibrationFlash(data->calibration)) {
+		al_draw_filled_rectangle(0, 0, 320, 180, al_map_rgb(255, 255, 255));
+		CalibrationFrameEnd(data->calibration);
+	}
+
+	if (GovernorFrameEnd(&data->governor)) {
+		SetQuality(game, data, data->governor.level);
 	}
-	data->ringpos = end;
-
-	al_unlock_mutex(data->mutex);
 }
 
-void FFT(void* buffer, unsigned int samples, void* userdata) {
-	float* buf = buffer;
+static void MixerPostprocess(void* buffer, unsigned int samples, void* userdata) {
+	// REMEMBER: don't use any drawing code inside this function
+	// PrintConsole etc. NOT ALLOWED!
 	struct GamestateResources* data = userdata;
-	double* in;
-	fftw_complex* out;
-	in = (double*)fftw_malloc(sizeof(double) * samples);
-	out = (fftw_complex*)fftw_malloc(sizeof(fftw_complex) * (samples / 2 + 1));
+	RealtimeEnter();
+	AnalysisFeed(data->analysis, buffer, samples, 2);
+	RealtimeLeave();
+}
 
-	float* window = CreateHanningWindow(samples, false);
+void FFT(struct GamestateResources* data, int channel, float* spectrum) {
+	unsigned int samples = data->analysis->fft_size;
+	float* buf = data->analysis->fftbuffer + channel * samples;
+	float* fft = data->fft[channel];
 	float min = 0, max = 0;
 	for (unsigned int i = 0; i < samples; i++) {
 		if (buf[i] > max) {
@@ -643,34 +667,22 @@ void FFT(void* buffer, unsigned int samples, void* userdata) {
 	if (min > max) {
 		max = min;
 	}
-	if (max > data->max_max) {
-		data->max_max = max;
+	if (max > data->max_max[channel]) {
+		data->max_max[channel] = max;
 	}
 
-	for (unsigned int i = 0; i < samples; i++) {
-		in[i] = (buf[i] * window[i]) / data->max_max;
-		//buf[i] = 0;
-		//PrintConsole(data->game, "%d: %f", i, buf[i]);
-	}
-	//PrintConsole(data->game, "samples: %d, min: %f, max: %f, max_max: %f", samples, min, max, data->max_max);
-	//fflush(stdout);
-	free(window);
+	// the window gets normalized by max_max; as the transform is linear, it's enough to scale its output
+	float scale = data->max_max[channel];
 
-	if (max < data->max_max) {
-		data->max_max -= (data->max_max - max) / 1024.0;
+	if (max < data->max_max[channel]) {
+		data->max_max[channel] -= (data->max_max[channel] - max) / 1024.0;
 	}
-	if (data->max_max < MAX_MAX_LIMIT) {
-		data->max_max = MAX_MAX_LIMIT; // reboot develop setting
+	if (data->max_max[channel] < MAX_MAX_LIMIT) {
+		data->max_max[channel] = MAX_MAX_LIMIT; // reboot develop setting
 	}
 
-	fftw_plan p = fftw_plan_dft_r2c_1d(samples, in, out, FFTW_ESTIMATE);
-	fftw_execute(p);
-
 	for (unsigned int i = 0; i < (samples / 2 + 1); i++) {
-		out[i][0] *= 1. / samples;
-		out[i][1] *= 1. / samples;
-
-		double val = sqrt(out[i][0] * out[i][0] + out[i][1] * out[i][1]);
+		double val = spectrum[i] / scale;
 		if (data->music_mode) {
 			val = sqrt(sqrt(val)) * 2;
 		} else {
@@ -679,18 +691,14 @@ void FFT(void* buffer, unsigned int samples, void* userdata) {
 				val = 1;
 			}
 		}
-		data->fft[i] = val;
+		fft[i] = val;
 		if (!data->music_mode) {
-			data->fft[i / 2] += val / 2;
-			if (data->fft[i / 2] > 1) data->fft[i / 2] = 1;
-			data->fft[i / 4] += val / 4;
-			if (data->fft[i / 4] > 1) data->fft[i / 4] = 1;
+			fft[i / 2] += val / 2;
+			if (fft[i / 2] > 1) fft[i / 2] = 1;
+			fft[i / 4] += val / 4;
+			if (fft[i / 4] > 1) fft[i / 4] = 1;
 		}
 	}
-
-	fftw_destroy_plan(p);
-	fftw_free(in);
-	fftw_free(out);
 }
 
 void Gamestate_ProcessEvent(struct Game* game, struct GamestateResources* data, ALLEGRO_EVENT* ev) {
@@ -701,14 +709,13 @@ void Gamestate_ProcessEvent(struct Game* game, struct GamestateResources* data,
 		// When there are no active gamestates, the engine will quit.
 	}
 	if (game->config.debug.enabled && (ev->type == ALLEGRO_EVENT_KEY_DOWN) && (ev->keyboard.keycode == ALLEGRO_KEY_SPACE)) {
-		data->x = 320 / 2;
-		data->y = 120;
-		data->vx = 0;
-		data->vy = 0;
+		FieldRespawn(&data->field);
+		data->field.vx = 0;
+		data->field.vy = 0;
 	}
 	if ((ev->type == ALLEGRO_EVENT_KEY_DOWN) && (ev->keyboard.keycode == ALLEGRO_KEY_R)) {
-		data->score1 = 0;
-		data->score2 = 0;
+		data->field.score1 = 0;
+		data->field.score2 = 0;
 	}
 	if (game->config.debug.enabled && (ev->type == ALLEGRO_EVENT_KEY_DOWN) && (ev->keyboard.keycode == ALLEGRO_KEY_N)) {
 		if (data->yoffset == 0) {
@@ -719,6 +726,9 @@ void Gamestate_ProcessEvent(struct Game* game, struct GamestateResources* data,
 			data->yoffset = 0;
 		}
 	}
+	if (data->calibration && (ev->type == ALLEGRO_EVENT_KEY_DOWN) && (ev->keyboard.keycode == ALLEGRO_KEY_C)) {
+		CalibrationStart(data->calibration, CALIBRATION_CLICKS);
+	}
 	if ((ev->type == ALLEGRO_EVENT_KEY_DOWN) && (ev->keyboard.keycode == ALLEGRO_KEY_TAB)) {
 		SwitchCurrentGamestate(game, "cinema");
 	}
@@ -733,9 +743,8 @@ void Gamestate_ProcessEvent(struct Game* game, struct GamestateResources* data,
 		LoadLevel(game, data, data->current_level);
 	}
 
-	if (ev->type == ALLEGRO_EVENT_AUDIO_RECORDER_FRAGMENT) {
-		ALLEGRO_AUDIO_RECORDER_EVENT* re = al_get_audio_recorder_event(ev);
-		MixerPostprocess(re->buffer, re->samples, data);
+	if (data->capture) {
+		CaptureProcessEvent(data->capture, ev);
 	}
 
 	if (ev->type == ALLEGRO_EVENT_DISPLAY_RESIZE) {
@@ -745,6 +754,7 @@ void Gamestate_ProcessEvent(struct Game* game, struct GamestateResources* data,
 		al_set_new_bitmap_flags(flags | ALLEGRO_MAG_LINEAR | ALLEGRO_MIN_LINEAR);
 		data->screen = CreateNotPreservedBitmap(al_get_display_width(game->display), al_get_display_height(game->display));
 		al_set_new_bitmap_flags(flags);
+		RenderGraphSetImport(data->graph, data->screen_target, data->screen);
 	}
 }
 
@@ -759,14 +769,19 @@ void* Gamestate_Load(struct Game* game, void (*progress)(struct Game*)) {
 
 	progress(game); // report that we progressed with the loading, so the engine can draw a progress bar
 
-	for (int i = 0; i < SAMPLE_RATE; i++) {
-		data->ringbuffer[i] = 0;
+	int device_rate = al_get_mixer_frequency(game->audio.mixer);
+	// with stereo input, each player gets their own channel
+	int channels = strtol(GetConfigOptionDefault(game, "waaaa", "stereo", "0"), NULL, 10) ? 2 : 1;
+	data->analysis = CreateAnalysis(game, device_rate, FFT_SAMPLES, channels);
+	for (int c = 0; c < channels; c++) {
+		data->fft[c] = calloc(data->analysis->fft_size / 2 + 1, sizeof(float));
+		data->onset[c] = CreateOnsetDetector(data->analysis->fft_size / 2 + 1);
 	}
+	data->pitch = CreatePitchTracker(data->analysis);
 
 	data->music_mode = false;
-	data->mutex = al_create_mutex();
 
-	data->mixer = al_create_mixer(SAMPLE_RATE, ALLEGRO_AUDIO_DEPTH_FLOAT32, ALLEGRO_CHANNEL_CONF_2);
+	data->mixer = al_create_mixer(device_rate, ALLEGRO_AUDIO_DEPTH_FLOAT32, ALLEGRO_CHANNEL_CONF_2);
 	al_attach_mixer_to_mixer(data->mixer, game->audio.music);
 
 	data->audio = al_load_audio_stream(GetDataFilePath(game, "waaaa.flac"), 4, 4096);
@@ -776,24 +791,35 @@ void* Gamestate_Load(struct Game* game, void (*progress)(struct Game*)) {
 	al_attach_audio_stream_to_mixer(data->audio, data->mixer);
 	al_set_audio_stream_gain(data->audio, 1);
 
-	data->recorder = al_create_audio_recorder(128, 1024, SAMPLE_RATE,
-		ALLEGRO_AUDIO_DEPTH_FLOAT32, ALLEGRO_CHANNEL_CONF_2);
+	data->capture = CreateCapture(game, data->analysis, device_rate);
 
-	if (!data->recorder) {
+	if (!data->capture) {
 		data->music_mode = true;
 		PrintConsole(game, "ERROR: audio recorder failed!");
+	} else {
+		data->calibration = CreateCalibration(game, device_rate);
+		CaptureSetListener(data->capture, CalibrationListen, data->calibration);
 	}
 
 	if (data->music_mode) {
 		al_set_mixer_postprocess_callback(data->mixer, MixerPostprocess, data);
-	} else {
-		al_register_event_source(game->event_queue, al_get_audio_recorder_event_source(data->recorder));
 	}
 
-	data->pixelator = CreateNotPreservedBitmap(320, 180);
-	data->stage = CreateNotPreservedBitmap(320, 180);
-	data->background = CreateNotPreservedBitmap(320, 180);
-	data->blurer = CreateNotPreservedBitmap(320 / 4, 180 / 4);
+	CreatePasses(game, data);
+
+	int history = strtol(GetConfigOptionDefault(game, "waaaa", "waterfall", WATERFALL_HISTORY), NULL, 10);
+	if (history > 0) {
+		data->waterfall = CreateWaterfall(history, BARS_VISIBLE);
+	}
+
+	const char* recording = GetConfigOption(game, "waaaa", "record");
+	if (recording) {
+		// inputs of every tick, to be replayed by waaaa-simulate
+		data->recording = al_fopen(recording, "wb");
+	}
+
+	data->batch = CreateSpriteBatch(BATCH_CAPACITY);
+	data->particles = CreateParticles(PARTICLES_CAPACITY, PARTICLES_GRAVITY, 1);
 
 	data->point_sample = al_load_sample(GetDataFilePath(game, "point.flac"));
 	data->point = al_create_sample_instance(data->point_sample);
@@ -803,6 +829,8 @@ void* Gamestate_Load(struct Game* game, void (*progress)(struct Game*)) {
 
 	data->game = game;
 
+	InitGovernor(&data->governor, game, sizeof(QUALITY_LEVELS) / sizeof(QUALITY_LEVELS[0]));
+
 	data->shader = CreateShader(game, GetDataFilePath(game, "vertex.glsl"), GetDataFilePath(game, "pixel.glsl"));
 
 	al_set_new_bitmap_flags(flags);
@@ -812,8 +840,12 @@ void* Gamestate_Load(struct Game* game, void (*progress)(struct Game*)) {
 
 void Gamestate_PostLoad(struct Game* game, struct GamestateResources* data) {
 	int flags = al_get_new_bitmap_flags();
+	al_set_new_bitmap_flags(flags ^ ALLEGRO_MAG_LINEAR);
+	RenderGraphPrepare(data->graph); // its targets get created with the flags set above
+
 	al_set_new_bitmap_flags(flags | ALLEGRO_MAG_LINEAR | ALLEGRO_MIN_LINEAR);
 	data->screen = CreateNotPreservedBitmap(al_get_display_width(game->display), al_get_display_height(game->display));
+	RenderGraphSetImport(data->graph, data->screen_target, data->screen);
 
 #ifndef __EMSCRIPTEN__
 	data->crt = al_create_bitmap(500, 500);
@@ -843,6 +875,21 @@ void Gamestate_PostLoad(struct Game* game, struct GamestateResources* data) {
 	al_destroy_bitmap(crt);
 #endif
 
+	data->atlas = CreateAtlas(ATLAS_SIZE, ATLAS_SIZE);
+	AtlasAddFont(data->atlas, data->font);
+#ifndef __EMSCRIPTEN__
+	ALLEGRO_BITMAP* packed = AtlasAdd(data->atlas, data->crt);
+	if (packed) {
+		al_destroy_bitmap(data->crt);
+		data->crt = packed;
+	}
+	packed = AtlasAdd(data->atlas, data->crtbg);
+	if (packed) {
+		al_destroy_bitmap(data->crtbg);
+		data->crtbg = packed;
+	}
+#endif
+
 	al_set_new_bitmap_flags(flags);
 }
 
@@ -852,24 +899,38 @@ void Gamestate_Unload(struct Game* game, struct GamestateResources* data) {
 	al_destroy_font(data->font);
 	al_destroy_audio_stream(data->audio);
 	al_destroy_mixer(data->mixer);
-	if (data->recorder) {
-		al_destroy_audio_recorder(data->recorder);
+	if (data->capture) {
+		DestroyCapture(data->capture);
+		DestroyCalibration(data->calibration);
 	}
 #ifndef __EMSCRIPTEN__
 	al_destroy_bitmap(data->crt);
 	al_destroy_bitmap(data->crtbg);
 #endif
+	DestroyAtlas(data->atlas);
+	DestroySpriteBatch(data->batch);
 	al_destroy_bitmap(data->screen);
-	al_destroy_bitmap(data->stage);
+	DestroyLevelView(data->view);
+	DestroyLevel(data->level);
 
-	al_destroy_bitmap(data->pixelator);
-	al_destroy_bitmap(data->blurer);
-	al_destroy_bitmap(data->background);
+	DestroyRenderGraph(data->graph);
 	DestroyShader(game, data->shader);
 	al_destroy_sample_instance(data->point);
 	al_destroy_sample(data->point_sample);
+	if (data->recording) {
+		al_fclose(data->recording);
+	}
+	DestroyParticles(data->particles);
 
-	al_destroy_mutex(data->mutex);
+	for (int c = 0; c < data->analysis->channels; c++) {
+		free(data->fft[c]);
+		DestroyOnsetDetector(data->onset[c]);
+	}
+	DestroyPitchTracker(data->pitch);
+	if (data->waterfall) {
+		DestroyWaterfall(data->waterfall);
+	}
+	DestroyAnalysis(data->analysis);
 	free(data);
 }
 
@@ -877,35 +938,33 @@ void Gamestate_Start(struct Game* game, struct GamestateResources* data) {
 	// Called when this gamestate gets control. Good place for initializing state,
 	// playing music etc.
 	data->use_shaders = true;
-	data->ringpos = 0;
-	data->max_max = MAX_MAX_LIMIT;
+	for (int c = 0; c < ANALYSIS_MAX_CHANNELS; c++) {
+		data->max_max[c] = MAX_MAX_LIMIT;
+	}
 	data->demo_mode = true;
-	if (data->recorder) {
-		al_start_audio_recorder(data->recorder);
+	if (data->capture) {
+		CaptureStart(data->capture);
 	}
 	LoadLevel(game, data, "levels/menu.lvl");
-	data->x = 320 / 2;
-	data->y = 120;
-	data->vx = 0;
-	data->vy = 0;
+	SetQuality(game, data, data->governor.level);
+	data->hop_counter = 0;
+	InitField(&data->field, rand());
+	FieldRespawn(&data->field);
+	data->particles->count = 0;
 	data->blink_counter = 0;
 
-	data->distortion = 0;
-	data->rotation = 0;
+	data->kick = 0;
 	data->screamtime = 0;
 	data->inmenu = true;
 	data->inmulti = false;
-	data->shakin_dudi = 0;
-	data->score1 = 0;
-	data->score2 = 0;
 
 	data->yoffset = 0;
 }
 
 void Gamestate_Stop(struct Game* game, struct GamestateResources* data) {
 	// Called when gamestate gets stopped. Stop timers, music etc. here.
-	if (data->recorder) {
-		al_stop_audio_recorder(data->recorder);
+	if (data->capture) {
+		CaptureStop(data->capture);
 	}
 }
 
@@ -921,15 +980,13 @@ void Gamestate_Resume(struct Game* game, struct GamestateResources* data) {
 // Ignore this for now.
 // TODO: Check, comment, refine and/or remove:
 void Gamestate_Reload(struct Game* game, struct GamestateResources* data) {
-	data->pixelator = CreateNotPreservedBitmap(320, 180);
-	data->stage = CreateNotPreservedBitmap(320, 180);
-	data->background = CreateNotPreservedBitmap(320, 180);
-	data->blurer = CreateNotPreservedBitmap(320 / 4, 180 / 4);
+	RenderGraphInvalidate(data->graph);
 
 	int flags = al_get_new_bitmap_flags();
 	al_set_new_bitmap_flags(flags | ALLEGRO_MAG_LINEAR | ALLEGRO_MIN_LINEAR);
 	data->screen = CreateNotPreservedBitmap(al_get_display_width(game->display), al_get_display_height(game->display));
 	al_set_new_bitmap_flags(flags);
+	RenderGraphSetImport(data->graph, data->screen_target, data->screen);
 
-	LoadLevel(game, data, data->current_level);
+	LevelViewInvalidate(data->view);
 }
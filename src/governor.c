@@ -0,0 +1,106 @@
+/*! \file governor.c
+ *  \brief Frame budget governor picking a quality level based on measured frame times.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "governor.h"
+#include <libsuperderpy.h>
+
+// The governor looks at two things: the interval between frames, which includes
+// waiting for the GPU and missed vsyncs, and the time we actually spend working
+// on a frame (analysis plus drawing). It steps down once frames have been late for
+// a while, and steps back up only after a much longer period with plenty of spare
+// time. When an upgrade gets taken back soon after, the next one waits twice as long.
+
+static void ResetMeasurements(struct Governor* g) {
+	g->frame_time = 0;
+	g->work_time = 0;
+	g->over = 0;
+	g->under = 0;
+}
+
+static double Smooth(double avg, double sample) {
+	if (avg == 0) {
+		return sample;
+	}
+	return avg + (sample - avg) * GOVERNOR_SMOOTHING;
+}
+
+void InitGovernor(struct Governor* g, struct Game* game, int num_levels) {
+	memset(g, 0, sizeof(struct Governor));
+	g->num_levels = num_levels;
+	g->enabled = strtol(GetConfigOptionDefault(game, "governor", "enabled", "1"), NULL, 10);
+	g->budget = strtod(GetConfigOptionDefault(game, "governor", "budget", "16.667"), NULL) / 1000.0;
+	g->level = strtol(GetConfigOptionDefault(game, "governor", "level", "0"), NULL, 10);
+	if (g->level < 0 || g->level >= num_levels) {
+		g->level = 0;
+	}
+	g->since_upgrade = GOVERNOR_UPGRADE_FRAMES;
+}
+
+void GovernorReportAnalysis(struct Governor* g, double seconds) {
+	g->analysis_time += seconds;
+}
+
+void GovernorFrameStart(struct Governor* g) {
+	double now = al_get_time();
+	if (g->last_frame) {
+		// don't let a single hiccup (e.g. loading or a paused window) skew the average
+		g->frame_time = Smooth(g->frame_time, MIN(now - g->last_frame, g->budget * 4));
+	}
+	g->last_frame = now;
+	g->frame_start = now;
+}
+
+// Returns true when the quality level has changed.
+bool GovernorFrameEnd(struct Governor* g) {
+	double work = al_get_time() - g->frame_start + g->analysis_time;
+	g->analysis_time = 0;
+	g->work_time = Smooth(g->work_time, work);
+
+	if (!g->enabled) {
+		return false;
+	}
+
+	g->since_upgrade++;
+	if (g->since_upgrade == GOVERNOR_UPGRADE_FRAMES * 4 && g->backoff) {
+		g->backoff--;
+	}
+
+	bool late = g->frame_time > g->budget * GOVERNOR_OVER_BUDGET;
+	g->over = late ? g->over + 1 : 0;
+	g->under = (!late && g->work_time < g->budget * GOVERNOR_HEADROOM) ? g->under + 1 : 0;
+
+	if (g->over >= GOVERNOR_DOWNGRADE_FRAMES && g->level < g->num_levels - 1) {
+		if (g->since_upgrade < GOVERNOR_UPGRADE_FRAMES) {
+			g->backoff = MIN(g->backoff + 1, GOVERNOR_MAX_BACKOFF);
+		}
+		g->level++;
+		ResetMeasurements(g);
+		return true;
+	}
+
+	if (g->under >= (GOVERNOR_UPGRADE_FRAMES << g->backoff) && g->level > 0) {
+		g->level--;
+		g->since_upgrade = 0;
+		ResetMeasurements(g);
+		return true;
+	}
+
+	return false;
+}
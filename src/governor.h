@@ -0,0 +1,53 @@
+/*! \file governor.h
+ *  \brief Frame budget governor picking a quality level based on measured frame times.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef WAAAA_GOVERNOR_H
+#define WAAAA_GOVERNOR_H
+
+#include <libsuperderpy.h>
+
+#define GOVERNOR_SMOOTHING 0.05 // weight of the newest sample in the moving averages
+#define GOVERNOR_OVER_BUDGET 1.2 // frame time above budget * this counts as a missed frame
+#define GOVERNOR_HEADROOM 0.5 // work time below budget * this counts as spare time
+#define GOVERNOR_DOWNGRADE_FRAMES 45
+#define GOVERNOR_UPGRADE_FRAMES 300
+#define GOVERNOR_MAX_BACKOFF 4
+
+struct Governor {
+	bool enabled;
+	int level; // 0 is the best quality
+	int num_levels;
+	double budget; // seconds per frame
+
+	double frame_time, work_time; // moving averages, in seconds
+	double analysis_time; // accumulated since the last frame
+	double last_frame, frame_start;
+
+	int over, under; // consecutive frames above and below thresholds
+	int backoff; // upgrades that had to be taken back, multiplies the time before next upgrade
+	int since_upgrade;
+};
+
+void InitGovernor(struct Governor* g, struct Game* game, int num_levels);
+void GovernorReportAnalysis(struct Governor* g, double seconds);
+void GovernorFrameStart(struct Governor* g);
+bool GovernorFrameEnd(struct Governor* g);
+
+#endif
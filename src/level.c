@@ -0,0 +1,109 @@
+/*! \file level.c
+ *  \brief Chunked tile storage for levels of any size, independent of Allegro.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "level.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Only the line offsets get indexed up front; the text of each line is kept around
+// and a chunk gets cut out of it on demand. Levels many screens wide cost one pass
+// over the file to load, and only what the ball and the camera actually visit gets
+// turned into chunks.
+
+struct Level* CreateLevel(const char* text, size_t size) {
+	struct Level* level = calloc(1, sizeof(struct Level));
+	level->text = malloc(size ? size : 1);
+	memcpy(level->text, text, size);
+	level->size = size;
+
+	size_t capacity = 64;
+	level->lines = malloc(capacity * sizeof(size_t));
+	size_t start = 0;
+	for (size_t i = 0; i <= size; i++) {
+		if (i < size && text[i] != '\n') {
+			continue;
+		}
+		int length = i - start;
+		if (length && text[i - 1] == '\r') {
+			length--;
+		}
+		if (i < size || length) { // no empty row after the last newline
+			if ((size_t)level->rows == capacity) {
+				capacity *= 2;
+				level->lines = realloc(level->lines, capacity * sizeof(size_t));
+			}
+			level->lines[level->rows++] = start;
+			if (length > level->columns) {
+				level->columns = length;
+			}
+		}
+		start = i + 1;
+	}
+
+	level->chunks_x = (level->columns + LEVEL_CHUNK_SIZE - 1) / LEVEL_CHUNK_SIZE;
+	level->chunks_y = (level->rows + LEVEL_CHUNK_SIZE - 1) / LEVEL_CHUNK_SIZE;
+	level->directory = calloc((size_t)level->chunks_x * level->chunks_y + 1, sizeof(struct LevelChunk*));
+	return level;
+}
+
+struct LevelChunk* LevelChunk(struct Level* level, int cx, int cy) {
+	struct LevelChunk** slot = &level->directory[cy * level->chunks_x + cx];
+	if (*slot) {
+		return *slot;
+	}
+
+	struct LevelChunk* chunk = malloc(sizeof(struct LevelChunk));
+	memset(chunk->tiles, LEVEL_EMPTY, sizeof(chunk->tiles));
+	for (int y = 0; y < LEVEL_CHUNK_SIZE && cy * LEVEL_CHUNK_SIZE + y < level->rows; y++) {
+		int row = cy * LEVEL_CHUNK_SIZE + y;
+		size_t start = level->lines[row];
+		size_t end = (row + 1 < level->rows) ? level->lines[row + 1] : level->size;
+		for (int x = 0; x < LEVEL_CHUNK_SIZE; x++) {
+			size_t pos = start + cx * LEVEL_CHUNK_SIZE + x;
+			if (pos >= end || level->text[pos] == '\n' || level->text[pos] == '\r') {
+				break;
+			}
+			chunk->tiles[y][x] = level->text[pos];
+		}
+	}
+
+	*slot = chunk;
+	level->loaded++;
+	return chunk;
+}
+
+// For sharing a level between threads; nothing gets written once all the chunks are there.
+void LevelLoadAll(struct Level* level) {
+	for (int cy = 0; cy < level->chunks_y; cy++) {
+		for (int cx = 0; cx < level->chunks_x; cx++) {
+			LevelChunk(level, cx, cy);
+		}
+	}
+}
+
+void DestroyLevel(struct Level* level) {
+	for (int i = 0; i < level->chunks_x * level->chunks_y; i++) {
+		free(level->directory[i]);
+	}
+	free(level->directory);
+	free(level->lines);
+	free(level->text);
+	free(level);
+}
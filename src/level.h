@@ -0,0 +1,66 @@
+/*! \file level.h
+ *  \brief Chunked tile storage for levels of any size, independent of Allegro.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef WAAAA_LEVEL_H
+#define WAAAA_LEVEL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#define LEVEL_CHUNK_SHIFT 5
+#define LEVEL_CHUNK_SIZE (1 << LEVEL_CHUNK_SHIFT) // tiles along each side of a chunk
+#define LEVEL_TILE_SIZE 4 // pixels
+#define LEVEL_EMPTY '.' // outside of the level, and where lines are too short
+
+struct LevelChunk {
+	char tiles[LEVEL_CHUNK_SIZE][LEVEL_CHUNK_SIZE]; // [y][x]
+};
+
+// Level files are text, one line per row of tiles. Chunks are parsed out of it
+// the first time something looks at them.
+struct Level {
+	int columns, rows; // in tiles; the longest line decides the width
+	int chunks_x, chunks_y;
+	struct LevelChunk** directory; // chunks_x * chunks_y, row by row; NULL until loaded
+	int loaded;
+
+	char* text;
+	size_t* lines; // offset of each row in text
+	size_t size;
+};
+
+struct Level* CreateLevel(const char* text, size_t size);
+struct LevelChunk* LevelChunk(struct Level* level, int cx, int cy);
+void LevelLoadAll(struct Level* level);
+void DestroyLevel(struct Level* level);
+
+// Tile lookup is just a directory access, chunks only get parsed on the first one.
+static inline char LevelTile(struct Level* level, int x, int y) {
+	if (x < 0 || y < 0 || x >= level->columns || y >= level->rows) {
+		return LEVEL_EMPTY;
+	}
+	struct LevelChunk* chunk = level->directory[(y >> LEVEL_CHUNK_SHIFT) * level->chunks_x + (x >> LEVEL_CHUNK_SHIFT)];
+	if (!chunk) {
+		chunk = LevelChunk(level, x >> LEVEL_CHUNK_SHIFT, y >> LEVEL_CHUNK_SHIFT);
+	}
+	return chunk->tiles[y & (LEVEL_CHUNK_SIZE - 1)][x & (LEVEL_CHUNK_SIZE - 1)];
+}
+
+#endif
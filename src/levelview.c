@@ -0,0 +1,129 @@
+/*! \file levelview.c
+ *  \brief Lazily rasterized chunks of the level around the camera.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "levelview.h"
+#include <libsuperderpy.h>
+
+// Each chunk gets rasterized into its own bitmap the first time it comes into view.
+// Once more than LEVELVIEW_MAX_CACHED of them are kept, the ones that aren't visible
+// get dropped again, so memory stays bounded no matter how wide the level is.
+
+struct LevelView* CreateLevelView(struct Level* level, bool bright) {
+	struct LevelView* v = calloc(1, sizeof(struct LevelView));
+	v->level = level;
+	v->bright = bright;
+	v->chunks = calloc((size_t)level->chunks_x * level->chunks_y + 1, sizeof(ALLEGRO_BITMAP*));
+	return v;
+}
+
+static ALLEGRO_BITMAP* Rasterize(struct LevelView* v, int cx, int cy) {
+	struct LevelChunk* chunk = LevelChunk(v->level, cx, cy);
+	ALLEGRO_BITMAP* bitmap = al_create_bitmap(LEVELVIEW_CHUNK_PIXELS, LEVELVIEW_CHUNK_PIXELS);
+
+	ALLEGRO_STATE state;
+	al_store_state(&state, ALLEGRO_STATE_TARGET_BITMAP);
+	al_set_target_bitmap(bitmap);
+	al_clear_to_color(al_map_rgba(0, 0, 0, 0));
+
+	int color = v->bright ? 50 : 32;
+	int color2 = v->bright ? 95 : 64;
+	for (int y = 0; y < LEVEL_CHUNK_SIZE; y++) {
+		for (int x = 0; x < LEVEL_CHUNK_SIZE; x++) {
+			ALLEGRO_COLOR c;
+			switch (chunk->tiles[y][x]) {
+				case 'O':
+					c = al_map_rgb(255, 255, 255);
+					break;
+				case 'X':
+					c = al_map_rgba(0, 0, color, color);
+					break;
+				case 'Y':
+					c = al_map_rgba(color, 0, 0, color);
+					break;
+				case 'a':
+					c = al_map_rgba(color2, color2, color2, color2);
+					break;
+				case '~':
+					c = al_map_rgba(0, color, 0, color);
+					break;
+				default:
+					continue;
+			}
+			int px = x * LEVEL_TILE_SIZE, py = y * LEVEL_TILE_SIZE;
+			al_draw_filled_rectangle(px, py, px + LEVEL_TILE_SIZE, py + LEVEL_TILE_SIZE, c);
+		}
+	}
+
+	al_restore_state(&state);
+	return bitmap;
+}
+
+static void Evict(struct LevelView* v, int x1, int y1, int x2, int y2) {
+	for (int cy = 0; cy < v->level->chunks_y; cy++) {
+		for (int cx = 0; cx < v->level->chunks_x; cx++) {
+			ALLEGRO_BITMAP** slot = &v->chunks[cy * v->level->chunks_x + cx];
+			if (*slot && (cx < x1 || cx > x2 || cy < y1 || cy > y2)) {
+				al_destroy_bitmap(*slot);
+				*slot = NULL;
+				v->cached--;
+			}
+		}
+	}
+}
+
+// Draws the part of the level starting at (x, y) in level pixels, at the origin of the target.
+void DrawLevelView(struct LevelView* v, int x, int y, int width, int height) {
+	int x1 = MAX(0, x / LEVELVIEW_CHUNK_PIXELS), y1 = MAX(0, y / LEVELVIEW_CHUNK_PIXELS);
+	int x2 = MIN(v->level->chunks_x - 1, (x + width - 1) / LEVELVIEW_CHUNK_PIXELS);
+	int y2 = MIN(v->level->chunks_y - 1, (y + height - 1) / LEVELVIEW_CHUNK_PIXELS);
+
+	for (int cy = y1; cy <= y2; cy++) {
+		for (int cx = x1; cx <= x2; cx++) {
+			ALLEGRO_BITMAP** slot = &v->chunks[cy * v->level->chunks_x + cx];
+			if (!*slot) {
+				*slot = Rasterize(v, cx, cy);
+				v->cached++;
+			}
+		}
+	}
+
+	al_hold_bitmap_drawing(true);
+	for (int cy = y1; cy <= y2; cy++) {
+		for (int cx = x1; cx <= x2; cx++) {
+			al_draw_bitmap(v->chunks[cy * v->level->chunks_x + cx], cx * LEVELVIEW_CHUNK_PIXELS - x, cy * LEVELVIEW_CHUNK_PIXELS - y, 0);
+		}
+	}
+	al_hold_bitmap_drawing(false);
+
+	if (v->cached > LEVELVIEW_MAX_CACHED) {
+		Evict(v, x1, y1, x2, y2);
+	}
+}
+
+// Drops all the rasterized chunks, e.g. after the display got lost.
+void LevelViewInvalidate(struct LevelView* v) {
+	Evict(v, 0, 0, -1, -1);
+}
+
+void DestroyLevelView(struct LevelView* v) {
+	LevelViewInvalidate(v);
+	free(v->chunks);
+	free(v);
+}
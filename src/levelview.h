@@ -0,0 +1,42 @@
+/*! \file levelview.h
+ *  \brief Lazily rasterized chunks of the level around the camera.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef WAAAA_LEVELVIEW_H
+#define WAAAA_LEVELVIEW_H
+
+#include "level.h"
+#include <libsuperderpy.h>
+
+#define LEVELVIEW_CHUNK_PIXELS (LEVEL_CHUNK_SIZE * LEVEL_TILE_SIZE)
+#define LEVELVIEW_MAX_CACHED 16 // chunks kept rasterized, beyond those in view
+
+struct LevelView {
+	struct Level* level; // not owned
+	ALLEGRO_BITMAP** chunks; // same layout as the level's directory; NULL when not rasterized
+	int cached;
+	bool bright; // stronger colors for when there are no shaders
+};
+
+struct LevelView* CreateLevelView(struct Level* level, bool bright);
+void DrawLevelView(struct LevelView* v, int x, int y, int width, int height);
+void LevelViewInvalidate(struct LevelView* v);
+void DestroyLevelView(struct LevelView* v);
+
+#endif
@@ -0,0 +1,152 @@
+/*! \file onset.c
+ *  \brief Spectral flux onset detection and tempo estimation.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "onset.h"
+#include <libsuperderpy.h>
+#include <math.h>
+
+// Onsets are peaks of the spectral flux (sum of the magnitude increases since the previous
+// hop) that rise above a threshold following its recent average. Intervals between each
+// onset and the few before it vote in a histogram of tempi folded into one octave; its
+// peak gives the tempo, and beats are predicted from it, realigned to onsets that land
+// close enough. Everything works on the spectrum the analysis has already computed,
+// so each hop costs one pass over the bins.
+
+#define TEMPO_BINS (ONSET_MAX_BPM - ONSET_MIN_BPM)
+
+struct OnsetDetector* CreateOnsetDetector(int bins) {
+	struct OnsetDetector* o = calloc(1, sizeof(struct OnsetDetector));
+	o->bins = bins;
+	o->previous = calloc(bins, sizeof(float));
+	return o;
+}
+
+static void UpdateTempo(struct OnsetDetector* o, double time) {
+	for (int i = 0; i < TEMPO_BINS; i++) {
+		o->tempo[i] *= ONSET_TEMPO_DECAY;
+	}
+
+	for (int k = 0; k < ONSET_INTERVALS; k++) {
+		if (!o->onsets[k]) {
+			continue;
+		}
+		double bpm = 60.0 / (time - o->onsets[k]);
+		while (bpm < ONSET_MIN_BPM) {
+			bpm *= 2;
+		}
+		while (bpm >= ONSET_MAX_BPM) {
+			bpm /= 2;
+		}
+		// intervals spanning more onsets are more likely to be off by a factor other than two
+		int age = (o->onsetpos - k - 1 + ONSET_INTERVALS) % ONSET_INTERVALS;
+		float weight = 1.0 / (age + 1);
+		int bin = (int)(bpm - ONSET_MIN_BPM);
+		float frac = bpm - ONSET_MIN_BPM - bin;
+		o->tempo[bin] += weight * (1 - frac);
+		o->tempo[(bin + 1) % TEMPO_BINS] += weight * frac; // the histogram wraps around an octave
+	}
+	o->onsets[o->onsetpos] = time;
+	o->onsetpos = (o->onsetpos + 1) % ONSET_INTERVALS;
+
+	int best = 0;
+	float sum = 0;
+	for (int i = 0; i < TEMPO_BINS; i++) {
+		sum += o->tempo[i];
+		if (o->tempo[i] > o->tempo[best]) {
+			best = i;
+		}
+	}
+	if (sum < 1) {
+		return;
+	}
+	float left = o->tempo[(best + TEMPO_BINS - 1) % TEMPO_BINS], right = o->tempo[(best + 1) % TEMPO_BINS];
+	float peak = left + o->tempo[best] + right;
+	o->bpm = ONSET_MIN_BPM + best + (right - left) / peak;
+	if (o->bpm < ONSET_MIN_BPM) {
+		o->bpm *= 2;
+	}
+	o->confidence = peak / sum;
+}
+
+static void UpdateBeat(struct OnsetDetector* o, double time) {
+	o->on_beat = false;
+	if (o->bpm <= 0) {
+		return;
+	}
+	double period = 60.0 / o->bpm;
+	double tolerance = period * ONSET_BEAT_TOLERANCE;
+	double since = time - o->beat;
+
+	if (o->onset) {
+		if (!o->beat || fabs(since - period) < tolerance) {
+			o->beat = time;
+			o->on_beat = true;
+			return;
+		}
+		if (since < tolerance) {
+			// the predicted beat came a bit early
+			o->beat = time;
+			return;
+		}
+	}
+	if (since >= period) {
+		o->beat += period * floor(since / period);
+		o->on_beat = true;
+	}
+}
+
+// Takes the magnitude spectrum of the latest hop. Returns true if it's an onset.
+bool OnsetFeed(struct OnsetDetector* o, const float* spectrum, double time) {
+	float flux = 0;
+	for (int i = 0; i < o->bins; i++) {
+		float m = log1pf(ONSET_COMPRESSION * spectrum[i]);
+		if (m > o->previous[i]) {
+			flux += m - o->previous[i];
+		}
+		o->previous[i] = m;
+	}
+	flux /= o->bins;
+
+	float mean = 0;
+	for (int i = 0; i < ONSET_HISTORY; i++) {
+		mean += o->history[i];
+	}
+	mean /= ONSET_HISTORY;
+	o->threshold = mean * ONSET_THRESHOLD_MULTIPLIER + ONSET_THRESHOLD_DELTA;
+
+	o->onset = o->hops >= ONSET_HISTORY && flux > o->threshold && flux > o->flux && time - o->last_onset >= ONSET_MIN_INTERVAL;
+	o->flux = flux;
+	o->history[o->histpos] = flux;
+	o->histpos = (o->histpos + 1) % ONSET_HISTORY;
+	o->hops++;
+
+	if (o->onset) {
+		o->strength = flux - o->threshold;
+		o->last_onset = time;
+		UpdateTempo(o, time);
+	}
+	UpdateBeat(o, time);
+	return o->onset;
+}
+
+void DestroyOnsetDetector(struct OnsetDetector* o) {
+	free(o->previous);
+	free(o);
+}
@@ -0,0 +1,64 @@
+/*! \file onset.h
+ *  \brief Spectral flux onset detection and tempo estimation.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef WAAAA_ONSET_H
+#define WAAAA_ONSET_H
+
+#include <libsuperderpy.h>
+
+#define ONSET_COMPRESSION 1000.0 // magnitudes go through log(1 + C * x) before taking the flux
+#define ONSET_HISTORY 16 // flux values the adaptive threshold is computed from
+#define ONSET_THRESHOLD_MULTIPLIER 1.5
+#define ONSET_THRESHOLD_DELTA 0.02
+#define ONSET_MIN_INTERVAL 0.08 // seconds
+#define ONSET_INTERVALS 6 // previous onsets each new one gets compared with
+#define ONSET_MIN_BPM 80 // inter-onset intervals get folded into this octave
+#define ONSET_MAX_BPM 160
+#define ONSET_TEMPO_DECAY 0.95 // applied to the tempo histogram on each onset
+#define ONSET_BEAT_TOLERANCE 0.2 // fraction of the beat period an onset may be off to realign the phase
+
+struct OnsetDetector {
+	int bins;
+	float* previous; // compressed magnitudes of the last hop
+
+	float flux; // average positive change per bin
+	float history[ONSET_HISTORY];
+	int histpos;
+	float threshold;
+
+	int hops; // fed so far, nothing gets detected until the threshold has some history
+	bool onset; // whether the last hop was an onset
+	float strength; // flux over threshold, for the last onset
+	double last_onset;
+	double onsets[ONSET_INTERVALS];
+	int onsetpos;
+
+	float tempo[ONSET_MAX_BPM - ONSET_MIN_BPM];
+	float bpm; // 0 until there's enough onsets to tell
+	float confidence; // share of the tempo histogram around the winning tempo
+	double beat; // time of the latest beat, predicted or aligned to an onset
+	bool on_beat; // whether a beat fell into the last hop
+};
+
+struct OnsetDetector* CreateOnsetDetector(int bins);
+bool OnsetFeed(struct OnsetDetector* o, const float* spectrum, double time);
+void DestroyOnsetDetector(struct OnsetDetector* o);
+
+#endif
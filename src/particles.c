@@ -0,0 +1,127 @@
+/*! \file particles.c
+ *  \brief Fixed capacity particle pool drawn with a single primitive call.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "particles.h"
+#include <libsuperderpy.h>
+#include <math.h>
+
+// Everything is allocated up front; bursts that don't fit are cut short instead.
+
+struct Particles* CreateParticles(int capacity, float gravity, float size) {
+	struct Particles* p = calloc(1, sizeof(struct Particles));
+	p->capacity = capacity;
+	p->gravity = gravity;
+	p->size = size;
+	p->x = calloc(capacity, sizeof(float));
+	p->y = calloc(capacity, sizeof(float));
+	p->vx = calloc(capacity, sizeof(float));
+	p->vy = calloc(capacity, sizeof(float));
+	p->life = calloc(capacity, sizeof(float));
+	p->decay = calloc(capacity, sizeof(float));
+	p->color = calloc(capacity, sizeof(ALLEGRO_COLOR));
+	p->vertices = calloc(capacity * PARTICLE_VERTICES, sizeof(ALLEGRO_VERTEX));
+	return p;
+}
+
+// Spreads `count` particles in all directions, with speeds and lifetimes (in ticks)
+// varying between half and full of the given ones.
+void ParticlesBurst(struct Particles* p, float x, float y, int count, float speed, int lifetime, ALLEGRO_COLOR color) {
+	count = MIN(count, p->capacity - p->count);
+	for (int i = p->count; i < p->count + count; i++) {
+		float angle = rand() / (float)RAND_MAX * 2 * ALLEGRO_PI;
+		float v = speed * (0.5 + rand() / (float)RAND_MAX * 0.5);
+		p->x[i] = x;
+		p->y[i] = y;
+		p->vx[i] = cos(angle) * v;
+		p->vy[i] = sin(angle) * v;
+		p->life[i] = 1;
+		p->decay[i] = 1.0 / (lifetime * (0.5 + rand() / (float)RAND_MAX * 0.5) + 1);
+		p->color[i] = color;
+	}
+	p->count += count;
+}
+
+// Kept separate, so the compiler knows the arrays don't overlap and can vectorize it.
+static void Integrate(float* restrict x, float* restrict y, float* restrict vx, float* restrict vy, float* restrict life, const float* restrict decay, float gravity, int count) {
+	for (int i = 0; i < count; i++) {
+		vy[i] += gravity;
+		x[i] += vx[i];
+		y[i] += vy[i];
+		life[i] -= decay[i];
+	}
+}
+
+void ParticlesUpdate(struct Particles* p) {
+	Integrate(p->x, p->y, p->vx, p->vy, p->life, p->decay, p->gravity, p->count);
+
+	// swap-remove the dead ones, including those that left the field
+	for (int i = 0; i < p->count;) {
+		if (p->life[i] > 0 && p->x[i] >= 0 && p->x[i] < 320 && p->y[i] < 180) {
+			i++;
+			continue;
+		}
+		int last = --p->count;
+		p->x[i] = p->x[last];
+		p->y[i] = p->y[last];
+		p->vx[i] = p->vx[last];
+		p->vy[i] = p->vy[last];
+		p->life[i] = p->life[last];
+		p->decay[i] = p->decay[last];
+		p->color[i] = p->color[last];
+	}
+}
+
+void DrawParticles(struct Particles* p) {
+	if (!p->count) {
+		return;
+	}
+	float h = p->size / 2;
+	for (int i = 0; i < p->count; i++) {
+		// premultiplied alpha, fading out over the particle's life
+		ALLEGRO_COLOR color = p->color[i];
+		float a = p->life[i];
+		color.r *= a;
+		color.g *= a;
+		color.b *= a;
+		color.a *= a;
+
+		float x1 = p->x[i] - h, y1 = p->y[i] - h, x2 = p->x[i] + h, y2 = p->y[i] + h;
+		ALLEGRO_VERTEX* v = p->vertices + i * PARTICLE_VERTICES;
+		v[0] = (ALLEGRO_VERTEX){.x = x1, .y = y1, .color = color};
+		v[1] = (ALLEGRO_VERTEX){.x = x2, .y = y1, .color = color};
+		v[2] = (ALLEGRO_VERTEX){.x = x2, .y = y2, .color = color};
+		v[3] = v[0];
+		v[4] = v[2];
+		v[5] = (ALLEGRO_VERTEX){.x = x1, .y = y2, .color = color};
+	}
+	al_draw_prim(p->vertices, NULL, NULL, 0, p->count * PARTICLE_VERTICES, ALLEGRO_PRIM_TRIANGLE_LIST);
+}
+
+void DestroyParticles(struct Particles* p) {
+	free(p->x);
+	free(p->y);
+	free(p->vx);
+	free(p->vy);
+	free(p->life);
+	free(p->decay);
+	free(p->color);
+	free(p->vertices);
+	free(p);
+}
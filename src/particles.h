@@ -0,0 +1,50 @@
+/*! \file particles.h
+ *  \brief Fixed capacity particle pool drawn with a single primitive call.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef WAAAA_PARTICLES_H
+#define WAAAA_PARTICLES_H
+
+#include <libsuperderpy.h>
+
+#define PARTICLE_VERTICES 6 // two triangles each
+
+// Structure of arrays, so the update loop can be vectorized. Dead particles get
+// replaced with the last live one, keeping the live ones packed at the front.
+struct Particles {
+	int capacity;
+	int count;
+	float gravity; // added to vy every tick
+	float size; // edge of the square drawn for each one
+
+	float *x, *y, *vx, *vy;
+	float* life; // 1 when emitted, dies at 0
+	float* decay; // subtracted from life every tick
+	ALLEGRO_COLOR* color;
+
+	ALLEGRO_VERTEX* vertices; // capacity * PARTICLE_VERTICES
+};
+
+struct Particles* CreateParticles(int capacity, float gravity, float size);
+void ParticlesBurst(struct Particles* p, float x, float y, int count, float speed, int lifetime, ALLEGRO_COLOR color);
+void ParticlesUpdate(struct Particles* p);
+void DrawParticles(struct Particles* p);
+void DestroyParticles(struct Particles* p);
+
+#endif
@@ -0,0 +1,275 @@
+/*! \file physics.c
+ *  \brief Ball physics and scoring of the playfield, independent of Allegro.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "physics.h"
+#include <math.h>
+#include <string.h>
+
+void InitField(struct Field* f, unsigned int seed) {
+	memset(f->bars, 0, sizeof(f->bars));
+	f->x = FIELD_WIDTH / 2;
+	f->y = 120;
+	f->vx = 0;
+	f->vy = 0;
+	f->camera = 0;
+	f->distortion = 0;
+	f->rotation = 0;
+	f->shakin_dudi = 0;
+	f->score1 = 0;
+	f->score2 = 0;
+	f->seed = seed;
+}
+
+static int Width(struct Field* f) {
+	return f->level->columns * LEVEL_TILE_SIZE;
+}
+
+// Puts the ball in the middle of the level.
+void FieldRespawn(struct Field* f) {
+	f->x = Width(f) / 2;
+	f->y = 120;
+}
+
+static void FollowBall(struct Field* f) {
+	f->camera = f->x - FIELD_WIDTH / 2;
+	if (f->camera > Width(f) - FIELD_WIDTH) {
+		f->camera = Width(f) - FIELD_WIDTH;
+	}
+	if (f->camera < 0) {
+		f->camera = 0;
+	}
+}
+
+// The ball stays where it was; FieldStep keeps it within the new level's bounds.
+void FieldSetLevel(struct Field* f, struct Level* level) {
+	f->level = level;
+	FollowBall(f);
+}
+
+float FieldRandom(struct Field* f) {
+	f->seed = f->seed * 1103515245 + 12345;
+	return ((f->seed >> 16) & 0x7fff) / (float)0x7fff;
+}
+
+// How much louder the loudest bar is than the average one.
+int FieldDistortion(const float* bars, int count) {
+	float gain = 0, sum = 0;
+	for (int i = 0; i < count; i++) {
+		sum += bars[i];
+		if (gain < bars[i]) {
+			gain = bars[i];
+		}
+	}
+	return (gain - sum / count) * 2;
+}
+
+void FieldApplyDistortion(struct Field* f, int distortion) {
+	f->distortion = distortion;
+	f->rotation += f->distortion * 3;
+}
+
+int FieldStep(struct Field* f, const float push[2]) {
+	int events = 0;
+
+	// COLLISION HANDLING (sucks)
+
+	int oldx = f->x;
+	int oldy = f->y;
+
+	f->x += f->vx;
+	f->y += f->vy;
+
+	if (f->vx > 0) {
+		f->vx -= 0.005;
+	} else if (f->vx < 0) {
+		f->vx += 0.005;
+	}
+	f->vy += 0.075;
+
+	if (f->y > 180 - BALL_HEIGHT - 5) {
+		f->vy = -f->vy / 2;
+		f->y = 178 - 5;
+	}
+	if (f->y < 0) {
+		f->y = 0;
+		f->vy = -f->vy * 0.75;
+	}
+
+	if (f->x < 0) {
+		f->vx = -f->vx * 0.75;
+		f->x = 0;
+	}
+	if (f->x > Width(f) - 1) {
+		f->vx = -f->vx * 0.75;
+		f->x = Width(f) - 1;
+	}
+	if (f->y == 180 - BALL_HEIGHT - 5) {
+		if (f->vx > 0) {
+			f->vx -= 0.01;
+		} else if (f->vx < 0) {
+			f->vx += 0.01;
+		}
+	}
+
+	float x = f->camera; // bars are drawn on the screen, not in the level
+	float width = BARS_WIDTH;
+
+	for (int i = BARS_OFFSET; i <= FIELD_WIDTH / BARS_WIDTH + BARS_OFFSET; i++) {
+		if (f->bars[i] != f->bars[i]) { // NaN
+			break;
+		}
+		int pos = 176 - f->bars[i] * BAR_HEIGHT;
+		int prev = 176 - f->bars[i - 1] * BAR_HEIGHT;
+		int next = 176 - f->bars[i + 1] * BAR_HEIGHT;
+
+		if (f->y - BALL_HEIGHT >= pos) {
+			if (x - 1 == f->x) {
+				// left
+				f->vy = (pos - f->y) / 10;
+				f->vx += -2;
+				f->y = pos;
+				events |= FIELD_LEFT_BUMP;
+			} else if (x + width == f->x) {
+				// right
+				f->vy = (pos - f->y) / 10;
+				f->vx += 2;
+				f->y = pos;
+				events |= FIELD_RIGHT_BUMP;
+			} else if ((x <= f->x) && (x + width >= f->x)) {
+				f->vy = (pos - f->y) / 8; // - f->vy * 0.25;
+				f->vx += (FieldRandom(f) - 0.5) * 2;
+				f->y = pos;
+				events |= FIELD_BAR_HIT;
+
+				if ((prev < pos) && (next > pos)) {
+					f->vx += -2;
+				}
+				if ((prev > pos) && (next < pos)) {
+					f->vy += 2;
+				}
+			}
+		}
+
+		x += width;
+	}
+
+	// collision with level
+
+	int oldsx = oldx / LEVEL_TILE_SIZE;
+	int oldsy = oldy / LEVEL_TILE_SIZE;
+
+	int sx = (int)(f->x / LEVEL_TILE_SIZE);
+	int sy = (int)(f->y / LEVEL_TILE_SIZE);
+
+	int tx = oldsx > 0 ? oldsx : 0;
+	int ty = oldsy > 0 ? oldsy : 0;
+
+	int colx = sx > 0 ? sx : 0;
+	int coly = sy > 0 ? sy : 0;
+
+	while ((tx != sx) && (ty != sy)) {
+		if (LevelTile(f->level, tx, ty) == '0') {
+			colx = tx;
+			coly = ty;
+			break;
+		}
+
+		if (tx != sx) {
+			if (sx > tx) {
+				tx++;
+			} else {
+				tx--;
+			}
+		}
+		if (ty != sy) {
+			if (sy > ty) {
+				ty++;
+			} else {
+				ty--;
+			}
+		}
+	}
+
+	char tile = LevelTile(f->level, colx, coly);
+
+	if ((tile == 'X') || (tile == 'Y')) {
+		f->vx = 0;
+		f->vy = 0;
+		FieldRespawn(f);
+
+		f->shakin_dudi = 120;
+
+		if (tile == 'X') {
+			f->score1++;
+			events |= FIELD_SCORE1;
+		} else {
+			f->score2++;
+			events |= FIELD_SCORE2;
+		}
+	}
+
+	if (tile == 'O') {
+		if (f->x != colx * LEVEL_TILE_SIZE) {
+			f->distortion = 3;
+		}
+		if (f->y != coly * LEVEL_TILE_SIZE) {
+			f->distortion = 3;
+		}
+		f->x = oldsx * LEVEL_TILE_SIZE;
+		f->y = oldsy * LEVEL_TILE_SIZE;
+		events |= FIELD_COLLISION;
+
+		f->vx = -f->vx * 0.5;
+		f->vy = -f->vy * 0.5;
+
+		if (fabs(f->vx) < 0.2) {
+			f->vx *= 10;
+		}
+		if (fabs(f->vy) < 0.2) {
+			f->vy *= 10;
+		}
+
+		if ((f->x == oldx) && (f->y == oldy)) {
+			// we're stuck! RANDOMMMMM and hope for the best
+			f->vx = (FieldRandom(f) - 0.5) * 5;
+			f->vy = (FieldRandom(f) - 0.5) * 5;
+			events |= FIELD_STUCK;
+		}
+	}
+
+	if (tile == '!') {
+		FieldRespawn(f);
+	}
+
+	if (tile == '~') {
+		f->vx += push[colx * LEVEL_TILE_SIZE - f->camera >= FIELD_WIDTH / 2 ? 1 : 0];
+	}
+
+	f->vx += sin(f->rotation / 20.0) / 75.0;
+
+	if (f->shakin_dudi) {
+		f->distortion = FieldRandom(f) * 15;
+		f->rotation += f->distortion;
+		f->shakin_dudi--;
+	}
+
+	FollowBall(f);
+	return events;
+}
@@ -0,0 +1,80 @@
+/*! \file physics.h
+ *  \brief Ball physics and scoring of the playfield, independent of Allegro.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef WAAAA_PHYSICS_H
+#define WAAAA_PHYSICS_H
+
+#include "level.h"
+#include <stddef.h>
+
+// This file gets built into the headless simulator too, so it can't pull in libsuperderpy.
+
+#define BARS_NUM (8192 / 2)
+#define BARS_WIDTH 4
+#define BARS_OFFSET 8
+#define BARS_VISIBLE (320 / BARS_WIDTH)
+#define BAR_HEIGHT 68
+
+#define BALL_WIDTH 3
+#define BALL_HEIGHT 3
+
+#define FIELD_WIDTH 320 // visible part of the level, in pixels
+#define FIELD_HEIGHT 180
+#define FIELD_INPUT_BARS (BARS_OFFSET + BARS_VISIBLE + 2) // the ones FieldStep looks at
+
+// events returned by FieldStep
+#define FIELD_SCORE1 (1 << 0)
+#define FIELD_SCORE2 (1 << 1)
+#define FIELD_COLLISION (1 << 2)
+#define FIELD_STUCK (1 << 3) // collision that left the ball where it was
+#define FIELD_LEFT_BUMP (1 << 4)
+#define FIELD_RIGHT_BUMP (1 << 5)
+#define FIELD_BAR_HIT (1 << 6) // landed on top of a bar
+
+struct Field {
+	struct Level* level; // not owned
+	float bars[BARS_NUM]; // they stay on the screen, wherever the camera goes
+
+	float x, y, vx, vy;
+	int camera; // left edge of the screen in the level, follows the ball
+	int distortion;
+	float rotation;
+	int shakin_dudi;
+	int score1, score2;
+
+	unsigned int seed; // each field has its own random sequence, so simulations are reproducible
+};
+
+// Everything that drives one tick from the outside, as recorded by the game and replayed by the simulator.
+struct FieldInput {
+	float bars[FIELD_INPUT_BARS];
+	float distortion; // before the music mode kick
+	float push[2]; // horizontal force of the pitch zones on each side of the field
+};
+
+void InitField(struct Field* f, unsigned int seed);
+void FieldSetLevel(struct Field* f, struct Level* level);
+void FieldRespawn(struct Field* f);
+int FieldDistortion(const float* bars, int count);
+void FieldApplyDistortion(struct Field* f, int distortion);
+int FieldStep(struct Field* f, const float push[2]);
+float FieldRandom(struct Field* f);
+
+#endif
@@ -0,0 +1,155 @@
+/*! \file pitch.c
+ *  \brief Pitch tracking based on the normalized autocorrelation.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "pitch.h"
+#include <libsuperderpy.h>
+#include <math.h>
+
+// McLeod's normalized square difference function: the autocorrelation r(t) of the window,
+// divided by the energy of the parts that overlap at lag t, so a perfectly periodic signal
+// peaks at 1 on each multiple of its period. The period is the first peak that gets close
+// enough to the highest one, which avoids picking an octave too low. The samples don't go
+// through the analysis window, which would bias the peaks of short windows towards shorter
+// lags, and they get zero padded to at least twice their length, so the autocorrelation
+// is linear; a circular one would add r(size - t) to r(t), which is about as large at the
+// lags looked at here.
+
+struct PitchTracker* CreatePitchTracker(struct Analysis* a) {
+	struct PitchTracker* p = calloc(1, sizeof(struct PitchTracker));
+	p->analysis = a;
+	// Every level has the same size at full resolution and only gets shorter with
+	// AnalysisSetResolution, so that is the longest window PickLevel can return.
+	int longest = a->fft_size >> (a->num_levels - 1);
+	p->energy = calloc(longest + 1, sizeof(double));
+	p->size = 2 * longest;
+	p->frame = fftw_malloc(sizeof(double) * p->size);
+	p->power = fftw_malloc(sizeof(fftw_complex) * (p->size / 2 + 1));
+	p->forward = fftw_plan_dft_r2c_1d(p->size, p->frame, p->power, FFTW_ESTIMATE);
+	p->inverse = fftw_plan_dft_c2r_1d(p->size, p->power, p->frame, FFTW_ESTIMATE);
+	return p;
+}
+
+// The shortest level whose window still fits two periods of the lowest pitch.
+static int PickLevel(struct Analysis* a) {
+	for (int l = 0; l < a->num_levels; l++) {
+		if ((a->rate >> l) / PITCH_MIN_FREQ <= a->levels[l].size / 2) {
+			return l;
+		}
+	}
+	return a->num_levels - 1;
+}
+
+static double NSDF(const double* energy, const double* r, int size, int lag) {
+	double m = energy[size - lag] + energy[size] - energy[lag];
+	return (m > 0) ? 2 * r[lag] / m : 0;
+}
+
+static void FindPitch(struct PitchTracker* p, int c, const double* energy, const double* r, int size, int rate) {
+	int min_lag = MAX(2, rate / PITCH_MAX_FREQ);
+	int max_lag = MIN(size / 2, rate / PITCH_MIN_FREQ);
+
+	// skip the lobe around zero lag, then take the highest point of each positive region
+	int peaks[PITCH_MAX_PEAKS];
+	double values[PITCH_MAX_PEAKS];
+	int num_peaks = 0, region = -1;
+	bool positive = true;
+	for (int t = 1; t <= max_lag; t++) {
+		double n = NSDF(energy, r, size, t);
+		if (n <= 0) {
+			positive = false;
+			region = -1;
+		} else if (!positive) {
+			positive = true;
+			if (num_peaks < PITCH_MAX_PEAKS) {
+				region = num_peaks++;
+				peaks[region] = t;
+				values[region] = n;
+			}
+		} else if (region >= 0 && n > values[region]) {
+			peaks[region] = t;
+			values[region] = n;
+		}
+	}
+
+	double highest = 0;
+	for (int i = 0; i < num_peaks; i++) {
+		if (peaks[i] >= min_lag) {
+			highest = MAX(highest, values[i]);
+		}
+	}
+	int best = -1;
+	for (int i = 0; i < num_peaks; i++) {
+		if (peaks[i] >= min_lag && values[i] >= highest * PITCH_PEAK_THRESHOLD) {
+			best = i;
+			break;
+		}
+	}
+	if (best < 0 || highest <= 0) {
+		return;
+	}
+
+	// parabolic interpolation between the neighbouring lags
+	int t = peaks[best];
+	double prev = NSDF(energy, r, size, t - 1), peak = values[best], next = NSDF(energy, r, size, t + 1);
+	double denominator = prev - 2 * peak + next;
+	double delta = (denominator < 0) ? 0.5 * (prev - next) / denominator : 0;
+	p->frequency[c] = rate / (t + delta);
+	p->confidence[c] = MIN(1.0, peak - 0.25 * (prev - next) * delta);
+}
+
+// Finds the pitch of each channel in the last window taken with AnalysisGetWindow.
+void PitchTrack(struct PitchTracker* p) {
+	struct Analysis* a = p->analysis;
+	int l = PickLevel(a);
+	int size = a->levels[l].size;
+
+	for (int c = 0; c < a->channels; c++) {
+		p->frequency[c] = 0;
+		p->confidence[c] = 0;
+		if (a->silent[c]) {
+			continue;
+		}
+		const float* in = AnalysisLevelWindow(a, l, c);
+		p->energy[0] = 0;
+		for (int i = 0; i < size; i++) {
+			p->frame[i] = in[i];
+			p->energy[i + 1] = p->energy[i] + in[i] * in[i];
+		}
+		memset(p->frame + size, 0, (p->size - size) * sizeof(double));
+
+		fftw_execute(p->forward);
+		for (int i = 0; i < p->size / 2 + 1; i++) {
+			p->power[i][0] = (p->power[i][0] * p->power[i][0] + p->power[i][1] * p->power[i][1]) / p->size;
+			p->power[i][1] = 0;
+		}
+		fftw_execute(p->inverse);
+
+		FindPitch(p, c, p->energy, p->frame, size, a->rate >> l);
+	}
+}
+
+void DestroyPitchTracker(struct PitchTracker* p) {
+	fftw_destroy_plan(p->forward);
+	fftw_destroy_plan(p->inverse);
+	fftw_free(p->frame);
+	fftw_free(p->power);
+	free(p->energy);
+	free(p);
+}
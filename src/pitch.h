@@ -0,0 +1,47 @@
+/*! \file pitch.h
+ *  \brief Pitch tracking based on the normalized autocorrelation.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef WAAAA_PITCH_H
+#define WAAAA_PITCH_H
+
+#include "analysis.h"
+#include <libsuperderpy.h>
+
+#define PITCH_MIN_FREQ 70
+#define PITCH_MAX_FREQ 1000
+#define PITCH_PEAK_THRESHOLD 0.9 // the first maximum at least this close to the highest one wins
+#define PITCH_MAX_PEAKS 64
+
+struct PitchTracker {
+	struct Analysis* analysis;
+	double* energy; // running sums of squared samples of the window being tracked
+	int size; // of the transforms below, at least twice as long as any analysis window
+	double* frame; // the window, zero padded to size; then its autocorrelation
+	fftw_complex* power; // size / 2 + 1 bins
+	fftw_plan forward, inverse;
+	float frequency[ANALYSIS_MAX_CHANNELS]; // fundamental frequency in Hz, 0 if none was found
+	float confidence[ANALYSIS_MAX_CHANNELS]; // height of the autocorrelation peak, 1 for a perfectly periodic signal
+};
+
+struct PitchTracker* CreatePitchTracker(struct Analysis* a);
+void PitchTrack(struct PitchTracker* p);
+void DestroyPitchTracker(struct PitchTracker* p);
+
+#endif
@@ -0,0 +1,144 @@
+/*! \file realtime.c
+ *  \brief Helpers for code running on the audio and analysis hot paths.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "realtime.h"
+#include <errno.h>
+#include <libsuperderpy.h>
+
+#if defined(__SSE__) || defined(_M_X64)
+#include <xmmintrin.h>
+#endif
+
+static __thread int hot = 0;
+
+#if defined(__SSE__) || defined(_M_X64)
+static __thread unsigned int saved; // MXCSR from before the outermost RealtimeEnter
+#elif defined(__aarch64__)
+static __thread unsigned long saved; // FPCR from before the outermost RealtimeEnter
+#endif
+
+// Makes the current thread treat denormal floats as zero, both as inputs (DAZ) and as
+// results (FTZ). Signals decaying into silence would otherwise spend a while in the
+// denormal range, where every operation can take a hundred times longer.
+static void EnableFlushToZero(void) {
+#if defined(__SSE__) || defined(_M_X64)
+	saved = _mm_getcsr();
+	_mm_setcsr(saved | 0x8040); // FTZ | DAZ
+#elif defined(__aarch64__)
+	__asm__ __volatile__("mrs %0, fpcr" : "=r"(saved));
+	__asm__ __volatile__("msr fpcr, %0" : : "r"(saved | (1 << 24))); // FZ
+#endif
+}
+
+// Puts back the mode EnableFlushToZero found, so code outside hot paths (on the main
+// thread too) keeps IEEE denormals.
+static void RestoreFloatMode(void) {
+#if defined(__SSE__) || defined(_M_X64)
+	_mm_setcsr(saved);
+#elif defined(__aarch64__)
+	__asm__ __volatile__("msr fpcr, %0" : : "r"(saved));
+#endif
+}
+
+void RealtimeEnter(void) {
+	if (hot++ == 0) {
+		EnableFlushToZero();
+	}
+}
+
+void RealtimeLeave(void) {
+	if (--hot == 0) {
+		RestoreFloatMode();
+	}
+}
+
+#ifdef REALTIME_CHECKS
+
+// Allocation checker: wraps glibc's allocator and aborts when it gets called from
+// a thread that's inside a hot path. Only available with glibc, which exposes its
+// allocator under alternative names that the wrappers can forward to.
+
+#ifndef __GLIBC__
+#error REALTIME_CHECKS needs glibc
+#endif
+
+extern void* __libc_malloc(size_t size);
+extern void* __libc_calloc(size_t n, size_t size);
+extern void* __libc_realloc(void* ptr, size_t size);
+extern void* __libc_memalign(size_t alignment, size_t size);
+extern void __libc_free(void* ptr);
+
+static void Violation(const char* what) {
+	hot = 0; // so the report itself can allocate
+	fprintf(stderr, "REALTIME VIOLATION: %s called on a hot path\n", what);
+	abort();
+}
+
+void* malloc(size_t size) {
+	if (hot) {
+		Violation("malloc");
+	}
+	return __libc_malloc(size);
+}
+
+void* calloc(size_t n, size_t size) {
+	if (hot) {
+		Violation("calloc");
+	}
+	return __libc_calloc(n, size);
+}
+
+void* realloc(void* ptr, size_t size) {
+	if (hot) {
+		Violation("realloc");
+	}
+	return __libc_realloc(ptr, size);
+}
+
+void* memalign(size_t alignment, size_t size) {
+	if (hot) {
+		Violation("memalign");
+	}
+	return __libc_memalign(alignment, size);
+}
+
+void* aligned_alloc(size_t alignment, size_t size) {
+	if (hot) {
+		Violation("aligned_alloc");
+	}
+	return __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void** ptr, size_t alignment, size_t size) {
+	if (hot) {
+		Violation("posix_memalign");
+	}
+	*ptr = __libc_memalign(alignment, size);
+	return *ptr ? 0 : ENOMEM;
+}
+
+void free(void* ptr) {
+	if (hot && ptr) {
+		Violation("free");
+	}
+	__libc_free(ptr);
+}
+
+#endif
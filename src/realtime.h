@@ -0,0 +1,30 @@
+/*! \file realtime.h
+ *  \brief Helpers for code running on the audio and analysis hot paths.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef WAAAA_REALTIME_H
+#define WAAAA_REALTIME_H
+
+// Marks a hot path, which runs with denormals flushed to zero. The thread's previous
+// floating point mode comes back when the outermost one is left. With REALTIME_CHECKS,
+// allocating memory inside aborts the game. Can be nested.
+void RealtimeEnter(void);
+void RealtimeLeave(void);
+
+#endif
@@ -0,0 +1,404 @@
+/*! \file rendergraph.c
+ *  \brief Multi-pass drawing declared as passes over named targets.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "rendergraph.h"
+#include <libsuperderpy.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(ALLEGRO_CFG_OPENGL) && !defined(ALLEGRO_CFG_OPENGLES)
+#include <allegro5/allegro_opengl.h>
+#define RENDER_GL_TIMERS
+#endif
+
+// Passes are declared once, in the order they have to run, each with one output
+// and any number of inputs; the gamestate only toggles them on and off as the
+// quality settings change. Whenever that happens, the schedule gets recompiled:
+// - passes whose output nobody reads afterwards are culled,
+// - transient targets get bitmaps assigned, sharing one between targets of the
+//   same size whose lifetimes don't overlap.
+// Then on execution, consecutive passes drawing into the same target run without
+// rebinding it, and a clear gets skipped when the target hasn't been touched since
+// it was cleared to the same color.
+
+#ifdef RENDER_GL_TIMERS
+#ifndef GL_TIMESTAMP
+#define GL_TIMESTAMP 0x8E28
+#endif
+#ifndef GL_QUERY_RESULT
+#define GL_QUERY_RESULT 0x8866
+#endif
+#ifndef GL_QUERY_RESULT_AVAILABLE
+#define GL_QUERY_RESULT_AVAILABLE 0x8867
+#endif
+
+struct RenderTimer {
+	void(APIENTRY* GenQueries)(int n, unsigned int* ids);
+	void(APIENTRY* DeleteQueries)(int n, const unsigned int* ids);
+	void(APIENTRY* QueryCounter)(unsigned int id, unsigned int target);
+	void(APIENTRY* GetQueryObjectiv)(unsigned int id, unsigned int pname, int* params);
+	void(APIENTRY* GetQueryObjectui64v)(unsigned int id, unsigned int pname, uint64_t* params);
+
+	unsigned int queries[RENDER_QUERY_FRAMES][RENDER_MAX_PASSES * 2]; // start and end of each pass
+	int passes[RENDER_QUERY_FRAMES][RENDER_MAX_PASSES];
+	int count[RENDER_QUERY_FRAMES];
+	int frame;
+};
+
+static struct RenderTimer* CreateTimer(void) {
+	ALLEGRO_DISPLAY* display = al_get_current_display();
+	if (!display || !(al_get_display_flags(display) & ALLEGRO_OPENGL) || !al_have_opengl_extension("GL_ARB_timer_query")) {
+		return NULL;
+	}
+	struct RenderTimer* t = calloc(1, sizeof(struct RenderTimer));
+	t->GenQueries = al_get_opengl_proc_address("glGenQueries");
+	t->DeleteQueries = al_get_opengl_proc_address("glDeleteQueries");
+	t->QueryCounter = al_get_opengl_proc_address("glQueryCounter");
+	t->GetQueryObjectiv = al_get_opengl_proc_address("glGetQueryObjectiv");
+	t->GetQueryObjectui64v = al_get_opengl_proc_address("glGetQueryObjectui64v");
+	if (!t->GenQueries || !t->DeleteQueries || !t->QueryCounter || !t->GetQueryObjectiv || !t->GetQueryObjectui64v) {
+		free(t);
+		return NULL;
+	}
+	for (int i = 0; i < RENDER_QUERY_FRAMES; i++) {
+		t->GenQueries(RENDER_MAX_PASSES * 2, t->queries[i]);
+	}
+	return t;
+}
+
+// Collects the results of the oldest frame in flight, if they're there already.
+static void CollectTimer(struct RenderGraph* g, struct RenderTimer* t) {
+	int frame = t->frame;
+	if (!t->count[frame]) {
+		return;
+	}
+	int available = 0;
+	t->GetQueryObjectiv(t->queries[frame][t->count[frame] * 2 - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+	if (!available) {
+		return; // lagging behind; these just get dropped
+	}
+	for (int i = 0; i < t->count[frame]; i++) {
+		uint64_t start, end;
+		t->GetQueryObjectui64v(t->queries[frame][i * 2], GL_QUERY_RESULT, &start);
+		t->GetQueryObjectui64v(t->queries[frame][i * 2 + 1], GL_QUERY_RESULT, &end);
+		struct RenderPass* pass = &g->passes[t->passes[frame][i]];
+		pass->gpu_time += (end - start) / 1e9;
+		pass->timed_frames++;
+	}
+}
+
+static void DestroyTimer(struct RenderTimer* t) {
+	for (int i = 0; i < RENDER_QUERY_FRAMES; i++) {
+		t->DeleteQueries(RENDER_MAX_PASSES * 2, t->queries[i]);
+	}
+	free(t);
+}
+#endif
+
+struct RenderGraph* CreateRenderGraph(struct Game* game) {
+	struct RenderGraph* g = calloc(1, sizeof(struct RenderGraph));
+	g->game = game;
+	g->profile = strtol(GetConfigOptionDefault(game, "render", "profile", "0"), NULL, 10);
+	g->dirty = true;
+	RenderGraphImport(g, "framebuffer", NULL);
+	return g;
+}
+
+// Does the part of the setup that needs the display: the targets take the new bitmap
+// flags that are current now, and GL timers get created when profiling. Passes and
+// resources can be declared from any thread (e.g. in Gamestate_Load), but this has to
+// be called on the thread that draws (e.g. in Gamestate_PostLoad), before the first
+// RenderGraphExecute.
+void RenderGraphPrepare(struct RenderGraph* g) {
+	int flags = al_get_new_bitmap_flags();
+	for (int i = 0; i < g->num_resources; i++) {
+		if (g->resources[i].transient) {
+			g->resources[i].flags = flags;
+		}
+	}
+	g->dirty = true;
+#ifdef RENDER_GL_TIMERS
+	if (g->profile && !g->timer) {
+		g->timer = CreateTimer();
+		if (!g->timer) {
+			PrintConsole(g->game, "render: no GL timer queries, profiling CPU time only");
+		}
+	}
+#endif
+}
+
+// Declares a target owned by the graph, created with the new bitmap flags that were
+// current at RenderGraphPrepare.
+int RenderGraphTarget(struct RenderGraph* g, const char* name, int width, int height) {
+	struct RenderResource* r = &g->resources[g->num_resources];
+	*r = (struct RenderResource){.name = name, .transient = true, .width = width, .height = height};
+	g->dirty = true;
+	return g->num_resources++;
+}
+
+int RenderGraphImport(struct RenderGraph* g, const char* name, ALLEGRO_BITMAP* bitmap) {
+	struct RenderResource* r = &g->resources[g->num_resources];
+	*r = (struct RenderResource){.name = name, .bitmap = bitmap};
+	g->dirty = true;
+	return g->num_resources++;
+}
+
+void RenderGraphSetImport(struct RenderGraph* g, int resource, ALLEGRO_BITMAP* bitmap) {
+	g->resources[resource].bitmap = bitmap;
+}
+
+int RenderGraphPass(struct RenderGraph* g, const char* name, int output, RenderFunction* execute) {
+	struct RenderPass* p = &g->passes[g->num_passes];
+	*p = (struct RenderPass){.name = name, .output = output, .execute = execute, .enabled = true};
+	g->dirty = true;
+	return g->num_passes++;
+}
+
+void RenderGraphInput(struct RenderGraph* g, int pass, int resource) {
+	struct RenderPass* p = &g->passes[pass];
+	p->inputs[p->num_inputs++] = resource;
+	g->dirty = true;
+}
+
+// The color can be changed every frame.
+void RenderGraphClear(struct RenderGraph* g, int pass, ALLEGRO_COLOR color) {
+	g->passes[pass].clear = true;
+	g->passes[pass].clear_color = color;
+}
+
+void RenderGraphEnable(struct RenderGraph* g, int pass, bool enabled) {
+	if (g->passes[pass].enabled != enabled) {
+		g->passes[pass].enabled = enabled;
+		g->dirty = true;
+	}
+}
+
+static void Compile(struct RenderGraph* g) {
+	// walk backwards, keeping passes that write to something that's still needed
+	bool needed[RENDER_MAX_RESOURCES] = {false};
+	bool keep[RENDER_MAX_PASSES] = {false};
+	for (int i = 0; i < g->num_resources; i++) {
+		needed[i] = !g->resources[i].transient;
+	}
+	for (int i = g->num_passes - 1; i >= 0; i--) {
+		struct RenderPass* p = &g->passes[i];
+		if (!p->enabled || !needed[p->output]) {
+			continue;
+		}
+		keep[i] = true;
+		for (int j = 0; j < p->num_inputs; j++) {
+			needed[p->inputs[j]] = true;
+		}
+	}
+
+	g->num_scheduled = 0;
+	for (int i = 0; i < g->num_resources; i++) {
+		g->resources[i].first = g->resources[i].last = -1;
+	}
+	for (int i = 0; i < g->num_passes; i++) {
+		if (!keep[i]) {
+			continue;
+		}
+		int s = g->num_scheduled++;
+		g->schedule[s] = i;
+		struct RenderPass* p = &g->passes[i];
+		for (int j = -1; j < p->num_inputs; j++) {
+			struct RenderResource* r = &g->resources[j < 0 ? p->output : p->inputs[j]];
+			if (r->first < 0) {
+				r->first = s;
+			}
+			r->last = s;
+		}
+	}
+
+	// assign bitmaps in the order targets come to life
+	for (int i = 0; i < g->num_physical; i++) {
+		g->physical[i].busy_until = -1;
+	}
+	for (int s = 0; s < g->num_scheduled; s++) {
+		for (int i = 0; i < g->num_resources; i++) {
+			struct RenderResource* r = &g->resources[i];
+			if (!r->transient || r->first != s) {
+				continue;
+			}
+			r->physical = -1;
+			for (int j = 0; j < g->num_physical; j++) {
+				struct RenderPhysical* ph = &g->physical[j];
+				if (ph->busy_until < s && ph->width == r->width && ph->height == r->height && ph->flags == r->flags) {
+					r->physical = j;
+					break;
+				}
+			}
+			if (r->physical < 0) {
+				r->physical = g->num_physical++;
+				g->physical[r->physical] = (struct RenderPhysical){.width = r->width, .height = r->height, .flags = r->flags};
+			}
+			g->physical[r->physical].busy_until = r->last;
+		}
+	}
+
+	g->dirty = false;
+}
+
+static ALLEGRO_BITMAP* Bitmap(struct RenderGraph* g, int resource) {
+	struct RenderResource* r = &g->resources[resource];
+	if (!r->transient) {
+		return r->bitmap;
+	}
+	struct RenderPhysical* ph = &g->physical[r->physical];
+	if (!ph->bitmap) {
+		int flags = al_get_new_bitmap_flags();
+		al_set_new_bitmap_flags(ph->flags);
+		ph->bitmap = CreateNotPreservedBitmap(ph->width, ph->height);
+		al_set_new_bitmap_flags(flags);
+		ph->cleared = false;
+	}
+	return ph->bitmap;
+}
+
+static void Report(struct RenderGraph* g) {
+	char line[1024];
+	int len = snprintf(line, sizeof(line), "render: %d binds, %d clears (%d skipped);", g->binds, g->clears, g->skipped_clears);
+	for (int s = 0; s < g->num_scheduled && len < (int)sizeof(line); s++) {
+		struct RenderPass* p = &g->passes[g->schedule[s]];
+		len += snprintf(line + len, sizeof(line) - len, " %s %.2f", p->name, p->cpu_time * 1000 / g->frames);
+		if (p->timed_frames && len < (int)sizeof(line)) {
+			len += snprintf(line + len, sizeof(line) - len, "/%.2f", p->gpu_time * 1000 / p->timed_frames);
+		}
+	}
+	PrintConsole(g->game, "%s ms (CPU/GPU)", line);
+	for (int i = 0; i < g->num_passes; i++) {
+		g->passes[i].cpu_time = g->passes[i].gpu_time = 0;
+		g->passes[i].timed_frames = 0;
+	}
+	g->frames = 0;
+}
+
+void RenderGraphExecute(struct RenderGraph* g, void* data) {
+	if (g->dirty) {
+		Compile(g);
+	}
+
+#ifdef RENDER_GL_TIMERS
+	struct RenderTimer* timer = g->timer;
+	if (timer) {
+		timer->frame = (timer->frame + 1) % RENDER_QUERY_FRAMES;
+		CollectTimer(g, timer);
+		timer->count[timer->frame] = 0;
+	}
+#endif
+
+	g->binds = g->clears = g->skipped_clears = 0;
+	int bound = -1; // physical bitmap for transient targets, -2 - resource otherwise
+	for (int s = 0; s < g->num_scheduled; s++) {
+		struct RenderPass* p = &g->passes[g->schedule[s]];
+		struct RenderResource* out = &g->resources[p->output];
+		double start = g->profile ? al_get_time() : 0;
+#ifdef RENDER_GL_TIMERS
+		if (timer) {
+			int n = timer->count[timer->frame]++;
+			timer->passes[timer->frame][n] = g->schedule[s];
+			timer->QueryCounter(timer->queries[timer->frame][n * 2], GL_TIMESTAMP);
+		}
+#endif
+
+		ALLEGRO_BITMAP* inputs[RENDER_MAX_INPUTS];
+		for (int i = 0; i < p->num_inputs; i++) {
+			inputs[i] = Bitmap(g, p->inputs[i]);
+		}
+
+		ALLEGRO_BITMAP* target = Bitmap(g, p->output);
+		int id = out->transient ? out->physical : -2 - p->output;
+		if (id != bound) {
+			if (target) {
+				al_set_target_bitmap(target);
+			} else {
+				SetFramebufferAsTarget(g->game);
+			}
+			bound = id;
+			g->binds++;
+		}
+
+		struct RenderPhysical* ph = out->transient ? &g->physical[out->physical] : NULL;
+		if (p->clear) {
+			if (ph && ph->cleared && !memcmp(&ph->clear_color, &p->clear_color, sizeof(ALLEGRO_COLOR))) {
+				g->skipped_clears++;
+			} else {
+				al_clear_to_color(p->clear_color);
+				g->clears++;
+				if (ph) {
+					ph->cleared = true;
+					ph->clear_color = p->clear_color;
+				}
+			}
+		}
+		if (p->execute) {
+			p->execute(g->game, data, inputs);
+			if (ph) {
+				ph->cleared = false;
+			}
+		}
+
+#ifdef RENDER_GL_TIMERS
+		if (timer) {
+			int n = timer->count[timer->frame] - 1;
+			timer->QueryCounter(timer->queries[timer->frame][n * 2 + 1], GL_TIMESTAMP);
+		}
+#endif
+		if (g->profile) {
+			p->cpu_time += al_get_time() - start;
+		}
+	}
+
+	if (bound != -2 - RENDER_FRAMEBUFFER) {
+		SetFramebufferAsTarget(g->game);
+	}
+
+	if (g->profile) {
+		g->frames++;
+		double now = al_get_time();
+		if (now - g->last_report >= RENDER_REPORT_INTERVAL) {
+			if (g->last_report) {
+				Report(g);
+			}
+			g->last_report = now;
+		}
+	}
+}
+
+// Drops all the bitmaps owned by the graph, e.g. after the display got lost.
+void RenderGraphInvalidate(struct RenderGraph* g) {
+	for (int i = 0; i < g->num_physical; i++) {
+		if (g->physical[i].bitmap) {
+			al_destroy_bitmap(g->physical[i].bitmap);
+			g->physical[i].bitmap = NULL;
+		}
+	}
+}
+
+void DestroyRenderGraph(struct RenderGraph* g) {
+	RenderGraphInvalidate(g);
+#ifdef RENDER_GL_TIMERS
+	if (g->timer) {
+		DestroyTimer(g->timer);
+	}
+#endif
+	free(g);
+}
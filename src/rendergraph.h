@@ -0,0 +1,100 @@
+/*! \file rendergraph.h
+ *  \brief Multi-pass drawing declared as passes over named targets.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef WAAAA_RENDERGRAPH_H
+#define WAAAA_RENDERGRAPH_H
+
+#include <libsuperderpy.h>
+
+#define RENDER_MAX_PASSES 24
+#define RENDER_MAX_RESOURCES 16
+#define RENDER_MAX_INPUTS 4
+#define RENDER_QUERY_FRAMES 4 // GPU timings are read back this many frames later, so nothing waits for them
+#define RENDER_REPORT_INTERVAL 10.0 // seconds
+#define RENDER_FRAMEBUFFER 0 // resource that's always there
+
+typedef void RenderFunction(struct Game* game, void* data, ALLEGRO_BITMAP* const* inputs);
+
+struct RenderResource {
+	const char* name;
+	bool transient; // owned by the graph and possibly sharing a bitmap with others
+	int width, height, flags; // for transient ones; flags as in al_set_new_bitmap_flags, see RenderGraphPrepare
+	ALLEGRO_BITMAP* bitmap; // imported ones only; NULL for the framebuffer
+	int first, last; // scheduled passes that use it, -1 when unused this frame
+	int physical; // index into the graph's bitmaps, for transient ones
+};
+
+struct RenderPass {
+	const char* name;
+	RenderFunction* execute; // NULL for passes that only clear
+	int output;
+	int inputs[RENDER_MAX_INPUTS];
+	int num_inputs;
+	bool clear;
+	ALLEGRO_COLOR clear_color;
+	bool enabled;
+
+	double cpu_time, gpu_time; // accumulated since the last report
+	int timed_frames;
+};
+
+struct RenderPhysical {
+	ALLEGRO_BITMAP* bitmap; // created on first use
+	int width, height, flags;
+	int busy_until; // last scheduled pass of the resource currently assigned to it
+	bool cleared; // nothing drawn since the last clear
+	ALLEGRO_COLOR clear_color;
+};
+
+struct RenderGraph {
+	struct Game* game;
+	struct RenderResource resources[RENDER_MAX_RESOURCES];
+	int num_resources;
+	struct RenderPass passes[RENDER_MAX_PASSES];
+	int num_passes;
+	struct RenderPhysical physical[RENDER_MAX_RESOURCES];
+	int num_physical;
+
+	int schedule[RENDER_MAX_PASSES]; // enabled passes whose output gets used, in order
+	int num_scheduled;
+	bool dirty; // passes got toggled since the last compile
+
+	int binds, clears, skipped_clears; // in the last frame
+
+	bool profile;
+	double last_report;
+	int frames;
+	void* timer; // GL timestamp queries, when profiling and available
+};
+
+struct RenderGraph* CreateRenderGraph(struct Game* game);
+void RenderGraphPrepare(struct RenderGraph* g);
+int RenderGraphTarget(struct RenderGraph* g, const char* name, int width, int height);
+int RenderGraphImport(struct RenderGraph* g, const char* name, ALLEGRO_BITMAP* bitmap);
+void RenderGraphSetImport(struct RenderGraph* g, int resource, ALLEGRO_BITMAP* bitmap);
+int RenderGraphPass(struct RenderGraph* g, const char* name, int output, RenderFunction* execute);
+void RenderGraphInput(struct RenderGraph* g, int pass, int resource);
+void RenderGraphClear(struct RenderGraph* g, int pass, ALLEGRO_COLOR color);
+void RenderGraphEnable(struct RenderGraph* g, int pass, bool enabled);
+void RenderGraphExecute(struct RenderGraph* g, void* data);
+void RenderGraphInvalidate(struct RenderGraph* g);
+void DestroyRenderGraph(struct RenderGraph* g);
+
+#endif
@@ -0,0 +1,116 @@
+/*! \file resampler.c
+ *  \brief Polyphase sample rate converter.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "resampler.h"
+#include "common.h"
+#include <libsuperderpy.h>
+#include <math.h>
+
+#define RESAMPLER_ROLLOFF 0.9 // fraction of the output Nyquist frequency that's kept
+
+static int GCD(int a, int b) {
+	while (b) {
+		int t = a % b;
+		a = b;
+		b = t;
+	}
+	return a;
+}
+
+struct Resampler* CreateResampler(int in_rate, int out_rate, int taps) {
+	struct Resampler* r = calloc(1, sizeof(struct Resampler));
+	int gcd = GCD(in_rate, out_rate);
+	r->up = out_rate / gcd;
+	r->down = in_rate / gcd;
+	r->taps = taps;
+
+	// Windowed-sinc lowpass designed at the upsampled rate (in_rate * up),
+	// cutting off below the lower of both Nyquist frequencies.
+	int n = r->up * taps;
+	double fc = 0.5 / MAX(r->up, r->down) * RESAMPLER_ROLLOFF;
+	float* window = CreateHanningWindow(n, false);
+
+	r->coeffs = calloc(n, sizeof(float));
+	for (int i = 0; i < n; i++) {
+		double t = i - (n - 1) / 2.0;
+		double sinc = (t == 0) ? 1.0 : sin(2 * ALLEGRO_PI * fc * t) / (2 * ALLEGRO_PI * fc * t);
+		// split into polyphase branches; each one reversed, so it can be walked along the history
+		int branch = i % r->up, k = i / r->up;
+		r->coeffs[branch * taps + (taps - 1 - k)] = r->up * 2 * fc * sinc * window[i];
+	}
+	free(window);
+
+	r->history = calloc(taps * 2, sizeof(float));
+	return r;
+}
+
+// Converts one channel of interleaved input frames (or all of them downmixed to mono,
+// if `channel` is negative) and writes them straight into the ring buffer.
+// Returns the number of output samples written.
+int Resample(struct Resampler* r, const float* in, unsigned int frames, int channels, int channel, float* ring, int ring_size, int* ringpos) {
+	int written = 0;
+	int pos = *ringpos;
+
+	for (unsigned int i = 0; i < frames; i++) {
+		float x = 0;
+		if (channel >= 0) {
+			x = in[i * channels + channel];
+		} else {
+			for (int c = 0; c < channels; c++) {
+				x += in[i * channels + c];
+			}
+			x /= channels;
+		}
+
+		if (r->up == r->down) {
+			ring[pos] = x;
+			pos = (pos + 1) % ring_size;
+			written++;
+			continue;
+		}
+
+		r->histpos = (r->histpos + 1) % r->taps;
+		r->history[r->histpos] = x;
+		r->history[r->histpos + r->taps] = x;
+
+		while (r->phase < r->up) {
+			const float* h = r->coeffs + r->phase * r->taps;
+			const float* hist = r->history + r->histpos + 1;
+			float y = 0;
+			for (int k = 0; k < r->taps; k++) {
+				y += h[k] * hist[k];
+			}
+			ring[pos] = y;
+			pos = (pos + 1) % ring_size;
+			written++;
+			r->phase += r->down;
+		}
+		r->phase -= r->up;
+	}
+
+	*ringpos = pos;
+	return written;
+}
+
+void DestroyResampler(struct Resampler* r) {
+	free(r->coeffs);
+	free(r->history);
+	free(r);
+}
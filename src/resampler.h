@@ -0,0 +1,37 @@
+/*! \file resampler.h
+ *  \brief Polyphase sample rate converter.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef WAAAA_RESAMPLER_H
+#define WAAAA_RESAMPLER_H
+
+struct Resampler {
+	int up, down; // rational conversion factor, reduced
+	int taps; // coefficients per polyphase branch
+	float* coeffs; // up * taps, branch after branch, stored reversed
+	float* history; // 2 * taps, mirrored so the inner loop never wraps
+	int histpos;
+	int phase;
+};
+
+struct Resampler* CreateResampler(int in_rate, int out_rate, int taps);
+int Resample(struct Resampler* r, const float* in, unsigned int frames, int channels, int channel, float* ring, int ring_size, int* ringpos);
+void DestroyResampler(struct Resampler* r);
+
+#endif
@@ -0,0 +1,100 @@
+/*! \file simulate.c
+ *  \brief Command line driver for the headless batch simulator.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "simulator.h"
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Usage: waaaa-simulate [-j threads] [-n matches] [-t seconds] [-s seed] [-r recording] level.lvl
+//
+// Recordings are written by the game when [waaaa] record is set to a path; they're raw
+// FieldInput structs, so they only replay on the same architecture.
+
+static char* ReadFile(const char* path, size_t* size) {
+	FILE* file = fopen(path, "rb");
+	if (!file) {
+		return NULL;
+	}
+	fseek(file, 0, SEEK_END);
+	long length = ftell(file);
+	fseek(file, 0, SEEK_SET);
+	char* data = malloc(length > 0 ? length : 1);
+	*size = fread(data, 1, length > 0 ? length : 0, file);
+	fclose(file);
+	return data;
+}
+
+int main(int argc, char** argv) {
+	int threads = sysconf(_SC_NPROCESSORS_ONLN);
+	int matches = 1000;
+	double seconds = 180;
+	unsigned int seed = 1;
+	const char* recording = NULL;
+	const char* level = NULL;
+
+	for (int i = 1; i < argc; i++) {
+		if (i + 1 < argc && !strcmp(argv[i], "-j")) {
+			threads = strtol(argv[++i], NULL, 10);
+		} else if (i + 1 < argc && !strcmp(argv[i], "-n")) {
+			matches = strtol(argv[++i], NULL, 10);
+		} else if (i + 1 < argc && !strcmp(argv[i], "-t")) {
+			seconds = strtod(argv[++i], NULL);
+		} else if (i + 1 < argc && !strcmp(argv[i], "-s")) {
+			seed = strtoul(argv[++i], NULL, 10);
+		} else if (i + 1 < argc && !strcmp(argv[i], "-r")) {
+			recording = argv[++i];
+		} else if (argv[i][0] != '-') {
+			level = argv[i];
+		} else {
+			level = NULL;
+			break;
+		}
+	}
+	if (!level || matches < 1 || seconds <= 0) {
+		fprintf(stderr, "usage: %s [-j threads] [-n matches] [-t seconds] [-s seed] [-r recording] level.lvl\n", argv[0]);
+		return 1;
+	}
+
+	size_t size;
+	char* text = ReadFile(level, &size);
+	if (!text) {
+		fprintf(stderr, "can't read level %s\n", level);
+		return 1;
+	}
+	struct Simulation* s = CreateSimulation(text, size, matches, seconds * SIMULATION_TICK_RATE, seed);
+	free(text);
+
+	if (recording) {
+		char* frames = ReadFile(recording, &size);
+		if (!frames || size < sizeof(struct FieldInput)) {
+			fprintf(stderr, "can't read recording %s\n", recording);
+			return 1;
+		}
+		SimulationSetRecording(s, (struct FieldInput*)frames, size / sizeof(struct FieldInput));
+		fprintf(stderr, "replaying %.1f s of input\n", size / sizeof(struct FieldInput) / (double)SIMULATION_TICK_RATE);
+		free(frames);
+	}
+
+	SimulationRun(s, threads);
+	SimulationReport(s, stdout);
+	DestroySimulation(s);
+	return 0;
+}
@@ -0,0 +1,293 @@
+/*! \file simulator.c
+ *  \brief Headless batch simulation of matches, for level balancing and physics throughput.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "simulator.h"
+#include <math.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Matches are independent, so they're simply spread over a pool of threads. Each
+// worker starts with a contiguous range of them and takes from its end; once it runs
+// dry it steals from the front of somebody else's range. Match length depends a lot
+// on the level and the input (goals reset the ball, stuck balls keep colliding), so
+// this keeps all the cores busy until the very end without any central queue.
+
+struct Worker {
+	struct Simulation* s;
+	struct Worker* workers;
+	int id, count;
+	pthread_t thread;
+	pthread_mutex_t mutex;
+	int begin, end; // matches left in this worker's range
+};
+
+// Two players taking turns at screaming, one on each side of the field.
+struct Voices {
+	unsigned int seed;
+	int remaining[2]; // ticks left of the current scream, 0 when silent
+	int length[2];
+	float center[2], width[2], amplitude[2], push[2];
+};
+
+static float Random(unsigned int* seed) {
+	*seed = *seed * 1103515245 + 12345;
+	return ((*seed >> 16) & 0x7fff) / (float)0x7fff;
+}
+
+static void SynthesizeInput(struct Voices* v, struct FieldInput* input) {
+	for (int i = 0; i < FIELD_INPUT_BARS; i++) {
+		input->bars[i] = Random(&v->seed) * 0.01; // room noise
+	}
+
+	for (int c = 0; c < 2; c++) {
+		input->push[c] = 0;
+		if (!v->remaining[c]) {
+			if (Random(&v->seed) > 1.0 / 90) {
+				continue;
+			}
+			v->length[c] = v->remaining[c] = 15 + Random(&v->seed) * 105;
+			// low voices on the outer edges, like the game mirrors them in stereo
+			float pos = Random(&v->seed) * BARS_VISIBLE / 2;
+			v->center[c] = BARS_OFFSET + (c ? BARS_VISIBLE - pos : pos);
+			v->width[c] = 1 + Random(&v->seed) * 6;
+			v->amplitude[c] = 0.3 + Random(&v->seed) * 1.2;
+			v->push[c] = (Random(&v->seed) - 0.5) * 0.1;
+		}
+
+		float envelope = fmin(1, fmin(v->length[c] - v->remaining[c] + 1, v->remaining[c]) / 5.0); // 5 ticks of attack and release
+		for (int i = 0; i < FIELD_INPUT_BARS; i++) {
+			float d = (i - v->center[c]) / v->width[c];
+			input->bars[i] += v->amplitude[c] * envelope * exp(-d * d);
+		}
+		input->push[c] = v->push[c];
+		v->remaining[c]--;
+	}
+
+	input->distortion = FieldDistortion(input->bars, FIELD_INPUT_BARS);
+}
+
+static void RunMatch(struct Simulation* s, int match) {
+	struct Field* f = malloc(sizeof(struct Field));
+	unsigned int seed = s->seed + match * 2654435761u;
+	InitField(f, seed);
+	FieldSetLevel(f, s->level);
+	FieldRespawn(f);
+
+	struct Voices voices = {.seed = ~seed};
+	struct FieldInput synthetic;
+	int offset = s->recording ? (long long)match * s->recording_length / s->matches : 0;
+
+	struct SimulationResult* r = &s->results[match];
+	memset(r, 0, sizeof(struct SimulationResult));
+	int since_goal = 0;
+
+	for (int t = 0; t < s->ticks; t++) {
+		const struct FieldInput* input = &synthetic;
+		if (s->recording) {
+			input = &s->recording[(offset + t) % s->recording_length];
+		} else {
+			SynthesizeInput(&voices, &synthetic);
+		}
+		memcpy(f->bars, input->bars, sizeof(input->bars));
+
+		FieldApplyDistortion(f, input->distortion);
+		int events = FieldStep(f, input->push);
+
+		if (events & FIELD_STUCK) {
+			r->stuck++;
+		}
+		if (events & FIELD_COLLISION) {
+			r->collisions++;
+		}
+		if (events & (FIELD_SCORE1 | FIELD_SCORE2)) {
+			since_goal = 0;
+		} else if (++since_goal == SIMULATION_STALL_TICKS) {
+			r->stalls++;
+		}
+		if (since_goal > r->longest_stall) {
+			r->longest_stall = since_goal;
+		}
+	}
+
+	r->score1 = f->score1;
+	r->score2 = f->score2;
+	free(f);
+}
+
+static bool TakeMatch(struct Worker* w, int* match) {
+	// own work from the back...
+	pthread_mutex_lock(&w->mutex);
+	if (w->begin < w->end) {
+		*match = --w->end;
+		pthread_mutex_unlock(&w->mutex);
+		return true;
+	}
+	pthread_mutex_unlock(&w->mutex);
+
+	// ...then others' from the front, so the two ends don't fight over the same matches
+	for (int i = 1; i < w->count; i++) {
+		struct Worker* victim = &w->workers[(w->id + i) % w->count];
+		pthread_mutex_lock(&victim->mutex);
+		if (victim->begin < victim->end) {
+			*match = victim->begin++;
+			pthread_mutex_unlock(&victim->mutex);
+			return true;
+		}
+		pthread_mutex_unlock(&victim->mutex);
+	}
+	return false;
+}
+
+static void* WorkerThread(void* arg) {
+	struct Worker* w = arg;
+	int match;
+	while (TakeMatch(w, &match)) {
+		RunMatch(w->s, match);
+	}
+	return NULL;
+}
+
+struct Simulation* CreateSimulation(const char* level, size_t size, int matches, int ticks, unsigned int seed) {
+	struct Simulation* s = calloc(1, sizeof(struct Simulation));
+	s->level = CreateLevel(level, size);
+	LevelLoadAll(s->level);
+
+	s->matches = matches;
+	s->ticks = ticks;
+	s->seed = seed;
+	s->results = calloc(matches, sizeof(struct SimulationResult));
+	return s;
+}
+
+void SimulationSetRecording(struct Simulation* s, const struct FieldInput* frames, int length) {
+	free(s->recording);
+	s->recording = NULL;
+	s->recording_length = length;
+	if (length) {
+		s->recording = malloc(length * sizeof(struct FieldInput));
+		memcpy(s->recording, frames, length * sizeof(struct FieldInput));
+	}
+}
+
+static double Now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+void SimulationRun(struct Simulation* s, int threads) {
+	if (threads < 1) {
+		threads = 1;
+	}
+	if (threads > SIMULATION_MAX_THREADS) {
+		threads = SIMULATION_MAX_THREADS;
+	}
+	if (threads > s->matches) {
+		threads = s->matches > 0 ? s->matches : 1;
+	}
+	s->threads = threads;
+
+	struct Worker* workers = calloc(threads, sizeof(struct Worker));
+	for (int i = 0; i < threads; i++) {
+		workers[i].s = s;
+		workers[i].workers = workers;
+		workers[i].id = i;
+		workers[i].count = threads;
+		workers[i].begin = (long long)s->matches * i / threads;
+		workers[i].end = (long long)s->matches * (i + 1) / threads;
+		pthread_mutex_init(&workers[i].mutex, NULL);
+	}
+
+	double start = Now();
+	// the calling thread is the first worker
+	for (int i = 1; i < threads; i++) {
+		pthread_create(&workers[i].thread, NULL, WorkerThread, &workers[i]);
+	}
+	WorkerThread(&workers[0]);
+	for (int i = 1; i < threads; i++) {
+		pthread_join(workers[i].thread, NULL);
+	}
+	s->seconds = Now() - start;
+
+	for (int i = 0; i < threads; i++) {
+		pthread_mutex_destroy(&workers[i].mutex);
+	}
+	free(workers);
+}
+
+static int CompareInts(const void* a, const void* b) {
+	return *(const int*)a - *(const int*)b;
+}
+
+void SimulationReport(struct Simulation* s, FILE* out) {
+	if (!s->matches) {
+		return;
+	}
+	double minutes = s->ticks / (double)(SIMULATION_TICK_RATE * 60);
+	double total_ticks = (double)s->matches * s->ticks;
+	fprintf(out, "%d matches of %.1f s on %d threads in %.2f s: %.0f ticks/s (%.0fx realtime)\n",
+		s->matches, s->ticks / (double)SIMULATION_TICK_RATE, s->threads, s->seconds,
+		total_ticks / s->seconds, total_ticks / SIMULATION_TICK_RATE / s->seconds);
+
+	double sum1 = 0, sum2 = 0, sq1 = 0, sq2 = 0, stuck = 0, collisions = 0;
+	int wins1 = 0, wins2 = 0, max_stuck = 0, stalled = 0, longest_stall = 0;
+	int* goals = malloc(s->matches * sizeof(int));
+	for (int i = 0; i < s->matches; i++) {
+		struct SimulationResult* r = &s->results[i];
+		sum1 += r->score1;
+		sum2 += r->score2;
+		sq1 += r->score1 * r->score1;
+		sq2 += r->score2 * r->score2;
+		wins1 += r->score1 > r->score2;
+		wins2 += r->score2 > r->score1;
+		stuck += r->stuck;
+		collisions += r->collisions;
+		if (r->stuck > max_stuck) {
+			max_stuck = r->stuck;
+		}
+		stalled += r->stalls > 0;
+		if (r->longest_stall > longest_stall) {
+			longest_stall = r->longest_stall;
+		}
+		goals[i] = r->score1 + r->score2;
+	}
+	qsort(goals, s->matches, sizeof(int), CompareInts);
+
+	double mean1 = sum1 / s->matches, mean2 = sum2 / s->matches;
+	fprintf(out, "score: %.2f +- %.2f : %.2f +- %.2f; wins %.1f%% : %.1f%%, draws %.1f%%\n",
+		mean1, sqrt(fmax(0, sq1 / s->matches - mean1 * mean1)), mean2, sqrt(fmax(0, sq2 / s->matches - mean2 * mean2)),
+		100.0 * wins1 / s->matches, 100.0 * wins2 / s->matches, 100.0 * (s->matches - wins1 - wins2) / s->matches);
+	fprintf(out, "goals per minute: p10 %.2f, median %.2f, p90 %.2f, max %.2f\n",
+		goals[s->matches / 10] / minutes, goals[s->matches / 2] / minutes, goals[s->matches * 9 / 10] / minutes, goals[s->matches - 1] / minutes);
+	fprintf(out, "collisions: %.1f per match; stuck: %.2f per match (max %d)\n", collisions / s->matches, stuck / s->matches, max_stuck);
+	fprintf(out, "stalls (%d s without a goal): %.1f%% of matches, longest %.1f s\n",
+		SIMULATION_STALL_TICKS / SIMULATION_TICK_RATE, 100.0 * stalled / s->matches, longest_stall / (double)SIMULATION_TICK_RATE);
+	free(goals);
+}
+
+void DestroySimulation(struct Simulation* s) {
+	DestroyLevel(s->level);
+	free(s->recording);
+	free(s->results);
+	free(s);
+}
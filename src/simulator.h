@@ -0,0 +1,60 @@
+/*! \file simulator.h
+ *  \brief Headless batch simulation of matches, for level balancing and physics throughput.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef WAAAA_SIMULATOR_H
+#define WAAAA_SIMULATOR_H
+
+#include "physics.h"
+#include <stdio.h>
+
+#define SIMULATION_TICK_RATE 60
+#define SIMULATION_STALL_TICKS (30 * SIMULATION_TICK_RATE) // this long without a goal counts as a stall
+#define SIMULATION_MAX_THREADS 256
+
+struct SimulationResult {
+	int score1, score2;
+	int stuck; // FIELD_STUCK events
+	int collisions;
+	int stalls;
+	int longest_stall; // in ticks
+};
+
+struct Simulation {
+	struct Level* level; // fully loaded, so all the threads can share it
+	int matches;
+	int ticks; // per match
+	unsigned int seed;
+
+	// replayed by every match, each starting at a different point; synthetic voices when NULL
+	struct FieldInput* recording;
+	int recording_length;
+
+	struct SimulationResult* results;
+	int threads; // used by the last SimulationRun
+	double seconds; // wall time of the last SimulationRun
+};
+
+struct Simulation* CreateSimulation(const char* level, size_t size, int matches, int ticks, unsigned int seed);
+void SimulationSetRecording(struct Simulation* s, const struct FieldInput* frames, int length);
+void SimulationRun(struct Simulation* s, int threads);
+void SimulationReport(struct Simulation* s, FILE* out);
+void DestroySimulation(struct Simulation* s);
+
+#endif
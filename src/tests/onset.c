@@ -0,0 +1,105 @@
+/*! \file onset.c
+ *  \brief Checks the onset detector against click tracks.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../analysis.h"
+#include "../onset.h"
+#include <math.h>
+#include <stdio.h>
+
+// The spectra get computed the way AnalysisSpectrum does for a single channel at the default
+// rate: Hanning window over the game's window, magnitudes normalized by the FFT size, one
+// hop per frame at 60 frames per second. Clicks are 10 ms of decaying noise over a quiet
+// noise floor, starting once the threshold has its history.
+#define RATE ANALYSIS_DEFAULT_RATE
+#define SIZE (8192 * ANALYSIS_DEFAULT_RATE / ANALYSIS_REFERENCE_RATE) // the window of the game
+#define HOPS_PER_SECOND 60
+#define DURATION 12.0 // seconds
+#define FIRST_CLICK 1.0 // seconds
+#define CLICK_LENGTH 0.01 // seconds
+#define NOISE_FLOOR 0.001
+#define BPM_TOLERANCE 2.0
+
+static double Noise(unsigned* state) {
+	*state = *state * 1664525u + 1013904223u;
+	return (*state >> 8) / (double)(1 << 24) * 2 - 1;
+}
+
+static int Check(double bpm) {
+	int length = DURATION * RATE;
+	float* audio = calloc(length, sizeof(float));
+	unsigned state = 1;
+	for (int i = 0; i < length; i++) {
+		audio[i] = NOISE_FLOOR * Noise(&state);
+	}
+	int clicks = 0;
+	for (double t = FIRST_CLICK; t + CLICK_LENGTH < DURATION; t += 60.0 / bpm, clicks++) {
+		int start = t * RATE;
+		for (int i = 0; i < CLICK_LENGTH * RATE; i++) {
+			audio[start + i] += 0.5 * Noise(&state) * exp(-5.0 * i / (CLICK_LENGTH * RATE));
+		}
+	}
+
+	double* in = fftw_malloc(sizeof(double) * SIZE);
+	fftw_complex* out = fftw_malloc(sizeof(fftw_complex) * (SIZE / 2 + 1));
+	fftw_plan plan = fftw_plan_dft_r2c_1d(SIZE, in, out, FFTW_ESTIMATE);
+	float* spectrum = calloc(SIZE / 2 + 1, sizeof(float));
+	struct OnsetDetector* o = CreateOnsetDetector(SIZE / 2 + 1);
+
+	int onsets = 0;
+	for (int hop = 1;; hop++) {
+		double time = (double)hop / HOPS_PER_SECOND;
+		int end = time * RATE;
+		if (end > length) {
+			break;
+		}
+		for (int i = 0; i < SIZE; i++) {
+			int j = end - SIZE + i;
+			in[i] = (j >= 0 ? audio[j] : 0) * 0.5 * (1 - cos(2 * M_PI * i / SIZE));
+		}
+		fftw_execute(plan);
+		for (int i = 0; i < SIZE / 2 + 1; i++) {
+			double re = out[i][0] / SIZE, im = out[i][1] / SIZE;
+			spectrum[i] = sqrt(re * re + im * im);
+		}
+		onsets += OnsetFeed(o, spectrum, time);
+	}
+
+	bool ok = onsets == clicks && fabs(o->bpm - bpm) <= BPM_TOLERANCE;
+	printf("%s: %.1f BPM, %d clicks, %d onsets, tempo %.2f BPM, confidence %.3f\n", ok ? "ok" : "FAIL", bpm, clicks, onsets, o->bpm, o->confidence);
+
+	DestroyOnsetDetector(o);
+	free(spectrum);
+	fftw_destroy_plan(plan);
+	fftw_free(in);
+	fftw_free(out);
+	free(audio);
+	return ok ? 0 : 1;
+}
+
+int main(void) {
+	int failed = 0;
+	// tempi whose beat period is a whole number of hops and ones whose isn't
+	failed += Check(120);
+	failed += Check(100);
+	failed += Check(90);
+	failed += Check(137);
+	failed += Check(155);
+	return failed;
+}
@@ -0,0 +1,69 @@
+/*! \file pitch.c
+ *  \brief Checks the pitch tracker against pure tones.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "../pitch.h"
+#include <math.h>
+#include <stdio.h>
+
+// Only what PitchTrack reads gets set up, so no game or audio device is needed: a single
+// channel, single resolution analysis at the default rate.
+#define RATE ANALYSIS_DEFAULT_RATE
+#define GAME_SIZE (8192 * ANALYSIS_DEFAULT_RATE / ANALYSIS_REFERENCE_RATE) // the window of the game
+#define SHORT_SIZE (2 * RATE / PITCH_MIN_FREQ + 2) // the shortest window PitchTrack accepts for the lowest pitch
+#define TOLERANCE 0.01 // relative
+
+static int Check(int size, double frequency) {
+	struct Analysis a = {0};
+	struct AnalysisLevel level = {0};
+	a.rate = RATE;
+	a.fft_size = size;
+	a.channels = 1;
+	a.num_levels = 1;
+	a.levels = &level;
+	level.size = size;
+	level.step = 1;
+	level.buffer = calloc(size, sizeof(float));
+	level.buffer_stride = size;
+	for (int i = 0; i < size; i++) {
+		level.buffer[i] = 0.5 * sin(2 * M_PI * frequency * i / RATE);
+	}
+
+	struct PitchTracker* p = CreatePitchTracker(&a);
+	PitchTrack(p);
+	bool ok = fabs(p->frequency[0] - frequency) <= frequency * TOLERANCE;
+	printf("%s: %d samples, %.2f Hz tone detected as %.2f Hz, confidence %.3f\n", ok ? "ok" : "FAIL", size, frequency, p->frequency[0], p->confidence[0]);
+	DestroyPitchTracker(p);
+
+	free(level.buffer);
+	return ok ? 0 : 1;
+}
+
+int main(void) {
+	int failed = 0;
+	// the lowest pitches have the longest periods, where a circular autocorrelation
+	// of the window would be off the most
+	failed += Check(GAME_SIZE, PITCH_MIN_FREQ * 1.02);
+	failed += Check(GAME_SIZE, PITCH_MIN_FREQ * 1.5);
+	failed += Check(GAME_SIZE, 220);
+	failed += Check(SHORT_SIZE, PITCH_MIN_FREQ * 1.02);
+	failed += Check(SHORT_SIZE, PITCH_MIN_FREQ * 1.1);
+	failed += Check(SHORT_SIZE, 220);
+	return failed;
+}
@@ -0,0 +1,71 @@
+/*! \file waterfall.c
+ *  \brief Scrolling spectrogram history kept in a ring texture.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "waterfall.h"
+#include <libsuperderpy.h>
+
+// Instead of scrolling the whole history each hop, the newest column overwrites the
+// oldest one in place, and drawing starts from the column after it, wrapping around.
+// Uploading a column and drawing the two parts costs the same regardless of the length
+// of the history.
+
+struct Waterfall* CreateWaterfall(int columns, int rows) {
+	struct Waterfall* w = calloc(1, sizeof(struct Waterfall));
+	w->columns = columns;
+	w->rows = rows;
+	w->bitmap = al_create_bitmap(columns, rows);
+
+	ALLEGRO_LOCKED_REGION* region = al_lock_bitmap(w->bitmap, ALLEGRO_PIXEL_FORMAT_ABGR_8888_LE, ALLEGRO_LOCK_WRITEONLY);
+	for (int y = 0; y < rows; y++) {
+		memset((char*)region->data + y * region->pitch, 0, columns * region->pixel_size);
+	}
+	al_unlock_bitmap(w->bitmap);
+	return w;
+}
+
+// Takes `rows` values from 0 to 1, lowest row first.
+void WaterfallPush(struct Waterfall* w, const float* values) {
+	ALLEGRO_LOCKED_REGION* region = al_lock_bitmap_region(w->bitmap, w->column, 0, 1, w->rows, ALLEGRO_PIXEL_FORMAT_ABGR_8888_LE, ALLEGRO_LOCK_WRITEONLY);
+	for (int i = 0; i < w->rows; i++) {
+		float v = values[i];
+		if (!(v > 0)) { // NaN too
+			v = 0;
+		}
+		uint32_t c = (uint32_t)(MIN(v, 1.0) * 255);
+		// premultiplied white, fading out to transparent
+		*(uint32_t*)((char*)region->data + (w->rows - 1 - i) * region->pitch) = c | (c << 8) | (c << 16) | (c << 24);
+	}
+	al_unlock_bitmap(w->bitmap);
+	w->column = (w->column + 1) % w->columns;
+}
+
+// Draws the whole history, oldest on the left.
+void DrawWaterfall(struct Waterfall* w, ALLEGRO_COLOR tint, float x, float y, float width, float height) {
+	float split = width * (w->columns - w->column) / w->columns;
+	al_draw_tinted_scaled_bitmap(w->bitmap, tint, w->column, 0, w->columns - w->column, w->rows, x, y, split, height, 0);
+	if (w->column) {
+		al_draw_tinted_scaled_bitmap(w->bitmap, tint, 0, 0, w->column, w->rows, x + split, y, width - split, height, 0);
+	}
+}
+
+void DestroyWaterfall(struct Waterfall* w) {
+	al_destroy_bitmap(w->bitmap);
+	free(w);
+}
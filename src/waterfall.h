@@ -0,0 +1,37 @@
+/*! \file waterfall.h
+ *  \brief Scrolling spectrogram history kept in a ring texture.
+ */
+/*
+ * Copyright (c) Sebastian Krzyszkowiak <dos@dosowisko.net>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef WAAAA_WATERFALL_H
+#define WAAAA_WATERFALL_H
+
+#include <libsuperderpy.h>
+
+struct Waterfall {
+	ALLEGRO_BITMAP* bitmap; // one column per hop, written in a circle
+	int columns, rows;
+	int column; // next one to be written, which is also the oldest one
+};
+
+struct Waterfall* CreateWaterfall(int columns, int rows);
+void WaterfallPush(struct Waterfall* w, const float* values);
+void DrawWaterfall(struct Waterfall* w, ALLEGRO_COLOR tint, float x, float y, float width, float height);
+void DestroyWaterfall(struct Waterfall* w);
+
+#endif